@@ -9,7 +9,9 @@
 #define TR_CS     L_TR_CS, TRACE_MODULE
 
 typedef struct _csstring_t csstring_t;
+typedef struct _csring_t csring_t;
 
 #include "csstring.h"
+#include "csring.h"
 
 #endif
@@ -0,0 +1,314 @@
+/*  =========================================================================
+    csbus - Collector bus envelope
+    =========================================================================*/
+
+/*
+    This module encodes and decodes the single frame envelope of the messages
+    published by the collector, and translates the subscription filters of the
+    configuration into the binary topics of the envelope:
+
+        S or S_         # All LogApi message types less Voice
+        S_<log_api_id>  # LogApi messages of type = <log_api_id>
+        V or V_         # Voice
+        V_<call_id>     # Voice for the Call with Id = <call_id>
+
+    The subscribers that can't lose messages (e.g. the persistence manager)
+    are lossless consumers: instead of a SUB socket, they connect a DEALER
+    socket to CSBUS_LOSSLESS_ENDPOINT, subscribe with csbus_lossless_subscribe
+    and grant credit with csbus_lossless_credit. The collector queues the
+    messages of a consumer without credit, spilling them to disk if
+    configured, so a slow consumer never slows down the ingest.
+*/
+
+
+#include "cs.h"
+#include "csbus.h"
+
+
+//  --------------------------------------------------------------------------
+//  Builds the topic of a message
+//  Input:
+//    type: CSBUS_SIGNALING or CSBUS_VOICE
+//    id: the MsgId or the call id
+//  Output:
+//    topic: CSBUS_TOPIC_LENGTH bytes
+
+void
+csbus_topic (char type, UINT32 id, unsigned char *topic)
+{
+  topic[0] = (unsigned char) type;
+  topic[1] = (unsigned char) (id >> 24);
+  topic[2] = (unsigned char) (id >> 16);
+  topic[3] = (unsigned char) (id >> 8);
+  topic[4] = (unsigned char) id;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Builds the envelope of a message
+//  Input:
+//    type: CSBUS_SIGNALING or CSBUS_VOICE
+//    id: the MsgId or the call id
+//    timestamp_ns: the reception time (ns since the Epoch)
+//    log_api_msg: the LogApi structure
+//    log_api_msg_size: the size of the LogApi structure
+//    voice_data: the voice data or NULL
+//    voice_data_size: the size of the voice data
+//  Output:
+//    The frame with the message
+
+zframe_t *
+csbus_encode (char type, UINT32 id, uint64_t timestamp_ns,
+    const void * const log_api_msg, size_t log_api_msg_size,
+    const void * const voice_data, size_t voice_data_size)
+{
+  zframe_t *frame = zframe_new (NULL,
+      CSBUS_HEADER_LENGTH + log_api_msg_size + voice_data_size);
+
+  if (frame) {
+    byte *data = zframe_data (frame);
+    csbus_topic (type, id, data);
+    memset (data + CSBUS_TOPIC_LENGTH, 0, 8 - CSBUS_TOPIC_LENGTH);
+    memcpy (data + 8, &timestamp_ns, sizeof (timestamp_ns));
+    memcpy (data + CSBUS_HEADER_LENGTH, log_api_msg, log_api_msg_size);
+    if (voice_data_size) {
+      memcpy (data + CSBUS_HEADER_LENGTH + log_api_msg_size,
+          voice_data, voice_data_size);
+    }
+  }
+
+  return frame;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Decodes the envelope of a message
+//  Input:
+//    frame: the frame received
+//  Output:
+//    msg: the decoded message, valid while the frame exists
+//    0 - Ok
+//   -1 - Nok. Bad format
+
+int
+csbus_decode (zframe_t *frame, csbus_msg_t *msg)
+{
+  const byte *data = zframe_data (frame);
+  size_t size = zframe_size (frame);
+
+  if (size < CSBUS_HEADER_LENGTH) {
+    return -1;
+  }
+
+  msg->type = (char) data[0];
+  msg->id = ((UINT32) data[1] << 24) | ((UINT32) data[2] << 16) |
+      ((UINT32) data[3] << 8) | (UINT32) data[4];
+  memcpy (&msg->timestamp_ns, data + 8, sizeof (msg->timestamp_ns));
+  msg->timestamp = (time_t) (msg->timestamp_ns / 1000000000ULL);
+  msg->log_api_msg = data + CSBUS_HEADER_LENGTH;
+
+  if (msg->type == CSBUS_VOICE) {
+    if (size < CSBUS_HEADER_LENGTH + sizeof (LogApiVoice)) {
+      return -1;
+    }
+    msg->log_api_msg_size = sizeof (LogApiVoice);
+    msg->voice_data = data + CSBUS_HEADER_LENGTH + sizeof (LogApiVoice);
+    msg->voice_data_size = size - CSBUS_HEADER_LENGTH - sizeof (LogApiVoice);
+  } else {
+    msg->log_api_msg_size = size - CSBUS_HEADER_LENGTH;
+    msg->voice_data = NULL;
+    msg->voice_data_size = 0;
+  }
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Subscribes to the messages of a topic
+//  Input:
+//    subscriber: the subscriber socket
+//    type: CSBUS_SIGNALING or CSBUS_VOICE
+//    id: the MsgId or the call id
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+int
+csbus_subscribe_topic (zsock_t *subscriber, char type, UINT32 id)
+{
+  unsigned char topic[CSBUS_TOPIC_LENGTH];
+
+  csbus_topic (type, id, topic);
+
+  return zmq_setsockopt (zsock_resolve (subscriber), ZMQ_SUBSCRIBE,
+      topic, sizeof (topic));
+}
+
+
+//  --------------------------------------------------------------------------
+//  Unsubscribes from the messages of a topic
+//  Input:
+//    subscriber: the subscriber socket
+//    type: CSBUS_SIGNALING or CSBUS_VOICE
+//    id: the MsgId or the call id
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+int
+csbus_unsubscribe_topic (zsock_t *subscriber, char type, UINT32 id)
+{
+  unsigned char topic[CSBUS_TOPIC_LENGTH];
+
+  csbus_topic (type, id, topic);
+
+  return zmq_setsockopt (zsock_resolve (subscriber), ZMQ_UNSUBSCRIBE,
+      topic, sizeof (topic));
+}
+
+
+//  --------------------------------------------------------------------------
+//  Translates a subscription filter of the configuration into a topic prefix
+//  Input:
+//    filter: S, S_, S_<log_api_id>, V, V_ or V_<call_id>
+//  Output:
+//    topic: the topic prefix, up to CSBUS_TOPIC_LENGTH bytes
+//    The length of the topic prefix or -1 when the filter is unknown
+
+int
+csbus_filter_topic (const char * const filter, unsigned char *topic)
+{
+  unsigned int id;
+  char type = filter[0];
+
+  if (type != CSBUS_SIGNALING && type != CSBUS_VOICE) {
+    TRACE (ERROR, "Subscription filter: Bad format (%s)", filter);
+    return -1;
+  }
+
+  if (streq (filter + 1, "") || streq (filter + 1, "_")) {
+    topic[0] = type;
+    return 1;
+  }
+
+  if (sscanf (filter + 1, "_%u", &id) == 1) {
+    csbus_topic (type, id, topic);
+    return CSBUS_TOPIC_LENGTH;
+  }
+
+  TRACE (ERROR, "Subscription filter: Bad format (%s)", filter);
+
+  return -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Subscribes to the messages selected by a filter of the configuration
+//  Input:
+//    subscriber: the subscriber socket
+//    filter: S, S_, S_<log_api_id>, V, V_ or V_<call_id>
+//  Output:
+//    0 - Ok
+//   -1 - Nok. Unknown filter
+
+int
+csbus_subscribe (zsock_t *subscriber, const char * const filter)
+{
+  unsigned char topic[CSBUS_TOPIC_LENGTH];
+  int len;
+  int rc = -1;
+
+  TRACE (FUNCTIONS, "Entering in csbus_subscribe");
+
+  len = csbus_filter_topic (filter, topic);
+  if (len != -1) {
+    rc = zmq_setsockopt (zsock_resolve (subscriber), ZMQ_SUBSCRIBE, topic, len);
+  }
+
+  TRACE (FUNCTIONS, "Leaving csbus_subscribe");
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Connects a lossless consumer to the collector
+//  Input:
+//    name: the name of the consumer, which identifies its queue
+//  Output:
+//    The DEALER socket of the consumer or NULL
+
+zsock_t *
+csbus_lossless_new (const char * const name)
+{
+  zsock_t *consumer = zsock_new_dealer (NULL);
+
+  if (consumer) {
+    zsock_set_identity (consumer, name);
+    if (zsock_connect (consumer, "%s", CSBUS_LOSSLESS_ENDPOINT) == -1) {
+      TRACE (ERROR, "Unable to connect to %s", CSBUS_LOSSLESS_ENDPOINT);
+      zsock_destroy (&consumer);
+    }
+  }
+
+  return consumer;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Subscribes a lossless consumer to the messages selected by a filter of the
+//  configuration
+//  Input:
+//    consumer: the DEALER socket of the consumer
+//    filter: S, S_, S_<log_api_id>, V, V_ or V_<call_id>
+//  Output:
+//    0 - Ok
+//   -1 - Nok. Unknown filter
+
+int
+csbus_lossless_subscribe (zsock_t *consumer, const char * const filter)
+{
+  unsigned char topic[CSBUS_TOPIC_LENGTH];
+  int len;
+
+  len = csbus_filter_topic (filter, topic);
+  if (len == -1) {
+    return -1;
+  }
+
+  return zsock_send (consumer, "sb", CSBUS_LOSSLESS_SUBSCRIBE, topic, (size_t) len);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Grants credit to the collector to send more messages to a lossless
+//  consumer
+//  Input:
+//    consumer: the DEALER socket of the consumer
+//    credit: the number of messages
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+int
+csbus_lossless_credit (zsock_t *consumer, int credit)
+{
+  return zsock_send (consumer, "si", CSBUS_LOSSLESS_CREDIT, credit);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Disconnects a lossless consumer from the collector, which forgets its
+//  subscriptions and its queue
+//  Input:
+//    consumer_p: the DEALER socket of the consumer
+
+void
+csbus_lossless_destroy (zsock_t **consumer_p)
+{
+  if (consumer_p && *consumer_p) {
+    zstr_send (*consumer_p, CSBUS_LOSSLESS_BYE);
+    zsock_destroy (consumer_p);
+  }
+}
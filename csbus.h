@@ -0,0 +1,98 @@
+#ifndef __CSBUS_H_INCLUDED__
+#define __CSBUS_H_INCLUDED__
+
+#include <stdint.h>
+#include "LogApiMsgDef.h"
+#include "czmq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//  Envelope of the messages published in the collector bus. Every message
+//  is a single frame:
+//
+//    0       type (CSBUS_SIGNALING or CSBUS_VOICE)
+//    1..4    id, big-endian (MsgId for signaling, call id for voice)
+//    5..7    spare
+//    8..15   reception time (ns since the Epoch)
+//    16..    LogApi structure [+ voice data]
+//
+//  The first CSBUS_TOPIC_LENGTH bytes are the topic, so the subscribers can
+//  narrow the messages received with binary prefixes.
+
+#define CSBUS_SIGNALING 'S'
+#define CSBUS_VOICE 'V'
+#define CSBUS_TOPIC_LENGTH 5
+#define CSBUS_HEADER_LENGTH 16
+
+//  Channel of the lossless consumers. Every consumer is a DEALER socket,
+//  identified by its name, that sends to the collector:
+//
+//    SUBSCRIBE <topic prefix>   subscribes to the messages of a prefix
+//    CREDIT <n>                 accepts n more messages
+//    BYE                        forgets the consumer
+//
+//  and receives the envelopes, one per frame, as long as it has credit.
+
+#define CSBUS_LOSSLESS_ENDPOINT "inproc://collector_lossless"
+#define CSBUS_LOSSLESS_SUBSCRIBE "SUBSCRIBE"
+#define CSBUS_LOSSLESS_CREDIT "CREDIT"
+#define CSBUS_LOSSLESS_BYE "BYE"
+
+// Message decoded from an envelope. The pointers refer to the frame data
+
+typedef struct {
+  char type;
+  UINT32 id;
+  time_t timestamp;             // Reception time (seconds)
+  uint64_t timestamp_ns;        // Reception time (ns since the Epoch)
+  const void *log_api_msg;
+  size_t log_api_msg_size;
+  const unsigned char *voice_data;
+  size_t voice_data_size;
+} csbus_msg_t;
+
+
+zframe_t *
+csbus_encode (char type, UINT32 id, uint64_t timestamp_ns,
+    const void * const log_api_msg, size_t log_api_msg_size,
+    const void * const voice_data, size_t voice_data_size);
+
+int
+csbus_decode (zframe_t *frame, csbus_msg_t *msg);
+
+void
+csbus_topic (char type, UINT32 id, unsigned char *topic);
+
+int
+csbus_filter_topic (const char * const filter, unsigned char *topic);
+
+int
+csbus_subscribe (zsock_t *subscriber, const char * const filter);
+
+int
+csbus_subscribe_topic (zsock_t *subscriber, char type, UINT32 id);
+
+int
+csbus_unsubscribe_topic (zsock_t *subscriber, char type, UINT32 id);
+
+zsock_t *
+csbus_lossless_new (const char * const name);
+
+int
+csbus_lossless_subscribe (zsock_t *consumer, const char * const filter);
+
+int
+csbus_lossless_credit (zsock_t *consumer, int credit);
+
+void
+csbus_lossless_destroy (zsock_t **consumer_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
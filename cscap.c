@@ -0,0 +1,212 @@
+/*  =========================================================================
+    cscap - Raw ingest capture writer
+    =========================================================================*/
+
+/*
+    This module writes the datagrams received from the LogServers to capture
+    files, each datagram with its reception time and its source address. The
+    records are appended through a stdio buffer and a new file is started
+    when the current one reaches the maximum size. The files are named
+
+        <directory>/<prefix>_<YYYYmmdd-HHMMSS>_<sequence>.cscap
+
+    and can be replayed with tools/csreplay.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "cscap.h"
+#include "trace.h"
+
+
+#define CSCAP_PATH_LENGTH 1024
+#define CSCAP_STDIO_BUFFER_LENGTH (1024 * 1024)
+
+// <Definition>
+
+struct _cscap_t {
+  char *directory;
+  char *prefix;
+  size_t max_file_size;
+  FILE *fp;
+  char *stdio_buffer;
+  size_t file_size;
+  unsigned int sequence;
+  uint64_t records;
+};
+
+
+//  --------------------------------------------------------------------------
+//  Closes the current capture file and opens the next one
+//  Input:
+//    self: the capture writer
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+static int
+cscap_rotate (cscap_t *self)
+{
+  char path[CSCAP_PATH_LENGTH];
+  char now_string[32];
+  cscap_file_header_t header;
+  time_t now = time (NULL);
+  struct tm now_tm;
+  int rc = 0;
+
+  TRACE (FUNCTIONS, "Entering in cscap_rotate");
+
+  if (self->fp) {
+    fclose (self->fp);
+    self->fp = NULL;
+  }
+
+  localtime_r (&now, &now_tm);
+  strftime (now_string, sizeof (now_string), "%Y%m%d-%H%M%S", &now_tm);
+  snprintf (path, sizeof (path), "%s/%s_%s_%u.cscap",
+      self->directory, self->prefix, now_string, self->sequence++);
+
+  if ((self->fp = fopen (path, "w")) == NULL) {
+    TRACE (ERROR, "Error: fopen(), errno=%d text=%s", errno, strerror (errno));
+    rc = -1;
+  }
+
+  if (rc == 0) {
+    setvbuf (self->fp, self->stdio_buffer, _IOFBF, CSCAP_STDIO_BUFFER_LENGTH);
+    memcpy (header.magic, CSCAP_MAGIC, sizeof (header.magic));
+    header.version = CSCAP_VERSION;
+    if (fwrite (&header, sizeof (header), 1, self->fp) != 1) {
+      TRACE (ERROR, "Error: fwrite(), errno=%d text=%s", errno, strerror (errno));
+      rc = -1;
+    }
+    self->file_size = sizeof (header);
+    TRACE (DEBUG, "Capture file: %s", path);
+  }
+
+  TRACE (FUNCTIONS, "Leaving cscap_rotate");
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Creates a capture writer
+//  Input:
+//    directory: where the capture files are written
+//    prefix: the prefix of the capture file names
+//    max_file_size: the size from which a new capture file is started
+//  Output:
+//    The created writer or NULL
+
+cscap_t *
+cscap_new (const char * const directory, const char * const prefix,
+    size_t max_file_size)
+{
+  cscap_t *self = (cscap_t *) calloc (1, sizeof (cscap_t));
+  if (self) {
+    self->directory = strdup (directory);
+    self->prefix = strdup (prefix);
+    self->max_file_size = max_file_size;
+    self->stdio_buffer = (char *) malloc (CSCAP_STDIO_BUFFER_LENGTH);
+    if (!self->directory || !self->prefix || !self->stdio_buffer ||
+        cscap_rotate (self) == -1) {
+      cscap_destroy (&self);
+    }
+  }
+
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Flushes and closes the current capture file and frees the writer
+//  Input:
+//    The target writer
+
+void
+cscap_destroy (cscap_t **self_p)
+{
+  if (self_p && *self_p) {
+    cscap_t *self = *self_p;
+    if (self->fp) {
+      fclose (self->fp);
+    }
+    free (self->stdio_buffer);
+    free (self->directory);
+    free (self->prefix);
+    free (self);
+    *self_p = NULL;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Appends a datagram to the capture
+//  Input:
+//    self: the capture writer
+//    timestamp_ns: the reception time of the datagram
+//    source: the source address of the datagram
+//    data: the datagram
+//    len: the length of the datagram
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+int
+cscap_write (cscap_t *self, uint64_t timestamp_ns,
+    const struct sockaddr_in * const source,
+    const unsigned char * const data, size_t len)
+{
+  cscap_record_header_t record;
+  int rc = 0;
+
+  if (self->file_size + sizeof (record) + len > self->max_file_size) {
+    rc = cscap_rotate (self);
+  }
+
+  if (rc == 0 && self->fp) {
+    record.timestamp_ns = timestamp_ns;
+    record.source_ip = source->sin_addr.s_addr;
+    record.source_port = source->sin_port;
+    record.length = (uint16_t) len;
+    if (fwrite (&record, sizeof (record), 1, self->fp) != 1 ||
+        fwrite (data, 1, len, self->fp) != len) {
+      TRACE (ERROR, "Error: fwrite(), errno=%d text=%s", errno, strerror (errno));
+      rc = -1;
+    } else {
+      self->file_size += sizeof (record) + len;
+      self->records++;
+    }
+  }
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Writes the buffered records to the current capture file
+//  Input:
+//    self: the capture writer
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+int
+cscap_flush (cscap_t *self)
+{
+  return (self->fp && fflush (self->fp) == EOF) ? -1 : 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of datagrams captured
+
+uint64_t
+cscap_records (cscap_t *self)
+{
+  return self->records;
+}
@@ -0,0 +1,62 @@
+#ifndef __CSCAP_H_INCLUDED__
+#define __CSCAP_H_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//  Capture file format. All the fields are in host byte order except the
+//  source address and port, kept in network byte order.
+//
+//    <file header>
+//    <record header> <datagram>
+//    <record header> <datagram>
+//    ...
+
+#define CSCAP_MAGIC "CSCP"
+#define CSCAP_VERSION 1
+
+typedef struct {
+  char magic[4];              // CSCAP_MAGIC
+  uint32_t version;           // CSCAP_VERSION
+} cscap_file_header_t;
+
+typedef struct {
+  uint64_t timestamp_ns;      // Reception time (ns since the Epoch)
+  uint32_t source_ip;         // Source IPv4 address
+  uint16_t source_port;       // Source UDP port
+  uint16_t length;            // Length of the datagram that follows
+} cscap_record_header_t;
+
+
+typedef struct _cscap_t cscap_t;
+
+cscap_t *
+cscap_new (const char * const directory, const char * const prefix,
+    size_t max_file_size);
+
+void
+cscap_destroy (cscap_t **self_p);
+
+int
+cscap_write (cscap_t *self, uint64_t timestamp_ns,
+    const struct sockaddr_in * const source,
+    const unsigned char * const data, size_t len);
+
+int
+cscap_flush (cscap_t *self);
+
+uint64_t
+cscap_records (cscap_t *self);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -10,12 +10,15 @@
       - Status messages, SDS-Type4 (without TL), SDS-TL TRANSFER
       - Individual calls (Duplex/Simplex)
       - Group calls (Normal/Broadcast)
-      - Streams of active voice calls as G.711 A-LAW streams
+      - Streams of active voice calls as G.711 A-LAW streams or native TETRA
+        traffic channel frames (TCH/S, TCH/7.2, TCH/4.8, TCH/2.4, STCH/U)
 
     Each UDP message received is analyzed and transformed into the corresponding
     LogApi message type.
 
-    The submodule discards junk data between LogApi messages received. Further,
+    The submodule discards junk data between LogApi messages received, jumping
+    straight to the next protocol signature found by a vectorised scanner. The
+    junk bytes skipped are reported by the STATS command. Further,
     it supports fragmented LogApi messages received in several UDP packets and
     several LogApi messages received in a UDP packet.
 
@@ -30,27 +33,179 @@
         V or V_         # Voice
         V_<call_id>     # Voice for the Call with Id = <call_id>
 
-    The submodule will publish the LogApi message types in a 0MQ multipart zmsg
-    in the following format:
+    The submodule will publish every LogApi message in a single frame with a
+    compact binary envelope (see csbus.h):
 
-        <filter>
-        <timestamp>
+        <type> <big-endian id> <spare> <timestamp>
         <LogApi structure with received data>
         <Voice data> (in the case of a Voice message type)
+
+    The type and id are the topic of the message, so the filters above are
+    translated into binary prefixes at the time of the subscription.
+
+    The bus is an XPUB socket, so the collector tracks the prefixes with
+    subscribers and doesn't build or publish the messages nobody is
+    subscribed to, e.g. the voice of the calls not recorded or intercepted.
+    The shards receive the subscriptions from the main collector thread.
+
+    By default the UDP listener reads one datagram per reactor wakeup. When
+    /collector/batch_size is greater than 1, the listener drains up to
+    batch_size datagrams per wakeup with recvmmsg into pre-allocated slots and
+    analyzes them in one pass. The number of datagrams drained per wakeup can
+    be queried with the STATS command through the parent pipe.
+
+    The data not yet processed is kept in a bounded reassembly ring mapped
+    twice in consecutive memory, so LogApi messages split across datagrams are
+    analyzed in place and the unprocessed data is never moved. The ring size
+    is set by /collector/reassembly_buffer_size. When a datagram doesn't fit,
+    the data not yet processed is discarded and the overflow is counted.
+
+    The reassembly state is kept per source address, so several LogServers
+    (or a redundant pair) can send to the same port without corrupting each
+    other's streams. Up to /collector/max_sources sources are tracked.
+
+    When /collector/shards is greater than 1, the collector runs that number of
+    receive threads, each one with its own UDP socket bound with SO_REUSEPORT.
+    The kernel distributes the datagrams by source address and port, so all
+    the data of a source is received by the same shard. The shards forward
+    their LogApi messages to the main collector thread, which publishes them
+    in the bus. The STATS command reports the statistics of all the shards.
+
+    The collector accounts for the data lost before it is analyzed: gaps in the
+    SequenceCounter of the LogApi messages of every source, gaps in the
+    m_uiPacketSeq of every voice stream (call and originator) and datagrams
+    dropped by the kernel because the socket buffer was full (SO_RXQ_OVFL).
+    Voice streams without activity for /collector/stream_inactivity_period
+    seconds are forgotten.
+
+    Every datagram is stamped by the kernel with its reception time in ns
+    (SO_TIMESTAMPNS), and the time is published with the LogApi messages
+    analyzed from it. The deviation of the interarrival time of the voice
+    packets from their nominal 60 ms interval is kept in log2 histograms per
+    voice stream and per originating node (m_uiOriginatingNode), together
+    with the RFC 3550 jitter estimate of every stream.
+
+    When /collector/generate_wav_files is set, the A-law voice data of every
+    call is also written to voice_<call_id>.wav. The file of a call is kept
+    open until the call is released or becomes inactive, and its WAVE header
+    is updated every /collector/maintenance_frequency seconds.
+
+    When built with CSCOL_HAVE_IO_URING (liburing) and /collector/backend is
+    io_uring, the datagrams are received with a multishot recvmsg on an
+    io_uring instead. The kernel writes every datagram, its source address
+    and its ancillary data straight into a buffer of a provided buffer ring
+    of /collector/io_uring_buffers entries, with no system call per
+    datagram. The reactor polls the ring and drains up to batch_size
+    completions per wakeup. The socket backend is used when io_uring isn't
+    available.
 */
 
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "cs.h"
 #include "csutil.h"
+#include "csbus.h"
+#include "cslogapi.h"
+#include "cscap.h"
+#include "cswav.h"
+#include "csvoice.h"
+#include "csqueue.h"
 
+#ifdef CSCOL_HAVE_IO_URING
+#include <liburing.h>
+#endif
 
-#define CSCOL_BUFFER_LENGTH 4096
+
+#define CSCOL_REASSEMBLY_LENGTH "65536"
 #define CSCOL_WORK_AREA_LENGTH 1024
+#define CSCOL_SLOT_LENGTH 4096
+#define CSCOL_MAX_BATCH_SIZE 1024
+#define CSCOL_MAX_SHARDS 64
+#define CSCOL_SOURCE_KEY_LENGTH 32
+#define CSCOL_CONTROL_LENGTH 64       // SO_RXQ_OVFL and SO_TIMESTAMPNS
+#define CSCOL_NODE_KEY_LENGTH 8
+#define CSCOL_TOPIC_KEY_LENGTH (2 * CSBUS_TOPIC_LENGTH + 1)
+#define CSCOL_VOICE_PACKET_INTERVAL_NS 60000000LL   // 480 A-law samples
+                                                    // or 2 TCH frames
+#define CSCOL_JITTER_BUCKETS 12
+#define CSCOL_JITTER_FIRST_BOUND_US 125
+#define CSCOL_URING_ENTRIES 64
+#define CSCOL_URING_BUFFER_GROUP 0
+#define CSCOL_URING_MAX_BUFFERS 32768
+
+
+// Reassembly state of a LogServer sending data to the collector
+
+typedef struct {
+  char key[CSCOL_SOURCE_KEY_LENGTH];
+  struct sockaddr_in addr;
+  csring_t *ring;
+  uint64_t datagrams;
+  uint64_t junk_bytes;
+  uint64_t resyncs;
+  int seq_valid;
+  UINT16 last_seq;
+  uint64_t seq_lost;
+  uint64_t seq_out_of_order;
+} cscol_source_t;
+
+
+// Loss accounting of a voice stream (a call and an originator)
+
+typedef struct {
+  UINT32 call_id;
+  UINT8 originator;
+  UINT16 random_id;
+  UINT8 last_seq;
+  time_t last_activity;
+  uint64_t packets;
+  uint64_t lost;
+  uint64_t out_of_order;
+  UINT16 node;
+  uint64_t last_arrival_ns;     // 0 = no packet in sequence yet
+  double jitter_ns;             // Interarrival jitter estimate (RFC 3550)
+  uint64_t jitter_histogram[CSCOL_JITTER_BUCKETS];
+} cscol_voice_stream_t;
+
+
+// Interarrival jitter of the voice streams of an originating node
+
+typedef struct {
+  UINT16 node;
+  uint64_t packets;
+  uint64_t jitter_histogram[CSCOL_JITTER_BUCKETS];
+} cscol_node_t;
+
+
+// Subscription of the bus subscribers to a topic prefix
+
+typedef struct {
+  byte prefix[CSBUS_TOPIC_LENGTH];
+  size_t len;
+  int count;
+} cscol_subscription_t;
+
+
+// Lossless consumer of the bus. Its messages are queued while it has no
+// credit
+
+typedef struct {
+  char *name;                   // Identity of the DEALER socket
+  int credit;
+  uint64_t delivered;
+  csqueue_t *queue;
+  zhash_t *filters;             // Topic prefixes (cscol_subscription_t)
+} cscol_consumer_t;
 
 
 // Context for a Call Stream Collector thread
 
 struct _cscol_t {
+  int shard_id;
+  int shards;
   int generate_wav_files;
   int log_server_endpoint_port;
   int log_server_endpoint_channel;
@@ -58,42 +213,164 @@ struct _cscol_t {
   csstring_t *conf_filename;
   csstring_t *log_server_endpoint_ip;
   zsock_t *publisher;
-  TetraFlexLogApiMessageHeader current_header;
-  time_t timestamp;
-  unsigned char *buffer;
-  int buffer_offset;
+  zhash_t *subscriptions;       // Topic prefixes with subscribers
+  int subscriptions_by_length[CSBUS_TOPIC_LENGTH + 1];
+  uint64_t unpublished;         // Messages without subscribers
+  zsock_t *lossless;            // ROUTER of the lossless consumers
+  zhash_t *consumers;           // Lossless consumers by name
+  size_t lossless_queue_depth;
+  csstring_t *lossless_spill_directory;
+  size_t lossless_spill_max_size;
+  uint64_t timestamp_ns;        // Reception time of the current datagram
+  int reassembly_size;
+  int max_sources;
+  zhash_t *sources;
+  cscol_source_t *source;
+  zsock_t *shard_collector;
+  zactor_t **shard_actors;
+  int batch_size;
+  int io_uring_enabled;         // /collector/backend is io_uring
+  int io_uring_buffers;
+#ifdef CSCOL_HAVE_IO_URING
+  struct io_uring uring;
+  int uring_ready;
+  struct io_uring_buf_ring *uring_buffer_ring;
+  unsigned char *uring_buffers;
+  size_t uring_buffer_length;
+  struct msghdr uring_msghdr;
+  uint64_t uring_rearms;
+#endif
+  unsigned char *slots;
+  struct iovec *slot_iovecs;
+  struct mmsghdr *slot_headers;
+  struct sockaddr_in *slot_addrs;
+  unsigned char *slot_controls;
+  zhash_t *voice_streams;
+  zhash_t *nodes;               // Jitter by originating node
+  unsigned int stream_inactivity_period;
+  unsigned int maintenance_frequency;
+  uint32_t kernel_drops;
+  uint64_t voice_lost;
+  int capture_enabled;
+  int capture_failed;
+  size_t capture_max_file_size;
+  csstring_t *capture_directory;
+  char capture_prefix[32];
+  cscap_t *capture;
+  cswav_t *wav_writers;         // WAVE files of the calls (generate_wav_files)
+  uint64_t voice_out_of_order;
+  uint64_t wakeups;
+  uint64_t datagrams;
+  uint64_t truncated;
+  uint64_t rejected;
+  uint64_t *drained_histogram;
+  int last_drained;
 };
 typedef struct _cscol_t cscol_t;
 
 
+//  --------------------------------------------------------------------------
+//  Creates the reassembly state of a LogServer
+//  Input:
+//    addr: the source address of the LogServer
+//    ring_size: the maximum size of the data not yet processed
+//  Output:
+//    The created source or NULL
+
+static cscol_source_t *
+cscol_source_new (const struct sockaddr_in * const addr, int ring_size)
+{
+  char ip[INET_ADDRSTRLEN];
+  cscol_source_t *self = (cscol_source_t *) zmalloc (sizeof (cscol_source_t));
+  if (self) {
+    memcpy (&self->addr, addr, sizeof (struct sockaddr_in));
+    inet_ntop (AF_INET, &addr->sin_addr, ip, sizeof (ip));
+    snprintf (self->key, sizeof (self->key), "%s:%u", ip, ntohs (addr->sin_port));
+    self->ring = csring_new (ring_size);
+    if (!self->ring) {
+      free (self);
+      self = NULL;
+    }
+  }
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees the reassembly state of a LogServer. Used as destructor of the
+//  sources table
+//  Input:
+//    The target source
+
+static void
+cscol_source_destroy (void *data)
+{
+  cscol_source_t *self = (cscol_source_t *) data;
+  if (self) {
+    csring_destroy (&self->ring);
+    free (self);
+  }
+}
+
+
 //  --------------------------------------------------------------------------
 //  Creates a thread specific Call Stream Collector context
 //  Input:
 //    conf_file : The configuration file
+//    shard_id : The receive thread. 0 is the main collector thread
 //  Output:
 //    The context created according to the configuration file
 
 static cscol_t*
-cscol_new (const char * const conf_file)
+cscol_new (const char * const conf_file, int shard_id)
 {
   cscol_t *self = (cscol_t *) zmalloc (sizeof (cscol_t));
   if (self) {
-    self->buffer = (unsigned char *) zmalloc (
-        CSCOL_BUFFER_LENGTH * sizeof (unsigned char));
+    self->shard_id = shard_id;
+    self->shards = 1;
     self->work_area = (char *) zmalloc (
         CSCOL_WORK_AREA_LENGTH * sizeof (char));
-    self->buffer_offset = 0;
+    self->reassembly_size = 0;
+    self->max_sources = 0;
+    self->sources = zhash_new ();
+    self->source = NULL;
+    self->shard_collector = NULL;
+    self->shard_actors = NULL;
     self->conf_filename = csstring_new (conf_file);
     self->log_server_endpoint_channel = -1;
     self->log_server_endpoint_ip = NULL;
     self->log_server_endpoint_port = -1;
     self->publisher = NULL;
     self->generate_wav_files = 0;
+    self->batch_size = 1;
+    self->slots = NULL;
+    self->slot_iovecs = NULL;
+    self->slot_headers = NULL;
+    self->slot_addrs = NULL;
+    self->slot_controls = NULL;
+    self->capture_enabled = 0;
+    self->capture_failed = 0;
+    self->capture_directory = NULL;
+    self->capture = NULL;
+    self->wav_writers = NULL;
+    self->voice_streams = zhash_new ();
+    self->nodes = zhash_new ();
+    self->subscriptions = zhash_new ();
+    self->lossless = NULL;
+    self->consumers = zhash_new ();
+    self->lossless_spill_directory = NULL;
+    self->drained_histogram = NULL;
   }
   return self;
 }
 
 
+#ifdef CSCOL_HAVE_IO_URING
+static void
+cscol_stop_uring (cscol_t *ctx);
+#endif
+
+
 //  --------------------------------------------------------------------------
 //  Frees all the resources created in the thread specific Call Stream Collector
 //  context
@@ -106,8 +383,34 @@ cscol_destroy (cscol_t **self_p)
   assert (self_p);
   if (*self_p) {
     cscol_t *self = *self_p;
-    free (self->buffer);
+    int i;
+    if (self->shard_actors) {
+      for (i = 0; i < self->shards - 1; i++) {
+        zactor_destroy (&self->shard_actors[i]);
+      }
+      free (self->shard_actors);
+    }
+#ifdef CSCOL_HAVE_IO_URING
+    cscol_stop_uring (self);
+#endif
+    zhash_destroy (&self->sources);
+    zsock_destroy (&self->shard_collector);
     free (self->work_area);
+    free (self->slots);
+    free (self->slot_iovecs);
+    free (self->slot_headers);
+    free (self->slot_addrs);
+    free (self->slot_controls);
+    zhash_destroy (&self->voice_streams);
+    zhash_destroy (&self->nodes);
+    zhash_destroy (&self->subscriptions);
+    zhash_destroy (&self->consumers);
+    zsock_destroy (&self->lossless);
+    csstring_destroy (&self->lossless_spill_directory);
+    cscap_destroy (&self->capture);
+    cswav_destroy (&self->wav_writers);
+    csstring_destroy (&self->capture_directory);
+    free (self->drained_histogram);
     csstring_destroy (&self->conf_filename);
     csstring_destroy (&self->log_server_endpoint_ip);
     close (self->log_server_endpoint_channel);
@@ -133,13 +436,44 @@ cscol_start_publisher (cscol_t *ctx)
 
   TRACE (FUNCTIONS, "Entering in cscol_start_publisher");
 
-  ctx->publisher = zsock_new_pub ("@inproc://collector");
-  assert (ctx->publisher);
+  if (ctx->shard_id == 0) {
+    // The subscriptions are received to publish only the topics with
+    // subscribers
+    ctx->publisher = zsock_new_xpub ("@inproc://collector");
+    assert (ctx->publisher);
 
-  if (!ctx->publisher) {
-    TRACE (ERROR, "Error: zsock_new_pub(), errno=%d text=%s",
-        errno, strerror (errno));
-    rc = -1;
+    if (!ctx->publisher) {
+      TRACE (ERROR, "Error: zsock_new_xpub(), errno=%d text=%s",
+          errno, strerror (errno));
+      rc = -1;
+    }
+
+    // The lossless consumers receive their messages on credit
+    if (rc == 0) {
+      ctx->lossless = zsock_new_router ("@" CSBUS_LOSSLESS_ENDPOINT);
+      if (!ctx->lossless) {
+        TRACE (ERROR, "Error: zsock_new_router(), errno=%d text=%s",
+            errno, strerror (errno));
+        rc = -1;
+      }
+    }
+
+    if (rc == 0 && ctx->shards > 1) {
+      ctx->shard_collector = zsock_new_pull ("@inproc://collector_shards");
+      if (!ctx->shard_collector) {
+        TRACE (ERROR, "Error: zsock_new_pull(), errno=%d text=%s",
+            errno, strerror (errno));
+        rc = -1;
+      }
+    }
+  } else {
+    // The shards forward their messages to the main collector thread
+    ctx->publisher = zsock_new_push (">inproc://collector_shards");
+    if (!ctx->publisher) {
+      TRACE (ERROR, "Error: zsock_new_push(), errno=%d text=%s",
+          errno, strerror (errno));
+      rc = -1;
+    }
   }
 
   TRACE (FUNCTIONS, "Leaving cscol_start_publisher");
@@ -162,6 +496,9 @@ cscol_start_listener (cscol_t *ctx)
   int rc = 0;
   struct sockaddr_in serv_addr;
   unsigned long net_addr;
+  int reuse_port = 1;
+  int rxq_ovfl = 1;
+  int timestamp_ns = 1;
 
   TRACE (FUNCTIONS, "Entering in cscol_start_listener");
 
@@ -172,6 +509,33 @@ cscol_start_listener (cscol_t *ctx)
     rc = -1;
   }
 
+  if (!rc && ctx->shards > 1) {
+    if (setsockopt (ctx->log_server_endpoint_channel, SOL_SOCKET, SO_REUSEPORT,
+        &reuse_port, sizeof (reuse_port)) == -1) {
+      TRACE (ERROR, "Error: setsockopt(), errno=%d text=%s",
+          errno, strerror (errno));
+      rc = -1;
+    }
+  }
+
+  // The kernel reports the datagrams dropped in each datagram received
+  if (!rc) {
+    if (setsockopt (ctx->log_server_endpoint_channel, SOL_SOCKET, SO_RXQ_OVFL,
+        &rxq_ovfl, sizeof (rxq_ovfl)) == -1) {
+      TRACE (WARNING, "Warning: SO_RXQ_OVFL not available, errno=%d text=%s",
+          errno, strerror (errno));
+    }
+  }
+
+  // The kernel stamps each datagram with its reception time
+  if (!rc) {
+    if (setsockopt (ctx->log_server_endpoint_channel, SOL_SOCKET, SO_TIMESTAMPNS,
+        &timestamp_ns, sizeof (timestamp_ns)) == -1) {
+      TRACE (WARNING, "Warning: SO_TIMESTAMPNS not available, errno=%d text=%s",
+          errno, strerror (errno));
+    }
+  }
+
   if (!rc) {
     memset ((char *) &serv_addr, 0, sizeof (serv_addr));
     serv_addr.sin_family = AF_INET;
@@ -191,6 +555,198 @@ cscol_start_listener (cscol_t *ctx)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Reserves the slots where the batched receive mode stores the datagrams
+//  drained in a reactor wakeup
+//  Input:
+//    A Call Stream Collector context
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+static int
+cscol_start_batch (cscol_t *ctx)
+{
+  int rc = 0;
+  int i = 0;
+
+  TRACE (FUNCTIONS, "Entering in cscol_start_batch");
+
+  ctx->slots = (unsigned char *) zmalloc (
+      ctx->batch_size * CSCOL_SLOT_LENGTH * sizeof (unsigned char));
+  ctx->slot_iovecs = (struct iovec *) zmalloc (
+      ctx->batch_size * sizeof (struct iovec));
+  ctx->slot_headers = (struct mmsghdr *) zmalloc (
+      ctx->batch_size * sizeof (struct mmsghdr));
+  ctx->slot_addrs = (struct sockaddr_in *) zmalloc (
+      ctx->batch_size * sizeof (struct sockaddr_in));
+  ctx->slot_controls = (unsigned char *) zmalloc (
+      ctx->batch_size * CSCOL_CONTROL_LENGTH * sizeof (unsigned char));
+  ctx->drained_histogram = (uint64_t *) zmalloc (
+      (ctx->batch_size + 1) * sizeof (uint64_t));
+
+  if (!ctx->slots || !ctx->slot_iovecs || !ctx->slot_headers ||
+      !ctx->slot_addrs || !ctx->slot_controls || !ctx->drained_histogram) {
+    TRACE (ERROR, "Error: unable to reserve %d receive slots", ctx->batch_size);
+    rc = -1;
+  }
+
+  for (i = 0; rc == 0 && i < ctx->batch_size; i++) {
+    ctx->slot_iovecs[i].iov_base = ctx->slots + i * CSCOL_SLOT_LENGTH;
+    ctx->slot_iovecs[i].iov_len = CSCOL_SLOT_LENGTH;
+    ctx->slot_headers[i].msg_hdr.msg_iov = &ctx->slot_iovecs[i];
+    ctx->slot_headers[i].msg_hdr.msg_iovlen = 1;
+    ctx->slot_headers[i].msg_hdr.msg_name = &ctx->slot_addrs[i];
+    ctx->slot_headers[i].msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+    ctx->slot_headers[i].msg_hdr.msg_control =
+        ctx->slot_controls + i * CSCOL_CONTROL_LENGTH;
+    ctx->slot_headers[i].msg_hdr.msg_controllen = CSCOL_CONTROL_LENGTH;
+  }
+
+  TRACE (FUNCTIONS, "Leaving cscol_start_batch");
+
+  return rc;
+}
+
+
+#ifdef CSCOL_HAVE_IO_URING
+
+//  --------------------------------------------------------------------------
+//  Submits the multishot recvmsg that receives the datagrams of the listener
+//  into the provided buffer ring. It has to be submitted again whenever the
+//  kernel ends it, e.g. when the ring ran out of buffers
+//  Input:
+//    ctx: the Call Stream Collector context of the thread
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+static int
+cscol_arm_uring (cscol_t *ctx)
+{
+  int rc = 0;
+  int error;
+  struct io_uring_sqe *sqe;
+
+  TRACE (FUNCTIONS, "Entering in cscol_arm_uring");
+
+  sqe = io_uring_get_sqe (&ctx->uring);
+  if (!sqe) {
+    TRACE (ERROR, "Error: io_uring_get_sqe(), submission queue full");
+    rc = -1;
+  }
+
+  if (!rc) {
+    io_uring_prep_recvmsg_multishot (sqe, ctx->log_server_endpoint_channel,
+        &ctx->uring_msghdr, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = CSCOL_URING_BUFFER_GROUP;
+
+    error = io_uring_submit (&ctx->uring);
+    if (error < 0) {
+      TRACE (ERROR, "Error: io_uring_submit(), errno=%d text=%s",
+          -error, strerror (-error));
+      rc = -1;
+    }
+  }
+
+  TRACE (FUNCTIONS, "Leaving cscol_arm_uring");
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Creates the io_uring and the provided buffer ring of the listener and
+//  starts receiving
+//  Input:
+//    ctx: the Call Stream Collector context of the thread
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+static int
+cscol_start_uring (cscol_t *ctx)
+{
+  int mask = io_uring_buf_ring_mask (ctx->io_uring_buffers);
+  int rc = 0;
+  int error;
+  int i;
+
+  TRACE (FUNCTIONS, "Entering in cscol_start_uring");
+
+  // Every buffer holds the recvmsg header, the source address, the
+  // ancillary data and a datagram
+  ctx->uring_buffer_length = sizeof (struct io_uring_recvmsg_out) +
+      sizeof (struct sockaddr_in) + CSCOL_CONTROL_LENGTH + CSCOL_SLOT_LENGTH;
+  ctx->uring_msghdr.msg_namelen = sizeof (struct sockaddr_in);
+  ctx->uring_msghdr.msg_controllen = CSCOL_CONTROL_LENGTH;
+
+  error = io_uring_queue_init (CSCOL_URING_ENTRIES, &ctx->uring, 0);
+  if (error < 0) {
+    TRACE (ERROR, "Error: io_uring_queue_init(), errno=%d text=%s",
+        -error, strerror (-error));
+    rc = -1;
+  } else {
+    ctx->uring_ready = 1;
+  }
+
+  if (!rc) {
+    ctx->uring_buffers = (unsigned char *) zmalloc (
+        ctx->io_uring_buffers * ctx->uring_buffer_length);
+    ctx->uring_buffer_ring = io_uring_setup_buf_ring (&ctx->uring,
+        ctx->io_uring_buffers, CSCOL_URING_BUFFER_GROUP, 0, &error);
+    if (!ctx->uring_buffers || !ctx->uring_buffer_ring) {
+      TRACE (ERROR, "Error: unable to register %d io_uring buffers, errno=%d",
+          ctx->io_uring_buffers, -error);
+      rc = -1;
+    }
+  }
+
+  if (!rc) {
+    for (i = 0; i < ctx->io_uring_buffers; i++) {
+      io_uring_buf_ring_add (ctx->uring_buffer_ring,
+          ctx->uring_buffers + i * ctx->uring_buffer_length,
+          ctx->uring_buffer_length, i, mask, i);
+    }
+    io_uring_buf_ring_advance (ctx->uring_buffer_ring, ctx->io_uring_buffers);
+    rc = cscol_arm_uring (ctx);
+  }
+
+  if (rc == -1) {
+    cscol_stop_uring (ctx);
+  }
+
+  TRACE (FUNCTIONS, "Leaving cscol_start_uring");
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees the io_uring and the provided buffer ring of the listener
+//  Input:
+//    ctx: the Call Stream Collector context of the thread
+
+static void
+cscol_stop_uring (cscol_t *ctx)
+{
+  if (ctx->uring_buffer_ring) {
+    io_uring_free_buf_ring (&ctx->uring, ctx->uring_buffer_ring,
+        ctx->io_uring_buffers, CSCOL_URING_BUFFER_GROUP);
+    ctx->uring_buffer_ring = NULL;
+  }
+  if (ctx->uring_ready) {
+    io_uring_queue_exit (&ctx->uring);
+    ctx->uring_ready = 0;
+  }
+  free (ctx->uring_buffers);
+  ctx->uring_buffers = NULL;
+}
+
+#endif
+
+
 //  --------------------------------------------------------------------------
 // Traces a Call Stream Collector context
 //  Input:
@@ -205,12 +761,27 @@ cscol_print (cscol_t *ctx)
   TRACE (DEBUG, "Callstream Collector Configuration");
   TRACE (DEBUG, "----------------------------------");
   TRACE (DEBUG, "  File: %s", csstring_data (ctx->conf_filename));
+  TRACE (DEBUG, "  Shard: %d/%d", ctx->shard_id, ctx->shards);
   TRACE (DEBUG, "  LogServer endpoint: udp://%s:%d",
       csstring_data (ctx->log_server_endpoint_ip), ctx->log_server_endpoint_port);
   TRACE (DEBUG, "  LogServer channel: %d", ctx->log_server_endpoint_channel);
   TRACE (DEBUG, "  Publisher: %s", zsock_type_str (ctx->publisher));
-  TRACE (DEBUG, "  Buffer: %p", &ctx->buffer);
-  TRACE (DEBUG, "  Offset: %d", ctx->buffer_offset);
+  TRACE (DEBUG, "  Reassembly ring size: %d", ctx->reassembly_size);
+  TRACE (DEBUG, "  Max sources: %d", ctx->max_sources);
+  TRACE (DEBUG, "  Capture: %d (%s)", ctx->capture_enabled,
+      csstring_data (ctx->capture_directory));
+  TRACE (DEBUG, "  Stream inactivity period (secs): %d",
+      ctx->stream_inactivity_period);
+  TRACE (DEBUG, "  Maintenance frequency (secs): %d",
+      ctx->maintenance_frequency);
+  TRACE (DEBUG, "  Batch size: %d", ctx->batch_size);
+  TRACE (DEBUG, "  Backend: %s (%d buffers)",
+      ctx->io_uring_enabled ? "io_uring" : "socket", ctx->io_uring_buffers);
+  TRACE (DEBUG, "  Lossless queue depth: %zu", ctx->lossless_queue_depth);
+  TRACE (DEBUG, "  Lossless spill directory: %s",
+      csstring_data (ctx->lossless_spill_directory));
+  TRACE (DEBUG, "  Lossless spill max size: %zu",
+      ctx->lossless_spill_max_size);
 
   TRACE (FUNCTIONS, "Leaving cscol_print");
 }
@@ -247,7 +818,102 @@ cscol_configure (cscol_t *ctx)
       "/collector/generate_wav_files", "0");
   ctx->generate_wav_files = atoi (generate_wav_files);
 
-  ctx->buffer_offset = 0;
+  char *batch_size = zconfig_resolve (root,
+      "/collector/batch_size", "1");
+  ctx->batch_size = atoi (batch_size);
+  if (ctx->batch_size < 1 || ctx->batch_size > CSCOL_MAX_BATCH_SIZE) {
+    TRACE (ERROR, "Bad configuration. batch_size: %d", ctx->batch_size);
+    ctx->batch_size = 1;
+  }
+
+  char *reassembly_size = zconfig_resolve (root,
+      "/collector/reassembly_buffer_size", CSCOL_REASSEMBLY_LENGTH);
+  ctx->reassembly_size = atoi (reassembly_size);
+  if (ctx->reassembly_size < 2 * CSCOL_SLOT_LENGTH) {
+    TRACE (ERROR, "Bad configuration. reassembly_buffer_size: %d",
+        ctx->reassembly_size);
+    ctx->reassembly_size = atoi (CSCOL_REASSEMBLY_LENGTH);
+  }
+
+  char *max_sources = zconfig_resolve (root,
+      "/collector/max_sources", "64");
+  ctx->max_sources = atoi (max_sources);
+  if (ctx->max_sources < 1) {
+    TRACE (ERROR, "Bad configuration. max_sources: %d", ctx->max_sources);
+    ctx->max_sources = 64;
+  }
+
+  char *stream_inactivity_period = zconfig_resolve (root,
+      "/collector/stream_inactivity_period", "60");
+  ctx->stream_inactivity_period = atoi (stream_inactivity_period);
+
+  char *maintenance_frequency = zconfig_resolve (root,
+      "/collector/maintenance_frequency", "10");
+  ctx->maintenance_frequency = atoi (maintenance_frequency);
+  if (ctx->maintenance_frequency < 1) {
+    TRACE (ERROR, "Bad configuration. maintenance_frequency: %d",
+        ctx->maintenance_frequency);
+    ctx->maintenance_frequency = 10;
+  }
+
+  char *capture_enabled = zconfig_resolve (root,
+      "/collector/capture/enabled", "0");
+  ctx->capture_enabled = atoi (capture_enabled);
+
+  char *capture_directory = zconfig_resolve (root,
+      "/collector/capture/directory", getenv ("CALLSTREAMSERVER_WORK_PATH"));
+  ctx->capture_directory = csstring_new (
+      capture_directory ? capture_directory : ".");
+
+  char *capture_max_file_size = zconfig_resolve (root,
+      "/collector/capture/max_file_size", "104857600");
+  ctx->capture_max_file_size = strtoul (capture_max_file_size, NULL, 10);
+
+  char *lossless_queue_depth = zconfig_resolve (root,
+      "/collector/lossless/queue_depth", "10000");
+  ctx->lossless_queue_depth = strtoul (lossless_queue_depth, NULL, 10);
+
+  // Without a spill directory, the messages over the queue depth are dropped
+  char *lossless_spill_directory = zconfig_resolve (root,
+      "/collector/lossless/spill_directory", "");
+  ctx->lossless_spill_directory = csstring_new (lossless_spill_directory);
+
+  // and the messages that don't fit in the spill file, 0 = no limit
+  char *lossless_spill_max_size = zconfig_resolve (root,
+      "/collector/lossless/spill_max_size", "1073741824");
+  ctx->lossless_spill_max_size = strtoul (lossless_spill_max_size, NULL, 10);
+
+  // Capture files of the thread: csserver_<shard>_<date>_<sequence>.cscap
+  snprintf (ctx->capture_prefix, sizeof (ctx->capture_prefix), "csserver_%d",
+      ctx->shard_id);
+
+  if (ctx->generate_wav_files) {
+    ctx->wav_writers = cswav_new (".", ctx->stream_inactivity_period);
+    if (!ctx->wav_writers) {
+      TRACE (ERROR, "WAVE files can't be generated");
+    }
+  }
+
+  char *shards = zconfig_resolve (root,
+      "/collector/shards", "1");
+  ctx->shards = atoi (shards);
+  if (ctx->shards < 1 || ctx->shards > CSCOL_MAX_SHARDS) {
+    TRACE (ERROR, "Bad configuration. shards: %d", ctx->shards);
+    ctx->shards = 1;
+  }
+
+  char *backend = zconfig_resolve (root,
+      "/collector/backend", "socket");
+  ctx->io_uring_enabled = streq (backend, "io_uring");
+
+  // The buffer ring size is a power of 2
+  char *io_uring_buffers = zconfig_resolve (root,
+      "/collector/io_uring_buffers", "1024");
+  ctx->io_uring_buffers = 1;
+  while (ctx->io_uring_buffers < atoi (io_uring_buffers) &&
+      ctx->io_uring_buffers < CSCOL_URING_MAX_BUFFERS) {
+    ctx->io_uring_buffers <<= 1;
+  }
 
   rc = cscol_start_publisher (ctx);
 
@@ -255,6 +921,22 @@ cscol_configure (cscol_t *ctx)
     rc = cscol_start_listener (ctx);
   }
 
+  if (rc == 0) {
+    rc = cscol_start_batch (ctx);
+  }
+
+  if (rc == 0 && ctx->io_uring_enabled) {
+#ifdef CSCOL_HAVE_IO_URING
+    if (cscol_start_uring (ctx) == -1) {
+      TRACE (WARNING, "Warning: io_uring not available. Using the socket backend");
+      ctx->io_uring_enabled = 0;
+    }
+#else
+    TRACE (WARNING, "Warning: built without io_uring. Using the socket backend");
+    ctx->io_uring_enabled = 0;
+#endif
+  }
+
   zconfig_destroy (&root);
 
   TRACE (FUNCTIONS, "Leaving cscol_configure");
@@ -264,692 +946,882 @@ cscol_configure (cscol_t *ctx)
 
 
 //  --------------------------------------------------------------------------
-//  Write the data chunk read from the socket to a file for debugging 
-//  purposes.
+//  Appends a datagram read from the socket to the raw ingest capture. The
+//  capture is started the first time it's needed when the L_TR_CS trace
+//  level is enabled at run time
 //  Input:
+//    ctx: the Call Stream Collector context of the thread
+//    addr: the source address of the datagram
 //    buffer: the received data from the socket
 //    buffer_len: the size of the data received
-//  Output:
-//    None
-static void cscol_save_chunk(const unsigned char * const buffer, int buffer_len)
-{
-    char *var = NULL;
-    char path_chunk[1024];
-    int fd = -1;
-    int rc = 0;
-
-    TRACE(FUNCTIONS, "Entering in cscol_save_chunk");
-
-    if ((var = getenv ("CALLSTREAMSERVER_WORK_PATH")) != NULL) {
-        sprintf(path_chunk, "%s/csserver_chunk_%lu.trace", var, time(NULL));
-    }
-    else {
-        rc = -1;
-    }
-
-    if (rc == 0) {
-        if ((fd = open(path_chunk, O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1) {
-            TRACE(ERROR, "Error: open()");
-            rc = -1;
-        }
-    }
-
-    if (rc == 0) {
-        if (write(fd, buffer, buffer_len) != buffer_len) {
-            TRACE(ERROR, "Error: write()");
-            rc = -1;
-        }
-    }
 
-    if (fd != -1) {
-        close(fd);
-        fd = -1;
+static void
+cscol_capture (cscol_t *ctx, const struct sockaddr_in * const addr,
+    const unsigned char * const buffer, int buffer_len)
+{
+  if (!ctx->capture && !ctx->capture_failed) {
+    ctx->capture = cscap_new (csstring_data (ctx->capture_directory),
+        ctx->capture_prefix, ctx->capture_max_file_size);
+    if (!ctx->capture) {
+      TRACE (ERROR, "Error: unable to start the capture in %s",
+          csstring_data (ctx->capture_directory));
+      ctx->capture_failed = 1;
     }
+  }
 
-    TRACE(FUNCTIONS, "Leaving cscol_save_chunk");
+  if (ctx->capture) {
+    cscap_write (ctx->capture, ctx->timestamp_ns, addr, buffer, buffer_len);
+  }
 }
 
+
 //  --------------------------------------------------------------------------
-//  Callback handler. Analyzes and process commands sent by the parent thread
-//  through the shared pipe.
+//  Builds the key of a topic prefix in the table of subscriptions
 //  Input:
-//    loop: the reactor
-//    reader: the parent thread endpoint
-//    arg: the Call Stream Collector context
+//    prefix: the topic prefix
+//    len: the length of the topic prefix
 //  Output:
-//    0 - Ok
-//   -1 - Nok
+//    key: the prefix in hexadecimal
 
-static int
-cscol_command_handler (zloop_t *loop, zsock_t *reader, void *arg)
+static void
+cscol_topic_key (const byte * const prefix, size_t len, char *key)
 {
-  bool command_handled = false;
-  int result = 0;
-//  cscol_t *ctx = (cscol_t *) arg;
+  static const char digits[] = "0123456789abcdef";
+  size_t i;
 
-  TRACE (FUNCTIONS, "Entering in cscol_command_handler");
-
-  zmsg_t *msg = zmsg_recv (reader);
-//  zmsg_print (msg);
+  for (i = 0; i < len; i++) {
+    key[2 * i] = digits[prefix[i] >> 4];
+    key[2 * i + 1] = digits[prefix[i] & 0x0f];
+  }
+  key[2 * len] = '\0';
+}
 
-  if (!msg)
-    result = 1;
 
-  char *command = zmsg_popstr (msg);
-  TRACE (DEBUG, "Command: %s", command);
+//  --------------------------------------------------------------------------
+//  Updates the subscriptions of the bus with a subscription message of the
+//  XPUB socket: 1 (subscribe) or 0 (unsubscribe) followed by the prefix. A
+//  prefix longer than the topic is kept as the topic, so it selects a
+//  superset of the messages
+//  Input:
+//    ctx: the Call Stream Collector context of the thread
+//    data: the subscription message
+//    size: the size of the subscription message
 
-  if (streq (command, "$TERM")) {
-    command_handled = true;
-    result = 1;
-  }
+static void
+cscol_update_subscription (cscol_t *ctx, const byte * const data, size_t size)
+{
+  char key[CSCOL_TOPIC_KEY_LENGTH];
+  cscol_subscription_t *subscription;
+  size_t len;
 
-  if ((!command_handled) && streq (command, "PING")) {
-    command_handled = true;
-    char *command = zmsg_popstr (msg);
-    zsock_send (reader, "s", command);
-    free (command);
+  if (size < 1 || (data[0] != 0 && data[0] != 1)) {
+    TRACE (ERROR, "Subscription: Bad format");
+    return;
   }
 
-  if (!command_handled) {
-    TRACE (ERROR, "Invalid message");
-    assert (false);
+  len = size - 1 < CSBUS_TOPIC_LENGTH ? size - 1 : CSBUS_TOPIC_LENGTH;
+  cscol_topic_key (data + 1, len, key);
+  subscription = (cscol_subscription_t *) zhash_lookup (ctx->subscriptions, key);
+
+  if (data[0] == 1) {
+    if (!subscription) {
+      subscription = (cscol_subscription_t *) zmalloc (
+          sizeof (cscol_subscription_t));
+      memcpy (subscription->prefix, data + 1, len);
+      subscription->len = len;
+      zhash_insert (ctx->subscriptions, key, subscription);
+      zhash_freefn (ctx->subscriptions, key, free);
+      ctx->subscriptions_by_length[len]++;
+    }
+    subscription->count++;
+    TRACE (DEBUG, "Subscription to <%s>", key);
+  } else if (subscription) {
+    subscription->count--;
+    if (subscription->count == 0) {
+      zhash_delete (ctx->subscriptions, key);
+      ctx->subscriptions_by_length[len]--;
+    }
+    TRACE (DEBUG, "Unsubscription from <%s>", key);
   }
-
-  free (command);
-  zmsg_destroy (&msg);
-
-  TRACE (FUNCTIONS, "Leaving cscol_command_handler");
-
-  return result;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process a TetraFlexLogApiMessageHeader from the LogServer UDP
-//  data stream.
+//  Checks whether a message has subscribers in the bus
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
-//    buffer: the received data and not yet processed
-//    buffer_len: the size of the data received and not yet processed
+//    type: CSBUS_SIGNALING or CSBUS_VOICE
+//    id: the MsgId or the call id
 //  Output:
-//    Bytes processed from the received data
+//    true if any subscription prefix matches the topic of the message
 
-static int
-cscol_analyze_message_header (cscol_t *ctx,
-    const unsigned char * const buffer, int buffer_len)
+static bool
+cscol_is_subscribed (cscol_t *ctx, char type, UINT32 id)
 {
-  int bytes_processed = 0;
+  char key[CSCOL_TOPIC_KEY_LENGTH];
+  byte topic[CSBUS_TOPIC_LENGTH];
+  size_t len;
+
+  if (ctx->subscriptions_by_length[0]) {
+    return true;
+  }
 
-  TRACE (FUNCTIONS, "Entering in cscol_analyze_message_header");
+  csbus_topic (type, id, topic);
 
-  if (buffer_len >= sizeof (ctx->current_header)) {
-    memcpy(&ctx->current_header, buffer, sizeof (ctx->current_header));
-    bytes_processed = sizeof (ctx->current_header);
-    ctx->timestamp = time (NULL);
+  for (len = 1; len <= CSBUS_TOPIC_LENGTH; len++) {
+    if (ctx->subscriptions_by_length[len]) {
+      cscol_topic_key (topic, len, key);
+      if (zhash_lookup (ctx->subscriptions, key)) {
+        return true;
+      }
+    }
   }
 
-  TRACE (FUNCTIONS, "Leaving cscol_analyze_message_header. "
-      "bytes_processed: %d", bytes_processed);
+  ctx->unpublished++;
 
-  return bytes_processed;
+  return false;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Publish a LogApiKeepAlive message type to the registered subscribers
+//  Updates the subscriptions of the main collector thread and forwards the
+//  subscription message to the shards
 //  Input:
-//    ctx: the Call Stream Collector context of the thread
-//    keep_alive: the message to be published
+//    ctx: the Call Stream Collector context of the main thread
+//    data: the subscription message
+//    size: the size of the subscription message
 
 static void
-cscol_dispatch_keep_alive (cscol_t *ctx,
-    const LogApiKeepAlive * const keep_alive)
+cscol_share_subscription (cscol_t *ctx, const byte * const data, size_t size)
 {
-  TRACE (FUNCTIONS, "Entering in cscol_dispatch_keep_alive");
-
-  snprintf (ctx->work_area, sizeof (ctx->work_area),
-      "S_%d", LOG_API_ALIVE);
-  zmsg_t * msg = zmsg_new ();
-  zmsg_pushstr (msg, ctx->work_area);
-  zmsg_addmem (msg, &ctx->timestamp, sizeof (time_t));
-  zmsg_addmem (msg, keep_alive, sizeof (LogApiKeepAlive));
-  zmsg_send (&msg, ctx->publisher);
-
-  TRACE (FUNCTIONS, "Leaving cscol_dispatch_keep_alive");
+  int i;
+
+  cscol_update_subscription (ctx, data, size);
+  for (i = 0; ctx->shard_actors && i < ctx->shards - 1; i++) {
+    zmsg_t *msg = zmsg_new ();
+    zmsg_addstr (msg, "SUBSCRIPTION");
+    zmsg_addmem (msg, data, size);
+    zmsg_send (&msg, ctx->shard_actors[i]);
+  }
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process a LogApiKeepAlive from the LogServer UDP data stream.
+//  Creates a lossless consumer with its queue
 //  Input:
-//    ctx: the Call Stream Collector context of the thread
-//    buffer: the data received and not yet processed
-//    buffer_len: the size of the data received and not yet processed
+//    ctx: the Call Stream Collector context of the main thread
+//    name: the identity of the consumer
 //  Output:
-//    Bytes processed from the received data
+//    The created consumer or NULL
 
-static int
-cscol_analyze_keep_alive (cscol_t *ctx,
-    const unsigned char * const buffer, int buffer_len)
+static cscol_consumer_t *
+cscol_consumer_new (cscol_t *ctx, const char * const name)
 {
-  LogApiKeepAlive keep_alive;
-  int bytes_processed = 0;
-
-  TRACE (FUNCTIONS, "Entering in cscol_analyze_keep_alive");
+  char path[1024];
+  const char *spill_path = NULL;
 
-  if (buffer_len >= sizeof (keep_alive)) {
-    memcpy (&keep_alive, buffer, sizeof (keep_alive));
-    bytes_processed = sizeof (keep_alive);
-    cscol_dispatch_keep_alive (ctx, &keep_alive);
+  cscol_consumer_t *self = (cscol_consumer_t *) zmalloc (
+      sizeof (cscol_consumer_t));
+  if (self) {
+    if (!streq (csstring_data (ctx->lossless_spill_directory), "")) {
+      snprintf (path, sizeof (path), "%s/lossless_%s.spill",
+          csstring_data (ctx->lossless_spill_directory), name);
+      spill_path = path;
+    }
+    self->name = strdup (name);
+    self->queue = csqueue_new (ctx->lossless_queue_depth, spill_path,
+        ctx->lossless_spill_max_size);
+    self->filters = zhash_new ();
+    if (!self->name || !self->queue || !self->filters) {
+      free (self->name);
+      csqueue_destroy (&self->queue);
+      zhash_destroy (&self->filters);
+      free (self);
+      self = NULL;
+    }
   }
-
-  TRACE(FUNCTIONS, "Leaving cscol_analyze_keep_alive. "
-      "bytes_processed: %d", bytes_processed);
-
-  return bytes_processed;
+  return self;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Publish a LogApiDuplexCallChange message type to the registered subscribers
+//  Frees a lossless consumer with the messages still queued. Used as
+//  destructor of the consumers table
 //  Input:
-//    ctx: the Call Stream Collector context of the thread
-//    duplex_call_change: the message to be published
+//    The target consumer
 
 static void
-cscol_dispatch_duplex_call_change (cscol_t *ctx,
-    const LogApiDuplexCallChange * const duplex_call_change)
+cscol_consumer_destroy (void *data)
 {
-  TRACE (FUNCTIONS, "Entering in cscol_dispatch_duplex_call_change");
-
-  snprintf (ctx->work_area, sizeof (ctx->work_area),
-      "S_%d", LOG_API_DUPLEX_CALL_CHANGE);
-  zmsg_t * msg = zmsg_new ();
-  zmsg_pushstr (msg, ctx->work_area);
-  zmsg_addmem (msg, &ctx->timestamp, sizeof (time_t));
-  zmsg_addmem (msg, duplex_call_change, sizeof (LogApiDuplexCallChange));
-  zmsg_send (&msg, ctx->publisher);
-
-  TRACE (FUNCTIONS, "Leaving cscol_dispatch_duplex_call_change");
+  cscol_consumer_t *self = (cscol_consumer_t *) data;
+  if (self) {
+    if (csqueue_size (self->queue)) {
+      TRACE (WARNING, "Lossless consumer %s: %zu messages discarded",
+          self->name, csqueue_size (self->queue));
+    }
+    free (self->name);
+    csqueue_destroy (&self->queue);
+    zhash_destroy (&self->filters);
+    free (self);
+  }
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process a LogApiDuplexCallChange from the LogServer UDP data
-//  stream.
+//  Checks whether a topic matches the subscriptions of a lossless consumer
 //  Input:
-//    ctx: the Call Stream Collector context of the thread
-//    buffer: the data received and not yet processed
-//    buffer_len: the size of the data received and not yet processed
+//    consumer: the lossless consumer
+//    topic: the topic of the message
 //  Output:
-//    Bytes processed from the received data
+//    true if any subscription prefix of the consumer matches the topic
 
-static int
-cscol_analyze_duplex_call_change (cscol_t *ctx,
-    const unsigned char * const buffer, int buffer_len)
+static bool
+cscol_consumer_is_subscribed (cscol_consumer_t *consumer,
+    const byte * const topic)
 {
-  LogApiDuplexCallChange duplex_call_change;
-  int bytes_processed = 0;
+  char key[CSCOL_TOPIC_KEY_LENGTH];
+  size_t len;
 
-  TRACE (FUNCTIONS, "Entering in analyze_duplex_call_change");
-
-  if (buffer_len >= sizeof (duplex_call_change)) {
-    memcpy (&duplex_call_change, buffer, sizeof (duplex_call_change));
-    bytes_processed = sizeof (duplex_call_change);
-    cscol_dispatch_duplex_call_change (ctx, &duplex_call_change);
+  for (len = 0; len <= CSBUS_TOPIC_LENGTH; len++) {
+    cscol_topic_key (topic, len, key);
+    if (zhash_lookup (consumer->filters, key)) {
+      return true;
+    }
   }
 
-  TRACE (FUNCTIONS, "Leaving analyze_duplex_call_change. "
-      "bytes_processed: %d", bytes_processed);
-
-  return bytes_processed;
+  return false;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Publish a LogApiDuplexCallRelease message type to the registered subscribers
+//  Sends queued messages to a lossless consumer while it has credit
 //  Input:
-//    ctx: the Call Stream Collector context of the thread
-//    duplex_call_release: the message to be published
+//    ctx: the Call Stream Collector context of the main thread
+//    consumer: the lossless consumer
 
 static void
-cscol_dispatch_duplex_call_release (cscol_t *ctx,
-    const LogApiDuplexCallRelease * const duplex_call_release)
+cscol_consumer_deliver (cscol_t *ctx, cscol_consumer_t *consumer)
 {
-  TRACE (FUNCTIONS, "Entering in cscol_dispatch_duplex_call_release");
+  zframe_t *frame;
 
-  snprintf (ctx->work_area, sizeof (ctx->work_area),
-      "S_%d", LOG_API_DUPLEX_CALL_RELEASE);
-  zmsg_t * msg = zmsg_new ();
-  zmsg_pushstr (msg, ctx->work_area);
-  zmsg_addmem (msg, &ctx->timestamp, sizeof (time_t));
-  zmsg_addmem (msg, duplex_call_release, sizeof (LogApiDuplexCallRelease));
-  zmsg_send (&msg, ctx->publisher);
-
-  TRACE (FUNCTIONS, "Leaving cscol_dispatch_duplex_call_release");
+  while (consumer->credit > 0 && (frame = csqueue_pop (consumer->queue))) {
+    zstr_sendm (ctx->lossless, consumer->name);
+    zframe_send (&frame, ctx->lossless, 0);
+    consumer->credit--;
+    consumer->delivered++;
+  }
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process a LogApiDuplexCallRelease from the LogServer UDP data
-//  stream.
+//  Publishes a bus message. In the main collector thread, the message is
+//  queued too for every lossless consumer subscribed to its topic
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
-//    buffer: the data received and not yet processed
-//    buffer_len: the size of the data received and not yet processed
-//  Output:
-//    Bytes processed from the received data
+//    frame_p: the envelope of the message, sent and destroyed
 
-static int
-cscol_analyze_duplex_call_release (cscol_t *ctx,
-    const unsigned char * const buffer, int buffer_len)
+static void
+cscol_publish (cscol_t *ctx, zframe_t **frame_p)
 {
-  LogApiDuplexCallRelease duplex_call_release;
-  int bytes_processed = 0;
-
-  TRACE (FUNCTIONS, "Entering in cscol_analyze_duplex_call_release");
-
-  if (buffer_len >= sizeof (duplex_call_release)) {
-    memcpy (&duplex_call_release, buffer, sizeof (duplex_call_release));
-    bytes_processed = sizeof (duplex_call_release);
-    cscol_dispatch_duplex_call_release (ctx, &duplex_call_release);
+  cscol_consumer_t *consumer;
+  zframe_t *copy;
+
+  if (ctx->lossless && zhash_size (ctx->consumers) &&
+      zframe_size (*frame_p) >= CSBUS_TOPIC_LENGTH) {
+    consumer = (cscol_consumer_t *) zhash_first (ctx->consumers);
+    while (consumer) {
+      if (cscol_consumer_is_subscribed (consumer, zframe_data (*frame_p))) {
+        copy = zframe_dup (*frame_p);
+        if (csqueue_push (consumer->queue, &copy) == -1) {
+          TRACE (ERROR, "Lossless consumer %s: queue full. Message dropped",
+              consumer->name);
+        }
+        cscol_consumer_deliver (ctx, consumer);
+      }
+      consumer = (cscol_consumer_t *) zhash_next (ctx->consumers);
+    }
   }
 
-  TRACE (FUNCTIONS, "Leaving cscol_analyze_duplex_call_release. "
-      "bytes_processed: %d", bytes_processed);
-
-  return bytes_processed;
+  zframe_send (frame_p, ctx->publisher, 0);
 }
 
 
 //  --------------------------------------------------------------------------
-//  Publish a LogApiSimplexCallStartChange message type to the registered subscribers
+//  Adds or removes a subscription of a lossless consumer. The subscriptions
+//  of the consumers select the messages published as the ones of the bus
 //  Input:
-//    ctx: the Call Stream Collector context of the thread
-//    simplex_call_start_change: the message to be published
+//    ctx: the Call Stream Collector context of the main thread
+//    consumer: the lossless consumer
+//    subscribe: 1 (subscribe) or 0 (unsubscribe)
+//    prefix: the topic prefix
+//    len: the length of the topic prefix
 
 static void
-cscol_dispatch_simplex_call_start_change (cscol_t *ctx,
-    const LogApiSimplexCallStartChange * const simplex_call_start_change)
+cscol_consumer_subscription (cscol_t *ctx, cscol_consumer_t *consumer,
+    byte subscribe, const byte * const prefix, size_t len)
 {
-  TRACE (FUNCTIONS, "Entering in cscol_dispatch_simplex_call_start_change");
-
-  snprintf (ctx->work_area, sizeof (ctx->work_area),
-      "S_%d", LOG_API_SIMPLEX_CALL_CHANGE);
-  zmsg_t * msg = zmsg_new ();
-  zmsg_pushstr (msg, ctx->work_area);
-  zmsg_addmem (msg, &ctx->timestamp, sizeof (time_t));
-  zmsg_addmem (msg, simplex_call_start_change, sizeof (LogApiSimplexCallStartChange));
-  zmsg_send (&msg, ctx->publisher);
+  char key[CSCOL_TOPIC_KEY_LENGTH];
+  byte subscription_msg[CSBUS_TOPIC_LENGTH + 1];
+  cscol_subscription_t *filter;
+
+  cscol_topic_key (prefix, len, key);
+  filter = (cscol_subscription_t *) zhash_lookup (consumer->filters, key);
+
+  if (subscribe && !filter) {
+    filter = (cscol_subscription_t *) zmalloc (sizeof (cscol_subscription_t));
+    memcpy (filter->prefix, prefix, len);
+    filter->len = len;
+    filter->count = 1;
+    zhash_insert (consumer->filters, key, filter);
+    zhash_freefn (consumer->filters, key, free);
+  } else if (!subscribe && filter) {
+    zhash_delete (consumer->filters, key);
+  } else {
+    return;
+  }
 
-  TRACE (FUNCTIONS, "Leaving cscol_dispatch_simplex_call_start_change");
+  subscription_msg[0] = subscribe;
+  memcpy (subscription_msg + 1, prefix, len);
+  cscol_share_subscription (ctx, subscription_msg, len + 1);
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process a LogApiSimplexCallStartChange from the LogServer UDP
-//  data stream.
+//  Forgets a lossless consumer, its subscriptions and its queue
 //  Input:
-//    ctx: the Call Stream Collector context of the thread
-//    buffer: the data received and not yet processed
-//    buffer_len: the size of the data received and not yet processed
-//  Output:
-//    Bytes processed from the received data
+//    ctx: the Call Stream Collector context of the main thread
+//    consumer: the lossless consumer
 
-static int
-cscol_analyze_simplex_call_start_change (cscol_t *ctx,
-    const unsigned char * const buffer, int buffer_len)
+static void
+cscol_consumer_remove (cscol_t *ctx, cscol_consumer_t *consumer)
 {
-  LogApiSimplexCallStartChange simplex_call_start_change;
-  int bytes_processed = 0;
-
-  TRACE (FUNCTIONS, "Entering in cscol_analyze_simplex_call_start_change");
-
-  if (buffer_len >= sizeof (simplex_call_start_change)) {
-    memcpy (&simplex_call_start_change, buffer, sizeof (simplex_call_start_change));
-    bytes_processed = sizeof (simplex_call_start_change);
-    cscol_dispatch_simplex_call_start_change (ctx, &simplex_call_start_change);
+  cscol_subscription_t *filter;
+  zlist_t *filters = zhash_keys (consumer->filters);
+  char *key;
+
+  key = (char *) zlist_first (filters);
+  while (key) {
+    filter = (cscol_subscription_t *) zhash_lookup (consumer->filters, key);
+    cscol_consumer_subscription (ctx, consumer, 0, filter->prefix, filter->len);
+    key = (char *) zlist_next (filters);
   }
+  zlist_destroy (&filters);
 
-  TRACE (FUNCTIONS, "Leaving cscol_analyze_simplex_call_start_change. "
-      "bytes_processed: %d", bytes_processed);
-
-  return bytes_processed;
+  TRACE (DEBUG, "Lossless consumer %s: disconnected", consumer->name);
+  zhash_delete (ctx->consumers, consumer->name);
 }
 
 
 //  --------------------------------------------------------------------------
-//  Publish a LogApiSimplexCallPttChange message type to the registered subscribers
+//  Returns the name of a jitter histogram bucket in the statistics: the
+//  upper bound of the bucket (lt_<bound>us) or ge_<bound>us for the last one
 //  Input:
-//    ctx: the Call Stream Collector context of the thread
-//    simplex_call_ptt_change: the message to be published
+//    bucket: the jitter histogram bucket
+//  Output:
+//    The name of the bucket
 
-static void
-cscol_dispatch_simplex_call_ptt_change (cscol_t *ctx,
-    const LogApiSimplexCallPttChange * const simplex_call_ptt_change)
+static const char *
+cscol_jitter_bucket_name (int bucket)
 {
-  TRACE (FUNCTIONS, "Entering in cscol_dispatch_simplex_call_ptt_change");
+  static const char *names[CSCOL_JITTER_BUCKETS] = {
+      "lt_125us", "lt_250us", "lt_500us", "lt_1000us", "lt_2000us",
+      "lt_4000us", "lt_8000us", "lt_16000us", "lt_32000us", "lt_64000us",
+      "lt_128000us", "ge_128000us"
+  };
 
-  snprintf (ctx->work_area, sizeof (ctx->work_area),
-      "S_%d", LOG_API_SIMPLEX_CALL_PTT_CHANGE);
-  zmsg_t * msg = zmsg_new ();
-  zmsg_pushstr (msg, ctx->work_area);
-  zmsg_addmem (msg, &ctx->timestamp, sizeof (time_t));
-  zmsg_addmem (msg, simplex_call_ptt_change, sizeof (LogApiSimplexCallPttChange));
-  zmsg_send (&msg, ctx->publisher);
-
-  TRACE (FUNCTIONS, "Leaving cscol_dispatch_simplex_call_ptt_change");
+  return names[bucket];
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process a LogApiSimplexCallPttChange from the LogServer UDP
-//  data stream.
+//  Appends the collector's ingest statistics to a response
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
-//    buffer: the data received and not yet processed
-//    buffer_len: the size of the data received and not yet processed
-//  Output:
-//    Bytes processed from the received data
+//    response: the response that will be sent to the requester
 
-static int
-cscol_analyze_simplex_call_ptt_change (cscol_t *ctx,
-    const unsigned char * const buffer, int buffer_len)
+static void
+cscol_stats (cscol_t *ctx, zmsg_t *response)
 {
-  LogApiSimplexCallPttChange simplex_call_ptt_change;
-  int bytes_processed = 0;
-
-  TRACE (FUNCTIONS, "Entering in cscol_analyze_simplex_call_ptt_change");
-
-  if (buffer_len >= sizeof (simplex_call_ptt_change)) {
-    memcpy (&simplex_call_ptt_change, buffer, sizeof (simplex_call_ptt_change));
-    bytes_processed = sizeof (simplex_call_ptt_change);
-    cscol_dispatch_simplex_call_ptt_change(ctx, &simplex_call_ptt_change);
+  int i = 0;
+  cscol_source_t *source;
+  cscol_voice_stream_t *stream;
+  cscol_node_t *node;
+  cscol_consumer_t *consumer;
+  uint64_t seq_lost = 0;
+  uint64_t seq_out_of_order = 0;
+  int bucket;
+
+  TRACE (FUNCTIONS, "Entering in cscol_stats");
+
+  zmsg_addstrf (response, "shard=%d", ctx->shard_id);
+  zmsg_addstrf (response, "batch_size=%d", ctx->batch_size);
+  zmsg_addstrf (response, "backend=%s",
+      ctx->io_uring_enabled ? "io_uring" : "socket");
+#ifdef CSCOL_HAVE_IO_URING
+  zmsg_addstrf (response, "io_uring_rearms=%" PRIu64, ctx->uring_rearms);
+#endif
+  zmsg_addstrf (response, "wakeups=%" PRIu64, ctx->wakeups);
+  zmsg_addstrf (response, "datagrams=%" PRIu64, ctx->datagrams);
+  zmsg_addstrf (response, "truncated=%" PRIu64, ctx->truncated);
+  zmsg_addstrf (response, "rejected=%" PRIu64, ctx->rejected);
+  zmsg_addstrf (response, "unpublished=%" PRIu64, ctx->unpublished);
+  zmsg_addstrf (response, "subscriptions=%zu", zhash_size (ctx->subscriptions));
+  zmsg_addstrf (response, "lossless_consumers=%zu", zhash_size (ctx->consumers));
+  zmsg_addstrf (response, "kernel_drops=%" PRIu32, ctx->kernel_drops);
+  zmsg_addstrf (response, "captured=%" PRIu64,
+      ctx->capture ? cscap_records (ctx->capture) : 0);
+  zmsg_addstrf (response, "sources=%zu", zhash_size (ctx->sources));
+  zmsg_addstrf (response, "last_drained=%d", ctx->last_drained);
+
+  if (ctx->drained_histogram) {
+    for (i = 1; i <= ctx->batch_size; i++) {
+      if (ctx->drained_histogram[i]) {
+        zmsg_addstrf (response, "drained_%d=%" PRIu64, i,
+            ctx->drained_histogram[i]);
+      }
+    }
   }
 
-  TRACE(FUNCTIONS, "Leaving cscol_analyze_simplex_call_ptt_change. "
-      "bytes_processed: %d", bytes_processed);
+  source = (cscol_source_t *) zhash_first (ctx->sources);
+  while (source) {
+    seq_lost += source->seq_lost;
+    seq_out_of_order += source->seq_out_of_order;
+    source = (cscol_source_t *) zhash_next (ctx->sources);
+  }
 
-  return bytes_processed;
-}
+  zmsg_addstrf (response, "seq_lost=%" PRIu64, seq_lost);
+  zmsg_addstrf (response, "seq_out_of_order=%" PRIu64, seq_out_of_order);
+  zmsg_addstrf (response, "voice_lost=%" PRIu64, ctx->voice_lost);
+  zmsg_addstrf (response, "voice_out_of_order=%" PRIu64,
+      ctx->voice_out_of_order);
+  zmsg_addstrf (response, "voice_streams=%zu", zhash_size (ctx->voice_streams));
+  zmsg_addstrf (response, "wav_files=%zu",
+      ctx->wav_writers ? cswav_size (ctx->wav_writers) : 0);
+
+  source = (cscol_source_t *) zhash_first (ctx->sources);
+  while (source) {
+    zmsg_addstrf (response, "source.%s.datagrams=%" PRIu64,
+        source->key, source->datagrams);
+    zmsg_addstrf (response, "source.%s.junk_bytes=%" PRIu64,
+        source->key, source->junk_bytes);
+    zmsg_addstrf (response, "source.%s.resyncs=%" PRIu64,
+        source->key, source->resyncs);
+    zmsg_addstrf (response, "source.%s.ring_overflows=%" PRIu64,
+        source->key, csring_overflows (source->ring));
+    zmsg_addstrf (response, "source.%s.ring_pending=%zu",
+        source->key, csring_size (source->ring));
+    zmsg_addstrf (response, "source.%s.seq_lost=%" PRIu64,
+        source->key, source->seq_lost);
+    zmsg_addstrf (response, "source.%s.seq_out_of_order=%" PRIu64,
+        source->key, source->seq_out_of_order);
+    source = (cscol_source_t *) zhash_next (ctx->sources);
+  }
 
+  stream = (cscol_voice_stream_t *) zhash_first (ctx->voice_streams);
+  while (stream) {
+    zmsg_addstrf (response, "call.%u.%u.packets=%" PRIu64,
+        stream->call_id, stream->originator, stream->packets);
+    zmsg_addstrf (response, "call.%u.%u.lost=%" PRIu64,
+        stream->call_id, stream->originator, stream->lost);
+    zmsg_addstrf (response, "call.%u.%u.out_of_order=%" PRIu64,
+        stream->call_id, stream->originator, stream->out_of_order);
+    zmsg_addstrf (response, "call.%u.%u.jitter_us=%.0f",
+        stream->call_id, stream->originator, stream->jitter_ns / 1000);
+    for (bucket = 0; bucket < CSCOL_JITTER_BUCKETS; bucket++) {
+      if (stream->jitter_histogram[bucket]) {
+        zmsg_addstrf (response, "call.%u.%u.jitter_%s=%" PRIu64,
+            stream->call_id, stream->originator,
+            cscol_jitter_bucket_name (bucket), stream->jitter_histogram[bucket]);
+      }
+    }
+    stream = (cscol_voice_stream_t *) zhash_next (ctx->voice_streams);
+  }
 
-//  --------------------------------------------------------------------------
-//  Publish a LogApiSimplexCallRelease message type to the registered subscribers
-//  Input:
-//    ctx: the Call Stream Collector context of the thread
-//    simplex_call_release: the message to be published
+  consumer = (cscol_consumer_t *) zhash_first (ctx->consumers);
+  while (consumer) {
+    zmsg_addstrf (response, "lossless.%s.credit=%d",
+        consumer->name, consumer->credit);
+    zmsg_addstrf (response, "lossless.%s.delivered=%" PRIu64,
+        consumer->name, consumer->delivered);
+    zmsg_addstrf (response, "lossless.%s.queued=%zu",
+        consumer->name, csqueue_size (consumer->queue));
+    zmsg_addstrf (response, "lossless.%s.spilled=%zu",
+        consumer->name, csqueue_spilled (consumer->queue));
+    zmsg_addstrf (response, "lossless.%s.high_water=%zu",
+        consumer->name, csqueue_high_water (consumer->queue));
+    zmsg_addstrf (response, "lossless.%s.dropped=%" PRIu64,
+        consumer->name, csqueue_dropped (consumer->queue));
+    consumer = (cscol_consumer_t *) zhash_next (ctx->consumers);
+  }
 
-static void
-cscol_dispatch_simplex_call_release (cscol_t *ctx,
-    const LogApiSimplexCallRelease * const simplex_call_release)
-{
-  TRACE (FUNCTIONS, "Entering in cscol_dispatch_simplex_call_release");
+  node = (cscol_node_t *) zhash_first (ctx->nodes);
+  while (node) {
+    zmsg_addstrf (response, "node.%u.packets=%" PRIu64,
+        node->node, node->packets);
+    for (bucket = 0; bucket < CSCOL_JITTER_BUCKETS; bucket++) {
+      if (node->jitter_histogram[bucket]) {
+        zmsg_addstrf (response, "node.%u.jitter_%s=%" PRIu64,
+            node->node, cscol_jitter_bucket_name (bucket),
+            node->jitter_histogram[bucket]);
+      }
+    }
+    node = (cscol_node_t *) zhash_next (ctx->nodes);
+  }
 
-  snprintf (ctx->work_area, sizeof (ctx->work_area),
-      "S_%d", LOG_API_SIMPLEX_CALL_RELEASE);
-  zmsg_t * msg = zmsg_new ();
-  zmsg_pushstr (msg, ctx->work_area);
-  zmsg_addmem (msg, &ctx->timestamp, sizeof (time_t));
-  zmsg_addmem (msg, simplex_call_release, sizeof (LogApiSimplexCallRelease));
-  zmsg_send (&msg, ctx->publisher);
+  // The statistics of every shard follow the ones of the main thread
+  for (i = 0; ctx->shard_actors && i < ctx->shards - 1; i++) {
+    zstr_send (ctx->shard_actors[i], "STATS");
+    zmsg_t *shard_response = zmsg_recv (ctx->shard_actors[i]);
+    if (shard_response) {
+      zframe_t *frame = zmsg_pop (shard_response);
+      while (frame) {
+        zmsg_append (response, &frame);
+        frame = zmsg_pop (shard_response);
+      }
+      zmsg_destroy (&shard_response);
+    }
+  }
 
-  TRACE (FUNCTIONS, "Leaving cscol_dispatch_simplex_call_release");
+  TRACE (FUNCTIONS, "Leaving cscol_stats");
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process a LogApiSimplexCallRelease from the LogServer UDP
-//  data stream.
+//  Callback handler. Analyzes and process commands sent by the parent thread
+//  through the shared pipe.
 //  Input:
-//    ctx: the Call Stream Collector context of the thread
-//    buffer: the data received and not yet processed
-//    buffer_len: the size of the data received and not yet processed
+//    loop: the reactor
+//    reader: the parent thread endpoint
+//    arg: the Call Stream Collector context
 //  Output:
-//    Bytes processed from the received data
+//    0 - Ok
+//   -1 - Nok
 
 static int
-cscol_analyze_simplex_call_release (cscol_t *ctx,
-    const unsigned char * const buffer, int buffer_len)
+cscol_command_handler (zloop_t *loop, zsock_t *reader, void *arg)
 {
-  LogApiSimplexCallRelease simplex_call_release;
-  int bytes_processed = 0;
+  bool command_handled = false;
+  int result = 0;
+  cscol_t *ctx = (cscol_t *) arg;
+
+  TRACE (FUNCTIONS, "Entering in cscol_command_handler");
+
+  zmsg_t *msg = zmsg_recv (reader);
+//  zmsg_print (msg);
+
+  if (!msg)
+    result = 1;
 
-  TRACE (FUNCTIONS, "Entering in cscol_analyze_simplex_call_release");
+  char *command = zmsg_popstr (msg);
+  TRACE (DEBUG, "Command: %s", command);
 
-  if (buffer_len >= sizeof (simplex_call_release)) {
-    memcpy (&simplex_call_release, buffer, sizeof (simplex_call_release));
-    bytes_processed = sizeof (simplex_call_release);
-    cscol_dispatch_simplex_call_release (ctx, &simplex_call_release);
+  if (streq (command, "$TERM")) {
+    command_handled = true;
+    result = 1;
   }
 
-  TRACE (FUNCTIONS, "Leaving cscol_analyze_simplex_call_release. "
-      "bytes_processed: %d", bytes_processed);
+  if ((!command_handled) && streq (command, "PING")) {
+    command_handled = true;
+    char *command = zmsg_popstr (msg);
+    zsock_send (reader, "s", command);
+    free (command);
+  }
 
-  return bytes_processed;
-}
+  if ((!command_handled) && streq (command, "STATS")) {
+    command_handled = true;
+    zmsg_t *response = zmsg_new ();
+    cscol_stats (ctx, response);
+    zmsg_send (&response, reader);
+  }
 
+  // Subscriptions of the bus forwarded by the main collector thread
+  if ((!command_handled) && streq (command, "SUBSCRIPTION")) {
+    command_handled = true;
+    zframe_t *subscription = zmsg_pop (msg);
+    if (subscription) {
+      cscol_update_subscription (ctx, zframe_data (subscription),
+          zframe_size (subscription));
+      zframe_destroy (&subscription);
+    }
+  }
 
-//  --------------------------------------------------------------------------
-//  Publish a LogApiGroupCallStartChange message type to the registered subscribers
-//  Input:
-//    ctx: the Call Stream Collector context of the thread
-//    group_call_start_change: the message to be published
+  if (!command_handled) {
+    TRACE (ERROR, "Invalid message");
+    assert (false);
+  }
 
-static void
-cscol_dispatch_group_call_start_change (cscol_t *ctx,
-    const LogApiGroupCallStartChange * const group_call_start_change)
-{
-  TRACE (FUNCTIONS, "Entering in cscol_dispatch_group_call_start_change");
+  free (command);
+  zmsg_destroy (&msg);
 
-  snprintf (ctx->work_area, sizeof (ctx->work_area),
-      "S_%d", LOG_API_GROUP_CALL_CHANGE);
-  zmsg_t * msg = zmsg_new ();
-  zmsg_pushstr (msg, ctx->work_area);
-  zmsg_addmem (msg, &ctx->timestamp, sizeof (time_t));
-  zmsg_addmem (msg, group_call_start_change, sizeof (LogApiGroupCallStartChange));
-  zmsg_send (&msg, ctx->publisher);
+  TRACE (FUNCTIONS, "Leaving cscol_command_handler");
 
-  TRACE (FUNCTIONS, "Leaving cscol_dispatch_group_call_start_change");
+  return result;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process a LogApiGroupCallStartChange from the LogServer UDP
-//  data stream.
+//  Accounts for the LogApi messages lost by a LogServer through the gaps in
+//  the SequenceCounter of the message headers
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
-//    buffer: the data received and not yet processed
-//    buffer_len: the size of the data received and not yet processed
-//  Output:
-//    Bytes processed from the received data
+//    header: the header of the LogApi message received
 
-static int
-cscol_analyze_group_call_start_change (cscol_t *ctx,
-    const unsigned char * const buffer, int buffer_len)
+static void
+cscol_track_sequence (cscol_t *ctx,
+    const TetraFlexLogApiMessageHeader * const header)
 {
-  LogApiGroupCallStartChange group_call_start_change;
-  int bytes_processed = 0;
-
-  TRACE (FUNCTIONS, "Entering in cscol_analyze_group_call_start_change");
-
-  TRACE (DEBUG, "Buffer len: %d - Size struct: %d", buffer_len, sizeof (group_call_start_change));
-
-  if (buffer_len >= sizeof (group_call_start_change)) {
-    memcpy (&group_call_start_change, buffer, sizeof (group_call_start_change));
-    bytes_processed = sizeof (group_call_start_change);
-    cscol_dispatch_group_call_start_change (ctx, &group_call_start_change);
+  cscol_source_t *source = ctx->source;
+  UINT16 gap;
+
+  if (source->seq_valid) {
+    gap = (UINT16) (header->SequenceCounter - source->last_seq - 1);
+    if (gap == 0) {
+      source->last_seq = header->SequenceCounter;
+    } else if (gap < 0x8000) {
+      TRACE (WARNING, "Source %s: %u LogApi messages lost",
+          source->key, gap);
+      source->seq_lost += gap;
+      source->last_seq = header->SequenceCounter;
+    } else {
+      // Duplicated or older than the last message received
+      source->seq_out_of_order++;
+    }
+  } else {
+    source->seq_valid = 1;
+    source->last_seq = header->SequenceCounter;
   }
-
-  TRACE (FUNCTIONS, "Leaving cscol_analyze_group_call_start_change. "
-      "bytes_processed: %d", bytes_processed);
-
-  return bytes_processed;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Publish a LogApiGroupCallPttActive message type to the registered subscribers
+//  Returns the jitter histogram bucket of a deviation from the nominal
+//  interarrival time. The first bucket holds the deviations below
+//  CSCOL_JITTER_FIRST_BOUND_US and every following bucket doubles the bound
 //  Input:
-//    ctx: the Call Stream Collector context of the thread
-//    group_call_ptt_active: the message to be published
+//    deviation_ns: the absolute deviation
+//  Output:
+//    The bucket
 
-static void
-cscol_dispatch_group_call_ptt_active (cscol_t *ctx,
-    const LogApiGroupCallPttActive * const group_call_ptt_active)
+static int
+cscol_jitter_bucket (uint64_t deviation_ns)
 {
-  TRACE (FUNCTIONS, "Entering in cscol_dispatch_group_call_ptt_active");
+  uint64_t bound_ns = CSCOL_JITTER_FIRST_BOUND_US * 1000ULL;
+  int bucket = 0;
 
-  snprintf (ctx->work_area, sizeof (ctx->work_area),
-      "S_%d", LOG_API_GROUP_CALL_PTT_ACTIVE);
-  zmsg_t * msg = zmsg_new ();
-  zmsg_pushstr (msg, ctx->work_area);
-  zmsg_addmem (msg, &ctx->timestamp, sizeof (time_t));
-  zmsg_addmem (msg, group_call_ptt_active, sizeof (LogApiGroupCallPttActive));
-  zmsg_send (&msg, ctx->publisher);
+  while (bucket < CSCOL_JITTER_BUCKETS - 1 && deviation_ns >= bound_ns) {
+    bound_ns <<= 1;
+    bucket++;
+  }
 
-  TRACE (FUNCTIONS, "Leaving cscol_dispatch_group_call_ptt_active");
+  return bucket;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process a LogApiGroupCallPttActive from the LogServer UDP
-//  data stream.
+//  Accounts for the interarrival jitter of a voice packet received in
+//  sequence, in its stream and in its originating node
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
-//    buffer: the data received and not yet processed
-//    buffer_len: the size of the data received and not yet processed
-//  Output:
-//    Bytes processed from the received data
+//    stream: the voice stream of the packet
+//    voice: the voice packet received
+//    intervals: the packet intervals since the previous packet received
 
-static int
-cscol_analyze_group_call_ptt_active (cscol_t *ctx,
-    const unsigned char * const buffer, int buffer_len)
+static void
+cscol_track_voice_jitter (cscol_t *ctx, cscol_voice_stream_t *stream,
+    const LogApiVoice * const voice, int intervals)
 {
-  LogApiGroupCallPttActive group_call_ptt_active;
-  int bytes_processed = 0;
-
-  TRACE (FUNCTIONS, "Entering in cscol_analyze_group_call_ptt_active");
-
-  if (buffer_len >= sizeof (group_call_ptt_active)) {
-    memcpy (&group_call_ptt_active, buffer, sizeof (group_call_ptt_active));
-    bytes_processed = sizeof (group_call_ptt_active);
-    cscol_dispatch_group_call_ptt_active (ctx, &group_call_ptt_active);
+  char key[CSCOL_NODE_KEY_LENGTH];
+  cscol_node_t *node;
+  int64_t interval_ns = CSCOL_VOICE_PACKET_INTERVAL_NS;
+  int64_t deviation_ns;
+  int bucket;
+
+  // A packet with a single TETRA frame carries half the speech time
+  if (voice->m_uiPayload1Info != PAYLOAD_INFO_G711 &&
+      cs_voice_payload_duration_ms (voice->m_uiPayload1Info) +
+      cs_voice_payload_duration_ms (voice->m_uiPayload2Info) == 30) {
+    interval_ns /= 2;
   }
 
-  TRACE (FUNCTIONS, "Leaving cscol_analyze_group_call_ptt_active. "
-      "bytes_processed: %d", bytes_processed);
+  deviation_ns = (int64_t) (ctx->timestamp_ns - stream->last_arrival_ns) -
+      intervals * interval_ns;
+  if (deviation_ns < 0) {
+    deviation_ns = -deviation_ns;
+  }
 
-  return bytes_processed;
+  bucket = cscol_jitter_bucket ((uint64_t) deviation_ns);
+  stream->jitter_ns += ((double) deviation_ns - stream->jitter_ns) / 16;
+  stream->jitter_histogram[bucket]++;
+
+  snprintf (key, sizeof (key), "%u", stream->node);
+  node = (cscol_node_t *) zhash_lookup (ctx->nodes, key);
+  if (!node) {
+    node = (cscol_node_t *) zmalloc (sizeof (cscol_node_t));
+    node->node = stream->node;
+    zhash_insert (ctx->nodes, key, node);
+    zhash_freefn (ctx->nodes, key, free);
+  }
+  node->packets++;
+  node->jitter_histogram[bucket]++;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Publish a LogApiGroupCallPttIdle message type to the registered subscribers
+//  Accounts for the voice packets lost in a voice stream through the gaps
+//  in the m_uiPacketSeq of the packets
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
-//    group_call_ptt_idle: the message to be published
+//    voice: the voice packet received
 
 static void
-cscol_dispatch_group_call_ptt_idle (cscol_t *ctx,
-    const LogApiGroupCallPttIdle * const group_call_ptt_idle)
+cscol_track_voice_sequence (cscol_t *ctx, const LogApiVoice * const voice)
 {
-  TRACE (FUNCTIONS, "Entering in cscol_dispatch_group_call_ptt_idle");
-
-  snprintf (ctx->work_area, sizeof (ctx->work_area),
-      "S_%d", LOG_API_GROUP_CALL_PTT_IDLE);
-  zmsg_t * msg = zmsg_new ();
-  zmsg_pushstr (msg, ctx->work_area);
-  zmsg_addmem (msg, &ctx->timestamp, sizeof (time_t));
-  zmsg_addmem (msg, group_call_ptt_idle, sizeof (LogApiGroupCallPttIdle));
-  zmsg_send (&msg, ctx->publisher);
+  cscol_voice_stream_t *stream;
+  char key[32];
+  UINT8 seq = voice->m_uiPacketSeq & 0x7f;
+  UINT8 gap;
+
+  snprintf (key, sizeof (key), "%u:%u",
+      voice->m_uiCallId, voice->m_uiStreamOriginator);
+
+  stream = (cscol_voice_stream_t *) zhash_lookup (ctx->voice_streams, key);
+
+  if (!stream) {
+    stream = (cscol_voice_stream_t *) zmalloc (sizeof (cscol_voice_stream_t));
+    stream->call_id = voice->m_uiCallId;
+    stream->originator = voice->m_uiStreamOriginator;
+    stream->random_id = voice->m_uiStreamRandomId;
+    stream->last_seq = seq;
+    stream->node = voice->m_uiOriginatingNode;
+    stream->last_arrival_ns = ctx->timestamp_ns;
+    zhash_insert (ctx->voice_streams, key, stream);
+    zhash_freefn (ctx->voice_streams, key, free);
+  } else if (stream->random_id != voice->m_uiStreamRandomId) {
+    // The source switched to a new stream. The sequence starts again
+    stream->random_id = voice->m_uiStreamRandomId;
+    stream->last_seq = seq;
+    stream->last_arrival_ns = ctx->timestamp_ns;
+  } else {
+    gap = (seq - stream->last_seq - 1) & 0x7f;
+    if (gap < 0x40) {
+      if (gap) {
+        TRACE (WARNING, "Call %u: %u voice packets lost", stream->call_id, gap);
+        stream->lost += gap;
+        ctx->voice_lost += gap;
+      }
+      cscol_track_voice_jitter (ctx, stream, voice, gap + 1);
+      stream->last_seq = seq;
+      stream->last_arrival_ns = ctx->timestamp_ns;
+    } else {
+      stream->out_of_order++;
+      ctx->voice_out_of_order++;
+    }
+  }
 
-  TRACE (FUNCTIONS, "Leaving cscol_dispatch_group_call_ptt_idle");
+  stream->packets++;
+  stream->last_activity = (time_t) (ctx->timestamp_ns / 1000000000ULL);
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process a LogApiGroupCallPttIdle from the LogServer UDP
-//  data stream.
+//  Publish a LogApi message to the registered subscribers straight from the
+//  received data
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
-//    buffer: the data received and not yet processed
-//    buffer_len: the size of the data received and not yet processed
-//  Output:
-//    Bytes processed from the received data
+//    descriptor: the descriptor of the LogApi message type
+//    log_api_msg: the LogApi message in the received data
 
-static int
-cscol_analyze_group_call_ptt_idle (cscol_t *ctx,
-    const unsigned char * const buffer, int buffer_len)
+static void
+cscol_dispatch_log_api (cscol_t *ctx,
+    const cs_log_api_descriptor_t * const descriptor,
+    const unsigned char * const log_api_msg)
 {
-  LogApiGroupCallPttIdle group_call_ptt_idle;
-  int bytes_processed = 0;
-
-  TRACE (FUNCTIONS, "Entering in cscol_analyze_group_call_ptt_idle");
+  TRACE (FUNCTIONS, "Entering in cscol_dispatch_log_api");
 
-  if (buffer_len >= sizeof (group_call_ptt_idle)) {
-    memcpy (&group_call_ptt_idle, buffer, sizeof (group_call_ptt_idle));
-    bytes_processed = sizeof (group_call_ptt_idle);
-    cscol_dispatch_group_call_ptt_idle (ctx, &group_call_ptt_idle);
+  zframe_t *frame = csbus_encode (CSBUS_SIGNALING, descriptor->msg_id,
+      ctx->timestamp_ns, log_api_msg, descriptor->size, NULL, 0);
+  if (frame) {
+    cscol_publish (ctx, &frame);
   }
 
-  TRACE (FUNCTIONS, "Leaving cscol_analyze_group_call_ptt_idle. "
-      "bytes_processed: %d", bytes_processed);
-
-  return bytes_processed;
+  TRACE (FUNCTIONS, "Leaving cscol_dispatch_log_api");
 }
 
 
 //  --------------------------------------------------------------------------
-//  Publish a LogApiGroupCallRelease message type to the registered subscribers
+//  Closes the WAVE file of a call when the LogApi message is its release
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
-//    group_call_release: the message to be published
+//    msg_id: the LogApi MsgId
+//    log_api_msg: the LogApi message in the received data
 
 static void
-cscol_dispatch_group_call_release (cscol_t *ctx,
-    const LogApiGroupCallRelease * const group_call_release)
+cscol_close_wav_file (cscol_t *ctx, UINT8 msg_id,
+    const unsigned char * const log_api_msg)
 {
-  TRACE (FUNCTIONS, "Entering in cscol_dispatch_group_call_release");
-
-  snprintf (ctx->work_area, sizeof (ctx->work_area),
-      "S_%d", LOG_API_GROUP_CALL_RELEASE);
-  zmsg_t * msg = zmsg_new ();
-  zmsg_pushstr (msg, ctx->work_area);
-  zmsg_addmem (msg, &ctx->timestamp, sizeof (time_t));
-  zmsg_addmem (msg, group_call_release, sizeof (LogApiGroupCallRelease));
-  zmsg_send (&msg, ctx->publisher);
-
-  TRACE (FUNCTIONS, "Leaving cscol_dispatch_group_call_release");
+  switch (msg_id) {
+  case LOG_API_DUPLEX_CALL_RELEASE:
+    cswav_close (ctx->wav_writers,
+        ((const LogApiDuplexCallRelease *) log_api_msg)->m_uiCallId);
+    break;
+  case LOG_API_SIMPLEX_CALL_RELEASE:
+    cswav_close (ctx->wav_writers,
+        ((const LogApiSimplexCallRelease *) log_api_msg)->m_uiCallId);
+    break;
+  case LOG_API_GROUP_CALL_RELEASE:
+    cswav_close (ctx->wav_writers,
+        ((const LogApiGroupCallRelease *) log_api_msg)->m_uiCallId);
+    break;
+  default:
+    break;
+  }
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process a LogApiGroupCallRelease from the LogServer UDP
-//  data stream.
+//  Analyzes and process a LogApi message from the LogServer UDP data stream.
+//  The message type is looked up in the LogApi registry by the MsgId of its
+//  header.
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
-//    buffer: the data received and not yet processed
+//    buffer: the received data and not yet processed
 //    buffer_len: the size of the data received and not yet processed
 //  Output:
 //    Bytes processed from the received data
 
 static int
-cscol_analyze_group_call_release(cscol_t *ctx,
+cscol_analyze_log_api (cscol_t *ctx,
     const unsigned char * const buffer, int buffer_len)
 {
-  LogApiGroupCallRelease group_call_release;
+  const TetraFlexLogApiMessageHeader *header =
+      (const TetraFlexLogApiMessageHeader *) buffer;
+  const cs_log_api_descriptor_t *descriptor;
   int bytes_processed = 0;
 
-  TRACE (FUNCTIONS, "Entering in analyze_group_call_release");
-
-  if (buffer_len >= sizeof (group_call_release)) {
-    memcpy (&group_call_release, buffer, sizeof (group_call_release));
-    bytes_processed = sizeof (group_call_release);
-    cscol_dispatch_group_call_release (ctx, &group_call_release);
+  TRACE (FUNCTIONS, "Entering in cscol_analyze_log_api");
+
+  if (buffer_len >= sizeof (TetraFlexLogApiMessageHeader)) {
+    descriptor = cs_log_api_descriptor (header->MsgId);
+    if (!descriptor) {
+      TRACE (DEBUG, "Message type: UNKNOWN (%x)", header->MsgId);
+      bytes_processed = 1;
+      ctx->source->junk_bytes++;
+    } else if (buffer_len >= descriptor->size) {
+      TRACE (DEBUG, "Message type: %s", descriptor->name);
+      if (header->MsgId != LOG_API_ALIVE) {
+        cscol_track_sequence (ctx, header);
+      }
+      if (cscol_is_subscribed (ctx, CSBUS_SIGNALING, header->MsgId)) {
+        cscol_dispatch_log_api (ctx, descriptor, buffer);
+      }
+      if (ctx->wav_writers) {
+        cscol_close_wav_file (ctx, header->MsgId, buffer);
+      }
+      bytes_processed = descriptor->size;
+    }
   }
 
-  TRACE (FUNCTIONS, "Leaving analyze_group_call_release. "
+  TRACE (FUNCTIONS, "Leaving cscol_analyze_log_api. "
       "bytes_processed: %d", bytes_processed);
 
   return bytes_processed;
@@ -957,31 +1829,36 @@ cscol_analyze_group_call_release(cscol_t *ctx,
 
 
 //  --------------------------------------------------------------------------
-//  Publish a LogApiStatusSDS message type to the registered subscribers
+//  Publish a LogApiVoice message type to the registered subscribers
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
-//    status_sds: the message to be published
+//    voice: the message to be published
+//    voice_data: the payloads of the message, A-law or native TETRA frames
+//    voice_data_len: the size of the payloads
 
 static void
-cscol_dispatch_status_sds (cscol_t *ctx,
-    const LogApiStatusSDS * const status_sds)
+cscol_dispatch_voice (cscol_t *ctx, const LogApiVoice * const voice,
+    const unsigned char * const voice_data, int voice_data_len)
 {
-  TRACE (FUNCTIONS, "Entering in cscol_dispatch_status_sds");
+  TRACE (FUNCTIONS, "Entering in cscol_dispatch_voice");
 
-  snprintf (ctx->work_area, sizeof (ctx->work_area),
-      "S_%d", LOG_API_SDS_STATUS);
-  zmsg_t * msg = zmsg_new ();
-  zmsg_pushstr (msg, ctx->work_area);
-  zmsg_addmem (msg, &ctx->timestamp, sizeof (time_t));
-  zmsg_addmem (msg, status_sds, sizeof (LogApiStatusSDS));
-  zmsg_send (&msg, ctx->publisher);
+  TRACE (DEBUG, "Call id: %u", voice->m_uiCallId);
+  zframe_t *frame = csbus_encode (CSBUS_VOICE, voice->m_uiCallId,
+      ctx->timestamp_ns,
+      voice, sizeof (LogApiVoice), voice_data, voice_data_len);
+  if (frame) {
+    cscol_publish (ctx, &frame);
+  }
 
-  TRACE (FUNCTIONS, "Leaving cscol_dispatch_status_sds");
+  TRACE (FUNCTIONS, "Leaving cscol_dispatch_voice");
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process a LogApiStatusSDS from the LogServer UDP data stream.
+//  Analyzes and process a LogApiVoice from the LogServer UDP data stream. The
+//  size of its payloads is given by their PayloadInfo, so G.711 and native
+//  TETRA frames are published as received. A packet with an unknown payload
+//  is skipped as junk.
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
 //    buffer: the data received and not yet processed
@@ -990,21 +1867,40 @@ cscol_dispatch_status_sds (cscol_t *ctx,
 //    Bytes processed from the received data
 
 static int
-cscol_analyze_status_sds (cscol_t *ctx,
+cscol_analyze_voice (cscol_t *ctx,
     const unsigned char * const buffer, int buffer_len)
 {
-  LogApiStatusSDS status_sds;
+  const LogApiVoice *voice = (const LogApiVoice *) buffer;
   int bytes_processed = 0;
+  int payload_size;
 
-  TRACE (FUNCTIONS, "Entering in analyze_status_sds");
+  TRACE (FUNCTIONS, "Entering in cscol_analyze_voice");
 
-  if (buffer_len >= sizeof (status_sds)) {
-    memcpy (&status_sds, buffer, sizeof (status_sds));
-    bytes_processed = sizeof (status_sds);
-    cscol_dispatch_status_sds (ctx, &status_sds);
+  if (buffer_len >= sizeof (LogApiVoice)) {
+    payload_size = cs_voice_packet_payload_size (voice);
+    TRACE (DEBUG, "payload: %d/%d size: %d", voice->m_uiPayload1Info,
+        voice->m_uiPayload2Info, payload_size);
+    if (payload_size == -1) {
+      TRACE (DEBUG, "Voice payload: UNKNOWN (%u/%u)",
+          voice->m_uiPayload1Info, voice->m_uiPayload2Info);
+      bytes_processed = 1;
+      ctx->source->junk_bytes++;
+    } else if (buffer_len >= sizeof (LogApiVoice) + payload_size) {
+      cscol_track_voice_sequence (ctx, voice);
+      if (ctx->wav_writers && voice->m_uiPayload1Info == PAYLOAD_INFO_G711) {
+        cswav_write (ctx->wav_writers, voice->m_uiCallId,
+            buffer + sizeof (LogApiVoice), payload_size);
+      }
+      if (payload_size > 0 &&
+          cscol_is_subscribed (ctx, CSBUS_VOICE, voice->m_uiCallId)) {
+        cscol_dispatch_voice (ctx, voice, buffer + sizeof (LogApiVoice),
+            payload_size);
+      }
+      bytes_processed = sizeof (LogApiVoice) + payload_size;
+    }
   }
 
-  TRACE (FUNCTIONS, "Leaving analyze_status_SDS. "
+  TRACE (FUNCTIONS, "Leaving cscol_analyze_voice. "
       "bytes_processed: %d", bytes_processed);
 
   return bytes_processed;
@@ -1012,31 +1908,8 @@ cscol_analyze_status_sds (cscol_t *ctx,
 
 
 //  --------------------------------------------------------------------------
-//  Publish a LogApiTextSDS message type to the registered subscribers
-//  Input:
-//    ctx: the Call Stream Collector context of the thread
-//    text_sds: the message to be published
-
-static void
-cscol_dispatch_text_sds (cscol_t *ctx,
-    const LogApiTextSDS * const text_sds)
-{
-  TRACE (FUNCTIONS, "Entering in cscol_dispatch_text_sds");
-
-  snprintf (ctx->work_area, sizeof (ctx->work_area),
-      "S_%d", LOG_API_SDS_TEXT);
-  zmsg_t * msg = zmsg_new ();
-  zmsg_pushstr (msg, ctx->work_area);
-  zmsg_addmem (msg, &ctx->timestamp, sizeof (time_t));
-  zmsg_addmem (msg, text_sds, sizeof (LogApiTextSDS));
-  zmsg_send (&msg, ctx->publisher);
-
-  TRACE (FUNCTIONS, "Leaving cscol_dispatch_text_sds");
-}
-
-
-//  --------------------------------------------------------------------------
-//  Analyzes and process a LogApiTextSDS from the LogServer UDP data stream.
+//  Analyzes and process the LogServer UDP data stream. Onces a LogApi message
+//  is detected, invokes the corresponding LogApi handler for further processing
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
 //    buffer: the data received and not yet processed
@@ -1045,21 +1918,51 @@ cscol_dispatch_text_sds (cscol_t *ctx,
 //    Bytes processed from the received data
 
 static int
-cscol_analyze_text_sds (cscol_t *ctx,
-    const unsigned char * const buffer, int buffer_len)
+cscol_analyze_streaming (cscol_t *ctx,
+    const unsigned char *buffer, int buffer_len)
 {
-  LogApiTextSDS text_sds;
   int bytes_processed = 0;
+  int log_api_bytes_processed = 0;
+  int bytes_remained = buffer_len;
+  unsigned int signature;
+  const unsigned char *buffer_orig;
 
-  TRACE (FUNCTIONS, "Entering in analyze_text_sds");
-
-  if (buffer_len >= sizeof (text_sds)) {
-    memcpy (&text_sds, buffer, sizeof (text_sds));
-    bytes_processed = sizeof (text_sds);
-    cscol_dispatch_text_sds (ctx, &text_sds);
+  TRACE (FUNCTIONS, "Entering in cscol_analyze_streaming");
+  TRACE (DEBUG, "buffer_len: %d", buffer_len);
+
+  buffer_orig = buffer;
+
+  while (bytes_remained > 4) {
+
+    TRACE (DEBUG, "buffer: %x", buffer);
+    memcpy (&signature, buffer, 4);
+
+    if (signature == LOG_API_PROTOCOL_SIGNATURE) {
+      TRACE (DEBUG, "Protocol signature found");
+      log_api_bytes_processed = cscol_analyze_log_api (ctx,
+          buffer, bytes_remained);
+    } else if (signature == VOICE_PROTOCOL_SIGNATURE) {
+      TRACE (DEBUG, "Voice protocol signature found");
+      log_api_bytes_processed = cscol_analyze_voice (ctx, buffer, bytes_remained);
+    } else {
+      // Out of sync. Skip the junk up to the next signature
+      log_api_bytes_processed = cs_find_signature (buffer, bytes_remained);
+      TRACE (DEBUG, "Junk bytes skipped: %d", log_api_bytes_processed);
+      ctx->source->junk_bytes += log_api_bytes_processed;
+      ctx->source->resyncs++;
+    }
+
+    bytes_processed += log_api_bytes_processed;
+    buffer = buffer_orig + bytes_processed;
+    bytes_remained = buffer_len - bytes_processed;
+
+    TRACE (FUNCTIONS, "bytes_processed: %d", bytes_processed);
+    TRACE (FUNCTIONS, "bytes_remained: %d", bytes_remained);
+
+    if (!log_api_bytes_processed) break; // We need to receive more data
   }
 
-  TRACE (FUNCTIONS, "Leaving analyze_text_sds. "
+  TRACE (FUNCTIONS, "Leaving cscol_analyze_streaming. "
       "bytes_processed: %d", bytes_processed);
 
   return bytes_processed;
@@ -1067,198 +1970,177 @@ cscol_analyze_text_sds (cscol_t *ctx,
 
 
 //  --------------------------------------------------------------------------
-//  Publish a LogApiVoice message type to the registered subscribers
+//  Selects the reassembly state of the source of a datagram. The state is
+//  created the first time a source is seen
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
-//    voice: the message to be published
-//    voice_data: the voice data in a-law format
+//    addr: the source address of the datagram
+//  Output:
+//    The selected source (also in ctx->source) or NULL if the source can't
+//    be tracked
 
-static void
-cscol_dispatch_voice (cscol_t *ctx,
-    const LogApiVoice * const voice, const unsigned char * const voice_data)
+static cscol_source_t *
+cscol_select_source (cscol_t *ctx, const struct sockaddr_in * const addr)
 {
-  time_t now = time (NULL);
+  cscol_source_t *source = ctx->source;
+  char ip[INET_ADDRSTRLEN];
+  char key[CSCOL_SOURCE_KEY_LENGTH];
+
+  // Most of the datagrams come from the same source than the previous one
+  if (source &&
+      source->addr.sin_addr.s_addr == addr->sin_addr.s_addr &&
+      source->addr.sin_port == addr->sin_port) {
+    return source;
+  }
 
-  TRACE (FUNCTIONS, "Entering in cscol_dispatch_voice");
+  inet_ntop (AF_INET, &addr->sin_addr, ip, sizeof (ip));
+  snprintf (key, sizeof (key), "%s:%u", ip, ntohs (addr->sin_port));
 
-  snprintf (ctx->work_area, CSCOL_WORK_AREA_LENGTH * sizeof (char), //sizeof (ctx->work_area),
-      "V_%u", voice->m_uiCallId);
-  TRACE (DEBUG, "Call id: %u", voice->m_uiCallId);
-  zmsg_t * msg = zmsg_new ();
-  zmsg_pushstr (msg, ctx->work_area);
-  zmsg_addmem (msg, &now, sizeof (time_t));
-  zmsg_addmem (msg, voice, sizeof (LogApiVoice));
-  zmsg_addmem (msg, voice_data, 480);
-  zmsg_send (&msg, ctx->publisher);
+  source = (cscol_source_t *) zhash_lookup (ctx->sources, key);
 
-  TRACE (FUNCTIONS, "Leaving cscol_dispatch_voice");
+  if (!source) {
+    if (zhash_size (ctx->sources) >= ctx->max_sources) {
+      TRACE (ERROR, "Too many sources. Datagram from %s rejected", key);
+    } else {
+      source = cscol_source_new (addr, ctx->reassembly_size);
+      if (source) {
+        TRACE (DEBUG, "New source: %s", key);
+        zhash_insert (ctx->sources, source->key, source);
+        zhash_freefn (ctx->sources, source->key, cscol_source_destroy);
+      } else {
+        TRACE (ERROR, "Error: unable to create the source %s", key);
+      }
+    }
+  }
+
+  ctx->source = source;
+
+  return source;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process a LogApiVoice with A-law payload from the LogServer UDP
-//  data stream.
+//  Analyzes a received datagram with the reassembly state of its source. If
+//  there is no data pending in the source's ring, the datagram is analyzed
+//  directly from its slot and only the incomplete message at its end is
+//  stored in the ring.
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
-//    buffer: the data received and not yet processed
-//    buffer_len: the size of the data received and not yet processed
-//  Output:
-//    Bytes processed from the received data
+//    addr: the source address of the datagram
+//    data: the datagram received
+//    data_len: the size of the datagram received
 
-static int
-cscol_analyze_voice (cscol_t *ctx,
-    const unsigned char * const buffer, int buffer_len)
+static void
+cscol_process_datagram (cscol_t *ctx, const struct sockaddr_in * const addr,
+    const unsigned char * const data, int data_len)
 {
-  LogApiVoice voice;
   int bytes_processed = 0;
+  cscol_source_t *source;
+  csring_t *ring;
 
-  TRACE (FUNCTIONS, "Entering in cscol_analyze_voice");
+  TRACE (FUNCTIONS, "Entering in cscol_process_datagram");
 
-  if (buffer_len >= sizeof (voice) + 480) {
-    memcpy (&voice, buffer, sizeof (voice));
-    bytes_processed = sizeof (voice);
-    TRACE (DEBUG, "sizeof(voice): %d", sizeof (voice));
-    TRACE (DEBUG, "payload: %d", voice.m_uiPayload1Info); 
-    if (voice.m_uiPayload1Info == 7) {
-      if (ctx->generate_wav_files) {
-        char path[256];
-        sprintf (path, "voice_%d.wav", voice.m_uiCallId);
-        cs_write_wav_file (path, buffer);
-      }
-      cscol_dispatch_voice (ctx, &voice, buffer + sizeof (voice));
-    }
-    bytes_processed += 480;
+  source = cscol_select_source (ctx, addr);
+
+  if (!source) {
+    ctx->rejected++;
+    TRACE (FUNCTIONS, "Leaving cscol_process_datagram");
+    return;
   }
 
-  TRACE (FUNCTIONS, "Leaving cscol_analyze_voice. "
-      "bytes_processed: %d", bytes_processed);
+  ring = source->ring;
+  source->datagrams++;
 
-  return bytes_processed;
+  if (csring_size (ring) == 0) {
+    bytes_processed = cscol_analyze_streaming (ctx, data, data_len);
+    if (data_len - bytes_processed) {
+      csring_append (ring, data + bytes_processed,
+          data_len - bytes_processed);
+    }
+  } else {
+    if (csring_append (ring, data, data_len) == -1) {
+      TRACE (ERROR, "Ring overflow (%s). Discarding %zu bytes not yet "
+          "processed", source->key, csring_size (ring));
+      csring_reset (ring);
+      csring_append (ring, data, data_len);
+    }
+
+    bytes_processed = cscol_analyze_streaming (ctx,
+        csring_head (ring), csring_size (ring));
+
+    csring_consume (ring, bytes_processed);
+  }
+
+  TRACE (FUNCTIONS, "Leaving cscol_process_datagram");
 }
 
 
 //  --------------------------------------------------------------------------
-//  Analyzes and process the LogServer UDP data stream. Onces a LogApi message
-//  is detected, invokes the corresponding LogApi handler for further processing
+//  Reads a control message received with a datagram: the datagrams dropped
+//  by the kernel or the reception time
 //  Input:
 //    ctx: the Call Stream Collector context of the thread
-//    buffer: the data received and not yet processed
-//    buffer_len: the size of the data received and not yet processed
-//  Output:
-//    Bytes processed from the received data
+//    cmsg: the control message
 
-static int
-cscol_analyze_streaming (cscol_t *ctx,
-    const unsigned char *buffer, int buffer_len)
+static void
+cscol_read_control_message (cscol_t *ctx, struct cmsghdr *cmsg)
 {
-  int bytes_processed = 0;
-  int log_api_bytes_processed = 0;
-  int bytes_remained = buffer_len;
-  unsigned int signature;
-  const unsigned char *buffer_orig;
+  struct timespec timestamp;
+  uint32_t kernel_drops;
+
+  if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+    memcpy (&timestamp, CMSG_DATA (cmsg), sizeof (timestamp));
+    ctx->timestamp_ns =
+        (uint64_t) timestamp.tv_sec * 1000000000ULL + timestamp.tv_nsec;
+  } else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+    memcpy (&kernel_drops, CMSG_DATA (cmsg), sizeof (kernel_drops));
+    if (kernel_drops != ctx->kernel_drops) {
+      TRACE (WARNING, "%u datagrams dropped by the kernel",
+          kernel_drops - ctx->kernel_drops);
+      ctx->kernel_drops = kernel_drops;
+    }
+  }
+}
 
-  TRACE (FUNCTIONS, "Entering in cscol_analyze_streaming");
-  TRACE (DEBUG, "buffer_len: %d", buffer_len);
 
-  buffer_orig = buffer;
+//  --------------------------------------------------------------------------
+//  Stamps the current datagram with the time of its analysis when the kernel
+//  didn't stamp it
+//  Input:
+//    ctx: the Call Stream Collector context of the thread
 
-  while (bytes_remained > 4) {
+static void
+cscol_stamp_datagram (cscol_t *ctx)
+{
+  struct timespec timestamp;
 
-    TRACE (DEBUG, "buffer: %x", buffer);
-    memcpy (&signature, buffer, 4);
+  if (!ctx->timestamp_ns) {
+    clock_gettime (CLOCK_REALTIME, &timestamp);
+    ctx->timestamp_ns =
+        (uint64_t) timestamp.tv_sec * 1000000000ULL + timestamp.tv_nsec;
+  }
+}
 
-    if (signature == LOG_API_PROTOCOL_SIGNATURE) {
 
-      TRACE (DEBUG, "Protocol signature found");
-      cscol_analyze_message_header (ctx, buffer, bytes_remained);
-
-      switch (ctx->current_header.MsgId) {
-      case LOG_API_ALIVE:
-        TRACE (DEBUG, "Message type: LOG_API_KEEP_ALIVE");
-        log_api_bytes_processed = cscol_analyze_keep_alive (ctx,
-            buffer, bytes_remained);
-        break;
-      case LOG_API_DUPLEX_CALL_CHANGE:
-        TRACE (DEBUG, "Message type: LOG_API_DUPLEX_CALL_CHANGE");
-        log_api_bytes_processed = cscol_analyze_duplex_call_change (ctx,
-            buffer, bytes_remained);
-        break;
-      case LOG_API_DUPLEX_CALL_RELEASE:
-        TRACE (DEBUG, "Message type: LOG_API_DUPLEX_CALL_RELEASE");
-        log_api_bytes_processed = cscol_analyze_duplex_call_release (ctx,
-            buffer, bytes_remained);
-        break;
-      case LOG_API_SIMPLEX_CALL_CHANGE:
-        TRACE (DEBUG, "Message type: LOG_API_SIMPLEX_CALL_START_CHANGE");
-        log_api_bytes_processed = cscol_analyze_simplex_call_start_change (ctx,
-            buffer, bytes_remained);
-        break;
-      case LOG_API_SIMPLEX_CALL_PTT_CHANGE:
-        TRACE (DEBUG, "Message type: LOG_API_SIMPLEX_CALL_PTT_CHANGE");
-        log_api_bytes_processed = cscol_analyze_simplex_call_ptt_change (ctx,
-            buffer, bytes_remained);
-        break;
-      case LOG_API_SIMPLEX_CALL_RELEASE:
-        TRACE (DEBUG, "Message type: LOG_API_SIMPLEX_CALL_RELEASE");
-        log_api_bytes_processed = cscol_analyze_simplex_call_release (ctx,
-            buffer, bytes_remained);
-        break;
-      case LOG_API_GROUP_CALL_CHANGE:
-        TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_START_CHANGE");
-        log_api_bytes_processed = cscol_analyze_group_call_start_change (ctx,
-            buffer, bytes_remained);
-        break;
-      case LOG_API_GROUP_CALL_PTT_ACTIVE:
-        TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_PPT_ACTIVE");
-        log_api_bytes_processed = cscol_analyze_group_call_ptt_active (ctx,
-            buffer, bytes_remained);
-        break;
-      case LOG_API_GROUP_CALL_PTT_IDLE:
-        TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_PTT_IDLE");
-        log_api_bytes_processed = cscol_analyze_group_call_ptt_idle (ctx,
-            buffer, bytes_remained);
-        break;
-      case LOG_API_GROUP_CALL_RELEASE:
-        TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_RELEASE");
-        log_api_bytes_processed = cscol_analyze_group_call_release (ctx,
-            buffer, bytes_remained);
-        break;
-      case LOG_API_SDS_STATUS:
-        TRACE (DEBUG, "Message type: LOG_API_SDS_STATUS");
-        log_api_bytes_processed = cscol_analyze_status_sds (ctx,
-            buffer, bytes_remained);
-        break;
-      case LOG_API_SDS_TEXT:
-        TRACE (DEBUG, "Message type: LOG_API_SDS_TEXT");
-        log_api_bytes_processed = cscol_analyze_text_sds (ctx,
-            buffer, bytes_remained);
-        break;
-      default:
-        TRACE (DEBUG, "Message type: UNKNOWN (%x)", ctx->current_header.MsgId);
-        log_api_bytes_processed = 1;
-        break;
-      }
-    } else if (signature == VOICE_PROTOCOL_SIGNATURE) {
-      TRACE (DEBUG, "Voice protocol signature found");
-      log_api_bytes_processed = cscol_analyze_voice (ctx, buffer, bytes_remained);
-    } else {
-      log_api_bytes_processed = 1;
-    }
+//  --------------------------------------------------------------------------
+//  Reads the ancillary data received with a datagram: the datagrams dropped
+//  by the kernel and the reception time
+//  Input:
+//    ctx: the Call Stream Collector context of the thread
+//    hdr: the header of the datagram received
 
-    bytes_processed += log_api_bytes_processed;
-    buffer = buffer_orig + bytes_processed;
-    bytes_remained = buffer_len - bytes_processed;
+static void
+cscol_read_control (cscol_t *ctx, struct msghdr *hdr)
+{
+  struct cmsghdr *cmsg;
 
-    TRACE (FUNCTIONS, "bytes_processed: %d", bytes_processed);
-    TRACE (FUNCTIONS, "bytes_remained: %d", bytes_remained);
+  ctx->timestamp_ns = 0;
 
-    if (!log_api_bytes_processed) break; // We need to receive more data
+  for (cmsg = CMSG_FIRSTHDR (hdr); cmsg; cmsg = CMSG_NXTHDR (hdr, cmsg)) {
+    cscol_read_control_message (ctx, cmsg);
   }
 
-  TRACE (FUNCTIONS, "Leaving cscol_analyze_streaming. "
-      "bytes_processed: %d", bytes_processed);
-
-  return bytes_processed;
+  cscol_stamp_datagram (ctx);
 }
 
 
@@ -1269,97 +2151,486 @@ cscol_analyze_streaming (cscol_t *ctx,
 //    item: the descriptor with the data received ready to read
 //    arg: the Call Stream Collector context of the thread
 //  Output:
-//    Bytes processed from the received data
+//    0 - Ok
 
 static int
 cscol_callstream_handler (zloop_t *loop, zmq_pollitem_t *item, void *arg)
 {
-  int rc = 0;
-  struct sockaddr_in cli_addr;
-  socklen_t len;
   int nr_bytes;
-  int bytes_processed = 0;
 
   cscol_t *ctx = (cscol_t *) arg;
+  struct msghdr *hdr = &ctx->slot_headers[0].msg_hdr;
 
   TRACE (FUNCTIONS, "Entering in cscol_callstream_handler");
 
-  memset(&cli_addr, 0, sizeof (struct sockaddr_in));
-  nr_bytes = recvfrom (item->fd, ctx->buffer + ctx->buffer_offset,
-        CSCOL_BUFFER_LENGTH * sizeof (unsigned char), 0,
-        (struct sockaddr *) &cli_addr, &len);
+  hdr->msg_namelen = sizeof (struct sockaddr_in);
+  hdr->msg_controllen = CSCOL_CONTROL_LENGTH;
+  hdr->msg_flags = 0;
+  nr_bytes = recvmsg (item->fd, hdr, MSG_TRUNC);
 
   if (nr_bytes == -1) {
-    TRACE (ERROR, "Error: read(), errno=%d text=%s", errno, strerror(errno));
-    rc = -1;
+    TRACE (ERROR, "Error: recvmsg(), errno=%d text=%s", errno, strerror(errno));
+  } else {
+    cscol_read_control (ctx, hdr);
   }
 
   if (nr_bytes == 0) {
     TRACE (WARNING, "Warning: nr_bytes: 0");
   }
 
+  if (nr_bytes > CSCOL_SLOT_LENGTH) {
+    TRACE (ERROR, "Datagram of %d bytes truncated to %d bytes",
+        nr_bytes, CSCOL_SLOT_LENGTH);
+    ctx->truncated++;
+    nr_bytes = CSCOL_SLOT_LENGTH;
+  }
+
   if (nr_bytes > 0) {
     TRACE (DEBUG, "Data received. nr_bytes = %d", nr_bytes);
-    TRACE (DEBUG, "Data in buffer. buffer_offset = %d", ctx->buffer_offset);
 
-    // Save the data chunks for debugging
-    if (tr_level & L_TR_CS) {
-        cscol_save_chunk(ctx->buffer + ctx->buffer_offset, nr_bytes);
+    // Capture the raw data for debugging and replay
+    if (ctx->capture_enabled || (tr_level & L_TR_CS)) {
+      cscol_capture (ctx, &ctx->slot_addrs[0], ctx->slots, nr_bytes);
+    }
+
+    cscol_process_datagram (ctx, &ctx->slot_addrs[0], ctx->slots, nr_bytes);
+
+    ctx->wakeups++;
+    ctx->datagrams++;
+    ctx->last_drained = 1;
+  }
+
+  TRACE (FUNCTIONS, "Leaving cscol_callstream_handler");
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Callback responsible for receiving the LogServer UDP data stream in batched
+//  mode. Drains up to batch_size datagrams per wakeup with a single recvmmsg
+//  and analyzes all of them before returning to the reactor.
+//  Input:
+//    loop: the event-driven reactor
+//    item: the descriptor with the data received ready to read
+//    arg: the Call Stream Collector context of the thread
+//  Output:
+//    0 - Ok
+
+static int
+cscol_callstream_batch_handler (zloop_t *loop, zmq_pollitem_t *item, void *arg)
+{
+  int nr_datagrams;
+  int i = 0;
+
+  cscol_t *ctx = (cscol_t *) arg;
+
+  TRACE (FUNCTIONS, "Entering in cscol_callstream_batch_handler");
+
+  for (i = 0; i < ctx->batch_size; i++) {
+    ctx->slot_headers[i].msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+    ctx->slot_headers[i].msg_hdr.msg_controllen = CSCOL_CONTROL_LENGTH;
+    ctx->slot_headers[i].msg_hdr.msg_flags = 0;
+  }
+
+  nr_datagrams = recvmmsg (item->fd, ctx->slot_headers, ctx->batch_size,
+      MSG_DONTWAIT, NULL);
+
+  if (nr_datagrams == -1) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      TRACE (ERROR, "Error: recvmmsg(), errno=%d text=%s", errno, strerror (errno));
+    }
+    nr_datagrams = 0;
+  }
+
+  TRACE (DEBUG, "Datagrams drained: %d", nr_datagrams);
+
+  for (i = 0; i < nr_datagrams; i++) {
+    const unsigned char *data = ctx->slots + i * CSCOL_SLOT_LENGTH;
+    int data_len = ctx->slot_headers[i].msg_len;
+
+    if (ctx->slot_headers[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      TRACE (ERROR, "Datagram truncated to %d bytes", data_len);
+      ctx->truncated++;
+    }
+
+    cscol_read_control (ctx, &ctx->slot_headers[i].msg_hdr);
+
+    // Capture the raw data for debugging and replay
+    if (ctx->capture_enabled || (tr_level & L_TR_CS)) {
+      cscol_capture (ctx, &ctx->slot_addrs[i], data, data_len);
+    }
+
+    if (data_len > 0) {
+      cscol_process_datagram (ctx, &ctx->slot_addrs[i], data, data_len);
+    }
+  }
+
+  ctx->wakeups++;
+  ctx->datagrams += nr_datagrams;
+  ctx->last_drained = nr_datagrams;
+  ctx->drained_histogram[nr_datagrams]++;
+
+  TRACE (FUNCTIONS, "Leaving cscol_callstream_batch_handler");
+
+  return 0;
+}
+
+
+#ifdef CSCOL_HAVE_IO_URING
+
+//  --------------------------------------------------------------------------
+//  Callback responsible for receiving the LogServer UDP data stream through
+//  the io_uring. Drains up to batch_size completions of the multishot
+//  recvmsg per wakeup, analyzes their datagrams in place and gives their
+//  buffers back to the provided buffer ring.
+//  Input:
+//    loop: the event-driven reactor
+//    item: the descriptor of the io_uring
+//    arg: the Call Stream Collector context of the thread
+//  Output:
+//    0 - Ok
+
+static int
+cscol_uring_handler (zloop_t *loop, zmq_pollitem_t *item, void *arg)
+{
+  cscol_t *ctx = (cscol_t *) arg;
+  struct io_uring_cqe *cqe;
+  struct io_uring_recvmsg_out *out;
+  struct cmsghdr *cmsg;
+  unsigned char *buffer;
+  int mask = io_uring_buf_ring_mask (ctx->io_uring_buffers);
+  int rearm = 0;
+  int returned = 0;
+  int nr_datagrams = 0;
+  int bid;
+
+  TRACE (FUNCTIONS, "Entering in cscol_uring_handler");
+
+  while (nr_datagrams < ctx->batch_size &&
+      io_uring_peek_cqe (&ctx->uring, &cqe) == 0) {
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+      rearm = 1;
+    }
+
+    if (cqe->res < 0) {
+      if (cqe->res != -ENOBUFS) {
+        TRACE (ERROR, "Error: recvmsg(), errno=%d text=%s",
+            -cqe->res, strerror (-cqe->res));
+      }
+    } else if (cqe->flags & IORING_CQE_F_BUFFER) {
+      bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+      buffer = ctx->uring_buffers + bid * ctx->uring_buffer_length;
+      out = io_uring_recvmsg_validate (buffer, cqe->res, &ctx->uring_msghdr);
+
+      if (out) {
+        const struct sockaddr_in *addr =
+            (const struct sockaddr_in *) io_uring_recvmsg_name (out);
+        const unsigned char *data = (const unsigned char *)
+            io_uring_recvmsg_payload (out, &ctx->uring_msghdr);
+        int data_len = io_uring_recvmsg_payload_length (out, cqe->res,
+            &ctx->uring_msghdr);
+
+        ctx->timestamp_ns = 0;
+        for (cmsg = io_uring_recvmsg_cmsg_firsthdr (out, &ctx->uring_msghdr);
+            cmsg;
+            cmsg = io_uring_recvmsg_cmsg_nexthdr (out, &ctx->uring_msghdr, cmsg)) {
+          cscol_read_control_message (ctx, cmsg);
+        }
+        cscol_stamp_datagram (ctx);
+
+        if (out->flags & MSG_TRUNC) {
+          TRACE (ERROR, "Datagram truncated to %d bytes", data_len);
+          ctx->truncated++;
+        }
+
+        // Capture the raw data for debugging and replay
+        if (ctx->capture_enabled || (tr_level & L_TR_CS)) {
+          cscol_capture (ctx, addr, data, data_len);
+        }
+
+        if (data_len > 0) {
+          cscol_process_datagram (ctx, addr, data, data_len);
+        }
+        nr_datagrams++;
+      }
+
+      io_uring_buf_ring_add (ctx->uring_buffer_ring, buffer,
+          ctx->uring_buffer_length, bid, mask, returned++);
     }
 
-    nr_bytes += ctx->buffer_offset; // Data length not yet processed
+    io_uring_cqe_seen (&ctx->uring, cqe);
+  }
+
+  if (returned) {
+    io_uring_buf_ring_advance (ctx->uring_buffer_ring, returned);
+  }
+
+  if (rearm) {
+    TRACE (DEBUG, "Multishot recvmsg ended. Submitting it again");
+    ctx->uring_rearms++;
+    cscol_arm_uring (ctx);
+  }
+
+  ctx->wakeups++;
+  ctx->datagrams += nr_datagrams;
+  ctx->last_drained = nr_datagrams;
+  ctx->drained_histogram[nr_datagrams]++;
+
+  TRACE (FUNCTIONS, "Leaving cscol_uring_handler");
+
+  return 0;
+}
+
+#endif
 
-    bytes_processed = cscol_analyze_streaming (ctx, ctx->buffer, nr_bytes);
 
-    if (nr_bytes - bytes_processed) {
-      memcpy (ctx->buffer, ctx->buffer + bytes_processed, nr_bytes - bytes_processed);
-      ctx->buffer_offset = nr_bytes - bytes_processed;
+//  --------------------------------------------------------------------------
+//  Callback responsible for publishing in the bus the LogApi messages
+//  forwarded by the shards
+//  Input:
+//    loop: the event-driven reactor
+//    reader: the socket where the shards forward their messages
+//    arg: the Call Stream Collector context of the main thread
+//  Output:
+//    0 - Ok
+
+static int
+cscol_shard_handler (zloop_t *loop, zsock_t *reader, void *arg)
+{
+  cscol_t *ctx = (cscol_t *) arg;
+
+  TRACE (FUNCTIONS, "Entering in cscol_shard_handler");
+
+  zframe_t *frame = zframe_recv (reader);
+  if (frame) {
+    cscol_publish (ctx, &frame);
+  }
+
+  TRACE (FUNCTIONS, "Leaving cscol_shard_handler");
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Callback responsible for the requests of the lossless consumers:
+//  SUBSCRIBE <topic prefix>, CREDIT <n> and BYE. A consumer is known from
+//  its first request
+//  Input:
+//    loop: the event-driven reactor
+//    reader: the ROUTER socket of the lossless consumers
+//    arg: the Call Stream Collector context of the main thread
+//  Output:
+//    0 - Ok
+
+static int
+cscol_lossless_handler (zloop_t *loop, zsock_t *reader, void *arg)
+{
+  cscol_t *ctx = (cscol_t *) arg;
+  cscol_consumer_t *consumer;
+
+  TRACE (FUNCTIONS, "Entering in cscol_lossless_handler");
+
+  zmsg_t *msg = zmsg_recv (reader);
+  char *name = zmsg_popstr (msg);
+  char *command = zmsg_popstr (msg);
+
+  if (!name || !command) {
+    TRACE (ERROR, "Lossless request: Bad format");
+  } else {
+    consumer = (cscol_consumer_t *) zhash_lookup (ctx->consumers, name);
+    if (!consumer && !streq (command, CSBUS_LOSSLESS_BYE)) {
+      consumer = cscol_consumer_new (ctx, name);
+      if (consumer) {
+        zhash_insert (ctx->consumers, name, consumer);
+        zhash_freefn (ctx->consumers, name, cscol_consumer_destroy);
+        TRACE (DEBUG, "Lossless consumer %s: connected", name);
+      }
+    }
+
+    if (!consumer) {
+      TRACE (DEBUG, "Lossless consumer %s: unknown", name);
+    } else if (streq (command, CSBUS_LOSSLESS_SUBSCRIBE)) {
+      zframe_t *prefix = zmsg_pop (msg);
+      if (prefix && zframe_size (prefix) <= CSBUS_TOPIC_LENGTH) {
+        cscol_consumer_subscription (ctx, consumer, 1,
+            zframe_data (prefix), zframe_size (prefix));
+      } else {
+        TRACE (ERROR, "Lossless subscription: Bad format");
+      }
+      zframe_destroy (&prefix);
+    } else if (streq (command, CSBUS_LOSSLESS_CREDIT)) {
+      char *credit = zmsg_popstr (msg);
+      if (credit) {
+        consumer->credit += atoi (credit);
+        free (credit);
+      }
+      cscol_consumer_deliver (ctx, consumer);
+    } else if (streq (command, CSBUS_LOSSLESS_BYE)) {
+      cscol_consumer_remove (ctx, consumer);
     } else {
-      ctx->buffer_offset = 0;
+      TRACE (ERROR, "Lossless request: Unknown (%s)", command);
     }
   }
 
-  TRACE (FUNCTIONS, "Leaving cscol_callstream_handler");
+  free (name);
+  free (command);
+  zmsg_destroy (&msg);
+
+  TRACE (FUNCTIONS, "Leaving cscol_lossless_handler");
 
   return 0;
 }
 
 
 //  --------------------------------------------------------------------------
-//  <Description>
-//  <Returns>
+//  Callback responsible for tracking the subscriptions of the bus. They are
+//  forwarded to the shards, which publish through the main collector thread
+//  Input:
+//    loop: the event-driven reactor
+//    reader: the XPUB socket of the bus
+//    arg: the Call Stream Collector context of the main thread
+//  Output:
+//    0 - Ok
+
+static int
+cscol_subscription_handler (zloop_t *loop, zsock_t *reader, void *arg)
+{
+  cscol_t *ctx = (cscol_t *) arg;
+
+  TRACE (FUNCTIONS, "Entering in cscol_subscription_handler");
+
+  zframe_t *frame = zframe_recv (reader);
+  if (frame) {
+    cscol_share_subscription (ctx, zframe_data (frame), zframe_size (frame));
+    zframe_destroy (&frame);
+  }
 
-//static int
-//cscol_timer_handler (zloop_t *loop, int timer_id, void *arg)
-//{
-//  cscol_t *ctx = (cscol_t *) arg;
-//
-//  TRACE (FUNCTIONS, "Entering in cscol_timer_handler");
-//  TRACE (FUNCTIONS, "Leaving cscol_timer_handler");
-//
-//  return 0;
-//}
+  TRACE (FUNCTIONS, "Leaving cscol_subscription_handler");
+
+  return 0;
+}
 
 
 //  --------------------------------------------------------------------------
-//  Entry function to the Call Stream Collector submodule
+//  Callback responsible for flushing the capture and forgetting the voice
+//  streams without activity
+//  Input:
+//    loop: the event-driven reactor
+//    timer_id: the timer identifier
+//    arg: the Call Stream Collector context of the thread
+//  Output:
+//    0 - Ok
+
+static int
+cscol_timer_handler (zloop_t *loop, int timer_id, void *arg)
+{
+  cscol_t *ctx = (cscol_t *) arg;
+  cscol_voice_stream_t *stream;
+  zlist_t *keys;
+  char *key;
+
+  TRACE (FUNCTIONS, "Entering in cscol_timer_handler");
+
+  time_t now = time (NULL);
+
+  if (ctx->capture) {
+    cscap_flush (ctx->capture);
+  }
+
+  if (ctx->wav_writers) {
+    cswav_maintain (ctx->wav_writers, now);
+  }
+
+  // The table can't be modified while it is iterated
+  keys = zhash_keys (ctx->voice_streams);
+  key = (char *) zlist_first (keys);
+
+  while (key) {
+    stream = (cscol_voice_stream_t *) zhash_lookup (ctx->voice_streams, key);
+    if (difftime (now, stream->last_activity) > ctx->stream_inactivity_period) {
+      TRACE (DEBUG, "Voice stream <%s> expired. packets: %" PRIu64
+          " lost: %" PRIu64, key, stream->packets, stream->lost);
+      zhash_delete (ctx->voice_streams, key);
+    }
+    key = (char *) zlist_next (keys);
+  }
+
+  zlist_destroy (&keys);
+
+  TRACE (FUNCTIONS, "Leaving cscol_timer_handler");
+
+  return 0;
+}
+
+
+// Arguments of a collector shard thread
+
+typedef struct {
+  const char *conf_file;
+  int shard_id;
+} cscol_shard_args_t;
+
+static void
+cscol_shard_task (zsock_t* pipe, void *args);
+
+
+//  --------------------------------------------------------------------------
+//  Starts the additional receive threads of the collector
+//  Input:
+//    ctx: the Call Stream Collector context of the main thread
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+static int
+cscol_start_shards (cscol_t *ctx)
+{
+  int rc = 0;
+  int i;
+  cscol_shard_args_t args;
+
+  TRACE (FUNCTIONS, "Entering in cscol_start_shards");
+
+  ctx->shard_actors = (zactor_t **) zmalloc (
+      (ctx->shards - 1) * sizeof (zactor_t *));
+
+  args.conf_file = csstring_data (ctx->conf_filename);
+
+  for (i = 0; rc == 0 && i < ctx->shards - 1; i++) {
+    args.shard_id = i + 1;
+    ctx->shard_actors[i] = zactor_new (cscol_shard_task, &args);
+    if (!ctx->shard_actors[i]) {
+      TRACE (ERROR, "Shard %d not created", i + 1);
+      rc = -1;
+    }
+  }
+
+  TRACE (FUNCTIONS, "Leaving cscol_start_shards");
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Runs a receive thread of the Call Stream Collector
 //  Input:
 //    pipe: the shared communication channel with the parent thread
-//    arg: the configuration file with the submodule's customizable properties
+//    conf_file: the configuration file with the submodule's properties
+//    shard_id: the receive thread. 0 is the main collector thread
 
-void
-cscol_task (zsock_t* pipe, void *args)
+static void
+cscol_run (zsock_t* pipe, const char * const conf_file, int shard_id)
 {
   int rc = -1;
-//  int id_timer;
+  int id_timer = -1;
   cscol_t *ctx;
-  char *conf_file;
 
-  TRACE (FUNCTIONS, "Entering in cscol_task");
-
-  conf_file = (char *) args;
+  TRACE (FUNCTIONS, "Entering in cscol_run");
 
-  ctx = cscol_new (conf_file);
+  ctx = cscol_new (conf_file, shard_id);
   assert (ctx);
 
   rc = cscol_configure (ctx);
@@ -1374,9 +2645,42 @@ cscol_task (zsock_t* pipe, void *args)
   rc = zloop_reader (loop, pipe, cscol_command_handler, ctx);
 
   if (rc == 0) {
-    rc = zloop_poller (loop, &item, cscol_callstream_handler, ctx);
+#ifdef CSCOL_HAVE_IO_URING
+    if (ctx->io_uring_enabled) {
+      item.fd = ctx->uring.ring_fd;
+      rc = zloop_poller (loop, &item, cscol_uring_handler, ctx);
+    } else
+#endif
+    if (ctx->batch_size > 1) {
+      rc = zloop_poller (loop, &item, cscol_callstream_batch_handler, ctx);
+    } else {
+      rc = zloop_poller (loop, &item, cscol_callstream_handler, ctx);
+    }
+  }
+
+  if (rc == 0 && ctx->shard_collector) {
+    rc = zloop_reader (loop, ctx->shard_collector, cscol_shard_handler, ctx);
+  }
+
+  // The subscriptions received before the loop starts are forwarded to the
+  // shards created below
+  if (rc == 0 && ctx->shard_id == 0) {
+    rc = zloop_reader (loop, ctx->publisher, cscol_subscription_handler, ctx);
+  }
+
+  if (rc == 0 && ctx->lossless) {
+    rc = zloop_reader (loop, ctx->lossless, cscol_lossless_handler, ctx);
+  }
+
+  if (rc == 0 && ctx->shard_id == 0 && ctx->shards > 1) {
+    rc = cscol_start_shards (ctx);
+  }
+
+  if (rc == 0) {
+    id_timer = zloop_timer (loop, ctx->maintenance_frequency * 1000, 0,
+        cscol_timer_handler, ctx);
+    rc = id_timer == -1 ? -1 : 0;
   }
-//  id_timer = zloop_timer (loop, 5000, 0, cscol_timer_handler, ctx);
 
   if (rc == 0) {
     rc = zsock_signal (pipe, 0);
@@ -1392,12 +2696,58 @@ cscol_task (zsock_t* pipe, void *args)
     }
   }
 
-//  zloop_timer_end (loop, id_timer);
+  if (id_timer != -1) {
+    zloop_timer_end (loop, id_timer);
+  }
+  if (ctx->shard_collector) {
+    zloop_reader_end (loop, ctx->shard_collector);
+  }
+  if (ctx->shard_id == 0) {
+    zloop_reader_end (loop, ctx->publisher);
+  }
+  if (ctx->lossless) {
+    zloop_reader_end (loop, ctx->lossless);
+  }
   zloop_poller_end (loop, &item);
   zloop_reader_end (loop, pipe);
   zloop_destroy (&loop);
   cscol_destroy (&ctx);
 
-  TRACE (FUNCTIONS, "Leaving cscol_task");
+  TRACE (FUNCTIONS, "Leaving cscol_run");
+}
+
+
+//  --------------------------------------------------------------------------
+//  Entry function to an additional receive thread of the collector
+//  Input:
+//    pipe: the shared communication channel with the main collector thread
+//    arg: the shard arguments
+
+static void
+cscol_shard_task (zsock_t* pipe, void *args)
+{
+  cscol_shard_args_t *shard_args = (cscol_shard_args_t *) args;
+
+  TRACE (FUNCTIONS, "Entering in cscol_shard_task");
+
+  cscol_run (pipe, shard_args->conf_file, shard_args->shard_id);
+
+  TRACE (FUNCTIONS, "Leaving cscol_shard_task");
 }
 
+
+//  --------------------------------------------------------------------------
+//  Entry function to the Call Stream Collector submodule
+//  Input:
+//    pipe: the shared communication channel with the parent thread
+//    arg: the configuration file with the submodule's customizable properties
+
+void
+cscol_task (zsock_t* pipe, void *args)
+{
+  TRACE (FUNCTIONS, "Entering in cscol_task");
+
+  cscol_run (pipe, (const char *) args, 0);
+
+  TRACE (FUNCTIONS, "Leaving cscol_task");
+}
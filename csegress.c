@@ -0,0 +1,247 @@
+/*  =========================================================================
+    csegress - Batched egress of UDP datagrams
+    =========================================================================*/
+
+/*
+    This module gathers the datagrams the media manager sends to the feeders
+    of all the intercepted calls while it processes the voice received in a
+    reactor wakeup, and sends them with one sendmmsg system call instead of
+    one sendto per datagram.
+
+    The datagrams are copied into capacity slots of CSEGRESS_SLOT_SIZE bytes
+    reserved up front, with their destination. When all the slots are taken
+    the queue is flushed before the next datagram is queued. A flush sends
+    the slots in order; sendmmsg stops at the first datagram it can't send,
+    which is dropped when the socket buffer is full (EAGAIN) or refused
+    (e.g. ECONNREFUSED after an ICMP port unreachable), and the flush goes on
+    with the following ones. The number of datagrams sent by every flush is
+    kept in a histogram.
+*/
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "cs.h"
+#include "csegress.h"
+#include <sys/socket.h>
+#include <fcntl.h>
+
+
+// <Definition>
+
+struct _csegress_t {
+  int channel;
+  size_t capacity;
+  size_t queued;
+  unsigned char *slots;
+  struct iovec *slot_iovecs;
+  struct mmsghdr *slot_headers;
+  struct sockaddr_in *slot_addrs;
+  uint64_t flushes;
+  uint64_t sent;
+  uint64_t dropped;
+  uint64_t *batch_histogram;    // Flushes by number of datagrams sent
+};
+
+
+//  --------------------------------------------------------------------------
+//  Creates an egress queue with its socket
+//  Input:
+//    capacity: the maximum number of datagrams sent by a flush
+//  Output:
+//    The created queue or NULL
+
+csegress_t *
+csegress_new (size_t capacity)
+{
+  size_t i;
+  csegress_t *self = (csegress_t *) zmalloc (sizeof (csegress_t));
+
+  if (self) {
+    self->capacity = capacity;
+    self->slots = (unsigned char *) zmalloc (capacity * CSEGRESS_SLOT_SIZE);
+    self->slot_iovecs = (struct iovec *) zmalloc (
+        capacity * sizeof (struct iovec));
+    self->slot_headers = (struct mmsghdr *) zmalloc (
+        capacity * sizeof (struct mmsghdr));
+    self->slot_addrs = (struct sockaddr_in *) zmalloc (
+        capacity * sizeof (struct sockaddr_in));
+    self->batch_histogram = (uint64_t *) zmalloc (
+        (capacity + 1) * sizeof (uint64_t));
+    self->channel = socket (AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    if (self->channel == -1 || !self->slots || !self->slot_iovecs ||
+        !self->slot_headers || !self->slot_addrs || !self->batch_histogram) {
+      TRACE (ERROR, "Error: unable to reserve %zu egress slots, errno=%d text=%s",
+          capacity, errno, strerror (errno));
+      csegress_destroy (&self);
+    }
+  }
+
+  if (self) {
+    fcntl (self->channel, F_SETFL, fcntl (self->channel, F_GETFL) | O_NONBLOCK);
+    for (i = 0; i < capacity; i++) {
+      self->slot_iovecs[i].iov_base = self->slots + i * CSEGRESS_SLOT_SIZE;
+      self->slot_headers[i].msg_hdr.msg_iov = &self->slot_iovecs[i];
+      self->slot_headers[i].msg_hdr.msg_iovlen = 1;
+      self->slot_headers[i].msg_hdr.msg_name = &self->slot_addrs[i];
+      self->slot_headers[i].msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+    }
+  }
+
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees the queue. The datagrams not flushed are lost
+//  Input:
+//    The target queue
+
+void
+csegress_destroy (csegress_t **self_p)
+{
+  if (self_p && *self_p) {
+    csegress_t *self = *self_p;
+    if (self->channel != -1) {
+      close (self->channel);
+    }
+    free (self->slots);
+    free (self->slot_iovecs);
+    free (self->slot_headers);
+    free (self->slot_addrs);
+    free (self->batch_histogram);
+    free (self);
+    *self_p = NULL;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Queues a datagram, flushing the queue first when it is full
+//  Input:
+//    self: the queue
+//    dest: the destination of the datagram
+//    data: the datagram
+//    len: the length of the datagram, up to CSEGRESS_SLOT_SIZE
+//  Output:
+//    0 - Ok
+//   -1 - Nok. The datagram has been dropped
+
+int
+csegress_queue (csegress_t *self, const struct sockaddr_in * const dest,
+    const void * const data, size_t len)
+{
+  if (len > CSEGRESS_SLOT_SIZE) {
+    TRACE (ERROR, "Egress datagram of %zu bytes dropped", len);
+    self->dropped++;
+    return -1;
+  }
+
+  if (self->queued == self->capacity) {
+    csegress_flush (self);
+  }
+
+  memcpy (self->slot_iovecs[self->queued].iov_base, data, len);
+  self->slot_iovecs[self->queued].iov_len = len;
+  self->slot_addrs[self->queued] = *dest;
+  self->queued++;
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Sends the datagrams queued
+//  Input:
+//    self: the queue
+//  Output:
+//    The number of datagrams sent
+
+int
+csegress_flush (csegress_t *self)
+{
+  size_t next = 0;
+  int sent = 0;
+  int rc;
+
+  if (self->queued == 0) {
+    return 0;
+  }
+
+  while (next < self->queued) {
+    rc = sendmmsg (self->channel, self->slot_headers + next,
+        self->queued - next, 0);
+    if (rc > 0) {
+      next += rc;
+      sent += rc;
+    } else if (rc == -1 && errno == EINTR) {
+      continue;
+    } else {
+      // The datagram that failed is dropped and the rest still sent
+      TRACE (DEBUG, "Egress datagram dropped, errno=%d text=%s",
+          errno, strerror (errno));
+      self->dropped++;
+      next++;
+    }
+  }
+
+  self->flushes++;
+  self->sent += sent;
+  self->batch_histogram[sent]++;
+  self->queued = 0;
+
+  return sent;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the maximum number of datagrams sent by a flush
+
+size_t
+csegress_capacity (csegress_t *self)
+{
+  return self->capacity;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of flushes with datagrams queued
+
+uint64_t
+csegress_flushes (csegress_t *self)
+{
+  return self->flushes;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of datagrams sent
+
+uint64_t
+csegress_sent (csegress_t *self)
+{
+  return self->sent;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of datagrams dropped
+
+uint64_t
+csegress_dropped (csegress_t *self)
+{
+  return self->dropped;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of flushes that sent batch_size datagrams
+
+uint64_t
+csegress_batches (csegress_t *self, size_t batch_size)
+{
+  return batch_size <= self->capacity ? self->batch_histogram[batch_size] : 0;
+}
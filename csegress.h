@@ -0,0 +1,56 @@
+#ifndef __CSEGRESS_H_INCLUDED__
+#define __CSEGRESS_H_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//  Batched egress of UDP datagrams. The datagrams queued for any
+//  destination are copied into pre-allocated slots and sent together with
+//  a single sendmmsg through one non blocking socket, when the slots are
+//  full or when the queue is flushed. A datagram the socket can't take is
+//  dropped and counted; the sender is never blocked.
+
+#define CSEGRESS_SLOT_SIZE 1500
+
+typedef struct _csegress_t csegress_t;
+
+csegress_t *
+csegress_new (size_t capacity);
+
+void
+csegress_destroy (csegress_t **self_p);
+
+int
+csegress_queue (csegress_t *self, const struct sockaddr_in * const dest,
+    const void * const data, size_t len);
+
+int
+csegress_flush (csegress_t *self);
+
+size_t
+csegress_capacity (csegress_t *self);
+
+uint64_t
+csegress_flushes (csegress_t *self);
+
+uint64_t
+csegress_sent (csegress_t *self);
+
+uint64_t
+csegress_dropped (csegress_t *self);
+
+uint64_t
+csegress_batches (csegress_t *self, size_t batch_size);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
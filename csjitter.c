@@ -0,0 +1,485 @@
+/*  =========================================================================
+    csjitter - Jitter buffer of the voice of a live call
+    =========================================================================*/
+
+/*
+    The voice frames of a call can arrive late, out of order or not at
+    all, and for duplex calls the frames of the parties arrive as two
+    streams that drift apart. This module puts every frame in the slot of
+    its sequence number and releases the frames of a channel in sequence
+    order.
+
+    The sequence number is the cyclic 7 bits sequence of the LogApi voice
+    (m_uiPacketSeq). The next frame expected and the CSJITTER_SLOTS - 1
+    frames after it have a slot; a frame already released or older is
+    dropped as late, and a frame further ahead or of a new stream (its
+    random id changes) restarts the channel from its sequence number. A
+    frame that looks late restarts the channel too when nothing is waiting
+    and nothing was released for max_wait_ms: the 7 bits sequence can't
+    tell a late frame from one after a loss of 64 frames or more.
+
+    When the next frame is missing the channel waits until the frame depth
+    positions after it has arrived or its oldest frame has waited
+    max_wait_ms, and then the missing frame is concealed: the last frame
+    released is repeated up to CSJITTER_MAX_REPEATS times in a row and
+    silence is played after that. So the frames in order never wait, and
+    a frame lost costs depth frames or max_wait_ms of delay at most.
+
+    The two channels of a duplex call are released frame by frame, as
+    pairs, so the parties stay aligned by sequence. When a channel has no
+    frames at all, its party isn't speaking, and the other one is released
+    alone with silence once it has depth frames or its oldest frame has
+    waited max_wait_ms.
+*/
+
+
+#include "cs.h"
+#include "csutil.h"
+#include "csjitter.h"
+
+
+#define CSJITTER_SEQ_MASK 0x7f
+#define CSJITTER_MAX_REPEATS 2
+#define CSJITTER_DEFAULT_FRAME_SIZE 240
+
+// The state of a channel for its release
+
+enum {
+  CSJITTER_IDLE,                // No frames
+  CSJITTER_WAIT,                // The next frame is missing, may still arrive
+  CSJITTER_FRAME,               // The next frame is there
+  CSJITTER_LOST                 // The next frame is missing and concealed
+};
+
+// <Definition>
+
+typedef struct {
+  bool present;
+  int64_t arrival;
+  size_t len;
+  uint8_t data[CSJITTER_MAX_FRAME_SIZE];
+} csjitter_slot_t;
+
+typedef struct {
+  bool started;
+  uint16_t stream_id;
+  uint8_t next;                 // Sequence number of the next frame released
+  size_t buffered;              // Frames in the slots
+  size_t frame_len;             // Of the last frame received
+  csjitter_slot_t slots[CSJITTER_SLOTS];
+  size_t last_len;              // 0 = no frame released yet
+  int repeats;                  // Of the last frame, in a row
+  int64_t released;             // Time of the last frame released
+  uint8_t last[CSJITTER_MAX_FRAME_SIZE];
+} csjitter_channel_t;
+
+struct _csjitter_t {
+  int channels;
+  int depth;
+  int max_wait_ms;
+  csjitter_channel_t channel[2];
+  uint64_t late;
+  uint64_t concealed;
+  uint64_t resyncs;
+};
+
+
+//  --------------------------------------------------------------------------
+//  Empties a channel and makes it wait for a sequence number
+//  Input:
+//    channel: the channel
+//    stream_id: the random id of the stream
+//    seq: the sequence number of the next frame
+
+static void
+csjitter_channel_reset (csjitter_channel_t *channel, uint16_t stream_id,
+    uint8_t seq)
+{
+  size_t i;
+
+  for (i = 0; i < CSJITTER_SLOTS; i++) {
+    channel->slots[i].present = false;
+  }
+  channel->started = true;
+  channel->stream_id = stream_id;
+  channel->next = seq;
+  channel->buffered = 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the release state of a channel
+//  Input:
+//    self: the jitter buffer
+//    channel: the channel
+//    now: the current time in milliseconds
+
+static int
+csjitter_channel_state (csjitter_t *self, csjitter_channel_t *channel,
+    int64_t now)
+{
+  size_t i;
+  int state = CSJITTER_WAIT;
+  uint8_t ahead;
+  int64_t oldest = now;
+
+  if (channel->buffered == 0) {
+    state = CSJITTER_IDLE;
+  } else if (channel->slots[channel->next % CSJITTER_SLOTS].present) {
+    state = CSJITTER_FRAME;
+  } else {
+    for (i = 0; i < CSJITTER_SLOTS; i++) {
+      if (channel->slots[i].present) {
+        ahead = (uint8_t) (i - channel->next) % CSJITTER_SLOTS;
+        if (ahead >= self->depth) {
+          state = CSJITTER_LOST;
+        }
+        if (channel->slots[i].arrival < oldest) {
+          oldest = channel->slots[i].arrival;
+        }
+      }
+    }
+    if (now - oldest >= self->max_wait_ms) {
+      state = CSJITTER_LOST;
+    }
+  }
+
+  return state;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the arrival time of the oldest frame of a channel with frames
+
+static int64_t
+csjitter_channel_oldest (csjitter_channel_t *channel)
+{
+  size_t i;
+  int64_t oldest = INT64_MAX;
+
+  for (i = 0; i < CSJITTER_SLOTS; i++) {
+    if (channel->slots[i].present && channel->slots[i].arrival < oldest) {
+      oldest = channel->slots[i].arrival;
+    }
+  }
+
+  return oldest;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Releases the next frame of a channel, concealing it when it is missing
+//  Input:
+//    self: the jitter buffer
+//    channel: the channel
+//    now: the current time in milliseconds
+//    dest: the buffer of the frame, of CSJITTER_MAX_FRAME_SIZE bytes
+//  Output:
+//    The length of the frame
+
+static size_t
+csjitter_channel_take (csjitter_t *self, csjitter_channel_t *channel,
+    int64_t now, uint8_t *dest)
+{
+  size_t len;
+  csjitter_slot_t *slot = &channel->slots[channel->next % CSJITTER_SLOTS];
+
+  if (slot->present) {
+    len = slot->len;
+    memcpy (dest, slot->data, len);
+    memcpy (channel->last, slot->data, len);
+    channel->last_len = len;
+    channel->repeats = 0;
+    slot->present = false;
+    channel->buffered--;
+  } else if (channel->last_len && channel->repeats < CSJITTER_MAX_REPEATS) {
+    len = channel->last_len;
+    memcpy (dest, channel->last, len);
+    channel->repeats++;
+    self->concealed++;
+  } else {
+    len = channel->frame_len ? channel->frame_len : CSJITTER_DEFAULT_FRAME_SIZE;
+    memset (dest, CSJITTER_SILENCE, len);
+    self->concealed++;
+  }
+  channel->next = (channel->next + 1) & CSJITTER_SEQ_MASK;
+  channel->released = now;
+
+  return len;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Creates a jitter buffer
+//  Input:
+//    channels: 1 for simplex and group calls, 2 for duplex calls
+//    depth: the frames received after a missing one before it is
+//      concealed, from 1 to CSJITTER_SLOTS - 1
+//    max_wait_ms: the time a frame waits for the missing frames before it
+//  Output:
+//    The created jitter buffer or NULL
+
+csjitter_t *
+csjitter_new (int channels, int depth, int max_wait_ms)
+{
+  csjitter_t *self = NULL;
+
+  if (channels < 1 || channels > 2 || depth < 1 || depth >= CSJITTER_SLOTS) {
+    TRACE (ERROR, "Bad jitter buffer: %d channels, depth %d", channels, depth);
+  } else {
+    self = (csjitter_t *) calloc (1, sizeof (csjitter_t));
+  }
+
+  if (self) {
+    self->channels = channels;
+    self->depth = depth;
+    self->max_wait_ms = max_wait_ms;
+  }
+
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees the jitter buffer and the frames still waiting
+//  Input:
+//    The target jitter buffer
+
+void
+csjitter_destroy (csjitter_t **self_p)
+{
+  if (self_p && *self_p) {
+    free (*self_p);
+    *self_p = NULL;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Puts a received frame in the jitter buffer
+//  Input:
+//    self: the jitter buffer
+//    channel: 0 or, for duplex calls, 1 for the stream of party B
+//    stream_id: the random id of the stream
+//    seq: the packet sequence number. Its 7 lower bits are used
+//    alaw: the A-law samples
+//    len: the number of samples
+//    now: the current time in milliseconds
+//  Output:
+//    0 - Ok
+//   -1 - Nok, the frame is late, repeated or too long
+
+int
+csjitter_push (csjitter_t *self, int channel, uint16_t stream_id, uint8_t seq,
+    const uint8_t * const alaw, size_t len, int64_t now)
+{
+  int rc = 0;
+  uint8_t distance;
+  csjitter_channel_t *target;
+  csjitter_slot_t *slot;
+
+  assert (channel >= 0 && channel < self->channels);
+  target = &self->channel[channel];
+  seq &= CSJITTER_SEQ_MASK;
+
+  if (len == 0 || len > CSJITTER_MAX_FRAME_SIZE) {
+    TRACE (ERROR, "Bad voice frame length: %zu", len);
+    return -1;
+  }
+
+  if (!target->started || target->stream_id != stream_id) {
+    csjitter_channel_reset (target, stream_id, seq);
+  }
+
+  distance = (seq - target->next) & CSJITTER_SEQ_MASK;
+  if (distance > CSJITTER_SEQ_MASK / 2 && target->buffered == 0 &&
+      now - target->released >= self->max_wait_ms) {
+    // Not late but after a loss of half the sequence or more
+    TRACE (DEBUG, "Jitter buffer: silent for %" PRId64 " ms, restarted",
+        now - target->released);
+    csjitter_channel_reset (target, stream_id, seq);
+    self->resyncs++;
+    distance = 0;
+  }
+  if (distance > CSJITTER_SEQ_MASK / 2) {
+    // Behind the next frame, already released or concealed
+    self->late++;
+    rc = -1;
+  } else {
+    if (distance >= CSJITTER_SLOTS) {
+      TRACE (DEBUG, "Jitter buffer: %u frames jump, restarted", distance);
+      csjitter_channel_reset (target, stream_id, seq);
+      self->resyncs++;
+    }
+    slot = &target->slots[seq % CSJITTER_SLOTS];
+    if (slot->present) {
+      self->late++;
+      rc = -1;
+    } else {
+      slot->present = true;
+      slot->arrival = now;
+      slot->len = len;
+      memcpy (slot->data, alaw, len);
+      target->buffered++;
+      target->frame_len = len;
+    }
+  }
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Releases the next frame of the jitter buffer, if it is due. For duplex
+//  calls the frames of both channels are released together, interleaved
+//  Input:
+//    self: the jitter buffer
+//    now: the current time in milliseconds
+//    dest: the buffer of the voice released
+//    size: the size of the buffer, channels * CSJITTER_MAX_FRAME_SIZE at
+//      least
+//  Output:
+//    The length of the voice released
+//    0 - Nothing due
+
+int
+csjitter_pop (csjitter_t *self, int64_t now, uint8_t *dest, size_t size)
+{
+  int state_a;
+  int state_b;
+  size_t len_a = 0;
+  size_t len_b = 0;
+  size_t block_size;
+  csjitter_channel_t *alone = NULL;
+  uint8_t frame_a[CSJITTER_MAX_FRAME_SIZE];
+  uint8_t frame_b[CSJITTER_MAX_FRAME_SIZE];
+
+  assert (size >= (size_t) self->channels * CSJITTER_MAX_FRAME_SIZE);
+
+  state_a = csjitter_channel_state (self, &self->channel[0], now);
+  if (self->channels == 1) {
+    if (state_a == CSJITTER_FRAME || state_a == CSJITTER_LOST) {
+      return (int) csjitter_channel_take (self, &self->channel[0], now, dest);
+    }
+    return 0;
+  }
+
+  state_b = csjitter_channel_state (self, &self->channel[1], now);
+  if (state_a == CSJITTER_WAIT || state_b == CSJITTER_WAIT ||
+      (state_a == CSJITTER_IDLE && state_b == CSJITTER_IDLE)) {
+    return 0;
+  }
+
+  // A party alone waits a bit for the other one to speak
+  if (state_a == CSJITTER_IDLE) {
+    alone = &self->channel[1];
+  } else if (state_b == CSJITTER_IDLE) {
+    alone = &self->channel[0];
+  }
+  if (alone && alone->buffered < (size_t) self->depth &&
+      now - csjitter_channel_oldest (alone) < self->max_wait_ms) {
+    return 0;
+  }
+
+  if (state_a != CSJITTER_IDLE) {
+    len_a = csjitter_channel_take (self, &self->channel[0], now,
+        frame_a);
+  }
+  if (state_b != CSJITTER_IDLE) {
+    len_b = csjitter_channel_take (self, &self->channel[1], now,
+        frame_b);
+  }
+
+  block_size = len_a > len_b ? len_a : len_b;
+  memset (frame_a + len_a, CSJITTER_SILENCE, block_size - len_a);
+  memset (frame_b + len_b, CSJITTER_SILENCE, block_size - len_b);
+  cs_interleave (frame_a, frame_b, block_size, dest);
+
+  return (int) (2 * block_size);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the time when the release of the frames waiting is unblocked
+//  even if the missing ones don't arrive, in milliseconds. That is the
+//  earliest deadline of the channels waiting for a missing frame or, for
+//  a duplex call with a party alone, the time its oldest frame has waited
+//  max_wait_ms. To be called when csjitter_pop releases nothing
+//  Input:
+//    self: the jitter buffer
+//    now: the current time in milliseconds
+//  Output:
+//    The time, after now
+//   -1 - No frames waiting
+
+int64_t
+csjitter_deadline (csjitter_t *self, int64_t now)
+{
+  int i;
+  int state[2];
+  int64_t channel_deadline;
+  int64_t deadline = -1;
+  csjitter_channel_t *alone = NULL;
+
+  for (i = 0; i < self->channels; i++) {
+    state[i] = csjitter_channel_state (self, &self->channel[i], now);
+    if (state[i] == CSJITTER_WAIT) {
+      channel_deadline = csjitter_channel_oldest (&self->channel[i]) +
+          self->max_wait_ms;
+      if (deadline == -1 || channel_deadline < deadline) {
+        deadline = channel_deadline;
+      }
+    }
+  }
+
+  // With no channel waiting, a duplex call may only wait for a party alone
+  if (deadline == -1 && self->channels == 2) {
+    if (state[0] == CSJITTER_IDLE && state[1] != CSJITTER_IDLE) {
+      alone = &self->channel[1];
+    } else if (state[1] == CSJITTER_IDLE && state[0] != CSJITTER_IDLE) {
+      alone = &self->channel[0];
+    }
+    if (alone) {
+      deadline = csjitter_channel_oldest (alone) + self->max_wait_ms;
+    }
+  }
+
+  // Already due: csjitter_pop wasn't called, don't make the caller spin
+  if (deadline != -1 && deadline <= now) {
+    deadline = now + 1;
+  }
+
+  return deadline;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of frames dropped because they arrived too late or
+//  twice
+
+uint64_t
+csjitter_late (csjitter_t *self)
+{
+  return self->late;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of missing frames concealed
+
+uint64_t
+csjitter_concealed (csjitter_t *self)
+{
+  return self->concealed;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of times a channel restarted after a jump of its
+//  sequence numbers
+
+uint64_t
+csjitter_resyncs (csjitter_t *self)
+{
+  return self->resyncs;
+}
@@ -0,0 +1,57 @@
+#ifndef __CSJITTER_H_INCLUDED__
+#define __CSJITTER_H_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//  Jitter buffer of the A-law voice of a live call, with one channel for
+//  simplex and group calls and two, A and B, for duplex calls. The frames
+//  of every channel are ordered by their 7 bits packet sequence number and
+//  released in order. A missing frame is concealed, repeating the last
+//  frame or with silence, once depth frames after it have arrived or the
+//  oldest frame waiting is max_wait_ms old. The two channels of a duplex
+//  call are released together, frame by frame, interleaved; a channel
+//  without voice is filled with silence.
+
+#define CSJITTER_SLOTS 16
+#define CSJITTER_MAX_FRAME_SIZE 480
+#define CSJITTER_SILENCE 0xd5
+
+typedef struct _csjitter_t csjitter_t;
+
+csjitter_t *
+csjitter_new (int channels, int depth, int max_wait_ms);
+
+void
+csjitter_destroy (csjitter_t **self_p);
+
+int
+csjitter_push (csjitter_t *self, int channel, uint16_t stream_id, uint8_t seq,
+    const uint8_t * const alaw, size_t len, int64_t now);
+
+int
+csjitter_pop (csjitter_t *self, int64_t now, uint8_t *dest, size_t size);
+
+int64_t
+csjitter_deadline (csjitter_t *self, int64_t now);
+
+uint64_t
+csjitter_late (csjitter_t *self);
+
+uint64_t
+csjitter_concealed (csjitter_t *self);
+
+uint64_t
+csjitter_resyncs (csjitter_t *self);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
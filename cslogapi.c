@@ -0,0 +1,64 @@
+/*  =========================================================================
+    cslogapi - LogApi message registry
+    =========================================================================*/
+
+/*
+    This module describes the LogApi message types known by the CallStream
+    modules. The collector, the persistence manager and the tracer use the
+    descriptors to validate and route the messages, so supporting a new LogApi
+    message type starts with adding its entry to the table below.
+*/
+
+
+#include "cslogapi.h"
+
+
+#define CS_LOG_API_ENTRY(id, type, msg_name) \
+  [id] = { id, msg_name, sizeof (type) }
+
+// Descriptors indexed by MsgId
+
+static const cs_log_api_descriptor_t
+cs_log_api_descriptors[CS_LOG_API_MSG_ID_COUNT] = {
+  CS_LOG_API_ENTRY (LOG_API_ALIVE, LogApiKeepAlive,
+      "LOG_API_KEEP_ALIVE"),
+  CS_LOG_API_ENTRY (LOG_API_DUPLEX_CALL_CHANGE, LogApiDuplexCallChange,
+      "LOG_API_DUPLEX_CALL_CHANGE"),
+  CS_LOG_API_ENTRY (LOG_API_DUPLEX_CALL_RELEASE, LogApiDuplexCallRelease,
+      "LOG_API_DUPLEX_CALL_RELEASE"),
+  CS_LOG_API_ENTRY (LOG_API_SIMPLEX_CALL_CHANGE, LogApiSimplexCallStartChange,
+      "LOG_API_SIMPLEX_CALL_START_CHANGE"),
+  CS_LOG_API_ENTRY (LOG_API_SIMPLEX_CALL_PTT_CHANGE, LogApiSimplexCallPttChange,
+      "LOG_API_SIMPLEX_CALL_PTT_CHANGE"),
+  CS_LOG_API_ENTRY (LOG_API_SIMPLEX_CALL_RELEASE, LogApiSimplexCallRelease,
+      "LOG_API_SIMPLEX_CALL_RELEASE"),
+  CS_LOG_API_ENTRY (LOG_API_GROUP_CALL_CHANGE, LogApiGroupCallStartChange,
+      "LOG_API_GROUP_CALL_START_CHANGE"),
+  CS_LOG_API_ENTRY (LOG_API_GROUP_CALL_PTT_ACTIVE, LogApiGroupCallPttActive,
+      "LOG_API_GROUP_CALL_PTT_ACTIVE"),
+  CS_LOG_API_ENTRY (LOG_API_GROUP_CALL_PTT_IDLE, LogApiGroupCallPttIdle,
+      "LOG_API_GROUP_CALL_PTT_IDLE"),
+  CS_LOG_API_ENTRY (LOG_API_GROUP_CALL_RELEASE, LogApiGroupCallRelease,
+      "LOG_API_GROUP_CALL_RELEASE"),
+  CS_LOG_API_ENTRY (LOG_API_SDS_STATUS, LogApiStatusSDS,
+      "LOG_API_SDS_STATUS"),
+  CS_LOG_API_ENTRY (LOG_API_SDS_TEXT, LogApiTextSDS,
+      "LOG_API_SDS_TEXT")
+};
+
+
+//  --------------------------------------------------------------------------
+//  Returns the descriptor of a LogApi message type
+//  Input:
+//    msg_id: the LogApi MsgId
+//  Output:
+//    The descriptor or NULL if the message type is unknown
+
+const cs_log_api_descriptor_t *
+cs_log_api_descriptor (UINT8 msg_id)
+{
+  const cs_log_api_descriptor_t *descriptor = &cs_log_api_descriptors[msg_id];
+
+  return descriptor->name ? descriptor : NULL;
+}
+
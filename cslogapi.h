@@ -0,0 +1,33 @@
+#ifndef __CSLOGAPI_H_INCLUDED__
+#define __CSLOGAPI_H_INCLUDED__
+
+#include <stddef.h>
+#include "LogApiMsgDef.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Number of slots of the tables indexed by the LogApi MsgId
+
+#define CS_LOG_API_MSG_ID_COUNT 256
+
+// Descriptor of a LogApi message type
+
+typedef struct {
+  UINT8 msg_id;         // LogApi MsgId
+  const char *name;     // Name used in the traces
+  size_t size;          // Size of the message on the wire
+} cs_log_api_descriptor_t;
+
+
+const cs_log_api_descriptor_t *
+cs_log_api_descriptor (UINT8 msg_id);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,319 @@
+/*  =========================================================================
+    csmap - Hash table keyed by 32-bit integers
+    =========================================================================*/
+
+/*
+    This module keeps items, e.g. the live calls, indexed by a 32-bit key
+    in a single array of slots with linear probing, so a lookup touches one
+    or a few consecutive slots and hashes no string.
+
+    The number of slots is a power of 2 and the table doubles when it is
+    70% full. A deleted item is not marked but filled in by the following
+    items of its probe sequence (backward shift deletion), so the lookups
+    never slow down after many insertions and deletions.
+*/
+
+
+#include "cs.h"
+#include "csmap.h"
+
+
+#define CSMAP_MIN_CAPACITY 64
+
+// Slot of the table. An empty slot has no item
+
+typedef struct {
+  uint32_t key;
+  void *item;
+} csmap_slot_t;
+
+// <Definition>
+
+struct _csmap_t {
+  csmap_slot_t *slots;
+  size_t capacity;              // Power of 2
+  size_t size;
+  size_t cursor;                // Slot of the current item of an iteration
+  csmap_destructor_fn *destructor;
+};
+
+
+//  --------------------------------------------------------------------------
+//  Returns the home slot of a key
+//  Input:
+//    self: the table
+//    key: the key
+//  Output:
+//    The index of the first slot of the probe sequence of the key
+
+static size_t
+csmap_home (csmap_t *self, uint32_t key)
+{
+  // Finalizer of MurmurHash3, so consecutive ids spread over the table
+  key ^= key >> 16;
+  key *= 0x85ebca6b;
+  key ^= key >> 13;
+  key *= 0xc2b2ae35;
+  key ^= key >> 16;
+
+  return key & (self->capacity - 1);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the slot of a key
+//  Input:
+//    self: the table
+//    key: the key
+//  Output:
+//    The slot of the key or the empty slot where it would be inserted
+
+static csmap_slot_t *
+csmap_slot (csmap_t *self, uint32_t key)
+{
+  size_t mask = self->capacity - 1;
+  size_t i = csmap_home (self, key);
+
+  while (self->slots[i].item && self->slots[i].key != key) {
+    i = (i + 1) & mask;
+  }
+
+  return &self->slots[i];
+}
+
+
+//  --------------------------------------------------------------------------
+//  Moves the items to a table with the double of slots
+//  Input:
+//    self: the table
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+static int
+csmap_grow (csmap_t *self)
+{
+  csmap_slot_t *slots = self->slots;
+  size_t capacity = self->capacity;
+  size_t i;
+
+  self->slots = (csmap_slot_t *) calloc (capacity * 2, sizeof (csmap_slot_t));
+  if (!self->slots) {
+    self->slots = slots;
+    return -1;
+  }
+  self->capacity = capacity * 2;
+
+  for (i = 0; i < capacity; i++) {
+    if (slots[i].item) {
+      *csmap_slot (self, slots[i].key) = slots[i];
+    }
+  }
+  free (slots);
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Creates an empty table
+//  Output:
+//    The created table or NULL
+
+csmap_t *
+csmap_new (void)
+{
+  csmap_t *self = (csmap_t *) calloc (1, sizeof (csmap_t));
+  if (self) {
+    self->capacity = CSMAP_MIN_CAPACITY;
+    self->slots = (csmap_slot_t *) calloc (self->capacity, sizeof (csmap_slot_t));
+    if (!self->slots) {
+      free (self);
+      self = NULL;
+    }
+  }
+
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees the table and, with a destructor, its items
+//  Input:
+//    The target table
+
+void
+csmap_destroy (csmap_t **self_p)
+{
+  size_t i;
+
+  if (self_p && *self_p) {
+    csmap_t *self = *self_p;
+    for (i = 0; self->destructor && i < self->capacity; i++) {
+      if (self->slots[i].item) {
+        self->destructor (&self->slots[i].item);
+      }
+    }
+    free (self->slots);
+    free (self);
+    *self_p = NULL;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Sets the destructor of the items, called when they are deleted and when
+//  the table is destroyed
+//  Input:
+//    self: the table
+//    destructor: the destructor of the items
+
+void
+csmap_set_destructor (csmap_t *self, csmap_destructor_fn *destructor)
+{
+  self->destructor = destructor;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Inserts an item
+//  Input:
+//    self: the table
+//    key: the key of the item
+//    item: the item
+//  Output:
+//    0 - Ok
+//   -1 - Nok. The key is already in the table or there is no memory
+
+int
+csmap_insert (csmap_t *self, uint32_t key, void *item)
+{
+  csmap_slot_t *slot;
+
+  assert (item);
+
+  if ((self->size + 1) * 10 > self->capacity * 7 && csmap_grow (self) == -1) {
+    return -1;
+  }
+
+  slot = csmap_slot (self, key);
+  if (slot->item) {
+    return -1;
+  }
+
+  slot->key = key;
+  slot->item = item;
+  self->size++;
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Finds an item
+//  Input:
+//    self: the table
+//    key: the key of the item
+//  Output:
+//    The item or NULL
+
+void *
+csmap_lookup (csmap_t *self, uint32_t key)
+{
+  return csmap_slot (self, key)->item;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Deletes an item, destroying it with the destructor if there is one
+//  Input:
+//    self: the table
+//    key: the key of the item
+
+void
+csmap_delete (csmap_t *self, uint32_t key)
+{
+  size_t mask = self->capacity - 1;
+  csmap_slot_t *slot = csmap_slot (self, key);
+  size_t hole;
+  size_t i;
+  size_t home;
+
+  if (!slot->item) {
+    return;
+  }
+
+  if (self->destructor) {
+    self->destructor (&slot->item);
+  }
+  slot->item = NULL;
+  self->size--;
+
+  // The following items of the cluster that can't be found past the hole
+  // are moved into it
+  hole = slot - self->slots;
+  for (i = (hole + 1) & mask; self->slots[i].item; i = (i + 1) & mask) {
+    home = csmap_home (self, self->slots[i].key);
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      self->slots[hole] = self->slots[i];
+      self->slots[i].item = NULL;
+      hole = i;
+    }
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of items
+
+size_t
+csmap_size (csmap_t *self)
+{
+  return self->size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Starts an iteration of the items
+//  Input:
+//    self: the table
+//  Output:
+//    The first item or NULL
+
+void *
+csmap_first (csmap_t *self)
+{
+  self->cursor = (size_t) -1;
+
+  return csmap_next (self);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Continues an iteration of the items
+//  Input:
+//    self: the table
+//  Output:
+//    The next item or NULL at the end of the table
+
+void *
+csmap_next (csmap_t *self)
+{
+  for (self->cursor++; self->cursor < self->capacity; self->cursor++) {
+    if (self->slots[self->cursor].item) {
+      return self->slots[self->cursor].item;
+    }
+  }
+
+  return NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the key of the current item of an iteration
+
+uint32_t
+csmap_cursor (csmap_t *self)
+{
+  return self->slots[self->cursor].key;
+}
@@ -0,0 +1,55 @@
+#ifndef __CSMAP_H_INCLUDED__
+#define __CSMAP_H_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//  Hash table of items keyed by a 32-bit integer (e.g. a call id), with
+//  open addressing. The items can't be NULL. The table must not be
+//  modified while it is iterated with csmap_first/csmap_next.
+
+typedef struct _csmap_t csmap_t;
+
+typedef void (csmap_destructor_fn) (void **item);
+
+csmap_t *
+csmap_new (void);
+
+void
+csmap_destroy (csmap_t **self_p);
+
+void
+csmap_set_destructor (csmap_t *self, csmap_destructor_fn *destructor);
+
+int
+csmap_insert (csmap_t *self, uint32_t key, void *item);
+
+void *
+csmap_lookup (csmap_t *self, uint32_t key);
+
+void
+csmap_delete (csmap_t *self, uint32_t key);
+
+size_t
+csmap_size (csmap_t *self);
+
+void *
+csmap_first (csmap_t *self);
+
+void *
+csmap_next (csmap_t *self);
+
+uint32_t
+csmap_cursor (csmap_t *self);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
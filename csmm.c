@@ -3,7 +3,6 @@
 
     TODO - Handle potentially orphan calls (lost of call release events)
     TODO - Handle calls without a call setup (lost of call setup events)
-    TODO - Queue requested call interceptions when all the feeders are busy
     =========================================================================
 
     This submodule is responsible for receiving the requested active voice calls'
@@ -31,6 +30,80 @@
     the selected feeder's Media Server until the call is released or the client
     requests to stop the ongoing call interception.
 
+    A call can be intercepted by several listeners at the same time, each
+    one identified by the session given in its request and served by its
+    own feeder. The voice of a call is received and merged once and the
+    result is sent to all its listeners.
+
+    A feeder sends the voice as raw A-law datagrams to its Media Server or,
+    when configured with mode "rtp", as RTP/PCMA packets of 20 ms that any
+    RTP player can receive directly. A stereo RTP feeder sends the stream of
+    every party of a duplex call with its own SSRC, A to the feeder port and
+    B to the port + 2. The response to an interception request of an RTP
+    feeder carries the rtp url and the SDP of the streams.
+
+    The datagrams for the feeders are not sent one by one. The voice
+    messages waiting in the voice subscriber are processed in the same
+    reactor wakeup and the datagrams they produce for all the calls are
+    sent together with sendmmsg (see csegress), up to
+    /media_manager/egress/batch per system call. The STATS command reports
+    the datagrams sent and dropped and the batch sizes.
+
+    With /media_manager/pacing/playout_delay set, the voice isn't sent as
+    it arrives but at its own pace: every call keeps a playout queue, and a
+    timing wheel (cswheel) ticking every /media_manager/pacing/tick
+    milliseconds releases a block when the previous one has been played,
+    e.g. every 60 ms for the 480 samples blocks. The first block of a
+    talkspurt waits the playout delay to absorb the bursts, and the queue
+    never holds more than /media_manager/pacing/playout_max milliseconds.
+
+    Before that, the voice frames of every call go through a jitter buffer
+    (csjitter) that puts them back in the order of their LogApi packet
+    sequence, pairs the frames of the parties A and B of duplex calls by
+    sequence and conceals the frames lost, repeating the last frame or
+    with silence. A missing frame is given up when the frame
+    /media_manager/jitter/depth positions after it arrives, or after
+    /media_manager/jitter/max_wait milliseconds; depth 0, the default,
+    sends the frames as they arrive.
+
+    When /media_manager/http/port is set, the submodule also serves the
+    voice of the live calls to web clients, with no feeder nor Media Server
+    in between: GET /live/<call id> gets a chunked WAVE stream or, with a
+    WebSocket upgrade, binary messages of A-law voice (see csweb). Every
+    request is a listener of its own, created when it arrives and removed
+    when the client goes away or the call ends, up to
+    /media_manager/http/max_clients clients. A client that hasn't completed
+    its request within /media_manager/http/request_timeout seconds is
+    answered 408 and closed.
+
+    The voice of all the intercepted calls is received by a single voice
+    subscriber, which subscribes to the topic of a call when its first
+    listener starts and unsubscribes when its last listener stops. The
+    live calls are indexed by call id (csmap), so routing a voice frame to
+    its feeder doesn't depend on the number of calls tracked or
+    intercepted. The free feeders wait in a list per feeder type, "M"ono
+    for simplex and group calls and "S"tereo for duplex calls, so a feeder
+    is allocated without scanning the busy ones.
+
+    A call whose release is lost is removed after call_inactivity_period
+    seconds without voice. Every call has an expiry timer in a timing wheel
+    (cswheel) advanced every maintenance_frequency seconds: the voice of a
+    call only updates its last activity, and the expiry checks it when it
+    is due and schedules itself again from the last voice. So the
+    maintenance visits the calls due only, not all the calls tracked.
+
+    When all the feeders of the type of a call are busy, an interception
+    request with a session waits for one instead of being refused, if
+    /media_manager/notification_publisher is set. The request is answered
+    "WAIT" with its position and, as soon as a feeder is given back by a
+    stopped interception or a released call, the waiting request with the
+    highest priority (the oldest among the same priority) gets it. The
+    response of a waiting request is published, the same frames as a
+    direct response after the session and the call id, so the client
+    subscribes to its session instead of polling. A request gives up after
+    its timeout or /media_manager/waiting/timeout seconds, and at most
+    /media_manager/waiting/max requests wait.
+
     General logic for recorded calls handling
     -----------------------------------------
     Once the start of play a recorded call has been requested, the submodule will:
@@ -44,15 +117,29 @@
 
 #include "cs.h"
 #include "csutil.h"
+#include "cslogapi.h"
+#include "csbus.h"
+#include "csvoice.h"
+#include "csmap.h"
+#include "csrtp.h"
+#include "csweb.h"
+#include "csegress.h"
+#include "cswheel.h"
+#include "csjitter.h"
 #include "wave.h"
 #include "md5.h"
 #include <libpq-fe.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
 
 
 
 #define LIVE_FEEDER_TAG 0x0001cafe
 #define LIVE_CALL_TAG   0x0000deaf
+#define LIVE_LISTENER_TAG 0x0000beef
 #define CALL_PLAYER_TAG 0x0000feda
+#define LIVE_REQUEST_TAG 0x0000face
+#define HTTP_REQUEST_TAG 0x0000babe
 
 #define CSMM_TMP_BUFFER 64
 #define CSMM_BUFFER_WORK_AREA_LENGTH 2048
@@ -89,14 +176,55 @@ struct _live_feeder_t {
   csstring_t *stream_name;
   bool free;
   char feeder_type;
+  zlist_t *free_list;           // Free feeders of the same type
   csstring_t *ip;
   int port;
   int channel;
   struct sockaddr_in serv_addr;
+  csrtp_t *rtp_a;               // RTP mode: mono stream or stream A
+  csrtp_t *rtp_b;               // RTP mode: stream B of the stereo feeders
+  csegress_t *egress;           // NULL = sendto through channel
 };
 typedef struct _live_feeder_t live_feeder_t;
 
 
+// The properties of a listener of an intercepted call
+
+struct _live_listener_t {
+  UINT32 tag;
+  csstring_t *session;          // "" for the requests without session
+  live_feeder_t *live_feeder;
+  csweb_t *web;                 // HTTP or WebSocket client, instead of a feeder
+  zloop_t *loop;                // Reactor polling the web client, NULL = none
+};
+typedef struct _live_listener_t live_listener_t;
+
+
+// An interception request waiting for a free feeder
+
+struct _live_request_t {
+  UINT32 tag;
+  UINT32 call_id;
+  csstring_t *session;
+  csstring_t *call_format;
+  zlist_t *free_list;           // The free feeders it waits for
+  int priority;                 // The highest is served first
+  uint64_t order;               // Of arrival, among the same priority
+  int timer_id;                 // Wait timeout
+};
+typedef struct _live_request_t live_request_t;
+
+
+// A web client whose request is not complete
+
+struct _http_request_t {
+  UINT32 tag;
+  csweb_t *web;
+  cswheel_timer_t expiry;       // Request timeout
+};
+typedef struct _http_request_t http_request_t;
+
+
 // The properties of an active call
 
 struct _live_call_t {
@@ -105,9 +233,16 @@ struct _live_call_t {
   char call_type;
   zchunk_t *voice_data_stream_a;
   zchunk_t *voice_data_stream_b;
-  zsock_t *subscriber;
-  live_feeder_t *live_feeder;
-  time_t last_activity;
+  bool subscribed;              // To its voice in the voice subscriber
+  zlist_t *listeners;
+  zlist_t *playout;             // Paced voice blocks (zchunk_t) not sent yet
+  int playout_ms;               // Voice in the playout queue
+  int64_t playout_due;          // Release time of the next voice block
+  cswheel_timer_t pacer;
+  csjitter_t *jitter;           // Created with the first voice frame
+  cswheel_timer_t jitter_timer; // Release of the frames waiting in vain
+  int64_t last_activity;        // Monotonic time of the last voice
+  cswheel_timer_t expiry;       // Removal of the call without voice
 };
 typedef struct _live_call_t live_call_t;
 
@@ -125,13 +260,42 @@ struct _csmm_t {
   csstring_t *voicerec_url;
   csstring_t *voicerec_repo;
   zlist_t *live_feeders;
-  zlist_t *live_calls;
+  zlist_t *free_mono_feeders;
+  zlist_t *free_stereo_feeders;
+  csmap_t *live_calls;          // Live calls by call id
   zlist_t *call_players;
   zsock_t *subscriber;
+  zsock_t *voice_subscriber;    // Voice of the intercepted calls
   zsock_t *command_listener;
+  zsock_t *notifier;            // Asynchronous responses. NULL = no waiting
+  zlist_t *waiting;             // Interception requests waiting for a feeder
+  size_t waiting_max;
+  int waiting_timeout;          // Seconds
+  uint64_t waiting_order;
+  uint64_t waiting_granted;
+  uint64_t waiting_expired;
   zloop_t *loop;
+  int http_port;                // 0 = no live streaming endpoint
+  int http_max_clients;
+  int http_channel;
+  zlist_t *http_requests;       // Web clients whose request is not complete
+  int http_request_timeout;     // Seconds
+  csegress_t *egress;           // Batched datagrams to the feeders
+  cswheel_t *media_wheel;       // Timers of the pacing and the jitter buffers
+  int media_timer;
+  int playout_delay;            // 0 = the voice is sent as it arrives
+  int playout_max;
+  uint64_t paced_blocks;
+  uint64_t paced_drops;
+  uint64_t paced_restarts;
+  int jitter_depth;             // 0 = no jitter buffers
+  int jitter_max_wait;
+  uint64_t jitter_late;         // Of the calls already removed
+  uint64_t jitter_concealed;
+  uint64_t jitter_resyncs;
   unsigned int call_inactivity_period;
   unsigned int maintenance_frequency;
+  cswheel_t *expiry_wheel;      // Expiry of the calls without voice
 };
 typedef struct _csmm_t csmm_t;
 
@@ -220,11 +384,40 @@ csmm_new (const char * const conf_file, zloop_t *loop)
     self->voicerec_url = NULL;
     self->voicerec_repo = NULL;
     self->live_feeders = NULL;
+    self->free_mono_feeders = NULL;
+    self->free_stereo_feeders = NULL;
     self->live_calls = NULL;
     self->call_players = NULL;
     self->subscriber = NULL;
+    self->voice_subscriber = NULL;
     self->command_listener = NULL;
+    self->notifier = NULL;
+    self->waiting = NULL;
+    self->waiting_max = 0;
+    self->waiting_timeout = 0;
+    self->waiting_order = 0;
+    self->waiting_granted = 0;
+    self->waiting_expired = 0;
     self->loop = loop;
+    self->http_port = 0;
+    self->http_max_clients = 0;
+    self->http_channel = -1;
+    self->http_requests = NULL;
+    self->http_request_timeout = 0;
+    self->egress = NULL;
+    self->media_wheel = NULL;
+    self->media_timer = -1;
+    self->playout_delay = 0;
+    self->playout_max = 0;
+    self->paced_blocks = 0;
+    self->paced_drops = 0;
+    self->paced_restarts = 0;
+    self->jitter_depth = 0;
+    self->jitter_max_wait = 0;
+    self->jitter_late = 0;
+    self->jitter_concealed = 0;
+    self->jitter_resyncs = 0;
+    self->expiry_wheel = NULL;
   }
 
   TRACE (FUNCTIONS, "Leaving csmm_new");
@@ -256,17 +449,54 @@ csmm_destroy (csmm_t **self_p)
     csstring_destroy (&self->filename_template);
     csstring_destroy (&self->voicerec_url);
     csstring_destroy (&self->voicerec_repo);
+    if (self->http_channel != -1) {
+      zmq_pollitem_t item = { 0, self->http_channel, ZMQ_POLLIN, 0 };
+      zloop_poller_end (self->loop, &item);
+      close (self->http_channel);
+    }
+    if (self->http_requests) {
+      http_request_t *request =
+          (http_request_t *) zlist_first (self->http_requests);
+      while (request) {
+        zmq_pollitem_t item = { 0, csweb_fd (request->web), ZMQ_POLLIN, 0 };
+        zloop_poller_end (self->loop, &item);
+        request = (http_request_t *) zlist_next (self->http_requests);
+      }
+      zlist_destroy (&self->http_requests);
+    }
+    if (self->media_timer != -1) {
+      zloop_timer_end (self->loop, self->media_timer);
+    }
+    if (self->waiting) {
+      live_request_t *request = (live_request_t *) zlist_first (self->waiting);
+      while (request) {
+        zloop_timer_end (self->loop, request->timer_id);
+        request = (live_request_t *) zlist_next (self->waiting);
+      }
+      zlist_destroy (&self->waiting);
+    }
+    // The live calls give back their feeders and close their web clients
+    csmap_destroy (&self->live_calls);
+    cswheel_destroy (&self->media_wheel);
+    cswheel_destroy (&self->expiry_wheel);
+    zlist_destroy (&self->free_mono_feeders);
+    zlist_destroy (&self->free_stereo_feeders);
     zlist_destroy (&self->live_feeders);
-    zlist_destroy (&self->live_calls);
+    csegress_destroy (&self->egress);
     zlist_destroy (&self->call_players);
     if (self->subscriber) {
       zloop_reader_end (self->loop, self->subscriber);
       zsock_destroy (&self->subscriber);
     }
+    if (self->voice_subscriber) {
+      zloop_reader_end (self->loop, self->voice_subscriber);
+      zsock_destroy (&self->voice_subscriber);
+    }
     if (self->command_listener) {
       zloop_reader_end (self->loop, self->command_listener);
       zsock_destroy (&self->command_listener);
     }
+    zsock_destroy (&self->notifier);
     free (self);
     *self_p = NULL;
   }
@@ -296,11 +526,15 @@ csmm_live_feeder_is (void *self)
 //    stream: stream's name
 //    ip: feeder's address
 //    port: feeder's port
+//    type: "M"ono or "S"tereo
+//    rtp: true to send the voice as RTP/PCMA instead of raw A-law. A stereo
+//      feeder sends stream A to port and stream B to port + 2
 //  Output:
 //    The created feeder
 
 static live_feeder_t*
-csmm_live_feeder_new (csstring_t *stream, csstring_t *ip, int port, char type)
+csmm_live_feeder_new (csstring_t *stream, csstring_t *ip, int port, char type,
+    bool rtp)
 {
   live_feeder_t *self;
   unsigned long net_addr;
@@ -315,6 +549,7 @@ csmm_live_feeder_new (csstring_t *stream, csstring_t *ip, int port, char type)
     self->stream_name = stream;
     self->feeder_type = type;
     self->free = true;
+    self->free_list = NULL;
     self->channel = -1;
   }
 
@@ -325,6 +560,19 @@ csmm_live_feeder_new (csstring_t *stream, csstring_t *ip, int port, char type)
   self->serv_addr.sin_addr.s_addr = htonl (net_addr);
   self->serv_addr.sin_port = htons (self->port);
 
+  if (rtp) {
+    self->rtp_a = csrtp_new (self->channel, &self->serv_addr, CSRTP_PT_PCMA,
+        CSRTP_G711_CLOCK_RATE, CSRTP_PTIME_MS);
+    assert (self->rtp_a);
+    if (type == 'S') {
+      struct sockaddr_in addr_b = self->serv_addr;
+      addr_b.sin_port = htons (self->port + 2);
+      self->rtp_b = csrtp_new (self->channel, &addr_b, CSRTP_PT_PCMA,
+          CSRTP_G711_CLOCK_RATE, CSRTP_PTIME_MS);
+      assert (self->rtp_b);
+    }
+  }
+
   TRACE (FUNCTIONS, "Leaving csmm_live_feeder_new");
 
   return self;
@@ -347,6 +595,8 @@ csmm_live_feeder_destroy (live_feeder_t **self_p)
     assert (csmm_live_feeder_is (self));
     csstring_destroy (&self->ip);
     csstring_destroy (&self->stream_name);
+    csrtp_destroy (&self->rtp_a);
+    csrtp_destroy (&self->rtp_b);
     close (self->channel);
     free (self);
     *self_p = NULL;
@@ -370,6 +620,149 @@ csmm_live_feeder_destructor (void **item)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Gives back a feeder to the free feeders of its type
+//  Input:
+//    A feeder
+
+static void
+csmm_live_feeder_release (live_feeder_t *self)
+{
+  if (!self->free) {
+    self->free = true;
+    if (self->free_list) {
+      zlist_append (self->free_list, self);
+    }
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Queues an RTP packet of a feeder in the batched egress
+//  Input:
+//    arg: the batched egress
+//    dest: the destination of the packet
+//    packet: the packet
+//    len: the length of the packet
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+static int
+csmm_live_feeder_rtp_sender (void *arg, const struct sockaddr_in * const dest,
+    const uint8_t * const packet, size_t len)
+{
+  return csegress_queue ((csegress_t *) arg, dest, packet, len);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Makes a feeder send its datagrams through the batched egress
+//  Input:
+//    self: the feeder
+//    egress: the batched egress
+
+static void
+csmm_live_feeder_set_egress (live_feeder_t *self, csegress_t *egress)
+{
+  self->egress = egress;
+  if (self->rtp_a) {
+    csrtp_set_sender (self->rtp_a, csmm_live_feeder_rtp_sender, egress);
+  }
+  if (self->rtp_b) {
+    csrtp_set_sender (self->rtp_b, csmm_live_feeder_rtp_sender, egress);
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Takes a free feeder for a new listener. An RTP feeder starts new streams
+//  Input:
+//    A free feeder
+
+static void
+csmm_live_feeder_acquire (live_feeder_t *self)
+{
+  self->free = false;
+  if (self->rtp_a) {
+    csrtp_reset (self->rtp_a);
+  }
+  if (self->rtp_b) {
+    csrtp_reset (self->rtp_b);
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Writes the media description of an RTP stream of an SDP
+//  Input:
+//    sdp: the end of the SDP
+//    size: the space left in the SDP
+//    port: the destination port of the stream
+//    rtp: the stream
+//    label: the label of the stream
+//  Output:
+//    The length of the media description
+
+static int
+csmm_live_feeder_sdp_media (char *sdp, size_t size, int port, csrtp_t *rtp,
+    const char * const label)
+{
+  return snprintf (sdp, size,
+      "m=audio %d RTP/AVP %d\r\n"
+      "a=rtpmap:%d PCMA/%d\r\n"
+      "a=ptime:%d\r\n"
+      "a=recvonly\r\n"
+      "a=ssrc:%u label:%s\r\n",
+      port, CSRTP_PT_PCMA, CSRTP_PT_PCMA, CSRTP_G711_CLOCK_RATE,
+      CSRTP_PTIME_MS, csrtp_ssrc (rtp), label);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Adds to a response the location of the stream of a feeder: the url of
+//  the Media Server stream or, for the RTP feeders, the rtp url followed by
+//  the SDP of the streams
+//  Input:
+//    ctx: the Call Stream Media Manager context of the thread
+//    feeder: the feeder
+//    call_id: the intercepted call
+//    call_format: the format of the Media Server stream
+//    response: the response that will be sent to the requester
+
+static void
+csmm_live_feeder_location (csmm_t *ctx, live_feeder_t *feeder, UINT32 call_id,
+    const char * const call_format, zmsg_t *response)
+{
+  char sdp[CSMM_BUFFER_WORK_AREA_LENGTH];
+  int len;
+
+  if (!feeder->rtp_a) {
+    zmsg_addstrf (response, "%s/%s.%s", csstring_data (ctx->media_server_endpoint),
+        csstring_data (feeder->stream_name), call_format);
+    return;
+  }
+
+  zmsg_addstrf (response, "rtp://%s:%d", csstring_data (feeder->ip), feeder->port);
+
+  len = snprintf (sdp, sizeof (sdp),
+      "v=0\r\n"
+      "o=- %u %u IN IP4 %s\r\n"
+      "s=%s call %u\r\n"
+      "c=IN IP4 %s\r\n"
+      "t=0 0\r\n",
+      csrtp_ssrc (feeder->rtp_a), call_id, csstring_data (feeder->ip),
+      csstring_data (feeder->stream_name), call_id, csstring_data (feeder->ip));
+  len += csmm_live_feeder_sdp_media (sdp + len, sizeof (sdp) - len,
+      feeder->port, feeder->rtp_a, feeder->rtp_b ? "A" : "voice");
+  if (feeder->rtp_b) {
+    len += csmm_live_feeder_sdp_media (sdp + len, sizeof (sdp) - len,
+        feeder->port + 2, feeder->rtp_b, "B");
+  }
+  zmsg_addstr (response, sdp);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Verifies if the input parameter is a call player
 //
@@ -518,6 +911,241 @@ csmm_find_call_player_by_call_id (csmm_t *ctx, UINT32 call_id, UINT32 call_dbId)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Verifies if the input parameter is a listener
+
+static bool
+csmm_live_listener_is (void *self)
+{
+  assert (self);
+  return ((live_listener_t *) self)->tag == LIVE_LISTENER_TAG;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Creates a listener of an intercepted call
+//  Input:
+//    session: the session of the interception request
+//    live_feeder: the feeder that sends the voice to the Media Server or
+//      NULL for a web client
+//  Output:
+//    The created listener
+
+static live_listener_t*
+csmm_live_listener_new (const char * const session, live_feeder_t *live_feeder)
+{
+  live_listener_t *self;
+
+  TRACE (FUNCTIONS, "Entering in csmm_live_listener_new");
+
+  self = (live_listener_t *) zmalloc (sizeof (live_listener_t));
+  if (self) {
+    self->tag = LIVE_LISTENER_TAG;
+    self->session = csstring_new (session);
+    self->live_feeder = live_feeder;
+  }
+
+  TRACE (FUNCTIONS, "Leaving csmm_live_listener_new");
+
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees a listener, giving back its feeder or closing its web client
+//  Input:
+//    A listener
+
+static void
+csmm_live_listener_destroy (live_listener_t **self_p)
+{
+  TRACE (FUNCTIONS, "Entering in csmm_live_listener_destroy");
+
+  assert (self_p);
+  if (*self_p) {
+    live_listener_t *self = *self_p;
+    assert (csmm_live_listener_is (self));
+    if (self->live_feeder) {
+      csmm_live_feeder_release (self->live_feeder);
+    }
+    if (self->loop) {
+      zmq_pollitem_t item = { 0, csweb_fd (self->web), ZMQ_POLLIN, 0 };
+      zloop_poller_end (self->loop, &item);
+    }
+    csweb_destroy (&self->web);
+    csstring_destroy (&self->session);
+    free (self);
+    *self_p = NULL;
+  }
+
+  TRACE (FUNCTIONS, "Leaving csmm_live_listener_destroy");
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees a listener and gives back its feeder
+//  Input:
+//    A listener
+
+static void
+csmm_live_listener_destructor (void **item)
+{
+  csmm_live_listener_destroy ((live_listener_t **) item);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Sends voice data to the Media Server or the web client of a listener
+//  Input:
+//    The listener
+//    The voice data, mono or stereo according to the call
+//    The length of the voice data
+//    The channels A and B of stereo voice data, split for the listeners
+//      with a stereo RTP feeder
+//    The samples of every channel
+//  Output:
+//    0 - Ok
+//   -1 - Nok. The connection of the web client is broken
+
+static int
+csmm_live_listener_send (live_listener_t *self, const UINT8 * const data,
+    size_t len, const UINT8 * const stream_a, const UINT8 * const stream_b,
+    size_t samples)
+{
+  live_feeder_t *feeder = self->live_feeder;
+
+  if (self->web) {
+    return csweb_send (self->web, data, len);
+  }
+
+  TRACE (DEBUG, "Sending data voice to feeder <%s>",
+      csstring_data (feeder->stream_name));
+
+  if (feeder->rtp_b) {
+    // Every channel of the stereo voice is an RTP stream of its own
+    csrtp_send (feeder->rtp_a, stream_a, samples);
+    csrtp_send (feeder->rtp_b, stream_b, samples);
+    return 0;
+  }
+
+  if (feeder->rtp_a) {
+    csrtp_send (feeder->rtp_a, data, len);
+    return 0;
+  }
+
+  if (feeder->egress) {
+    csegress_queue (feeder->egress, &feeder->serv_addr, data, len);
+    return 0;
+  }
+
+  sendto (self->live_feeder->channel,
+      data,
+      len,
+      0,
+      (struct sockaddr *) &self->live_feeder->serv_addr,
+      sizeof (self->live_feeder->serv_addr));
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Verifies if the input parameter is a waiting interception request
+
+static bool
+csmm_live_request_is (void *self)
+{
+  assert (self);
+  return ((live_request_t *) self)->tag == LIVE_REQUEST_TAG;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Creates an interception request waiting for a free feeder
+//  Input:
+//    call_id: the call to be intercepted
+//    session: the session of the request
+//    call_format: the format of the stream url
+//    free_list: the free feeders that can serve the call
+//    priority: the priority of the request
+//    order: the arrival order of the request
+//  Output:
+//    The created request
+
+static live_request_t*
+csmm_live_request_new (UINT32 call_id, const char * const session,
+    const char * const call_format, zlist_t *free_list, int priority,
+    uint64_t order)
+{
+  live_request_t *self;
+
+  TRACE (FUNCTIONS, "Entering in csmm_live_request_new");
+
+  self = (live_request_t *) zmalloc (sizeof (live_request_t));
+  if (self) {
+    self->tag = LIVE_REQUEST_TAG;
+    self->call_id = call_id;
+    self->session = csstring_new (session);
+    self->call_format = csstring_new (call_format);
+    self->free_list = free_list;
+    self->priority = priority;
+    self->order = order;
+    self->timer_id = -1;
+  }
+
+  TRACE (FUNCTIONS, "Leaving csmm_live_request_new");
+
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees a waiting interception request. Its timer belongs to the caller
+//  Input:
+//    A waiting request
+
+static void
+csmm_live_request_destroy (live_request_t **self_p)
+{
+  TRACE (FUNCTIONS, "Entering in csmm_live_request_destroy");
+
+  assert (self_p);
+  if (*self_p) {
+    live_request_t *self = *self_p;
+    assert (csmm_live_request_is (self));
+    csstring_destroy (&self->session);
+    csstring_destroy (&self->call_format);
+    free (self);
+    *self_p = NULL;
+  }
+
+  TRACE (FUNCTIONS, "Leaving csmm_live_request_destroy");
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees a waiting interception request
+//  Input:
+//    A waiting request
+
+static void
+csmm_live_request_destructor (void **item)
+{
+  csmm_live_request_destroy ((live_request_t **) item);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns true if a waiting request is served before another one
+
+static bool
+csmm_live_request_precedes (live_request_t *self, live_request_t *other)
+{
+  return self->priority > other->priority ||
+      (self->priority == other->priority && self->order < other->order);
+}
+
+
 //  --------------------------------------------------------------------------
 //  Verifies if the input parameter is a call
 
@@ -553,7 +1181,16 @@ csmm_live_call_new (UINT32 call_id, char call_type)
     self->voice_data_stream_a = NULL;
     self->voice_data_stream_b = NULL;
     self->call_type = call_type;
-    self->last_activity = time (NULL);
+    self->last_activity = zclock_mono ();
+    cswheel_timer_init (&self->expiry, self);
+    self->listeners = zlist_new ();
+    zlist_set_destructor (self->listeners, csmm_live_listener_destructor);
+    self->playout = zlist_new ();
+    self->playout_ms = 0;
+    self->playout_due = 0;
+    cswheel_timer_init (&self->pacer, self);
+    self->jitter = NULL;
+    cswheel_timer_init (&self->jitter_timer, self);
   }
 
   TRACE (FUNCTIONS, "Leaving csmm_live_call_new");
@@ -576,13 +1213,16 @@ csmm_live_call_destroy (live_call_t **self_p)
   if (*self_p) {
     live_call_t *self = *self_p;
     assert (csmm_live_call_is (self));
-    if (self->live_feeder) {
-      self->live_feeder->free = true;
-      self->live_feeder = NULL;
-    }
-    if (self->subscriber) {
-      zsock_destroy (&self->subscriber);
+    zlist_destroy (&self->listeners);
+    cswheel_cancel (&self->pacer);
+    cswheel_cancel (&self->jitter_timer);
+    csjitter_destroy (&self->jitter);
+    cswheel_cancel (&self->expiry);
+    zchunk_t *block;
+    while ((block = (zchunk_t *) zlist_pop (self->playout))) {
+      zchunk_destroy (&block);
     }
+    zlist_destroy (&self->playout);
     if (self->voice_data_stream_a) {
       zchunk_destroy (&self->voice_data_stream_a);
       self->voice_data_stream_a = NULL;
@@ -629,14 +1269,7 @@ csmm_find_live_call (csmm_t *ctx, UINT32 call_id)
 
   TRACE (FUNCTIONS, "Entering in csmm_find_live_call");
 
-  live_call = (live_call_t *) zlist_first (ctx->live_calls);
-
-  while (live_call) {
-    if (live_call->id == call_id)
-      break;
-    else
-      live_call = (live_call_t *) zlist_next (ctx->live_calls);
-  }
+  live_call = (live_call_t *) csmap_lookup (ctx->live_calls, call_id);
 
   TRACE (FUNCTIONS, "Leaving csmm_find_live_call");
 
@@ -662,10 +1295,21 @@ csmm_insert_live_call(csmm_t *ctx, UINT32 call_id, char call_type)
 
   TRACE (FUNCTIONS, "Entering in csmm_insert_live_call");
 
+  if (csmm_find_live_call (ctx, call_id)) {
+    TRACE (ERROR, "Call with id <%u> already live", call_id);
+    return -1;
+  }
+
   live_call = csmm_live_call_new (call_id, call_type);
   assert (live_call);
 
-  rc = zlist_append (ctx->live_calls, live_call);
+  rc = csmap_insert (ctx->live_calls, call_id, live_call);
+  if (rc == -1) {
+    csmm_live_call_destroy (&live_call);
+  } else {
+    cswheel_schedule (ctx->expiry_wheel, &live_call->expiry,
+        live_call->last_activity + (int64_t) ctx->call_inactivity_period * 1000);
+  }
 
   TRACE (FUNCTIONS, "Leaving csmm_insert_live_call");
 
@@ -675,41 +1319,591 @@ csmm_insert_live_call(csmm_t *ctx, UINT32 call_id, char call_type)
 
 
 //  --------------------------------------------------------------------------
-//  Removes an active call identified by call_id from the Media manager's thread
-//  context
+//  Finds the listener of a session among the listeners of an active call
 //  Input:
-//    The target Call Stream Media Manager context
-//    The call identifier
+//    The active call's representation
+//    The session
 //  Output:
-//    0: call removed
-//   -1: call not removed or not found
+//    The listener or NULL
 
-static int
-csmm_remove_live_call (csmm_t *ctx, UINT32 call_id)
+static live_listener_t*
+csmm_find_live_listener (live_call_t *live_call, const char * const session)
 {
-  int rc = 0;
-  live_call_t* live_call;
-
-  TRACE (FUNCTIONS, "Entering in csmm_remove_live_call");
-
-  live_call = csmm_find_live_call (ctx, call_id);
+  live_listener_t *listener = (live_listener_t *) zlist_first (live_call->listeners);
 
-  if (live_call) {
-    if (live_call->live_feeder) {
-      live_call->live_feeder->free = true;
-      live_call->live_feeder = NULL;
-    }
-    if (live_call->subscriber) {
-      zloop_reader_end (ctx->loop, live_call->subscriber);
-      zsock_destroy (&live_call->subscriber);
-    }
-    zlist_remove (ctx->live_calls, live_call);
-  } else {
-    TRACE (ERROR, "Call with id <%u> not found", call_id);
-    rc = -1;
+  while (listener && !streq (csstring_data (listener->session), session)) {
+    listener = (live_listener_t *) zlist_next (live_call->listeners);
   }
 
-  TRACE (FUNCTIONS, "Leaving csmm_remove_live_call");
+  return listener;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Starts receiving the voice of a call in the voice subscriber, once for
+//  all its listeners
+//  Input:
+//    The target Call Stream Media Manager context
+//    The active call's representation
+
+static void
+csmm_subscribe_live_call (csmm_t *ctx, live_call_t *live_call)
+{
+  if (!live_call->subscribed) {
+    live_call->subscribed = csbus_subscribe_topic (ctx->voice_subscriber,
+        CSBUS_VOICE, live_call->id) == 0;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Stops receiving the voice of a call in the voice subscriber
+//  Input:
+//    The target Call Stream Media Manager context
+//    The active call's representation
+
+static void
+csmm_unsubscribe_live_call (csmm_t *ctx, live_call_t *live_call)
+{
+  if (live_call->subscribed) {
+    csbus_unsubscribe_topic (ctx->voice_subscriber, CSBUS_VOICE, live_call->id);
+    live_call->subscribed = false;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Sends voice data of an active call to all its listeners. Stereo voice
+//  data is split into its channels once, at the first listener with a
+//  stereo RTP feeder. The listeners whose web client has gone are removed
+//  Input:
+//    The Call Stream Media Manager context of the thread
+//    The active call's representation
+//    The voice data
+//    The length of the voice data
+
+static void
+csmm_send_to_live_listeners (csmm_t *ctx, live_call_t *live_call,
+    const UINT8 * const data, size_t len)
+{
+  zlist_t *gone = NULL;
+  live_listener_t *listener = (live_listener_t *) zlist_first (live_call->listeners);
+  UINT8 stream_a[CS_VOICE_MAX_PAYLOAD_SIZE];
+  UINT8 stream_b[CS_VOICE_MAX_PAYLOAD_SIZE];
+  size_t samples = 0;
+
+  TRACE (DEBUG, "Sending data voice with call id <%u> to <%zu> listeners",
+      live_call->id, zlist_size (live_call->listeners));
+
+  while (listener) {
+    if (!samples && !listener->web && listener->live_feeder->rtp_b) {
+      samples = len / 2;
+      if (samples > CS_VOICE_MAX_PAYLOAD_SIZE) {
+        samples = CS_VOICE_MAX_PAYLOAD_SIZE;
+      }
+      cs_deinterleave (data, samples, stream_a, stream_b);
+    }
+    if (csmm_live_listener_send (listener, data, len, stream_a, stream_b,
+        samples) == -1) {
+      if (!gone) {
+        gone = zlist_new ();
+      }
+      zlist_append (gone, listener);
+    }
+    listener = (live_listener_t *) zlist_next (live_call->listeners);
+  }
+
+  // The list of listeners can't change while it is iterated
+  if (gone) {
+    while ((listener = (live_listener_t *) zlist_pop (gone))) {
+      TRACE (DEBUG, "Call <%u>: web client <%s> gone", live_call->id,
+          csstring_data (listener->session));
+      zlist_remove (live_call->listeners, listener);
+    }
+    zlist_destroy (&gone);
+    if (zlist_size (live_call->listeners) == 0) {
+      csmm_unsubscribe_live_call (ctx, live_call);
+    }
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the duration of a block of voice of a call, 8 A-law samples per
+//  millisecond and channel
+//  Input:
+//    The active call's representation
+//    The length of the voice data
+//  Output:
+//    The duration in milliseconds
+
+static int
+csmm_voice_block_ms (live_call_t *live_call, size_t len)
+{
+  return (int) (len / (live_call->call_type == 'D' ? 2 : 1) / 8);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Sends voice data of an active call to its listeners at the pace of the
+//  voice. The voice is held in the playout queue of the call and released
+//  by the pacing wheel one block after the other, every block when the
+//  previous one has been played. The first block waits playout_delay
+//  milliseconds, so the bursts of the LogServer are absorbed; when more
+//  than playout_max milliseconds are waiting the oldest voice is dropped.
+//  Without pacing the voice is sent at once
+//  Input:
+//    The Call Stream Media Manager context of the thread
+//    The active call's representation
+//    The voice data
+//    The length of the voice data
+
+static void
+csmm_pace_voice (csmm_t *ctx, live_call_t *live_call, const UINT8 * const data,
+    size_t len)
+{
+  zchunk_t *block;
+
+  if (!ctx->media_wheel || ctx->playout_delay <= 0) {
+    csmm_send_to_live_listeners (ctx, live_call, data, len);
+    return;
+  }
+
+  block = zchunk_new (data, len);
+  assert (block);
+  zlist_append (live_call->playout, block);
+  live_call->playout_ms += csmm_voice_block_ms (live_call, len);
+  ctx->paced_blocks++;
+
+  while (live_call->playout_ms > ctx->playout_max &&
+      zlist_size (live_call->playout) > 1) {
+    block = (zchunk_t *) zlist_pop (live_call->playout);
+    live_call->playout_ms -= csmm_voice_block_ms (live_call, zchunk_size (block));
+    zchunk_destroy (&block);
+    ctx->paced_drops++;
+  }
+
+  // The playout starts again after the queue has run dry
+  if (!cswheel_pending (&live_call->pacer)) {
+    live_call->playout_due = zclock_mono () + ctx->playout_delay;
+    cswheel_schedule (ctx->media_wheel, &live_call->pacer,
+        live_call->playout_due);
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Releases the next block of voice of the playout queue of a call to its
+//  listeners and schedules the following one
+//  Input:
+//    arg: the Call Stream Media Manager context of the thread
+//    timer: the pacer of the call
+
+static void
+csmm_pace_release (void *arg, cswheel_timer_t *timer)
+{
+  csmm_t *ctx = (csmm_t *) arg;
+  live_call_t *live_call = (live_call_t *) timer->item;
+  zchunk_t *block = (zchunk_t *) zlist_pop (live_call->playout);
+  int block_ms;
+
+  if (block) {
+    block_ms = csmm_voice_block_ms (live_call, zchunk_size (block));
+    live_call->playout_ms -= block_ms;
+    csmm_send_to_live_listeners (ctx, live_call, zchunk_data (block),
+        zchunk_size (block));
+    zchunk_destroy (&block);
+
+    if (zlist_size (live_call->playout)) {
+      live_call->playout_due += block_ms;
+      cswheel_schedule (ctx->media_wheel, &live_call->pacer,
+          live_call->playout_due);
+    } else {
+      ctx->paced_restarts++;
+    }
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Releases the voice due in the jitter buffer of a call to the pacing and
+//  schedules the release of the frames left, for when the frames they wait
+//  for will be considered lost
+//  Input:
+//    The Call Stream Media Manager context of the thread
+//    The active call's representation
+
+static void
+csmm_jitter_release (csmm_t *ctx, live_call_t *live_call)
+{
+  int len;
+  int64_t now = zclock_mono ();
+  int64_t deadline;
+  UINT8 voice_data[2 * CSJITTER_MAX_FRAME_SIZE];
+
+  while ((len = csjitter_pop (live_call->jitter, now, voice_data,
+      sizeof (voice_data))) > 0) {
+    csmm_pace_voice (ctx, live_call, voice_data, len);
+  }
+
+  deadline = csjitter_deadline (live_call->jitter, now);
+  if (deadline == -1) {
+    cswheel_cancel (&live_call->jitter_timer);
+  } else {
+    cswheel_schedule (ctx->media_wheel, &live_call->jitter_timer, deadline);
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Dispatches an expired timer of the media wheel to its call
+//  Input:
+//    arg: the Call Stream Media Manager context of the thread
+//    timer: the pacer or the jitter timer of a call
+
+static void
+csmm_media_expire (void *arg, cswheel_timer_t *timer)
+{
+  csmm_t *ctx = (csmm_t *) arg;
+  live_call_t *live_call = (live_call_t *) timer->item;
+
+  if (timer == &live_call->pacer) {
+    csmm_pace_release (ctx, timer);
+  } else {
+    csmm_jitter_release (ctx, live_call);
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Makes a session a listener of an active call, served by a free feeder
+//  Input:
+//    ctx: the Call Stream Media Manager context of the thread
+//    live_call: the active call's representation
+//    session: the session of the listener
+//    live_feeder: the feeder, already out of the free feeders
+
+static void
+csmm_live_call_add_listener (csmm_t *ctx, live_call_t *live_call,
+    const char * const session, live_feeder_t *live_feeder)
+{
+  live_listener_t *listener;
+
+  csmm_live_feeder_acquire (live_feeder);
+  listener = csmm_live_listener_new (session, live_feeder);
+  assert (listener);
+  zlist_append (live_call->listeners, listener);
+
+  csmm_subscribe_live_call (ctx, live_call);
+  TRACE (DEBUG, "Call <%u>: %zu listeners", live_call->id,
+      zlist_size (live_call->listeners));
+}
+
+
+//  --------------------------------------------------------------------------
+//  Publishes the response to a waiting interception request, the same
+//  frames as a direct response after the session and the call id
+//  Input:
+//    ctx: the Call Stream Media Manager context of the thread
+//    request: the waiting request
+//    response: the response, destroyed once sent
+
+static void
+csmm_notify_live_request (csmm_t *ctx, live_request_t *request,
+    zmsg_t **response_p)
+{
+  zmsg_pushstrf (*response_p, "%u", request->call_id);
+  zmsg_pushstr (*response_p, csstring_data (request->session));
+  if (zmsg_send (response_p, ctx->notifier) == -1) {
+    TRACE (ERROR, "Call <%u>: session <%s> not notified", request->call_id,
+        csstring_data (request->session));
+    zmsg_destroy (response_p);
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Takes a request out of the waiting requests and frees it
+//  Input:
+//    ctx: the Call Stream Media Manager context of the thread
+//    request: the waiting request
+
+static void
+csmm_remove_live_request (csmm_t *ctx, live_request_t *request)
+{
+  if (request->timer_id != -1) {
+    zloop_timer_end (ctx->loop, request->timer_id);
+  }
+  // The list destroys the request
+  zlist_remove (ctx->waiting, request);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Finds the waiting request of a session for a call
+//  Input:
+//    ctx: the Call Stream Media Manager context of the thread
+//    call_id: the call
+//    session: the session
+//  Output:
+//    The request or NULL
+
+static live_request_t*
+csmm_find_live_request (csmm_t *ctx, UINT32 call_id, const char * const session)
+{
+  live_request_t *request = (live_request_t *) zlist_first (ctx->waiting);
+
+  while (request && (request->call_id != call_id ||
+      !streq (csstring_data (request->session), session))) {
+    request = (live_request_t *) zlist_next (ctx->waiting);
+  }
+
+  return request;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the position of a request among the ones waiting for the same
+//  feeders, from 1
+
+static size_t
+csmm_live_request_position (csmm_t *ctx, live_request_t *request)
+{
+  size_t position = 1;
+  live_request_t *other = (live_request_t *) zlist_first (ctx->waiting);
+
+  while (other) {
+    if (other->free_list == request->free_list &&
+        csmm_live_request_precedes (other, request)) {
+      position++;
+    }
+    other = (live_request_t *) zlist_next (ctx->waiting);
+  }
+
+  return position;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Callback responsible for giving up a request that has waited too long
+//  Input:
+//    loop: the reactor
+//    timer_id: the timer of the request
+//    arg: the Call Stream Media Manager context of the thread
+//  Output:
+//    0: processed
+
+static int
+csmm_live_request_timeout_handler (zloop_t *loop, int timer_id, void *arg)
+{
+  csmm_t *ctx = (csmm_t *) arg;
+  live_request_t *request = (live_request_t *) zlist_first (ctx->waiting);
+  zmsg_t *response;
+
+  TRACE (FUNCTIONS, "Entering in csmm_live_request_timeout_handler");
+
+  while (request && request->timer_id != timer_id) {
+    request = (live_request_t *) zlist_next (ctx->waiting);
+  }
+
+  if (request) {
+    TRACE (DEBUG, "Call <%u>: session <%s> gave up waiting for a feeder",
+        request->call_id, csstring_data (request->session));
+    response = zmsg_new ();
+    zmsg_addstr (response, "NOK");
+    zmsg_addstr (response, "Feeder not available");
+    csmm_notify_live_request (ctx, request, &response);
+    // The timer of a single expiry is already gone
+    request->timer_id = -1;
+    csmm_remove_live_request (ctx, request);
+    ctx->waiting_expired++;
+  }
+
+  TRACE (FUNCTIONS, "Leaving csmm_live_request_timeout_handler");
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Puts an interception request to wait for a free feeder. A repeated
+//  request of a session keeps its place
+//  Input:
+//    ctx: the Call Stream Media Manager context of the thread
+//    live_call: the active call's representation
+//    call_format: the format of the stream url
+//    session: the session of the request
+//    free_list: the free feeders that can serve the call
+//    priority: the priority of the request
+//    timeout: the seconds the request waits at most, 0 = the default
+//    response: the response that will be sent to the requester
+//  Output:
+//    0: queued
+//   -1: not queued
+
+static int
+csmm_queue_live_call (csmm_t *ctx, live_call_t *live_call,
+    const char * const call_format, const char * const session,
+    zlist_t *free_list, int priority, int timeout, zmsg_t *response)
+{
+  live_request_t *request;
+
+  request = csmm_find_live_request (ctx, live_call->id, session);
+
+  if (!request) {
+    if (!ctx->notifier || !*session ||
+        zlist_size (ctx->waiting) >= ctx->waiting_max) {
+      return -1;
+    }
+    request = csmm_live_request_new (live_call->id, session, call_format,
+        free_list, priority, ctx->waiting_order++);
+    assert (request);
+    if (timeout <= 0) {
+      timeout = ctx->waiting_timeout;
+    }
+    request->timer_id = zloop_timer (ctx->loop, timeout * 1000, 1,
+        csmm_live_request_timeout_handler, ctx);
+    zlist_append (ctx->waiting, request);
+  }
+
+  TRACE (DEBUG, "Call <%u>: session <%s> waiting for a feeder, position %zu",
+      live_call->id, session, csmm_live_request_position (ctx, request));
+  zmsg_addstr (response, "WAIT");
+  zmsg_addstrf (response, "%zu", csmm_live_request_position (ctx, request));
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Gives up the waiting requests of a call, notifying them
+//  Input:
+//    ctx: the Call Stream Media Manager context of the thread
+//    call_id: the call
+//    reason: the reason notified
+
+static void
+csmm_cancel_live_requests (csmm_t *ctx, UINT32 call_id,
+    const char * const reason)
+{
+  live_request_t *request = (live_request_t *) zlist_first (ctx->waiting);
+  live_request_t *next;
+  zmsg_t *response;
+
+  while (request) {
+    next = (live_request_t *) zlist_next (ctx->waiting);
+    if (request->call_id == call_id) {
+      response = zmsg_new ();
+      zmsg_addstr (response, "NOK");
+      zmsg_addstr (response, reason);
+      csmm_notify_live_request (ctx, request, &response);
+      csmm_remove_live_request (ctx, request);
+      // The cursor of the list is lost when an item is removed
+      next = (live_request_t *) zlist_first (ctx->waiting);
+    }
+    request = next;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Serves the waiting requests with the free feeders, the first served by
+//  priority and, among the same priority, by arrival. Called whenever
+//  feeders are given back
+//  Input:
+//    ctx: the Call Stream Media Manager context of the thread
+
+static void
+csmm_grant_live_requests (csmm_t *ctx)
+{
+  live_request_t *request;
+  live_request_t *best;
+  live_call_t *live_call;
+  live_feeder_t *live_feeder;
+  zmsg_t *response;
+
+  do {
+    best = NULL;
+    request = (live_request_t *) zlist_first (ctx->waiting);
+    while (request) {
+      if (zlist_size (request->free_list) &&
+          (!best || csmm_live_request_precedes (request, best))) {
+        best = request;
+      }
+      request = (live_request_t *) zlist_next (ctx->waiting);
+    }
+
+    if (best) {
+      response = zmsg_new ();
+      live_call = csmm_find_live_call (ctx, best->call_id);
+      if (live_call && csmm_find_live_listener (live_call,
+          csstring_data (best->session))) {
+        // The session started listening, e.g. as a web client, meanwhile
+        TRACE (ERROR, "Call <%u>: session <%s> already listening",
+            best->call_id, csstring_data (best->session));
+        zmsg_addstr (response, "NOK");
+        zmsg_addstrf (response, "Session <%s> in use",
+            csstring_data (best->session));
+      } else if (live_call) {
+        live_feeder = (live_feeder_t *) zlist_pop (best->free_list);
+        csmm_live_call_add_listener (ctx, live_call,
+            csstring_data (best->session), live_feeder);
+        TRACE (DEBUG, "Call <%u>: session <%s> granted feeder <%s>",
+            best->call_id, csstring_data (best->session),
+            csstring_data (live_feeder->stream_name));
+        zmsg_addstr (response, "OK");
+        csmm_live_feeder_location (ctx, live_feeder, best->call_id,
+            csstring_data (best->call_format), response);
+        ctx->waiting_granted++;
+      } else {
+        zmsg_addstr (response, "NOK");
+        zmsg_addstrf (response, "Call <%u> not found", best->call_id);
+      }
+      csmm_notify_live_request (ctx, best, &response);
+      csmm_remove_live_request (ctx, best);
+    }
+  } while (best);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Removes an active call identified by call_id from the Media manager's thread
+//  context
+//  Input:
+//    The target Call Stream Media Manager context
+//    The call identifier
+//  Output:
+//    0: call removed
+//   -1: call not removed or not found
+
+static int
+csmm_remove_live_call (csmm_t *ctx, UINT32 call_id)
+{
+  int rc = 0;
+  live_call_t* live_call;
+
+  TRACE (FUNCTIONS, "Entering in csmm_remove_live_call");
+
+  live_call = csmm_find_live_call (ctx, call_id);
+
+  if (live_call) {
+    zlist_purge (live_call->listeners);
+    csmm_unsubscribe_live_call (ctx, live_call);
+    if (live_call->jitter) {
+      ctx->jitter_late += csjitter_late (live_call->jitter);
+      ctx->jitter_concealed += csjitter_concealed (live_call->jitter);
+      ctx->jitter_resyncs += csjitter_resyncs (live_call->jitter);
+    }
+    csmap_delete (ctx->live_calls, call_id);
+    csmm_cancel_live_requests (ctx, call_id, "Call released");
+    // Its feeders are free for the requests of other calls
+    csmm_grant_live_requests (ctx);
+  } else {
+    TRACE (ERROR, "Call with id <%u> not found", call_id);
+    rc = -1;
+  }
+
+  TRACE (FUNCTIONS, "Leaving csmm_remove_live_call");
 
   return rc;
 }
@@ -731,13 +1925,13 @@ csmm_get_live_calls (csmm_t *ctx, zmsg_t *response)
 
   TRACE (FUNCTIONS, "Entering in csmm_get_live_calls");
 
-  if (zlist_size (ctx->live_calls) > 0) {
-    zmsg_addstrf (response, "%zu", zlist_size (ctx->live_calls));
-    live_call_t *call = (live_call_t *) zlist_first (ctx->live_calls);
+  if (csmap_size (ctx->live_calls) > 0) {
+    zmsg_addstrf (response, "%zu", csmap_size (ctx->live_calls));
+    live_call_t *call = (live_call_t *) csmap_first (ctx->live_calls);
     while (call) {
       TRACE (DEBUG, "Call: %u", call->id);
       zmsg_addstrf (response, "%u", call->id);
-      call = (live_call_t *) zlist_next (ctx->live_calls);
+      call = (live_call_t *) csmap_next (ctx->live_calls);
     }
   } else {
     zmsg_addstr (response, "0");
@@ -750,70 +1944,93 @@ csmm_get_live_calls (csmm_t *ctx, zmsg_t *response)
 
 
 //  --------------------------------------------------------------------------
-//  Callback responsible for processing a received voice LogApi messages.
+//  Sends the voice of a received voice LogApi message to the listeners of
+//  its call
 //  Input:
-//    loop: the event-driven reactor
-//    reader: the descriptor with the data received ready to read
-//    arg: the Call Stream Media Manager context of the thread
+//    ctx: the Call Stream Media Manager context of the thread
+//    frame: the bus message
 //  Output:
 //    0: processed
 //   -1: not processed
 
 static int
-csmm_voice_data_handler (zloop_t *loop, zsock_t *reader, void *arg)
+csmm_voice_data_process (csmm_t *ctx, zframe_t *frame)
 {
   int rc = 0;
   UINT32 call_id;
-  csmm_t *ctx;
-  zmsg_t* msg;
-  char *tag;
-  zframe_t *timestamp;
-  zframe_t *log_api_msg;
-  zframe_t *data;
+  csbus_msg_t bus_msg;
+  UINT8 decoded[CS_VOICE_MAX_PAYLOAD_SIZE];
+  const UINT8 *alaw = NULL;
+  int alaw_len = -1;
 
-  TRACE (FUNCTIONS, "Entering in csmm_voice_data_handler");
-
-  ctx = (csmm_t *) arg;
-
-  msg = zmsg_recv (reader);
-  assert (msg);
-//  zmsg_print (msg);
-
-  tag = zmsg_popstr (msg);
-  timestamp = zmsg_pop (msg);
-  log_api_msg = zmsg_pop (msg);
-  data = zmsg_pop (msg);
+  TRACE (FUNCTIONS, "Entering in csmm_voice_data_process");
 
-  if (zframe_size (timestamp) != sizeof (time_t)) {
-    TRACE (ERROR, "Timestamp: Bad format");
-    rc = -1;
-  }
+  if (csbus_decode (frame, &bus_msg) == 0 && bus_msg.type == CSBUS_VOICE) {
 
-  rc = sscanf (tag, "V_%u", &call_id);
+    call_id = bus_msg.id;
+    live_call_t *call = csmm_find_live_call (ctx, call_id);
 
-  if (rc != EOF && rc > 0) {
+    // The native TETRA frames are decoded to A-law for the feeders
+    const LogApiVoice *voice = (const LogApiVoice *) bus_msg.log_api_msg;
+    if (voice->m_uiPayload1Info == PAYLOAD_INFO_G711) {
+      alaw = bus_msg.voice_data;
+      alaw_len = bus_msg.voice_data_size;
+    } else {
+      alaw = decoded;
+      alaw_len = cs_voice_decode (voice, bus_msg.voice_data,
+          bus_msg.voice_data_size, decoded, sizeof (decoded));
+    }
 
+    if (alaw_len == -1) {
+      TRACE (DEBUG, "Call <%u>: no decoder for payload <%u>",
+          call_id, voice->m_uiPayload1Info);
+    } else if (call) {
 
-    live_call_t *call = csmm_find_live_call (ctx, call_id);
-    if (call) {
+      // The expiry of the call checks this time when it is due
+      call->last_activity = zclock_mono ();
 
-      time_t now = time (NULL);
-      call->last_activity = now;
+      if (zlist_size (call->listeners)) {
 
-      if (call->live_feeder) {
+        //
+        // Put the frames in order. The streams A and B of duplex calls are
+        // merged frame by frame, aligned by sequence
+        //
+
+        if (ctx->jitter_depth > 0) {
+          StreamOriginatorEnum originator = voice->m_uiStreamOriginator;
+          if (call->call_type == 'D' && originator != STREAM_ORG_A_SUB &&
+              originator != STREAM_ORG_B_SUB) {
+            TRACE (DEBUG, "Duplex call <%u>. Bad originator: <%d>",
+                call->id, originator);
+          } else {
+            if (!call->jitter) {
+              call->jitter = csjitter_new (call->call_type == 'D' ? 2 : 1,
+                  ctx->jitter_depth, ctx->jitter_max_wait);
+              assert (call->jitter);
+            }
+            int channel = call->call_type == 'D' && originator == STREAM_ORG_B_SUB;
+            if (csjitter_push (call->jitter, channel,
+                voice->m_uiStreamRandomId, voice->m_uiPacketSeq, alaw, alaw_len,
+                zclock_mono ()) == -1) {
+              TRACE (DEBUG, "Call <%u>: late frame <%u>", call->id,
+                  voice->m_uiPacketSeq & 0x7f);
+            }
+            csmm_jitter_release (ctx, call);
+          }
+        }
 
         //
         // Duplex calls. Merge stream A and stream B frames
         //
 
-        if (call->call_type == 'D') {
+        else if (call->call_type == 'D') {
 
           //
           // Fetch the originator stream
           //
 
-          LogApiVoice *log_api_voice;
-          log_api_voice = (LogApiVoice *) zframe_data (log_api_msg);
+          const LogApiVoice *log_api_voice;
+          log_api_voice = (const LogApiVoice *) bus_msg.log_api_msg;
           StreamOriginatorEnum originator = log_api_voice->m_uiStreamOriginator;
           TRACE (DEBUG, "Duplex call. Originator: <%d>", originator);
 
@@ -827,11 +2044,11 @@ csmm_voice_data_handler (zloop_t *loop, zsock_t *reader, void *arg)
 
             if (originator == STREAM_ORG_A_SUB) {
               TRACE (DEBUG, "LMIG: Caching Channel 1");
-              call->voice_data_stream_a = zchunk_new (zframe_data (data), zframe_size (data));
+              call->voice_data_stream_a = zchunk_new (alaw, alaw_len);
             }
             if (originator == STREAM_ORG_B_SUB) {
               TRACE (DEBUG, "LMIG: Caching Channel 2");
-              call->voice_data_stream_b = zchunk_new (zframe_data (data), zframe_size (data));
+              call->voice_data_stream_b = zchunk_new (alaw, alaw_len);
             }
         
             if (call->voice_data_stream_a != NULL && call->voice_data_stream_b != NULL) {
@@ -842,16 +2059,17 @@ csmm_voice_data_handler (zloop_t *loop, zsock_t *reader, void *arg)
 
               TRACE (DEBUG, "LMIG: Merging channel 1 with channel 2");
 
-              zchunk_t *voice_data = zchunk_new (NULL, zchunk_size(call->voice_data_stream_a) +
-                                                       zchunk_size(call->voice_data_stream_b));
-
-              int block_size = zchunk_size(call->voice_data_stream_b);
-              int i = 0;
-
-              for (i = 0; i < block_size; i++) {
-                zchunk_append (voice_data, zchunk_data (call->voice_data_stream_a) + i, 1);
-                zchunk_append (voice_data, zchunk_data (call->voice_data_stream_b) + i, 1);
+              UINT8 voice_data[2 * CS_VOICE_MAX_PAYLOAD_SIZE];
+              size_t block_size = zchunk_size (call->voice_data_stream_b);
+              if (block_size > zchunk_size (call->voice_data_stream_a)) {
+                block_size = zchunk_size (call->voice_data_stream_a);
               }
+              if (block_size > CS_VOICE_MAX_PAYLOAD_SIZE) {
+                block_size = CS_VOICE_MAX_PAYLOAD_SIZE;
+              }
+
+              cs_interleave (zchunk_data (call->voice_data_stream_a),
+                  zchunk_data (call->voice_data_stream_b), block_size, voice_data);
 
               zchunk_destroy (&call->voice_data_stream_a);
               zchunk_destroy (&call->voice_data_stream_b);
@@ -862,17 +2080,7 @@ csmm_voice_data_handler (zloop_t *loop, zsock_t *reader, void *arg)
               // Broadcast merged frames
               //
 
-              TRACE (DEBUG, "Sending duplex data voice with call id <%u> to feeder <%s>",
-                  call->id, csstring_data (call->live_feeder->stream_name));
-
-              sendto (call->live_feeder->channel,
-                  zchunk_data (voice_data),
-                  zchunk_size (voice_data),
-                  0,
-                  (struct sockaddr *) &call->live_feeder->serv_addr,
-                  sizeof (call->live_feeder->serv_addr));
-
-              zchunk_destroy (&voice_data);
+              csmm_pace_voice (ctx, call, voice_data, 2 * block_size);
             }
           } else {
             TRACE (DEBUG, "LMIG: Channel 2 arrived without channel 1");
@@ -883,38 +2091,64 @@ csmm_voice_data_handler (zloop_t *loop, zsock_t *reader, void *arg)
           // Simplex and Group calls
           //
 
-          TRACE (DEBUG, "Sending data voice with call id <%u> to feeder <%s>",
-              call->id, csstring_data (call->live_feeder->stream_name));
-
           //
           // Broadcast frame
           //
 
-          sendto (call->live_feeder->channel,
-              zframe_data (data),
-              zframe_size (data),
-              0,
-              (struct sockaddr *) &call->live_feeder->serv_addr,
-              sizeof (call->live_feeder->serv_addr));
+          csmm_pace_voice (ctx, call, alaw, alaw_len);
         } 
       } else {
-        TRACE (ERROR, "No feeder found for call <%u>", call->id);
+        // Frames already queued when the interception stopped
+        TRACE (DEBUG, "No listener found for call <%u>", call->id);
         rc = -1;
       }
     } else {
-      TRACE (ERROR, "No call found for id <%u>", call->id);
+      TRACE (DEBUG, "No call found for id <%u>", call_id);
       rc = -1;
     }
   } else {
-    TRACE (ERROR, "Tag: Bad format");
+    TRACE (ERROR, "Bus message: Bad format");
     rc = -1;
   }
 
-  free (tag);
-  zframe_destroy (&timestamp);
-  zframe_destroy (&log_api_msg);
-  zframe_destroy (&data);
-  zmsg_destroy (&msg);
+  TRACE (FUNCTIONS, "Leaving csmm_voice_data_process");
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Callback responsible for processing the received voice LogApi messages.
+//  The messages already waiting are processed in the same wakeup and the
+//  datagrams for the feeders of all the calls are sent together at the end
+//  Input:
+//    loop: the event-driven reactor
+//    reader: the descriptor with the data received ready to read
+//    arg: the Call Stream Media Manager context of the thread
+//  Output:
+//    0: processed
+
+static int
+csmm_voice_data_handler (zloop_t *loop, zsock_t *reader, void *arg)
+{
+  csmm_t *ctx = (csmm_t *) arg;
+  zframe_t *frame;
+  size_t drained = 0;
+  size_t max_drained = ctx->egress ? csegress_capacity (ctx->egress) : 1;
+
+  TRACE (FUNCTIONS, "Entering in csmm_voice_data_handler");
+
+  do {
+    frame = zframe_recv (reader);
+    assert (frame);
+    csmm_voice_data_process (ctx, frame);
+    zframe_destroy (&frame);
+    drained++;
+  } while (drained < max_drained && (zsock_events (reader) & ZMQ_POLLIN));
+
+  if (ctx->egress) {
+    csegress_flush (ctx->egress);
+  }
 
   TRACE (FUNCTIONS, "Leaving csmm_voice_data_handler");
 
@@ -923,129 +2157,519 @@ csmm_voice_data_handler (zloop_t *loop, zsock_t *reader, void *arg)
 
 
 //  --------------------------------------------------------------------------
-//  Callback responsible for processing a call interception request.
+//  Callback responsible for processing a call interception request. Every
+//  session is a listener with its own feeder. A repeated request of a session
+//  gets the stream of its listener again. When all the feeders are busy, a
+//  request with a session waits for one and its response is published later
 //  Input:
 //    ctx: the Call Stream Media Manager context of the thread
 //    call_id: identification of the call to be intercepted
+//    call_format: the format of the stream url
+//    session: the session of the listener ("" when the request has none)
+//    priority: the priority of the request when it waits
+//    timeout: the seconds the request waits at most, 0 = the default
 //    response: the response that will be sent to the requester
 //  Output:
 //    0: processed
 //   -1: not processed
 
 static int
-csmm_start_broadcast_live_call (csmm_t *ctx, UINT32 call_id, char *call_format, zmsg_t *response)
+csmm_start_broadcast_live_call (csmm_t *ctx, UINT32 call_id, char *call_format,
+    const char * const session, int priority, int timeout, zmsg_t *response)
 {
   int rc = 0;
+  live_listener_t *listener;
 
   TRACE (FUNCTIONS, "Entering in csmm_start_broadcast_live_call");
 
-  live_call_t *call = csmm_find_live_call (ctx, call_id);
+  live_call_t *call = csmm_find_live_call (ctx, call_id);
+
+  if (call) {
+    listener = csmm_find_live_listener (call, session);
+    if (listener && listener->web) {
+        TRACE (ERROR, "Call <%u>: session <%s> is a web client", call_id, session);
+        zmsg_addstr (response, "NOK");
+        zmsg_addstrf (response, "Session <%s> in use", session);
+        rc = -1;
+    } else if (listener) {
+        zmsg_addstr (response, "OK");
+        csmm_live_feeder_location (ctx, listener->live_feeder, call_id,
+            call_format, response);
+    } else {
+      live_feeder_t *live_feeder = NULL;
+      zlist_t *free_list = NULL;
+
+      // A live_feeder is apropiate to handle a call whenever:
+      //  The feeder is free
+      //  and
+      //    The call type is "D"uplex and the feeder type is "S"tereo
+      //    or
+      //    The call type is "S"implex or "G"roup and the feeder type is "M"ono
+
+      if (call->call_type == 'D') {
+        free_list = ctx->free_stereo_feeders;
+      } else if (call->call_type == 'S' || call->call_type == 'G') {
+        free_list = ctx->free_mono_feeders;
+      }
+      if (free_list) {
+        live_feeder = (live_feeder_t *) zlist_pop (free_list);
+      }
+
+      if (live_feeder) {
+        csmm_live_call_add_listener (ctx, call, session, live_feeder);
+        zmsg_addstr (response, "OK");
+        csmm_live_feeder_location (ctx, live_feeder, call_id, call_format,
+            response);
+      } else if (free_list && csmm_queue_live_call (ctx, call, call_format,
+          session, free_list, priority, timeout, response) == 0) {
+        TRACE (DEBUG, "No available feeder resource found for call with id <%u>"
+            ", request queued", call_id);
+      } else {
+        TRACE (ERROR, "No available feeder resource found for call with id <%u>",
+            call_id);
+        zmsg_addstr (response, "NOK");
+        zmsg_addstr (response, "Feeder not available");
+        rc = -1;
+      }
+    }
+  } else {
+    TRACE (ERROR, "Call with id <%u> not found", call_id);
+    zmsg_addstr (response, "NOK");
+    zmsg_addstrf (response, "Call <%u> not found", call_id);
+    rc = -1;
+  }
+
+  TRACE (FUNCTIONS, "Leaving csmm_start_broadcast_live_call");
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Callback responsible for processing the stop call interception request.
+//  Input:
+//    ctx: the Call Stream Media Manager context of the thread
+//    call_id: identification of the call to be intercepted
+//    session: the listener to stop or NULL to stop all the listeners
+//    response: the response that will be sent to the requester
+//  Output:
+//    0: processed
+//   -1: not processed
+
+static int
+csmm_stop_broadcast_live_call (csmm_t *ctx, UINT32 call_id,
+    const char * const session, zmsg_t *response)
+{
+  int rc = 0;
+  live_listener_t *listener = NULL;
+  live_request_t *request;
+
+  TRACE (FUNCTIONS, "Entering in csmm_stop_broadcast_live_call");
+
+  live_call_t *call = csmm_find_live_call (ctx, call_id);
+
+  if (call) {
+    if (session) {
+      listener = csmm_find_live_listener (call, session);
+    }
+    if (listener) {
+      // The list destroys the listener
+      zlist_remove (call->listeners, listener);
+    } else if (session && (request = csmm_find_live_request (ctx, call_id,
+        session))) {
+      csmm_remove_live_request (ctx, request);
+    } else if (!session && zlist_size (call->listeners)) {
+      zlist_purge (call->listeners);
+    } else {
+      rc = -1;
+    }
+
+    if (rc == 0 && !session) {
+      csmm_cancel_live_requests (ctx, call_id, "Interception stopped");
+    }
+
+    if (rc == 0 && zlist_size (call->listeners) == 0) {
+      csmm_unsubscribe_live_call (ctx, call);
+    }
+
+    if (rc == -1) {
+      TRACE (ERROR, "Call with id <%u> not intercepted", call_id);
+      zmsg_addstr (response, "NOK");
+      zmsg_addstrf (response, "Call <%u> not intercepted", call_id);
+    }
+  } else {
+    TRACE (ERROR, "Call with id <%u> not found", call_id);
+    zmsg_addstr (response, "NOK");
+    zmsg_addstrf (response, "Call <%u> not found", call_id);
+    rc = -1;
+  }
+
+  if (rc == 0) {
+    zmsg_addstr (response, "OK");
+    zmsg_addstr (response, "OK");
+    csmm_grant_live_requests (ctx);
+  }
+
+  TRACE (FUNCTIONS, "Leaving csmm_stop_broadcast_live_call");
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Verifies if the input parameter is a web client whose request is not
+//  complete
+
+static bool
+csmm_http_request_is (void *self)
+{
+  assert (self);
+  return ((http_request_t *) self)->tag == HTTP_REQUEST_TAG;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Creates a web client whose request is not complete
+//  Input:
+//    web: the web client
+//  Output:
+//    The created request
+
+static http_request_t *
+csmm_http_request_new (csweb_t *web)
+{
+  http_request_t *self = (http_request_t *) zmalloc (sizeof (http_request_t));
+  if (self) {
+    self->tag = HTTP_REQUEST_TAG;
+    self->web = web;
+    cswheel_timer_init (&self->expiry, self);
+  }
+
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees a web client whose request is not complete, with its timeout and
+//  its web client when it is still there. Used as destructor of the list
+//  Input:
+//    The target request
+
+static void
+csmm_http_request_destroy (http_request_t **self_p)
+{
+  assert (self_p);
+  if (*self_p) {
+    http_request_t *self = *self_p;
+    assert (csmm_http_request_is (self));
+    cswheel_cancel (&self->expiry);
+    csweb_destroy (&self->web);
+    free (self);
+    *self_p = NULL;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees a web client whose request is not complete
+//  Input:
+//    A request
+
+static void
+csmm_http_request_destructor (void **item)
+{
+  csmm_http_request_destroy ((http_request_t **) item);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Closes a web client that hasn't completed its request in time
+//  Input:
+//    ctx: the Call Stream Media Manager context of the thread
+//    request: the request
+
+static void
+csmm_http_request_expire (csmm_t *ctx, http_request_t *request)
+{
+  zmq_pollitem_t item = { 0, csweb_fd (request->web), ZMQ_POLLIN, 0 };
+
+  TRACE (DEBUG, "Web client: request not complete after %d seconds",
+      ctx->http_request_timeout);
+  zloop_poller_end (ctx->loop, &item);
+  csweb_reject (request->web, 408, "Request Timeout");
+  zlist_remove (ctx->http_requests, request);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Callback responsible for reading what a streaming web client sends. A
+//  client that closes its connection or sends a WebSocket Close leaves the
+//  call
+//  Input:
+//    loop: the reactor
+//    item: the socket of the web client
+//    arg: the Call Stream Media Manager context of the thread
+//  Output:
+//    0: processed
+
+static int
+csmm_http_listener_handler (zloop_t *loop, zmq_pollitem_t *item, void *arg)
+{
+  csmm_t *ctx = (csmm_t *) arg;
+  live_listener_t *listener = NULL;
+
+  TRACE (FUNCTIONS, "Entering in csmm_http_listener_handler");
+
+  live_call_t *call = (live_call_t *) csmap_first (ctx->live_calls);
+  while (call) {
+    listener = (live_listener_t *) zlist_first (call->listeners);
+    while (listener &&
+        (!listener->web || csweb_fd (listener->web) != item->fd)) {
+      listener = (live_listener_t *) zlist_next (call->listeners);
+    }
+    if (listener) {
+      break;
+    }
+    call = (live_call_t *) csmap_next (ctx->live_calls);
+  }
+
+  if (!listener) {
+    zloop_poller_end (loop, item);
+  } else if (csweb_read (listener->web) == -1) {
+    TRACE (DEBUG, "Call <%u>: web client <%s> gone", call->id,
+        csstring_data (listener->session));
+    // The listener ends its poller
+    zlist_remove (call->listeners, listener);
+    if (zlist_size (call->listeners) == 0) {
+      csmm_unsubscribe_live_call (ctx, call);
+    }
+  }
+
+  TRACE (FUNCTIONS, "Leaving csmm_http_listener_handler");
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Starts the stream of a web client whose request is complete. The client
+//  becomes a listener of the call in its request
+//  Input:
+//    ctx: the Call Stream Media Manager context of the thread
+//    web: the web client
+
+static void
+csmm_http_start_listener (csmm_t *ctx, csweb_t *web)
+{
+  const char *path = csweb_path (web);
+  const char *session = csweb_session (web);
+  char generated[CSMM_TMP_BUFFER];
+  char *end = NULL;
+  UINT32 call_id = 0;
+  live_call_t *call = NULL;
+  live_listener_t *listener;
+
+  TRACE (FUNCTIONS, "Entering in csmm_http_start_listener");
+
+  // GET /live/<call id>[.wav]
+  if (strncmp (path, "/live/", 6) == 0) {
+    call_id = strtoul (path + 6, &end, 10);
+  }
+  if (!end || end == path + 6 || (*end && strcmp (end, ".wav") != 0)) {
+    csweb_reject (web, 400, "Bad Request");
+    csweb_destroy (&web);
+  } else if (!(call = csmm_find_live_call (ctx, call_id))) {
+    TRACE (DEBUG, "Web client: call <%u> not found", call_id);
+    csweb_reject (web, 404, "Not Found");
+    csweb_destroy (&web);
+  } else {
+    if (!session) {
+      snprintf (generated, sizeof (generated), "web-%d", csweb_fd (web));
+      session = generated;
+    }
+    // A session listens once, streaming or waiting for a feeder
+    if (csmm_find_live_listener (call, session) ||
+        csmm_find_live_request (ctx, call_id, session)) {
+      csweb_reject (web, 409, "Conflict");
+      csweb_destroy (&web);
+    }
+  }
+
+  if (web) {
+    listener = csmm_live_listener_new (session, NULL);
+    assert (listener);
+    listener->web = web;
+    if (csweb_start (web, call->call_type == 'D' ? 2 : 1) == -1) {
+      csmm_live_listener_destroy (&listener);
+    } else {
+      // The client is read to see it leave while the call is silent
+      zmq_pollitem_t item = { 0, csweb_fd (web), ZMQ_POLLIN, 0 };
+      if (zloop_poller (ctx->loop, &item, csmm_http_listener_handler,
+          ctx) == 0) {
+        listener->loop = ctx->loop;
+      }
+      zlist_append (call->listeners, listener);
+      csmm_subscribe_live_call (ctx, call);
+      TRACE (DEBUG, "Call <%u>: %s client <%s>, %zu listeners", call_id,
+          csweb_is_websocket (web) ? "WebSocket" : "HTTP", session,
+          zlist_size (call->listeners));
+    }
+  }
+
+  TRACE (FUNCTIONS, "Leaving csmm_http_start_listener");
+}
+
+
+//  --------------------------------------------------------------------------
+//  Callback responsible for reading the request of a web client
+//  Input:
+//    loop: the reactor
+//    item: the socket of the web client
+//    arg: the Call Stream Media Manager context of the thread
+//  Output:
+//    0: processed
+
+static int
+csmm_http_request_handler (zloop_t *loop, zmq_pollitem_t *item, void *arg)
+{
+  csmm_t *ctx = (csmm_t *) arg;
+  csweb_t *web;
+  int rc;
+
+  TRACE (FUNCTIONS, "Entering in csmm_http_request_handler");
+
+  http_request_t *request = (http_request_t *) zlist_first (ctx->http_requests);
+  while (request && csweb_fd (request->web) != item->fd) {
+    request = (http_request_t *) zlist_next (ctx->http_requests);
+  }
+
+  rc = request ? csweb_read_request (request->web) : -1;
+
+  // Once streaming, the web client is read by its listener's poller
+  if (rc != 0) {
+    zloop_poller_end (loop, item);
+  }
+  if (request && rc != 0) {
+    web = NULL;
+    if (rc == 1) {
+      // The web client goes from its request to its listener
+      web = request->web;
+      request->web = NULL;
+    }
+    zlist_remove (ctx->http_requests, request);
+    if (web) {
+      csmm_http_start_listener (ctx, web);
+    }
+  }
+
+  TRACE (FUNCTIONS, "Leaving csmm_http_request_handler");
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Callback responsible for accepting the connections of the web clients
+//  Input:
+//    loop: the reactor
+//    item: the listening socket of the live streaming endpoint
+//    arg: the Call Stream Media Manager context of the thread
+//  Output:
+//    0: processed
+
+static int
+csmm_http_accept_handler (zloop_t *loop, zmq_pollitem_t *item, void *arg)
+{
+  csmm_t *ctx = (csmm_t *) arg;
+  int fd;
+  int nodelay = 1;
+
+  TRACE (FUNCTIONS, "Entering in csmm_http_accept_handler");
 
-  if (call) {
-    if (call->live_feeder && call->live_feeder->free == false) {
-        zmsg_addstr (response, "OK");
-        zmsg_addstrf (response, "%s/%s.%s", csstring_data (ctx->media_server_endpoint),
-            csstring_data (call->live_feeder->stream_name), call_format);
+  while ((fd = accept (item->fd, NULL, NULL)) != -1) {
+    if (csweb_connections () >= (size_t) ctx->http_max_clients) {
+      TRACE (ERROR, "Web client rejected: %d clients", ctx->http_max_clients);
+      close (fd);
+      continue;
+    }
+    fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+
+    // The voice blocks are sent as soon as they arrive
+    setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof (nodelay));
+
+    csweb_t *web = csweb_new (fd);
+    http_request_t *request = web ? csmm_http_request_new (web) : NULL;
+    if (request) {
+      zmq_pollitem_t client = { 0, fd, ZMQ_POLLIN, 0 };
+      zlist_append (ctx->http_requests, request);
+      zloop_poller (loop, &client, csmm_http_request_handler, ctx);
+      cswheel_schedule (ctx->expiry_wheel, &request->expiry,
+          zclock_mono () + (int64_t) ctx->http_request_timeout * 1000);
     } else {
-      live_feeder_t *live_feeder = (live_feeder_t *) zlist_first (ctx->live_feeders);
-      while (live_feeder) {
-
-        // A live_feeder is apropiate to handle a call whenever:
-        //  The feeder is free
-        //  and
-        //    The call type is "D"uplex and the feeder type is "S"tereo
-        //    or
-        //    The call type is "S"implex or "G"roup and the feeder type is "M"ono
-
-        if (
-             (live_feeder->free) && 
-             (
-               (call->call_type == 'D' && live_feeder->feeder_type == 'S') || 
-               ((call->call_type == 'S' || call->call_type == 'G') && live_feeder->feeder_type == 'M')
-             )
-           )
-          break;
-        else
-          live_feeder = (live_feeder_t *) zlist_next (ctx->live_feeders);
-      }
-      if (live_feeder) {
-        live_feeder->free = false;
-        call->live_feeder = live_feeder;
-        call->subscriber = zsock_new_sub (">inproc://collector", 0);
-        assert (call->subscriber);
-        char call_id_str[64];
-        snprintf (call_id_str, 64, "V_%u", call_id);
-        zsock_set_subscribe (call->subscriber, call_id_str);
-        rc = zloop_reader (ctx->loop, call->subscriber, csmm_voice_data_handler,
-            ctx);
-        zmsg_addstr (response, "OK");
-        zmsg_addstrf (response, "%s/%s.%s", csstring_data (ctx->media_server_endpoint),
-            csstring_data (live_feeder->stream_name), call_format);
-      } else {
-        TRACE (ERROR, "No available feeder resource found for call with id <%u>",
-            call_id);
-        zmsg_addstr (response, "NOK");
-        zmsg_addstr (response, "Feeder not available");
-        rc = -1;
-      }
+      csweb_destroy (&web);
     }
-  } else {
-    TRACE (ERROR, "Call with id <%u> not found", call_id);
-    zmsg_addstr (response, "NOK");
-    zmsg_addstrf (response, "Call <%u> not found", call_id);
-    rc = -1;
   }
 
-  TRACE (FUNCTIONS, "Leaving csmm_start_broadcast_live_call");
+  if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+    TRACE (ERROR, "Error: accept(), errno=%d text=%s", errno, strerror (errno));
+  }
 
-  return rc;
+  TRACE (FUNCTIONS, "Leaving csmm_http_accept_handler");
+
+  return 0;
 }
 
 
 //  --------------------------------------------------------------------------
-//  Callback responsible for processing the stop call interception request.
+//  Opens the live streaming endpoint, where the web clients get the voice
+//  of the calls without any feeder
 //  Input:
-//    ctx: the Call Stream Media Manager context of the thread
-//    call_id: identification of the call to be intercepted
-//    response: the response that will be sent to the requester
+//    The target Call Stream Media Manager context
 //  Output:
-//    0: processed
-//   -1: not processed
+//    0 - Ok
+//   -1 - Nok
 
 static int
-csmm_stop_broadcast_live_call (csmm_t *ctx, UINT32 call_id, zmsg_t *response)
+csmm_http_start (csmm_t *ctx)
 {
   int rc = 0;
+  int reuse_addr = 1;
+  struct sockaddr_in serv_addr;
 
-  TRACE (FUNCTIONS, "Entering in csmm_stop_broadcast_live_call");
+  TRACE (FUNCTIONS, "Entering in csmm_http_start");
 
-  live_call_t *call = csmm_find_live_call (ctx, call_id);
+  if ((ctx->http_channel = socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK,
+      IPPROTO_TCP)) == -1) {
+    TRACE (ERROR, "Error: socket(), errno=%d text=%s", errno, strerror (errno));
+    rc = -1;
+  }
 
-  if (call) {
-    if (call->live_feeder && (call->live_feeder->free == false)) {
-      call->live_feeder->free = true;
-      call->live_feeder = NULL;
-      zloop_reader_end(ctx->loop, call->subscriber);
-      zsock_destroy(&call->subscriber);
-    } else {
-      TRACE (ERROR, "Call with id <%u> not intercepted", call_id);
-      zmsg_addstr (response, "NOK");
-      zmsg_addstrf (response, "Call <%u> not intercepted", call_id);
+  if (!rc) {
+    setsockopt (ctx->http_channel, SOL_SOCKET, SO_REUSEADDR,
+        &reuse_addr, sizeof (reuse_addr));
+    memset ((char *) &serv_addr, 0, sizeof (serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons (ctx->http_port);
+    serv_addr.sin_addr.s_addr = htonl (INADDR_ANY);
+    if (bind (ctx->http_channel, (struct sockaddr *) &serv_addr,
+        sizeof (serv_addr)) == -1 || listen (ctx->http_channel, SOMAXCONN) == -1) {
+      TRACE (ERROR, "Error: bind(%d), errno=%d text=%s",
+          ctx->http_port, errno, strerror (errno));
       rc = -1;
     }
-  } else {
-    TRACE (ERROR, "Call with id <%u> not found", call_id);
-    zmsg_addstr (response, "NOK");
-    zmsg_addstrf (response, "Call <%u> not found", call_id);
-    rc = -1;
   }
 
-  if (rc == 0) {
-    zmsg_addstr (response, "OK");
-    zmsg_addstr (response, "OK");
+  if (!rc) {
+    zmq_pollitem_t item = { 0, ctx->http_channel, ZMQ_POLLIN, 0 };
+    rc = zloop_poller (ctx->loop, &item, csmm_http_accept_handler, ctx);
   }
 
-  TRACE (FUNCTIONS, "Leaving csmm_stop_broadcast_live_call");
+  if (rc && ctx->http_channel != -1) {
+    close (ctx->http_channel);
+    ctx->http_channel = -1;
+  }
+
+  TRACE (FUNCTIONS, "Leaving csmm_http_start");
 
   return rc;
 }
@@ -1602,6 +3226,75 @@ csmm_stop_play_call_v2 (csmm_t *ctx, char* call_type, UINT32 call_id, UINT32 cal
   return rc;
 }
 
+//  --------------------------------------------------------------------------
+//  Adds the statistics of the media manager to a response, one name=value
+//  per frame
+//  Input:
+//    ctx: the Call Stream Media Manager context
+//    response: the response
+
+static void
+csmm_stats (csmm_t *ctx, zmsg_t *response)
+{
+  size_t i;
+  uint64_t jitter_late = ctx->jitter_late;
+  uint64_t jitter_concealed = ctx->jitter_concealed;
+  uint64_t jitter_resyncs = ctx->jitter_resyncs;
+  live_call_t *call;
+
+  TRACE (FUNCTIONS, "Entering in csmm_stats");
+
+  zmsg_addstrf (response, "live_calls=%zu", csmap_size (ctx->live_calls));
+  zmsg_addstrf (response, "free_mono_feeders=%zu",
+      zlist_size (ctx->free_mono_feeders));
+  zmsg_addstrf (response, "free_stereo_feeders=%zu",
+      zlist_size (ctx->free_stereo_feeders));
+  zmsg_addstrf (response, "web_clients=%zu", csweb_connections ());
+  zmsg_addstrf (response, "waiting=%zu", zlist_size (ctx->waiting));
+  zmsg_addstrf (response, "waiting_granted=%" PRIu64, ctx->waiting_granted);
+  zmsg_addstrf (response, "waiting_expired=%" PRIu64, ctx->waiting_expired);
+
+  if (ctx->egress) {
+    zmsg_addstrf (response, "egress_batch=%zu", csegress_capacity (ctx->egress));
+    zmsg_addstrf (response, "egress_flushes=%" PRIu64,
+        csegress_flushes (ctx->egress));
+    zmsg_addstrf (response, "egress_sent=%" PRIu64, csegress_sent (ctx->egress));
+    zmsg_addstrf (response, "egress_dropped=%" PRIu64,
+        csegress_dropped (ctx->egress));
+    for (i = 0; i <= csegress_capacity (ctx->egress); i++) {
+      if (csegress_batches (ctx->egress, i)) {
+        zmsg_addstrf (response, "egress_batch_%zu=%" PRIu64, i,
+            csegress_batches (ctx->egress, i));
+      }
+    }
+  } else {
+    zmsg_addstr (response, "egress_batch=0");
+  }
+
+  zmsg_addstrf (response, "playout_delay=%d",
+      ctx->media_wheel ? ctx->playout_delay : 0);
+  zmsg_addstrf (response, "paced_blocks=%" PRIu64, ctx->paced_blocks);
+  zmsg_addstrf (response, "paced_drops=%" PRIu64, ctx->paced_drops);
+  zmsg_addstrf (response, "paced_restarts=%" PRIu64, ctx->paced_restarts);
+
+  call = (live_call_t *) csmap_first (ctx->live_calls);
+  while (call) {
+    if (call->jitter) {
+      jitter_late += csjitter_late (call->jitter);
+      jitter_concealed += csjitter_concealed (call->jitter);
+      jitter_resyncs += csjitter_resyncs (call->jitter);
+    }
+    call = (live_call_t *) csmap_next (ctx->live_calls);
+  }
+  zmsg_addstrf (response, "jitter_depth=%d", ctx->jitter_depth);
+  zmsg_addstrf (response, "jitter_late=%" PRIu64, jitter_late);
+  zmsg_addstrf (response, "jitter_concealed=%" PRIu64, jitter_concealed);
+  zmsg_addstrf (response, "jitter_resyncs=%" PRIu64, jitter_resyncs);
+
+  TRACE (FUNCTIONS, "Leaving csmm_stats");
+}
+
+
 //  --------------------------------------------------------------------------
 //  Callback handler. Analyzes and process commands sent by the parent thread
 //  through the shared pipe and api requests sent by external clients.
@@ -1649,19 +3342,39 @@ csmm_command_handler (zloop_t *loop, zsock_t *reader, void *arg)
     zmsg_t *response = zmsg_new ();
     UINT32 call_id = zmsg_popint (msg);
     char *call_format = zmsg_popstr (msg);
+    char *session = zmsg_popstr (msg);
+    char *priority = zmsg_popstr (msg);
+    char *timeout = zmsg_popstr (msg);
     TRACE (DEBUG, "CallId: <%u>", call_id);
     TRACE (DEBUG, "CallFormat: <%s>", call_format);
-    csmm_start_broadcast_live_call (ctx, call_id, call_format, response);
+    TRACE (DEBUG, "Session: <%s>", session ? session : "");
+    TRACE (DEBUG, "Priority: <%s>", priority ? priority : "0");
+    csmm_start_broadcast_live_call (ctx, call_id, call_format,
+        session ? session : "", priority ? atoi (priority) : 0,
+        timeout ? atoi (timeout) : 0, response);
     zmsg_send (&response, reader);
     free (call_format);
+    free (session);
+    free (priority);
+    free (timeout);
   }
 
   if ((!command_handled) && streq (command, "STOP_CALL_INTERCEPTION")) {
     command_handled = true;
     zmsg_t *response = zmsg_new ();
     UINT32 call_id = zmsg_popint (msg);
+    char *session = zmsg_popstr (msg);
     TRACE (DEBUG, "CallId: <%u>", call_id);
-    csmm_stop_broadcast_live_call (ctx, call_id, response);
+    TRACE (DEBUG, "Session: <%s>", session ? session : "all");
+    csmm_stop_broadcast_live_call (ctx, call_id, session, response);
+    zmsg_send (&response, reader);
+    free (session);
+  }
+
+  if ((!command_handled) && streq (command, "STATS")) {
+    command_handled = true;
+    zmsg_t *response = zmsg_new ();
+    csmm_stats (ctx, response);
     zmsg_send (&response, reader);
   }
 
@@ -1736,6 +3449,122 @@ csmm_command_handler (zloop_t *loop, zsock_t *reader, void *arg)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Handles a LogApiDuplexCallChange message. A new call is inserted as live call
+//  Input:
+//    ctx: the Call Stream Media Manager context
+//    log_api_msg: the LogApiDuplexCallChange message
+
+static void
+csmm_handle_duplex_call_change (csmm_t *ctx, const void * const log_api_msg)
+{
+  const LogApiDuplexCallChange * const duplex_call_change =
+      (const LogApiDuplexCallChange *) log_api_msg;
+
+  if (duplex_call_change->m_uiAction == INDI_NEWCALLSETUP) {
+    csmm_insert_live_call (ctx, duplex_call_change->m_uiCallId, 'D');
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiDuplexCallRelease message. The call is removed from the live calls
+//  Input:
+//    ctx: the Call Stream Media Manager context
+//    log_api_msg: the LogApiDuplexCallRelease message
+
+static void
+csmm_handle_duplex_call_release (csmm_t *ctx, const void * const log_api_msg)
+{
+  const LogApiDuplexCallRelease * const duplex_call_release =
+      (const LogApiDuplexCallRelease *) log_api_msg;
+
+  csmm_remove_live_call (ctx, duplex_call_release->m_uiCallId);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiSimplexCallStartChange message. A new call is inserted as live call
+//  Input:
+//    ctx: the Call Stream Media Manager context
+//    log_api_msg: the LogApiSimplexCallStartChange message
+
+static void
+csmm_handle_simplex_call_start_change (csmm_t *ctx, const void * const log_api_msg)
+{
+  const LogApiSimplexCallStartChange * const simplex_call_start_change =
+      (const LogApiSimplexCallStartChange *) log_api_msg;
+
+  if (simplex_call_start_change->m_uiAction == INDI_NEWCALLSETUP) {
+    csmm_insert_live_call (ctx, simplex_call_start_change->m_uiCallId, 'S');
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiSimplexCallRelease message. The call is removed from the live calls
+//  Input:
+//    ctx: the Call Stream Media Manager context
+//    log_api_msg: the LogApiSimplexCallRelease message
+
+static void
+csmm_handle_simplex_call_release (csmm_t *ctx, const void * const log_api_msg)
+{
+  const LogApiSimplexCallRelease * const simplex_call_release =
+      (const LogApiSimplexCallRelease *) log_api_msg;
+
+  csmm_remove_live_call (ctx, simplex_call_release->m_uiCallId);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiGroupCallStartChange message. A new call is inserted as live call
+//  Input:
+//    ctx: the Call Stream Media Manager context
+//    log_api_msg: the LogApiGroupCallStartChange message
+
+static void
+csmm_handle_group_call_start_change (csmm_t *ctx, const void * const log_api_msg)
+{
+  const LogApiGroupCallStartChange * const group_call_start_change =
+      (const LogApiGroupCallStartChange *) log_api_msg;
+
+  if (group_call_start_change->m_uiAction == GROUPCALL_NEWCALLSETUP) {
+    csmm_insert_live_call (ctx, group_call_start_change->m_uiCallId, 'G');
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiGroupCallRelease message. The call is removed from the live calls
+//  Input:
+//    ctx: the Call Stream Media Manager context
+//    log_api_msg: the LogApiGroupCallRelease message
+
+static void
+csmm_handle_group_call_release (csmm_t *ctx, const void * const log_api_msg)
+{
+  const LogApiGroupCallRelease * const group_call_release =
+      (const LogApiGroupCallRelease *) log_api_msg;
+
+  csmm_remove_live_call (ctx, group_call_release->m_uiCallId);
+}
+
+
+// Handlers of the LogApi message types indexed by MsgId
+
+typedef void (csmm_handler_fn) (csmm_t *ctx, const void * const log_api_msg);
+
+static csmm_handler_fn * const csmm_handlers[CS_LOG_API_MSG_ID_COUNT] = {
+  [LOG_API_DUPLEX_CALL_CHANGE] = csmm_handle_duplex_call_change,
+  [LOG_API_DUPLEX_CALL_RELEASE] = csmm_handle_duplex_call_release,
+  [LOG_API_SIMPLEX_CALL_CHANGE] = csmm_handle_simplex_call_start_change,
+  [LOG_API_SIMPLEX_CALL_RELEASE] = csmm_handle_simplex_call_release,
+  [LOG_API_GROUP_CALL_CHANGE] = csmm_handle_group_call_start_change,
+  [LOG_API_GROUP_CALL_RELEASE] = csmm_handle_group_call_release
+};
+
+
 //  --------------------------------------------------------------------------
 //  Callback responsible for processing a received call setup or call release
 //  LogApi message.
@@ -1750,117 +3579,34 @@ csmm_command_handler (zloop_t *loop, zsock_t *reader, void *arg)
 static int
 csmm_voice_signaling_handler (zloop_t *loop, zsock_t *reader, void *arg)
 {
-  int rc;
-  UINT32 msg_id;
-  UINT32 call_id;
+  const cs_log_api_descriptor_t *descriptor = NULL;
   csmm_t *ctx;
-  zmsg_t* msg;
-  char *tag;
-  zframe_t *timestamp;
-  zframe_t *log_api_msg;
+  zframe_t *frame;
+  csbus_msg_t bus_msg;
 
   TRACE (FUNCTIONS, "Entering in csmm_voice_signaling_handler");
 
   ctx = (csmm_t *) arg;
 
-  msg = zmsg_recv (reader);
-  assert (msg);
-//  zmsg_print (msg);
-
-  tag = zmsg_popstr (msg);
-  timestamp = zmsg_pop (msg);
-  log_api_msg = zmsg_pop (msg);
+  frame = zframe_recv (reader);
+  assert (frame);
 
-  if (zframe_size (timestamp) != sizeof (time_t)) {
-    TRACE (ERROR, "Timestamp: Bad format");
+  if (csbus_decode (frame, &bus_msg) == -1) {
+    TRACE (ERROR, "Bus message: Bad format");
+  } else if (bus_msg.type == CSBUS_SIGNALING) {
+    descriptor = cs_log_api_descriptor ((UINT8) bus_msg.id);
   }
 
-  rc = sscanf (tag, "S_%u", &msg_id);
-
-  if (rc != EOF && rc > 0) {
-    switch (msg_id) {
-    case LOG_API_DUPLEX_CALL_CHANGE:
-      TRACE (DEBUG, "Message type: LOG_API_DUPLEX_CALL_CHANGE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiDuplexCallChange)) {
-        LogApiDuplexCallChange *duplex_call_change =
-            (LogApiDuplexCallChange *) zframe_data (log_api_msg);
-        if (duplex_call_change->m_uiAction == INDI_NEWCALLSETUP) {
-          call_id = duplex_call_change->m_uiCallId;
-          csmm_insert_live_call (ctx, call_id, 'D');
-        }
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_DUPLEX_CALL_RELEASE:
-      TRACE (DEBUG, "Message type: LOG_API_DUPLEX_CALL_RELEASE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiDuplexCallRelease)) {
-        LogApiDuplexCallRelease *duplex_call_release =
-            (LogApiDuplexCallRelease *) zframe_data (log_api_msg);
-        call_id = duplex_call_release->m_uiCallId;
-        csmm_remove_live_call (ctx, call_id);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_SIMPLEX_CALL_CHANGE:
-      TRACE (DEBUG, "Message type: LOG_API_SIMPLEX_CALL_START_CHANGE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiSimplexCallStartChange)) {
-        LogApiSimplexCallStartChange *simplex_call_start_change =
-            (LogApiSimplexCallStartChange *) zframe_data (log_api_msg);
-        if (simplex_call_start_change->m_uiAction == INDI_NEWCALLSETUP) {
-          call_id = simplex_call_start_change->m_uiCallId;
-          csmm_insert_live_call (ctx, call_id, 'S');
-        }
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_SIMPLEX_CALL_RELEASE:
-      TRACE (DEBUG, "Message type: LOG_API_SIMPLEX_CALL_RELEASE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiSimplexCallRelease)) {
-        LogApiSimplexCallRelease *simplex_call_release =
-            (LogApiSimplexCallRelease *) zframe_data (log_api_msg);
-        call_id = simplex_call_release->m_uiCallId;
-        csmm_remove_live_call (ctx, call_id);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_GROUP_CALL_CHANGE:
-      TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_START_CHANGE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiGroupCallStartChange)) {
-        LogApiGroupCallStartChange *group_call_start_change =
-            (LogApiGroupCallStartChange *) zframe_data (log_api_msg);
-        if (group_call_start_change->m_uiAction == GROUPCALL_NEWCALLSETUP) {
-          call_id = group_call_start_change->m_uiCallId;
-          csmm_insert_live_call (ctx, call_id, 'G');
-        }
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_GROUP_CALL_RELEASE:
-      TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_RELEASE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiGroupCallRelease)) {
-        LogApiGroupCallRelease *group_call_release =
-            (LogApiGroupCallRelease *) zframe_data (log_api_msg);
-        call_id = group_call_release->m_uiCallId;
-        csmm_remove_live_call (ctx, call_id);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    default:
-      TRACE (DEBUG, "Message type: UNKNOWN (%x)", msg_id);
-      break;
+  if (descriptor && csmm_handlers[descriptor->msg_id]) {
+    TRACE (DEBUG, "Message type: %s", descriptor->name);
+    if (bus_msg.log_api_msg_size != descriptor->size) {
+      TRACE (ERROR, "LogApi message: Bad format");
+    } else {
+      csmm_handlers[descriptor->msg_id] (ctx, bus_msg.log_api_msg);
     }
   }
 
-  free (tag);
-  zframe_destroy (&timestamp);
-  zframe_destroy (&log_api_msg);
-  zmsg_destroy (&msg);
+  zframe_destroy (&frame);
 
   TRACE (FUNCTIONS, "Leaving csmm_voice_signaling_handler");
 
@@ -1911,6 +3657,8 @@ csmm_print (csmm_t *ctx)
       TRACE (DEBUG, "      port: %d", live_feeder->port);
       TRACE (DEBUG, "      channel: %d", live_feeder->channel);
       TRACE (DEBUG, "      free: %s", live_feeder->free ? "yes" : "no");
+      TRACE (DEBUG, "      mode: %s", live_feeder->rtp_a ? "rtp" : "raw");
+      TRACE (DEBUG, "      batched: %s", live_feeder->egress ? "yes" : "no");
       live_feeder = (live_feeder_t *) zlist_next (ctx->live_feeders);
     }
   } else {
@@ -1922,21 +3670,32 @@ csmm_print (csmm_t *ctx)
   TRACE (DEBUG, "  ------------");
   TRACE (DEBUG, "  Active calls");
   TRACE (DEBUG, "  ------------");
-  if (zlist_size (ctx->live_calls)) {
-    live_call_t *call = (live_call_t *) zlist_first (ctx->live_calls);
+  if (csmap_size (ctx->live_calls)) {
+    live_call_t *call = (live_call_t *) csmap_first (ctx->live_calls);
     while (call) {
       TRACE (DEBUG, "    Id: %d", call->id);
-      if (call->live_feeder) {
-        TRACE (DEBUG, "      Feeder: %s", csstring_data (call->live_feeder->stream_name));
-      } else {
+      live_listener_t *listener = (live_listener_t *) zlist_first (call->listeners);
+      if (!listener) {
         TRACE (DEBUG, "      Feeder: empty");
       }
-      if (call->subscriber) {
+      while (listener) {
+        if (listener->web) {
+          TRACE (DEBUG, "      %s client: session <%s>",
+              csweb_is_websocket (listener->web) ? "WebSocket" : "HTTP",
+              csstring_data (listener->session));
+        } else {
+          TRACE (DEBUG, "      Feeder: %s (session <%s>)",
+              csstring_data (listener->live_feeder->stream_name),
+              csstring_data (listener->session));
+        }
+        listener = (live_listener_t *) zlist_next (call->listeners);
+      }
+      if (call->subscribed) {
         TRACE (DEBUG, "      Subscriber: active");
       } else {
         TRACE (DEBUG, "      Subscriber: inactive");
       }
-      call = (live_call_t *) zlist_next (ctx->live_calls);
+      call = (live_call_t *) csmap_next (ctx->live_calls);
     }
   } else {
     TRACE (DEBUG, "    Empty");
@@ -1965,30 +3724,96 @@ csmm_print (csmm_t *ctx)
 
 
 //  --------------------------------------------------------------------------
-//  <Description>
-//  <Returns>
+//  Callback responsible for releasing the paced voice and the voice of the
+//  jitter buffers due
+//  Input:
+//    loop: the reactor
+//    timer_id: the media timer
+//    arg: the Call Stream Media Manager context of the thread
+//  Output:
+//    0: processed
 
 static int
-csmm_maintenance_handler (zloop_t *loop, int timer_id, void *arg)
+csmm_media_handler (zloop_t *loop, int timer_id, void *arg)
 {
-  TRACE (FUNCTIONS, "Entering in csmm_maintenance_handler");
+  csmm_t *ctx = (csmm_t *) arg;
+
+  TRACE (FUNCTIONS, "Entering in csmm_media_handler");
+
+  cswheel_advance (ctx->media_wheel, zclock_mono (), csmm_media_expire, ctx);
+
+  if (ctx->egress) {
+    csegress_flush (ctx->egress);
+  }
+
+  TRACE (FUNCTIONS, "Leaving csmm_media_handler");
+
+  return 0;
+}
 
+
+//  --------------------------------------------------------------------------
+//  Removes a call without voice for call_inactivity_period seconds, the
+//  release of the call being lost. A call with voice since its expiry was
+//  scheduled is scheduled again from its last voice
+//  Input:
+//    arg: the Call Stream Media Manager context of the thread
+//    timer: the expiry of the call
+
+static void
+csmm_live_call_expire (void *arg, cswheel_timer_t *timer)
+{
   csmm_t *ctx = (csmm_t *) arg;
-  live_call_t *live_call;
+  live_call_t *live_call = (live_call_t *) timer->item;
+  int64_t inactivity_ms = (int64_t) ctx->call_inactivity_period * 1000;
+  int64_t idle_ms = zclock_mono () - live_call->last_activity;
+
+  if (idle_ms >= inactivity_ms) {
+    TRACE (DEBUG, "Call <%u> had been without activity since <%" PRId64
+        "> seconds", live_call->id, idle_ms / 1000);
+    csmm_remove_live_call (ctx, live_call->id);
+  } else {
+    cswheel_schedule (ctx->expiry_wheel, &live_call->expiry,
+        live_call->last_activity + inactivity_ms);
+  }
+}
 
-  time_t now = time (NULL);
 
-  live_call = (live_call_t *) zlist_first (ctx->live_calls);
+//  --------------------------------------------------------------------------
+//  Dispatches an expired timer of the expiry wheel to its call or web client
+//  Input:
+//    arg: the Call Stream Media Manager context of the thread
+//    timer: the expiry of a call or the timeout of a web client request
 
-  while (live_call) {
-    double inactivity = difftime (now, live_call->last_activity);
-    TRACE (DEBUG, "Call <%u> had been without activity since <%.f> seconds",
-        live_call->id, inactivity);
-    if (inactivity > ctx->call_inactivity_period) {
-      csmm_remove_live_call (ctx, live_call->id);
-    }
-    live_call = (live_call_t *) zlist_next (ctx->live_calls);
+static void
+csmm_expire (void *arg, cswheel_timer_t *timer)
+{
+  if (csmm_http_request_is (timer->item)) {
+    csmm_http_request_expire ((csmm_t *) arg, (http_request_t *) timer->item);
+  } else {
+    csmm_live_call_expire (arg, timer);
   }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Callback responsible for expiring the calls without voice and the web
+//  clients whose request is not complete. Only the timers due are visited
+//  Input:
+//    loop: the reactor
+//    timer_id: the maintenance timer
+//    arg: the Call Stream Media Manager context of the thread
+//  Output:
+//    0: processed
+
+static int
+csmm_maintenance_handler (zloop_t *loop, int timer_id, void *arg)
+{
+  TRACE (FUNCTIONS, "Entering in csmm_maintenance_handler");
+
+  csmm_t *ctx = (csmm_t *) arg;
+
+  cswheel_advance (ctx->expiry_wheel, zclock_mono (), csmm_expire, ctx);
 
   TRACE (FUNCTIONS, "Leaving csmm_maintenance_handler");
 
@@ -2068,8 +3893,15 @@ csmm_configure (csmm_t *ctx)
 
   string = zconfig_resolve (root, "/media_manager/call_inactivity_period", "300");
   ctx->call_inactivity_period = atoi (string);
-  string = zconfig_resolve (root, "/media_manager/maintenance_frequency", "60");
+  string = zconfig_resolve (root, "/media_manager/maintenance_frequency", "1");
   ctx->maintenance_frequency = atoi (string);
+  if (ctx->maintenance_frequency == 0) {
+    ctx->maintenance_frequency = 1;
+  }
+  // The calls expire with the resolution of the maintenance
+  ctx->expiry_wheel = cswheel_new (64, ctx->maintenance_frequency * 1000,
+      zclock_mono ());
+  assert (ctx->expiry_wheel);
 
   rc = csmm_connect_db (ctx);
 
@@ -2082,6 +3914,11 @@ csmm_configure (csmm_t *ctx)
   assert (ctx->live_feeders);
   zlist_set_destructor (ctx->live_feeders, csmm_live_feeder_destructor);
 
+  ctx->free_mono_feeders = zlist_new ();
+  assert (ctx->free_mono_feeders);
+  ctx->free_stereo_feeders = zlist_new ();
+  assert (ctx->free_stereo_feeders);
+
   for (x = 1; x <= num_feeders; x++) {
     snprintf (path, sizeof (path), "/media_manager/feeders/feeder_%d/stream", x);
     string = zconfig_resolve (root, path, "");
@@ -2097,13 +3934,78 @@ csmm_configure (csmm_t *ctx)
     string = zconfig_resolve (root, path, "4321");
     int port = atoi (string);
 
+    snprintf (path, sizeof (path), "/media_manager/feeders/feeder_%d/mode", x);
+    string = zconfig_resolve (root, path, "raw");
+    bool rtp = streq (string, "rtp");
+    if (!rtp && !streq (string, "raw")) {
+      TRACE (ERROR, "Bad configuration. Feeder <%s> mode: %s",
+          csstring_data (stream), string);
+    }
+
     snprintf (path, sizeof (path), "/media_manager/feeders/feeder_%d/type", x);
     string = zconfig_resolve (root, path, "M");
 
-    live_feeder_t* live_feeder = csmm_live_feeder_new (stream, ip, port, string[0]);
+    live_feeder_t* live_feeder = csmm_live_feeder_new (stream, ip, port,
+        string[0], rtp);
     assert (live_feeder);
 
     rc = zlist_append (ctx->live_feeders, live_feeder);
+
+    if (live_feeder->feeder_type == 'M') {
+      live_feeder->free_list = ctx->free_mono_feeders;
+    } else if (live_feeder->feeder_type == 'S') {
+      live_feeder->free_list = ctx->free_stereo_feeders;
+    } else {
+      TRACE (ERROR, "Bad configuration. Feeder <%s> type: %c",
+          csstring_data (stream), live_feeder->feeder_type);
+    }
+    if (live_feeder->free_list) {
+      zlist_append (live_feeder->free_list, live_feeder);
+    }
+  }
+
+  // The voice of the live calls is paced when there is a playout delay
+  //
+  string = zconfig_resolve (root, "/media_manager/pacing/playout_delay", "0");
+  ctx->playout_delay = atoi (string);
+  string = zconfig_resolve (root, "/media_manager/pacing/playout_max", "600");
+  ctx->playout_max = atoi (string);
+  string = zconfig_resolve (root, "/media_manager/pacing/tick", "10");
+  int pacing_tick = atoi (string);
+
+  // and put in order by a jitter buffer per call
+  //
+  string = zconfig_resolve (root, "/media_manager/jitter/depth", "0");
+  ctx->jitter_depth = atoi (string);
+  if (ctx->jitter_depth >= CSJITTER_SLOTS) {
+    TRACE (ERROR, "Bad configuration. Jitter depth: %d", ctx->jitter_depth);
+    ctx->jitter_depth = CSJITTER_SLOTS - 1;
+  }
+  string = zconfig_resolve (root, "/media_manager/jitter/max_wait", "120");
+  ctx->jitter_max_wait = atoi (string);
+
+  if ((ctx->playout_delay > 0 || ctx->jitter_depth > 0) && pacing_tick > 0) {
+    ctx->media_wheel = cswheel_new (64, pacing_tick, zclock_mono ());
+    assert (ctx->media_wheel);
+    ctx->media_timer = zloop_timer (ctx->loop, pacing_tick, 0,
+        csmm_media_handler, ctx);
+  } else {
+    ctx->jitter_depth = 0;
+  }
+
+  // The datagrams for the feeders of all the calls are sent in batches
+  //
+  string = zconfig_resolve (root, "/media_manager/egress/batch", "64");
+  int egress_batch = atoi (string);
+  if (egress_batch > 1) {
+    ctx->egress = csegress_new (egress_batch);
+  }
+  if (ctx->egress) {
+    live_feeder_t *live_feeder = (live_feeder_t *) zlist_first (ctx->live_feeders);
+    while (live_feeder) {
+      csmm_live_feeder_set_egress (live_feeder, ctx->egress);
+      live_feeder = (live_feeder_t *) zlist_next (ctx->live_feeders);
+    }
   }
 
   // Read the call players' configuration
@@ -2134,9 +4036,9 @@ csmm_configure (csmm_t *ctx)
 
   // Configure active calls
   //
-  ctx->live_calls = zlist_new ();
+  ctx->live_calls = csmap_new ();
   assert (ctx->live_calls);
-  zlist_set_destructor (ctx->live_calls, csmm_live_call_destructor);
+  csmap_set_destructor (ctx->live_calls, csmm_live_call_destructor);
 
   // Read subscriptions configuration
   //
@@ -2149,15 +4051,54 @@ csmm_configure (csmm_t *ctx)
   for (x = 1; x <= num_subscriptions; x++) {
     snprintf (path, sizeof (path), "/media_manager/subscriptions/subscription_%d", x);
     string = zconfig_resolve (root, path, "0");
-    zsock_set_subscribe (ctx->subscriber, string);
+    csbus_subscribe (ctx->subscriber, string);
   }
 
   rc = zloop_reader (ctx->loop, ctx->subscriber, csmm_voice_signaling_handler, ctx);
 
+  // The voice subscriptions follow the interceptions
+  ctx->voice_subscriber = zsock_new_sub (">inproc://collector", 0);
+  assert (ctx->voice_subscriber);
+  rc = zloop_reader (ctx->loop, ctx->voice_subscriber, csmm_voice_data_handler, ctx);
+
   string = zconfig_resolve (root, "/media_manager/command_listener_endpoint", "");
   ctx->command_listener = zsock_new_rep (string);
   rc = zloop_reader (ctx->loop, ctx->command_listener, csmm_command_handler, ctx);
 
+  // The interception requests wait for a free feeder when the granted ones
+  // can be notified
+  //
+  ctx->waiting = zlist_new ();
+  assert (ctx->waiting);
+  zlist_set_destructor (ctx->waiting, csmm_live_request_destructor);
+  string = zconfig_resolve (root, "/media_manager/notification_publisher", "");
+  if (*string) {
+    ctx->notifier = zsock_new_pub (string);
+    if (!ctx->notifier) {
+      TRACE (ERROR, "Error: zsock_new_pub(), errno=%d text=%s",
+          errno, strerror (errno));
+    }
+  }
+  string = zconfig_resolve (root, "/media_manager/waiting/max", "32");
+  ctx->waiting_max = atoi (string);
+  string = zconfig_resolve (root, "/media_manager/waiting/timeout", "60");
+  ctx->waiting_timeout = atoi (string);
+
+  // The live streaming endpoint
+  //
+  ctx->http_requests = zlist_new ();
+  assert (ctx->http_requests);
+  zlist_set_destructor (ctx->http_requests, csmm_http_request_destructor);
+  string = zconfig_resolve (root, "/media_manager/http/port", "0");
+  ctx->http_port = atoi (string);
+  string = zconfig_resolve (root, "/media_manager/http/max_clients", "64");
+  ctx->http_max_clients = atoi (string);
+  string = zconfig_resolve (root, "/media_manager/http/request_timeout", "10");
+  ctx->http_request_timeout = atoi (string);
+  if (ctx->http_port) {
+    csmm_http_start (ctx);
+  }
+
   zconfig_destroy (&root);
 
   TRACE (FUNCTIONS, "Leaving csmm_configure");
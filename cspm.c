@@ -13,21 +13,38 @@
 
       mp3_mode = 0 -> Data is saved in wav format
       mp3_mode = 1 -> Data is saved in mp3 format
+
+    With /persistence_manager/lossless = 1 the submodule is a lossless
+    consumer of the collector instead (see csbus.h): the collector queues
+    the messages while the database is slow and sends them as the credit
+    granted by the submodule allows, so none of them is lost.
+
+    A call whose release is lost is saved after call_inactivity_period
+    seconds without voice. Every call has an expiry timer in a timing wheel
+    (cswheel) advanced every maintenance_frequency seconds; the voice only
+    updates the last activity of its call, which the expiry checks when it
+    is due, so the maintenance visits the calls due only.
 */
 
 
 #include "cs.h"
 #include "csutil.h"
+#include "cslogapi.h"
+#include "csbus.h"
+#include "csvoice.h"
+#include "cswheel.h"
 #include "wave.h"
 #include <libpq-fe.h>
 
 
 #define MP3_CONVERTER_TAG 0x0000fade
+#define CALL_ACTIVITY_TAG 0x0000acdc
 
 
 #define CSPM_TMP_BUFFER 64
 #define CSPM_BUFFER_WORK_AREA_LENGTH 2048
 #define NUMBER_LENGTH 30
+#define CSPM_LOSSLESS_NAME "persistence_manager"
 
 
 #ifdef __cplusplus
@@ -55,9 +72,15 @@ struct _cspm_t {
   zhash_t *mp3_converters;
   zhash_t *voice_calls_last_activity;
   zhash_t *voice_calls_types;
+  zhash_t *voice_calls_native;  // Speech time (ms) of the calls recorded
+                                // with native TETRA payloads
   unsigned int call_inactivity_period;
   unsigned int maintenance_frequency;
+  cswheel_t *expiry_wheel;      // Expiry of the calls without voice
   unsigned int mp3_mode;
+  int lossless;                 // The subscriber is a lossless consumer
+  int lossless_credit;
+  int consumed;                 // Messages received not yet given back as credit
 };
 typedef struct _cspm_t cspm_t;
 
@@ -74,6 +97,17 @@ struct _mp3_converter_t {
 typedef struct _mp3_converter_t mp3_converter_t;
 
 
+// The activity of a call being recorded
+
+struct _call_activity_t {
+  UINT32 tag;
+  UINT32 call_id;
+  int64_t last_activity;        // Monotonic time of the last voice
+  cswheel_timer_t expiry;       // Saving of the call without voice
+};
+typedef struct _call_activity_t call_activity_t;
+
+
 //  --------------------------------------------------------------------------
 //  Verifies if the input parameter is a mp3 converter
 //
@@ -452,6 +486,29 @@ cspm_remove_voice_block (void *item)
 }
 
 
+//  --------------------------------------------------------------------------
+//  Creates the entry to monitor a call's activity
+//  Input:
+//    The call's identifier
+//  Output:
+//    The created entry
+
+static call_activity_t*
+cspm_call_activity_new (UINT32 call_id)
+{
+  call_activity_t *self = (call_activity_t *) zmalloc (sizeof (call_activity_t));
+
+  if (self) {
+    self->tag = CALL_ACTIVITY_TAG;
+    self->call_id = call_id;
+    self->last_activity = zclock_mono ();
+    cswheel_timer_init (&self->expiry, self);
+  }
+
+  return self;
+}
+
+
 //  --------------------------------------------------------------------------
 //  Frees all the resources created for monitoring a call's activity
 //  Input:
@@ -462,7 +519,9 @@ cspm_remove_call_activity (void *item)
 {
   TRACE (FUNCTIONS, "Entering in cspm_remove_call_activity");
 
-  time_t *obj = (time_t *) item;
+  call_activity_t *obj = (call_activity_t *) item;
+  assert (obj->tag == CALL_ACTIVITY_TAG);
+  cswheel_cancel (&obj->expiry);
   free (obj);
 
   TRACE (FUNCTIONS, "Leaving cspm_remove_call_activity");
@@ -568,6 +627,8 @@ cspm_new (const char * const conf_file, zloop_t *loop)
     self->mp3_converters = zhash_new ();
     self->voice_calls_last_activity = zhash_new ();
     self->voice_calls_types = zhash_new ();
+    self->voice_calls_native = zhash_new ();
+    self->expiry_wheel = NULL;
   }
 
   TRACE (FUNCTIONS, "Leaving cspm_new");
@@ -600,9 +661,15 @@ cspm_destroy (cspm_t **self_p)
     zhash_destroy (&self->mp3_converters);
     zhash_destroy (&self->voice_calls_last_activity);
     zhash_destroy (&self->voice_calls_types);
+    zhash_destroy (&self->voice_calls_native);
+    cswheel_destroy (&self->expiry_wheel);
     if (self->subscriber) {
       zloop_reader_end (self->loop, self->subscriber);
-      zsock_destroy (&(self->subscriber));
+      if (self->lossless) {
+        csbus_lossless_destroy (&(self->subscriber));
+      } else {
+        zsock_destroy (&(self->subscriber));
+      }
     }
     free (self);
     *self_p = NULL;
@@ -639,6 +706,8 @@ cspm_print (cspm_t *ctx)
       ctx->maintenance_frequency);
   TRACE (DEBUG, "  MP3 mode: %d", 
       ctx->mp3_mode);
+  TRACE (DEBUG, "  Lossless: %d (credit %d)",
+      ctx->lossless, ctx->lossless_credit);
 
   TRACE (FUNCTIONS, "Leaving cspm_print");
 }
@@ -821,15 +890,18 @@ cspm_init_cache_voice_data (cspm_t *ctx, UINT32 call_id, char call_type)
 
     // Creates the entry to store the call's last activity
     //
-    time_t *aux_time = malloc (sizeof (time_t));
-    *aux_time = time (NULL);
-    rc = zhash_insert (ctx->voice_calls_last_activity, call_id_str, aux_time);
+    call_activity_t *activity = cspm_call_activity_new (call_id);
+    assert (activity);
+    rc = zhash_insert (ctx->voice_calls_last_activity, call_id_str, activity);
 
     if (rc != -1) {
 
-      // Binds the desctructor handler of the last activity entry
+      // Binds the desctructor handler of the last activity entry and
+      // schedules its expiry
       //
       zhash_freefn (ctx->voice_calls_last_activity, call_id_str, cspm_remove_call_activity);
+      cswheel_schedule (ctx->expiry_wheel, &activity->expiry,
+          activity->last_activity + (int64_t) ctx->call_inactivity_period * 1000);
 
       // Creates the entry to store the call type
       //
@@ -866,6 +938,7 @@ cspm_init_cache_voice_data (cspm_t *ctx, UINT32 call_id, char call_type)
       }
     } else {
       TRACE (ERROR, "Unable to register call activity for call <%u>", call_id);
+      cspm_remove_call_activity (activity);
     }
   } else {
     TRACE (ERROR, "Unable to create voice data store for call <%u>", call_id);
@@ -923,11 +996,12 @@ cspm_cache_voice_data (cspm_t *ctx, UINT32 call_id, StreamOriginatorEnum origina
     TRACE (ERROR, "Protocol error. Call <%u> received without previous CALLSETUP", call_id);
   }
 
-  // Update last activity information
+  // Update last activity information. The expiry of the call checks it
+  // when it is due
   //
-  time_t *last_activity = (time_t *) zhash_lookup (ctx->voice_calls_last_activity, call_id_str);
-  if (last_activity) {
-    *last_activity = time (NULL);
+  call_activity_t *activity = (call_activity_t *) zhash_lookup (ctx->voice_calls_last_activity, call_id_str);
+  if (activity) {
+    activity->last_activity = zclock_mono ();
   } else {
     TRACE (ERROR, "Last activity for call <%u> not registered", call_id);
   }
@@ -937,6 +1011,68 @@ cspm_cache_voice_data (cspm_t *ctx, UINT32 call_id, StreamOriginatorEnum origina
   return rc;
 }
 
+
+//  --------------------------------------------------------------------------
+// Stores a call's voice packet with native TETRA payloads as a record of the
+// voice container. The records of all the streams of the call are kept in
+// arrival order in the stream A list
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    call_id: the call's identifier
+//    voice: the LogApiVoice packet
+//    data: the payloads of the packet
+//    len: the payloads' length
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+static int
+cspm_cache_native_voice_data (cspm_t *ctx, UINT32 call_id,
+    const LogApiVoice * const voice, const UINT8 * const data, size_t len)
+{
+  UINT8 record[sizeof (cs_voice_record_header_t) + CS_VOICE_MAX_PAYLOAD_SIZE];
+  cs_voice_record_header_t *header = (cs_voice_record_header_t *) record;
+  char call_id_str[CSPM_TMP_BUFFER];
+  int rc = 0;
+
+  TRACE (FUNCTIONS, "Entering in cspm_cache_native_voice_data");
+
+  snprintf (call_id_str, CSPM_TMP_BUFFER, "%u", call_id);
+
+  if (len > CS_VOICE_MAX_PAYLOAD_SIZE ||
+      !zhash_lookup (ctx->voice_calls_types, call_id_str)) {
+    TRACE (ERROR, "Protocol error. Call <%u> received without previous CALLSETUP", call_id);
+    rc = -1;
+  }
+
+  if (rc == 0) {
+    header->originator = voice->m_uiStreamOriginator;
+    header->payload1_info = voice->m_uiPayload1Info;
+    header->payload2_info = voice->m_uiPayload2Info;
+    header->spare = 0;
+    memcpy (record + sizeof (cs_voice_record_header_t), data, len);
+
+    rc = cspm_cache_voice_data (ctx, call_id, STREAM_ORG_A_SUB,
+        record, sizeof (cs_voice_record_header_t) + len);
+  }
+
+  if (rc == 0) {
+    uint64_t *speech_ms = (uint64_t *) zhash_lookup (ctx->voice_calls_native,
+        call_id_str);
+    if (!speech_ms) {
+      speech_ms = (uint64_t *) zmalloc (sizeof (uint64_t));
+      zhash_insert (ctx->voice_calls_native, call_id_str, speech_ms);
+      zhash_freefn (ctx->voice_calls_native, call_id_str, free);
+    }
+    *speech_ms += cs_voice_payload_duration_ms (voice->m_uiPayload1Info) +
+        cs_voice_payload_duration_ms (voice->m_uiPayload2Info);
+  }
+
+  TRACE (FUNCTIONS, "Leaving cspm_cache_native_voice_data");
+
+  return rc;
+}
+
 //
 //
 //
@@ -1042,6 +1178,50 @@ static int cspm_copy_voice_data_to_wav_file (const char *path, char call_type,
 }
 
 
+//  --------------------------------------------------------------------------
+//  Returns the size of the stereo interleave of a stream A block and a
+//  stream B block of a duplex call. A block longer than its counterpart is
+//  truncated
+//  Input:
+//    block_stream_a: the block of stream A
+//    block_stream_b: the block of stream B
+
+static size_t
+cspm_interleaved_size (zchunk_t *block_stream_a, zchunk_t *block_stream_b)
+{
+  size_t block_size = zchunk_size (block_stream_b);
+
+  if (block_size > zchunk_size (block_stream_a)) {
+    block_size = zchunk_size (block_stream_a);
+  }
+
+  return 2 * block_size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Writes the stereo interleave of a stream A block and a stream B block
+//  of a duplex call
+//  Input:
+//    dest: where the interleave is written
+//    block_stream_a: the block of stream A
+//    block_stream_b: the block of stream B
+//  Output:
+//    The size of the interleave
+
+static size_t
+cspm_interleave (UINT8 *dest, zchunk_t *block_stream_a,
+    zchunk_t *block_stream_b)
+{
+  size_t size = cspm_interleaved_size (block_stream_a, block_stream_b);
+
+  cs_interleave (zchunk_data (block_stream_a), zchunk_data (block_stream_b),
+      size / 2, dest);
+
+  return size;
+}
+
+
 //  --------------------------------------------------------------------------
 // Saves a call's voice data
 //  Input:
@@ -1064,6 +1244,7 @@ cspm_save_voice_data (cspm_t *ctx, UINT32 call_id)
   float duration_in_seconds = 0;
   int chunks_in_stream_a = 0;
   int chunks_in_stream_b = 0;
+  UINT8 *dest;
 
   TRACE (FUNCTIONS, "Entering in cspm_save_voice_data");
 
@@ -1101,8 +1282,7 @@ cspm_save_voice_data (cspm_t *ctx, UINT32 call_id)
       zchunk_t *block_stream_a = (zchunk_t *) zlist_first (voice_blocks_stream_a);
       zchunk_t *block_stream_b = (zchunk_t *) zlist_first (voice_blocks_stream_b);
       while (block_stream_b && block_stream_a) {
-        voice_data_len += zchunk_size (block_stream_a);
-        voice_data_len += zchunk_size (block_stream_b);
+        voice_data_len += cspm_interleaved_size (block_stream_a, block_stream_b);
         block_stream_a = (zchunk_t *) zlist_next (voice_blocks_stream_a);
         block_stream_b = (zchunk_t *) zlist_next (voice_blocks_stream_b);
       }
@@ -1116,14 +1296,18 @@ cspm_save_voice_data (cspm_t *ctx, UINT32 call_id)
 
     TRACE (DEBUG, "Call Id: <%u>. Voice data length: <%d>", call_id, voice_data_len);
 
-    // Reserves memory for the voice call
+    // Reserves memory for the voice call, sized up front so the blocks are
+    // written in place
     //
     voice_data = zchunk_new (NULL, sizeof(wave_header) + voice_data_len);
+    zchunk_fill (voice_data, 0, sizeof(wave_header) + voice_data_len);
+    dest = zchunk_data (voice_data);
   
     // Adds the wave header
     //
     fill_wav_header (&wave_header, *call_type, voice_data_len, &duration_in_seconds);
-    zchunk_append (voice_data, &wave_header, sizeof(wave_header));
+    memcpy (dest, &wave_header, sizeof(wave_header));
+    dest += sizeof(wave_header);
 
     // Concatenates the voice call chunks
     //
@@ -1131,22 +1315,17 @@ cspm_save_voice_data (cspm_t *ctx, UINT32 call_id)
     if (*call_type == 'D') {
       zchunk_t *block_stream_b = (zchunk_t *) zlist_first (voice_blocks_stream_b);
       while (block_stream_b && block_stream_a) {
-        int block_size = zchunk_size (block_stream_b);
-        int i = 0;
-
         // Merge stream A with stream B
         //
-        for (i = 0; i < block_size; i++) {
-          zchunk_append (voice_data, zchunk_data (block_stream_a) + i, 1);
-          zchunk_append (voice_data, zchunk_data (block_stream_b) + i, 1);
-        }
+        dest += cspm_interleave (dest, block_stream_a, block_stream_b);
 
         block_stream_a = (zchunk_t *) zlist_next (voice_blocks_stream_a);
         block_stream_b = (zchunk_t *) zlist_next (voice_blocks_stream_b);
       }
     } else {
       while (block_stream_a) {
-        zchunk_append (voice_data, zchunk_data (block_stream_a), zchunk_size (block_stream_a));
+        memcpy (dest, zchunk_data (block_stream_a), zchunk_size (block_stream_a));
+        dest += zchunk_size (block_stream_a);
         block_stream_a = (zchunk_t *) zlist_next (voice_blocks_stream_a);
       }
     }
@@ -1958,6 +2137,347 @@ cspm_save_status_sds (cspm_t *ctx, const time_t * const timestamp,
 }
 
 
+// --------------------------------------------------------------------------
+// Saves a call's voice data recorded with native TETRA payloads in the voice
+// container format (see csvoice.h)
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    call_id: the call's identifier
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+static int
+cspm_save_native_voice_data (cspm_t *ctx, UINT32 call_id)
+{
+  int rc = 0;
+  char call_id_str[CSPM_TMP_BUFFER];
+  size_t voice_data_len = sizeof (cs_voice_container_header_t);
+  cs_voice_container_header_t header;
+  zchunk_t *voice_data = NULL;
+  zchunk_t *block;
+
+  TRACE (FUNCTIONS, "Entering in cspm_save_native_voice_data");
+
+  snprintf (call_id_str, CSPM_TMP_BUFFER, "%u", call_id);
+
+  uint64_t *speech_ms = (uint64_t *) zhash_lookup (ctx->voice_calls_native,
+      call_id_str);
+  zlist_t *voice_blocks = (zlist_t *) zhash_lookup (ctx->voice_calls_stream_a,
+      call_id_str);
+
+  if (voice_blocks) {
+    block = (zchunk_t *) zlist_first (voice_blocks);
+    while (block) {
+      voice_data_len += zchunk_size (block);
+      block = (zchunk_t *) zlist_next (voice_blocks);
+    }
+
+    TRACE (DEBUG, "Call Id: <%u>. Native voice data length: <%zu>",
+        call_id, voice_data_len);
+
+    memcpy (header.magic, CS_VOICE_CONTAINER_MAGIC, sizeof (header.magic));
+    header.version = CS_VOICE_CONTAINER_VERSION;
+    memset (header.spare, 0, sizeof (header.spare));
+
+    voice_data = zchunk_new (NULL, voice_data_len);
+    zchunk_append (voice_data, &header, sizeof (header));
+    block = (zchunk_t *) zlist_first (voice_blocks);
+    while (block) {
+      zchunk_append (voice_data, zchunk_data (block), zchunk_size (block));
+      block = (zchunk_t *) zlist_next (voice_blocks);
+    }
+
+    rc = cspm_save_voice_data_helper (ctx, voice_data, call_id,
+        speech_ms ? *speech_ms / 1000.0 : 0);
+
+    zchunk_destroy (&voice_data);
+  } else {
+    TRACE (ERROR, "No voice data found for call %u", call_id);
+  }
+
+  // Frees all the working area memory reserved for the call
+  //
+  zhash_delete (ctx->voice_calls_stream_a, call_id_str);
+  zhash_delete (ctx->voice_calls_stream_b, call_id_str);
+  zhash_delete (ctx->voice_calls_last_activity, call_id_str);
+  zhash_delete (ctx->voice_calls_types, call_id_str);
+  zhash_delete (ctx->voice_calls_native, call_id_str);
+  zhash_delete (ctx->mp3_converters, call_id_str);
+
+  TRACE (FUNCTIONS, "Leaving cspm_save_native_voice_data");
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Saves the voice data cached for a released call in the configured format.
+//  The calls received with native TETRA payloads are saved as received
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    call_id: the call identifier
+
+static void
+cspm_save_call_voice_data (cspm_t *ctx, UINT32 call_id)
+{
+  char call_id_str[CSPM_TMP_BUFFER];
+
+  snprintf (call_id_str, CSPM_TMP_BUFFER, "%u", call_id);
+
+  if (zhash_lookup (ctx->voice_calls_native, call_id_str)) {
+    cspm_save_native_voice_data (ctx, call_id);
+  } else if (ctx->mp3_mode) {
+    cspm_save_voice_data_as_mp3 (ctx, call_id);
+  } else {
+    cspm_save_voice_data (ctx, call_id);
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiKeepAlive message
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    timestamp: the reception time
+//    log_api_msg: the LogApiKeepAlive message
+
+static void
+cspm_handle_keep_alive (cspm_t *ctx, const time_t * const timestamp,
+    const void * const log_api_msg)
+{
+  cspm_save_keep_alive (ctx, timestamp,
+      (const LogApiKeepAlive *) log_api_msg);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiDuplexCallChange message. A new call is saved and its
+//  voice data cache is initialized
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    timestamp: the reception time
+//    log_api_msg: the LogApiDuplexCallChange message
+
+static void
+cspm_handle_duplex_call_change (cspm_t *ctx, const time_t * const timestamp,
+    const void * const log_api_msg)
+{
+  const LogApiDuplexCallChange * const duplex_call_change =
+      (const LogApiDuplexCallChange *) log_api_msg;
+
+  if (duplex_call_change->m_uiAction == INDI_NEWCALLSETUP) {
+    cspm_save_duplex_call_change (ctx, timestamp, duplex_call_change);
+    cspm_init_cache_voice_data (ctx, duplex_call_change->m_uiCallId, 'D');
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiDuplexCallRelease message. The release is saved and the
+//  voice data cached for the call is stored
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    timestamp: the reception time
+//    log_api_msg: the LogApiDuplexCallRelease message
+
+static void
+cspm_handle_duplex_call_release (cspm_t *ctx, const time_t * const timestamp,
+    const void * const log_api_msg)
+{
+  const LogApiDuplexCallRelease * const duplex_call_release =
+      (const LogApiDuplexCallRelease *) log_api_msg;
+
+  cspm_save_duplex_call_release (ctx, timestamp, duplex_call_release);
+  cspm_save_call_voice_data (ctx, duplex_call_release->m_uiCallId);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiSimplexCallStartChange message. A new call is saved and its
+//  voice data cache is initialized
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    timestamp: the reception time
+//    log_api_msg: the LogApiSimplexCallStartChange message
+
+static void
+cspm_handle_simplex_call_start_change (cspm_t *ctx, const time_t * const timestamp,
+    const void * const log_api_msg)
+{
+  const LogApiSimplexCallStartChange * const simplex_call_start_change =
+      (const LogApiSimplexCallStartChange *) log_api_msg;
+
+  if (simplex_call_start_change->m_uiAction == INDI_NEWCALLSETUP) {
+    cspm_save_simplex_call_start_change (ctx, timestamp, simplex_call_start_change);
+    cspm_init_cache_voice_data (ctx, simplex_call_start_change->m_uiCallId, 'S');
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiSimplexCallPttChange message
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    timestamp: the reception time
+//    log_api_msg: the LogApiSimplexCallPttChange message
+
+static void
+cspm_handle_simplex_call_ptt_change (cspm_t *ctx, const time_t * const timestamp,
+    const void * const log_api_msg)
+{
+  cspm_save_simplex_call_ptt_change (ctx, timestamp,
+      (const LogApiSimplexCallPttChange *) log_api_msg);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiSimplexCallRelease message. The release is saved and the
+//  voice data cached for the call is stored
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    timestamp: the reception time
+//    log_api_msg: the LogApiSimplexCallRelease message
+
+static void
+cspm_handle_simplex_call_release (cspm_t *ctx, const time_t * const timestamp,
+    const void * const log_api_msg)
+{
+  const LogApiSimplexCallRelease * const simplex_call_release =
+      (const LogApiSimplexCallRelease *) log_api_msg;
+
+  cspm_save_simplex_call_release (ctx, timestamp, simplex_call_release);
+  cspm_save_call_voice_data (ctx, simplex_call_release->m_uiCallId);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiGroupCallStartChange message. A new call is saved and its
+//  voice data cache is initialized
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    timestamp: the reception time
+//    log_api_msg: the LogApiGroupCallStartChange message
+
+static void
+cspm_handle_group_call_start_change (cspm_t *ctx, const time_t * const timestamp,
+    const void * const log_api_msg)
+{
+  const LogApiGroupCallStartChange * const group_call_start_change =
+      (const LogApiGroupCallStartChange *) log_api_msg;
+
+  if (group_call_start_change->m_uiAction == GROUPCALL_NEWCALLSETUP) {
+    cspm_save_group_call_start_change (ctx, timestamp, group_call_start_change);
+    cspm_init_cache_voice_data (ctx, group_call_start_change->m_uiCallId, 'G');
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiGroupCallPttActive message
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    timestamp: the reception time
+//    log_api_msg: the LogApiGroupCallPttActive message
+
+static void
+cspm_handle_group_call_ptt_active (cspm_t *ctx, const time_t * const timestamp,
+    const void * const log_api_msg)
+{
+  cspm_save_group_call_ptt_active (ctx, timestamp,
+      (const LogApiGroupCallPttActive *) log_api_msg);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiGroupCallPttIdle message
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    timestamp: the reception time
+//    log_api_msg: the LogApiGroupCallPttIdle message
+
+static void
+cspm_handle_group_call_ptt_idle (cspm_t *ctx, const time_t * const timestamp,
+    const void * const log_api_msg)
+{
+  cspm_save_group_call_ptt_idle (ctx, timestamp,
+      (const LogApiGroupCallPttIdle *) log_api_msg);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiGroupCallRelease message. The release is saved and the
+//  voice data cached for the call is stored
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    timestamp: the reception time
+//    log_api_msg: the LogApiGroupCallRelease message
+
+static void
+cspm_handle_group_call_release (cspm_t *ctx, const time_t * const timestamp,
+    const void * const log_api_msg)
+{
+  const LogApiGroupCallRelease * const group_call_release =
+      (const LogApiGroupCallRelease *) log_api_msg;
+
+  cspm_save_group_call_release (ctx, timestamp, group_call_release);
+  cspm_save_call_voice_data (ctx, group_call_release->m_uiCallId);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiStatusSDS message
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    timestamp: the reception time
+//    log_api_msg: the LogApiStatusSDS message
+
+static void
+cspm_handle_status_sds (cspm_t *ctx, const time_t * const timestamp,
+    const void * const log_api_msg)
+{
+  cspm_save_status_sds (ctx, timestamp,
+      (const LogApiStatusSDS *) log_api_msg);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles a LogApiTextSDS message
+//  Input:
+//    ctx: the Call Stream Persistence Manager context
+//    timestamp: the reception time
+//    log_api_msg: the LogApiTextSDS message
+
+static void
+cspm_handle_text_sds (cspm_t *ctx, const time_t * const timestamp,
+    const void * const log_api_msg)
+{
+  cspm_save_text_sds (ctx, timestamp,
+      (const LogApiTextSDS *) log_api_msg);
+}
+
+
+// Handlers of the LogApi message types indexed by MsgId
+
+typedef void (cspm_handler_fn) (cspm_t *ctx, const time_t * const timestamp,
+    const void * const log_api_msg);
+
+static cspm_handler_fn * const cspm_handlers[CS_LOG_API_MSG_ID_COUNT] = {
+  [LOG_API_ALIVE] = cspm_handle_keep_alive,
+  [LOG_API_DUPLEX_CALL_CHANGE] = cspm_handle_duplex_call_change,
+  [LOG_API_DUPLEX_CALL_RELEASE] = cspm_handle_duplex_call_release,
+  [LOG_API_SIMPLEX_CALL_CHANGE] = cspm_handle_simplex_call_start_change,
+  [LOG_API_SIMPLEX_CALL_PTT_CHANGE] = cspm_handle_simplex_call_ptt_change,
+  [LOG_API_SIMPLEX_CALL_RELEASE] = cspm_handle_simplex_call_release,
+  [LOG_API_GROUP_CALL_CHANGE] = cspm_handle_group_call_start_change,
+  [LOG_API_GROUP_CALL_PTT_ACTIVE] = cspm_handle_group_call_ptt_active,
+  [LOG_API_GROUP_CALL_PTT_IDLE] = cspm_handle_group_call_ptt_idle,
+  [LOG_API_GROUP_CALL_RELEASE] = cspm_handle_group_call_release,
+  [LOG_API_SDS_STATUS] = cspm_handle_status_sds,
+  [LOG_API_SDS_TEXT] = cspm_handle_text_sds
+};
+
+
 //  --------------------------------------------------------------------------
 //  Callback responsible for processing a received LogApi message.
 //  Input:
@@ -1972,196 +2492,51 @@ static int
 cspm_callstream_handler (zloop_t *loop, zsock_t *reader, void *arg)
 {
   TRACE (FUNCTIONS, "Entering in cspm_callstream_handler");
-  UINT32 msg_id;
-  UINT32 call_id;
-  int rc;
+  const cs_log_api_descriptor_t *descriptor;
+  csbus_msg_t bus_msg;
 
   cspm_t *ctx = (cspm_t *) arg;
 
-  zmsg_t* msg;
-  msg = zmsg_recv (reader);
-  assert (msg);
-  zmsg_print (msg);
-
-  char *tag = zmsg_popstr (msg);
-  zframe_t *timestamp = zmsg_pop (msg);
-  zframe_t *log_api_msg = zmsg_pop (msg);
-
-  if (zframe_size (timestamp) != sizeof (time_t)) {
-    TRACE (ERROR, "Timestamp: Bad format");
-  }
-
-  rc = sscanf (tag, "S_%u", &msg_id);
-
-  if (rc != EOF && rc > 0) {
-    switch (msg_id) {
-    case LOG_API_ALIVE:
-      TRACE (DEBUG, "Message type: LOG_API_KEEP_ALIVE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiKeepAlive)) {
-        LogApiKeepAlive *keep_alive;
-        keep_alive = (LogApiKeepAlive *) zframe_data (log_api_msg);
-        cspm_save_keep_alive (ctx, (time_t *) zframe_data (timestamp), keep_alive);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_DUPLEX_CALL_CHANGE:
-      TRACE (DEBUG, "Message type: LOG_API_DUPLEX_CALL_CHANGE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiDuplexCallChange)) {
-        LogApiDuplexCallChange *duplex_call_change;
-        duplex_call_change = (LogApiDuplexCallChange *) zframe_data (log_api_msg);
-        if (duplex_call_change->m_uiAction == INDI_NEWCALLSETUP) {
-          cspm_save_duplex_call_change (ctx, (time_t *) zframe_data (timestamp), duplex_call_change);
-          cspm_init_cache_voice_data (ctx, duplex_call_change->m_uiCallId, 'D');
-        }
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_DUPLEX_CALL_RELEASE:
-      TRACE (DEBUG, "Message type: LOG_API_DUPLEX_CALL_RELEASE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiDuplexCallRelease)) {
-        LogApiDuplexCallRelease *duplex_call_release;
-        duplex_call_release = (LogApiDuplexCallRelease *) zframe_data (log_api_msg);
-        cspm_save_duplex_call_release (ctx, (time_t *) zframe_data (timestamp), duplex_call_release);
-        if (ctx->mp3_mode) {
-          cspm_save_voice_data_as_mp3 (ctx, duplex_call_release->m_uiCallId);
-        } else {
-          cspm_save_voice_data (ctx, duplex_call_release->m_uiCallId);
-        }
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_SIMPLEX_CALL_CHANGE:
-      TRACE (DEBUG, "Message type: LOG_API_SIMPLEX_CALL_START_CHANGE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiSimplexCallStartChange)) {
-        LogApiSimplexCallStartChange *simplex_call_start_change;
-        simplex_call_start_change = (LogApiSimplexCallStartChange *) zframe_data (log_api_msg);
-        if (simplex_call_start_change->m_uiAction == INDI_NEWCALLSETUP) {
-          cspm_save_simplex_call_start_change (ctx, (time_t *) zframe_data (timestamp), simplex_call_start_change);
-          cspm_init_cache_voice_data (ctx, simplex_call_start_change->m_uiCallId, 'S');
-        }
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_SIMPLEX_CALL_PTT_CHANGE:
-      TRACE (DEBUG, "Message type: LOG_API_SIMPLEX_CALL_PTT_CHANGE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiSimplexCallPttChange)) {
-        LogApiSimplexCallPttChange *simplex_call_ptt_change;
-        simplex_call_ptt_change = (LogApiSimplexCallPttChange *) zframe_data (log_api_msg);
-        cspm_save_simplex_call_ptt_change (ctx, (time_t *) zframe_data (timestamp), simplex_call_ptt_change);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_SIMPLEX_CALL_RELEASE:
-      TRACE (DEBUG, "Message type: LOG_API_SIMPLEX_CALL_RELEASE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiSimplexCallRelease)) {
-        LogApiSimplexCallRelease *simplex_call_release;
-        simplex_call_release = (LogApiSimplexCallRelease *) zframe_data (log_api_msg);
-        cspm_save_simplex_call_release (ctx, (time_t *) zframe_data (timestamp), simplex_call_release);
-        if (ctx->mp3_mode) {
-          cspm_save_voice_data_as_mp3 (ctx, simplex_call_release->m_uiCallId);
-        } else {
-          cspm_save_voice_data (ctx, simplex_call_release->m_uiCallId);
-        }
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_GROUP_CALL_CHANGE:
-      TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_START_CHANGE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiGroupCallStartChange)) {
-        LogApiGroupCallStartChange *group_call_start_change;
-        group_call_start_change = (LogApiGroupCallStartChange *) zframe_data (log_api_msg);
-        if (group_call_start_change->m_uiAction == GROUPCALL_NEWCALLSETUP) {
-          cspm_save_group_call_start_change (ctx, (time_t *) zframe_data (timestamp), group_call_start_change);
-          cspm_init_cache_voice_data (ctx, group_call_start_change->m_uiCallId, 'G');
-        }
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_GROUP_CALL_PTT_ACTIVE:
-      TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_PPT_ACTIVE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiGroupCallPttActive)) {
-        LogApiGroupCallPttActive *group_call_ptt_active;
-        group_call_ptt_active = (LogApiGroupCallPttActive *) zframe_data (log_api_msg);
-        cspm_save_group_call_ptt_active (ctx, (time_t *) zframe_data (timestamp), group_call_ptt_active);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_GROUP_CALL_PTT_IDLE:
-      TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_PTT_IDLE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiGroupCallPttIdle)) {
-        LogApiGroupCallPttIdle *group_call_ptt_idle;
-        group_call_ptt_idle = (LogApiGroupCallPttIdle *) zframe_data (log_api_msg);
-        cspm_save_group_call_ptt_idle (ctx, (time_t *) zframe_data (timestamp), group_call_ptt_idle);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_GROUP_CALL_RELEASE:
-      TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_RELEASE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiGroupCallRelease)) {
-        LogApiGroupCallRelease *group_call_release;
-        group_call_release = (LogApiGroupCallRelease *) zframe_data (log_api_msg);
-        cspm_save_group_call_release (ctx, (time_t *) zframe_data (timestamp), group_call_release);
-        if (ctx->mp3_mode) {
-          cspm_save_voice_data_as_mp3 (ctx, group_call_release->m_uiCallId);
-        } else {
-          cspm_save_voice_data (ctx, group_call_release->m_uiCallId);
-        }
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_SDS_STATUS:
-      TRACE (DEBUG, "Message type: LOG_API_SDS_STATUS");
-      if (zframe_size (log_api_msg) == sizeof (LogApiStatusSDS)) {
-        LogApiStatusSDS *status_sds;
-        status_sds = (LogApiStatusSDS *) zframe_data (log_api_msg);
-        cspm_save_status_sds (ctx, (time_t *) zframe_data (timestamp), status_sds);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_SDS_TEXT:
-      TRACE (DEBUG, "Message type: LOG_API_SDS_TEXT");
-      if (zframe_size (log_api_msg) == sizeof (LogApiTextSDS)) {
-        LogApiTextSDS *text_sds;
-        text_sds = (LogApiTextSDS *) zframe_data (log_api_msg);
-        cspm_save_text_sds (ctx, (time_t *) zframe_data (timestamp), text_sds);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
+  zframe_t *frame = zframe_recv (reader);
+  assert (frame);
+
+  if (csbus_decode (frame, &bus_msg) == -1) {
+    TRACE (ERROR, "Bus message: Bad format");
+  } else if (bus_msg.type == CSBUS_SIGNALING) {
+    descriptor = cs_log_api_descriptor ((UINT8) bus_msg.id);
+    if (!descriptor) {
+      TRACE (DEBUG, "Message type: UNKNOWN (%u)", bus_msg.id);
+    } else if (bus_msg.log_api_msg_size != descriptor->size) {
+      TRACE (ERROR, "LogApi message: Bad format");
+    } else {
+      TRACE (DEBUG, "Message type: %s", descriptor->name);
+      if (cspm_handlers[descriptor->msg_id]) {
+        cspm_handlers[descriptor->msg_id] (ctx,
+            &bus_msg.timestamp, bus_msg.log_api_msg);
       }
-      break;
-    default:
-      TRACE (DEBUG, "Message type: UNKNOWN (%x)", msg_id);
-      break;
     }
-  } else {
-    rc = sscanf (tag, "V_%u", &call_id);
-    if (rc != EOF && rc > 0) {
-      LogApiVoice *log_api_voice;
-      log_api_voice = (LogApiVoice *) zframe_data (log_api_msg);
-      StreamOriginatorEnum originator = log_api_voice->m_uiStreamOriginator;
-      TRACE (DEBUG, "Originator: <%d>", originator);
-      zframe_t *voice_data = zmsg_pop (msg);
-      cspm_cache_voice_data (ctx, call_id, originator, zframe_data (voice_data), zframe_size (voice_data));
-      zframe_destroy (&voice_data);
+  } else if (bus_msg.type == CSBUS_VOICE) {
+    const LogApiVoice *log_api_voice = (const LogApiVoice *) bus_msg.log_api_msg;
+    StreamOriginatorEnum originator = log_api_voice->m_uiStreamOriginator;
+    TRACE (DEBUG, "Originator: <%d>", originator);
+    if (log_api_voice->m_uiPayload1Info == PAYLOAD_INFO_G711) {
+      cspm_cache_voice_data (ctx, bus_msg.id, originator,
+          bus_msg.voice_data, bus_msg.voice_data_size);
     } else {
-      TRACE (DEBUG, "Message tag: UNKNOWN (%s)", tag);
+      cspm_cache_native_voice_data (ctx, bus_msg.id, log_api_voice,
+          bus_msg.voice_data, bus_msg.voice_data_size);
     }
+  } else {
+    TRACE (DEBUG, "Message type: UNKNOWN (%c)", bus_msg.type);
   }
 
-  free (tag);
-  zframe_destroy (&timestamp);
-  zframe_destroy (&log_api_msg);
-  zmsg_destroy (&msg);
+  zframe_destroy (&frame);
+
+  // The credit is given back in blocks of half the window
+  if (ctx->lossless && ++ctx->consumed >= ctx->lossless_credit / 2) {
+    csbus_lossless_credit (ctx->subscriber, ctx->consumed);
+    ctx->consumed = 0;
+  }
 
   TRACE (FUNCTIONS, "Leaving cspm_callstream_handler");
 
@@ -2200,15 +2575,37 @@ cspm_configure (cspm_t *ctx)
   string = zconfig_resolve (root, "/persistence_manager/call_inactivity_period", "300");
   ctx->call_inactivity_period = atoi (string);
 
-  string = zconfig_resolve (root, "/persistence_manager/maintenance_frequency", "60");
+  string = zconfig_resolve (root, "/persistence_manager/maintenance_frequency", "1");
   ctx->maintenance_frequency = atoi (string);
+  if (ctx->maintenance_frequency == 0) {
+    ctx->maintenance_frequency = 1;
+  }
+
+  // The calls expire with the resolution of the maintenance
+  ctx->expiry_wheel = cswheel_new (64, ctx->maintenance_frequency * 1000,
+      zclock_mono ());
+  assert (ctx->expiry_wheel);
 
   string = zconfig_resolve (root, "/basic/mp3_mode", "0");
   ctx->mp3_mode = atoi (string);
 
+  string = zconfig_resolve (root, "/persistence_manager/lossless", "0");
+  ctx->lossless = atoi (string);
+
+  string = zconfig_resolve (root, "/persistence_manager/lossless_credit", "256");
+  ctx->lossless_credit = atoi (string);
+  if (ctx->lossless_credit < 2) {
+    TRACE (ERROR, "Bad configuration. lossless_credit: %d", ctx->lossless_credit);
+    ctx->lossless_credit = 256;
+  }
+
   rc = cspm_connect_db (ctx);
 
-  ctx->subscriber = zsock_new_sub (">inproc://collector", 0);
+  if (ctx->lossless) {
+    ctx->subscriber = csbus_lossless_new (CSPM_LOSSLESS_NAME);
+  } else {
+    ctx->subscriber = zsock_new_sub (">inproc://collector", 0);
+  }
   assert (ctx->subscriber);
 
   string = zconfig_resolve (root, "/persistence_manager/subscriptions", "0");
@@ -2217,7 +2614,15 @@ cspm_configure (cspm_t *ctx)
   for (x = 1; x <= num_subscriptions; x++) {
     snprintf (path, sizeof (path), "/persistence_manager/subscriptions/subscription_%d", x);
     string = zconfig_resolve (root, path, "0");
-    zsock_set_subscribe (ctx->subscriber, string);
+    if (ctx->lossless) {
+      csbus_lossless_subscribe (ctx->subscriber, string);
+    } else {
+      csbus_subscribe (ctx->subscriber, string);
+    }
+  }
+
+  if (ctx->lossless) {
+    csbus_lossless_credit (ctx->subscriber, ctx->lossless_credit);
   }
 
   rc = zloop_reader (ctx->loop, ctx->subscriber, cspm_callstream_handler, ctx);
@@ -2231,8 +2636,53 @@ cspm_configure (cspm_t *ctx)
 
 
 //  --------------------------------------------------------------------------
-//  <Description>
-//  <Returns>
+//  Saves a call without voice for call_inactivity_period seconds, the
+//  release of the call being lost. A call with voice since its expiry was
+//  scheduled is scheduled again from its last voice
+//  Input:
+//    arg: the Call Stream Persistence Manager context
+//    timer: the expiry of the call
+
+static void
+cspm_call_activity_expire (void *arg, cswheel_timer_t *timer)
+{
+  cspm_t *ctx = (cspm_t *) arg;
+  call_activity_t *activity = (call_activity_t *) timer->item;
+  UINT32 call_id = activity->call_id;
+  int64_t inactivity_ms = (int64_t) ctx->call_inactivity_period * 1000;
+  int64_t idle_ms = zclock_mono () - activity->last_activity;
+  char call_id_str[CSPM_TMP_BUFFER];
+
+  if (idle_ms < inactivity_ms) {
+    cswheel_schedule (ctx->expiry_wheel, &activity->expiry,
+        activity->last_activity + inactivity_ms);
+    return;
+  }
+
+  TRACE (DEBUG, "Call <%u> had been without activity since <%" PRId64
+      "> seconds", call_id, idle_ms / 1000);
+  cspm_save_call_voice_data (ctx, call_id);
+
+  // A call not saved is tried again after another period
+  snprintf (call_id_str, CSPM_TMP_BUFFER, "%u", call_id);
+  activity = (call_activity_t *) zhash_lookup (ctx->voice_calls_last_activity,
+      call_id_str);
+  if (activity) {
+    cswheel_schedule (ctx->expiry_wheel, &activity->expiry,
+        zclock_mono () + inactivity_ms);
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Callback responsible for expiring the calls without voice. Only the calls
+//  due are visited
+//  Input:
+//    loop: the reactor
+//    timer_id: the maintenance timer
+//    arg: the Call Stream Persistence Manager context
+//  Output:
+//    0: processed
 
 static int
 cspm_maintenance_handler (zloop_t *loop, int timer_id, void *arg)
@@ -2240,27 +2690,9 @@ cspm_maintenance_handler (zloop_t *loop, int timer_id, void *arg)
   TRACE (FUNCTIONS, "Entering in cspm_maintenance_handler");
 
   cspm_t *ctx = (cspm_t *) arg;
-  time_t *last_call_activity;
-
-  time_t now = time (NULL);
 
-  last_call_activity = (time_t *) zhash_first (ctx->voice_calls_last_activity);
-
-  while (last_call_activity) {
-    const char * call_id_str = zhash_cursor (ctx->voice_calls_last_activity);
-    double inactivity = difftime (now, *last_call_activity);
-    TRACE (DEBUG, "Call <%s> had been without activity since <%.f> seconds",
-        call_id_str, inactivity);
-    if (inactivity > ctx->call_inactivity_period) {
-      UINT32 call_id = atoi (zhash_cursor (ctx->voice_calls_last_activity));
-      if (ctx->mp3_mode) {
-        cspm_save_voice_data_as_mp3 (ctx, call_id);
-      } else {
-        cspm_save_voice_data (ctx, call_id);
-      }
-    }
-    last_call_activity = (time_t *) zhash_next (ctx->voice_calls_last_activity);
-  }
+  cswheel_advance (ctx->expiry_wheel, zclock_mono (), cspm_call_activity_expire,
+      ctx);
 
   TRACE (FUNCTIONS, "Leaving cspm_maintenance_handler");
 
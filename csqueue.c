@@ -0,0 +1,325 @@
+/*  =========================================================================
+    csqueue - Queue of bus frames with spill to disk
+    =========================================================================*/
+
+/*
+    This module keeps the frames published for a lossless consumer of the
+    collector bus while the consumer has no credit to receive them.
+
+    The queue holds up to max_depth frames in memory. Once it is full, the
+    following frames are appended to the spill file
+
+        <length (uint32, host order)> <frame data>
+
+    and every frame pushed after them goes to the file too, so the order is
+    kept. When the frames in memory have been popped, the spilled ones are
+    read back from the file one by one. The file is emptied as soon as it
+    has been read completely, and removed with the queue or when a write
+    fails, dropping the frames it holds.
+
+    The spill file never grows over spill_max bytes: a consumer that
+    doesn't catch up drops the frames that don't fit until it has read
+    the whole file.
+*/
+
+
+#include "cs.h"
+#include "csqueue.h"
+
+
+// <Definition>
+
+struct _csqueue_t {
+  zlist_t *frames;              // Frames in memory
+  size_t max_depth;
+  char *spill_path;             // NULL = the frames over max_depth are dropped
+  size_t spill_max;             // Bytes, 0 = no limit
+  FILE *spill_writer;
+  FILE *spill_reader;
+  size_t spill_size;            // Bytes written to the spill file
+  size_t spilled;               // Frames in the spill file not yet read
+  size_t high_water;
+  uint64_t dropped;
+};
+
+
+//  --------------------------------------------------------------------------
+//  Closes and removes the spill file
+//  Input:
+//    self: the queue
+
+static void
+csqueue_close_spill (csqueue_t *self)
+{
+  if (self->spill_writer) {
+    fclose (self->spill_writer);
+    self->spill_writer = NULL;
+  }
+  if (self->spill_reader) {
+    fclose (self->spill_reader);
+    self->spill_reader = NULL;
+  }
+  if (self->spill_path) {
+    unlink (self->spill_path);
+  }
+  self->spill_size = 0;
+  self->spilled = 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Empties the spill file once it has been read completely, so it is
+//  written again from its start
+//  Input:
+//    self: the queue
+
+static void
+csqueue_rewind_spill (csqueue_t *self)
+{
+  if (fflush (self->spill_writer) == 0 &&
+      ftruncate (fileno (self->spill_writer), 0) == 0) {
+    rewind (self->spill_writer);
+    rewind (self->spill_reader);
+    self->spill_size = 0;
+  } else {
+    TRACE (ERROR, "Error: ftruncate(%s), errno=%d text=%s",
+        self->spill_path, errno, strerror (errno));
+    csqueue_close_spill (self);
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Appends a frame to the spill file, which is created if needed
+//  Input:
+//    self: the queue
+//    frame: the frame to spill
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+static int
+csqueue_spill (csqueue_t *self, zframe_t *frame)
+{
+  uint32_t len = (uint32_t) zframe_size (frame);
+
+  if (self->spill_max &&
+      self->spill_size + sizeof (len) + len > self->spill_max) {
+    return -1;
+  }
+
+  if (!self->spill_writer) {
+    self->spill_writer = fopen (self->spill_path, "w");
+    if (self->spill_writer) {
+      self->spill_reader = fopen (self->spill_path, "r");
+    }
+    if (!self->spill_reader) {
+      TRACE (ERROR, "Error: fopen(%s), errno=%d text=%s",
+          self->spill_path, errno, strerror (errno));
+      csqueue_close_spill (self);
+      return -1;
+    }
+    TRACE (DEBUG, "Spill file: %s", self->spill_path);
+  }
+
+  // A frame partly written would be read back as garbage, with all the
+  // frames after it: the spill file is given up
+  if (fwrite (&len, sizeof (len), 1, self->spill_writer) != 1 ||
+      fwrite (zframe_data (frame), 1, len, self->spill_writer) != len) {
+    TRACE (ERROR, "Error: fwrite(), errno=%d text=%s. %zu frames lost",
+        errno, strerror (errno), self->spilled);
+    self->dropped += self->spilled;
+    csqueue_close_spill (self);
+    return -1;
+  }
+
+  self->spill_size += sizeof (len) + len;
+  self->spilled++;
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Reads back the oldest frame of the spill file
+//  Input:
+//    self: the queue
+//  Output:
+//    The frame or NULL
+
+static zframe_t *
+csqueue_unspill (csqueue_t *self)
+{
+  zframe_t *frame = NULL;
+  uint32_t len;
+
+  // The frames spilled may be still in the stdio buffer of the writer
+  fflush (self->spill_writer);
+
+  if (fread (&len, sizeof (len), 1, self->spill_reader) == 1) {
+    frame = zframe_new (NULL, len);
+    if (frame && fread (zframe_data (frame), 1, len, self->spill_reader) != len) {
+      zframe_destroy (&frame);
+    }
+  }
+
+  if (!frame) {
+    TRACE (ERROR, "Spill file %s: truncated. %zu frames lost",
+        self->spill_path, self->spilled);
+    self->dropped += self->spilled;
+    csqueue_close_spill (self);
+  } else if (--self->spilled == 0) {
+    csqueue_rewind_spill (self);
+  }
+
+  return frame;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Creates a queue
+//  Input:
+//    max_depth: the maximum number of frames kept in memory
+//    spill_path: the spill file or NULL
+//    spill_max: the maximum size of the spill file in bytes, 0 = no limit
+//  Output:
+//    The created queue or NULL
+
+csqueue_t *
+csqueue_new (size_t max_depth, const char * const spill_path,
+    size_t spill_max)
+{
+  csqueue_t *self = (csqueue_t *) calloc (1, sizeof (csqueue_t));
+  if (self) {
+    self->frames = zlist_new ();
+    self->max_depth = max_depth;
+    self->spill_max = spill_max;
+    if (spill_path) {
+      self->spill_path = strdup (spill_path);
+    }
+    if (!self->frames || (spill_path && !self->spill_path)) {
+      csqueue_destroy (&self);
+    }
+  }
+
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees the queue with its frames and removes its spill file
+//  Input:
+//    The target queue
+
+void
+csqueue_destroy (csqueue_t **self_p)
+{
+  zframe_t *frame;
+
+  if (self_p && *self_p) {
+    csqueue_t *self = *self_p;
+    if (self->frames) {
+      while ((frame = (zframe_t *) zlist_pop (self->frames))) {
+        zframe_destroy (&frame);
+      }
+      zlist_destroy (&self->frames);
+    }
+    csqueue_close_spill (self);
+    free (self->spill_path);
+    free (self);
+    *self_p = NULL;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Appends a frame to the queue. The queue takes the ownership of the frame
+//  Input:
+//    self: the queue
+//    frame_p: the frame
+//  Output:
+//    0 - Ok
+//   -1 - Nok. The frame has been dropped
+
+int
+csqueue_push (csqueue_t *self, zframe_t **frame_p)
+{
+  int rc = 0;
+
+  if (!self->spilled && zlist_size (self->frames) < self->max_depth) {
+    zlist_append (self->frames, *frame_p);
+    *frame_p = NULL;
+  } else {
+    if (!self->spill_path || csqueue_spill (self, *frame_p) == -1) {
+      self->dropped++;
+      rc = -1;
+    }
+    zframe_destroy (frame_p);
+  }
+
+  if (csqueue_size (self) > self->high_water) {
+    self->high_water = csqueue_size (self);
+  }
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Takes the oldest frame of the queue
+//  Input:
+//    self: the queue
+//  Output:
+//    The frame or NULL when the queue is empty
+
+zframe_t *
+csqueue_pop (csqueue_t *self)
+{
+  zframe_t *frame = (zframe_t *) zlist_pop (self->frames);
+
+  if (!frame && self->spilled) {
+    frame = csqueue_unspill (self);
+  }
+
+  return frame;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of frames in the queue, in memory or spilled
+
+size_t
+csqueue_size (csqueue_t *self)
+{
+  return zlist_size (self->frames) + self->spilled;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of frames in the spill file
+
+size_t
+csqueue_spilled (csqueue_t *self)
+{
+  return self->spilled;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the maximum number of frames ever queued
+
+size_t
+csqueue_high_water (csqueue_t *self)
+{
+  return self->high_water;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of frames dropped
+
+uint64_t
+csqueue_dropped (csqueue_t *self)
+{
+  return self->dropped;
+}
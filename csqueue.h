@@ -0,0 +1,51 @@
+#ifndef __CSQUEUE_H_INCLUDED__
+#define __CSQUEUE_H_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "czmq.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//  FIFO of the bus frames waiting for the credit of a lossless consumer.
+//  Up to max_depth frames are kept in memory. The following ones are
+//  spilled to a file, when there is one, and read back in order once the
+//  frames in memory have been delivered, up to spill_max bytes. Without a
+//  spill file, or once it is full, the frames over max_depth are dropped.
+
+typedef struct _csqueue_t csqueue_t;
+
+csqueue_t *
+csqueue_new (size_t max_depth, const char * const spill_path,
+    size_t spill_max);
+
+void
+csqueue_destroy (csqueue_t **self_p);
+
+int
+csqueue_push (csqueue_t *self, zframe_t **frame_p);
+
+zframe_t *
+csqueue_pop (csqueue_t *self);
+
+size_t
+csqueue_size (csqueue_t *self);
+
+size_t
+csqueue_spilled (csqueue_t *self);
+
+size_t
+csqueue_high_water (csqueue_t *self);
+
+uint64_t
+csqueue_dropped (csqueue_t *self);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
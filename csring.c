@@ -0,0 +1,314 @@
+/*  =========================================================================
+    csring - Reassembly ring buffer
+    =========================================================================*/
+
+/*
+    A bounded byte ring whose storage is mapped twice in consecutive virtual
+    memory. Thanks to the mirror, the data not yet consumed and the free space
+    are always seen as contiguous memory regions, so a producer can write
+    straight into the ring and a consumer can parse data that wraps around
+    the end of the storage in place, without ever moving it.
+*/
+
+
+#include "cs.h"
+#include <sys/mman.h>
+
+#define CSRING_TAG   0x0000b0b0
+
+// <Definition>
+
+struct _csring_t {
+  uint32_t tag;
+  unsigned char *base;
+  size_t capacity;
+  uint64_t read;
+  uint64_t write;
+  uint64_t overflows;
+};
+
+
+//  --------------------------------------------------------------------------
+//  Maps the same shared memory object twice, one mapping right after the
+//  other
+//  Input:
+//    capacity: the size of the storage, multiple of the page size
+//  Output:
+//    The first mapping or NULL
+
+static unsigned char *
+csring_map_mirror (size_t capacity)
+{
+  char path[] = "/dev/shm/csring-XXXXXX";
+  unsigned char *base = NULL;
+  int fd = -1;
+  int rc = 0;
+
+  TRACE (FUNCTIONS, "Entering in csring_map_mirror");
+
+  if ((fd = mkstemp (path)) == -1) {
+    TRACE (ERROR, "Error: mkstemp(), errno=%d text=%s", errno, strerror (errno));
+    rc = -1;
+  }
+
+  if (rc == 0) {
+    unlink (path);
+    if (ftruncate (fd, capacity) == -1) {
+      TRACE (ERROR, "Error: ftruncate(), errno=%d text=%s", errno, strerror (errno));
+      rc = -1;
+    }
+  }
+
+  if (rc == 0) {
+    // Reserve the address range for both mappings
+    base = (unsigned char *) mmap (NULL, 2 * capacity, PROT_NONE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+      TRACE (ERROR, "Error: mmap(), errno=%d text=%s", errno, strerror (errno));
+      base = NULL;
+      rc = -1;
+    }
+  }
+
+  if (rc == 0) {
+    if (mmap (base, capacity, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap (base + capacity, capacity, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+      TRACE (ERROR, "Error: mmap(), errno=%d text=%s", errno, strerror (errno));
+      munmap (base, 2 * capacity);
+      base = NULL;
+      rc = -1;
+    }
+  }
+
+  if (fd != -1) {
+    close (fd);
+  }
+
+  TRACE (FUNCTIONS, "Leaving csring_map_mirror");
+
+  return base;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Verifies if the input parameter is a ring
+
+bool
+csring_is (void *self)
+{
+  assert (self);
+  return ((csring_t *) self)->tag == CSRING_TAG;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Creates a ring
+//  Input:
+//    max_size: the maximum number of bytes stored. It is rounded up to a
+//      multiple of the page size
+//  Output:
+//    The created ring or NULL
+
+csring_t*
+csring_new (size_t max_size)
+{
+  size_t page_size = (size_t) sysconf (_SC_PAGESIZE);
+  csring_t *self = (csring_t *) zmalloc (sizeof (csring_t));
+  if (self) {
+    self->tag = CSRING_TAG;
+    self->capacity = ((max_size + page_size - 1) / page_size) * page_size;
+    self->read = 0;
+    self->write = 0;
+    self->overflows = 0;
+    self->base = csring_map_mirror (self->capacity);
+    if (!self->base) {
+      free (self);
+      self = NULL;
+    }
+  }
+
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees all the resources created in a ring
+//  Input:
+//    The target ring
+
+void
+csring_destroy (csring_t **self_p)
+{
+  assert (self_p);
+  if (*self_p) {
+    csring_t *self = *self_p;
+    assert (csring_is (self));
+    munmap (self->base, 2 * self->capacity);
+    free (self);
+    *self_p = NULL;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the start of the data not yet consumed. The csring_size bytes
+//  from it are contiguous.
+
+unsigned char *
+csring_head (csring_t *self)
+{
+  assert (self);
+  return self->base + (self->read % self->capacity);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of bytes not yet consumed
+
+size_t
+csring_size (csring_t *self)
+{
+  assert (self);
+  return (size_t) (self->write - self->read);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns where the next bytes have to be written. The csring_free bytes
+//  from it are contiguous.
+
+unsigned char *
+csring_tail (csring_t *self)
+{
+  assert (self);
+  return self->base + (self->write % self->capacity);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns where len bytes can be written directly. They must be committed
+//  later with csring_produce.
+//  Input:
+//    len: the number of bytes that will be written at most
+//  Output:
+//    The tail of the ring or NULL if there isn't enough free space. In this
+//    case the overflow is counted
+
+unsigned char *
+csring_reserve (csring_t *self, size_t len)
+{
+  unsigned char *tail = NULL;
+
+  assert (self);
+
+  if (len > csring_free (self)) {
+    self->overflows++;
+  } else {
+    tail = csring_tail (self);
+  }
+
+  return tail;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of bytes that can be written
+
+size_t
+csring_free (csring_t *self)
+{
+  assert (self);
+  return self->capacity - csring_size (self);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the maximum number of bytes stored
+
+size_t
+csring_capacity (csring_t *self)
+{
+  assert (self);
+  return self->capacity;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Commits len bytes written directly at csring_tail
+
+void
+csring_produce (csring_t *self, size_t len)
+{
+  assert (self);
+  assert (len <= csring_free (self));
+  self->write += len;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Releases len bytes from csring_head
+
+void
+csring_consume (csring_t *self, size_t len)
+{
+  assert (self);
+  assert (len <= csring_size (self));
+  self->read += len;
+  if (self->read == self->write) {
+    self->read = 0;
+    self->write = 0;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Copies data at the end of the ring
+//  Input:
+//    data: the data to store
+//    len: the data's length
+//  Output:
+//    0 - Ok
+//   -1 - Nok. The data doesn't fit and the overflow is counted
+
+int
+csring_append (csring_t *self, const void * const data, size_t len)
+{
+  int rc = 0;
+
+  assert (self);
+
+  if (len > csring_free (self)) {
+    self->overflows++;
+    rc = -1;
+  } else {
+    memcpy (csring_tail (self), data, len);
+    self->write += len;
+  }
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Discards all the data not yet consumed
+
+void
+csring_reset (csring_t *self)
+{
+  assert (self);
+  self->read = 0;
+  self->write = 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of appends refused because the ring was full
+
+uint64_t
+csring_overflows (csring_t *self)
+{
+  assert (self);
+  return self->overflows;
+}
@@ -0,0 +1,56 @@
+#ifndef __CSRING_H_INCLUDED__
+#define __CSRING_H_INCLUDED__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+bool
+csring_is (void *self);
+
+csring_t*
+csring_new (size_t max_size);
+
+void
+csring_destroy (csring_t **self_p);
+
+unsigned char *
+csring_head (csring_t *self);
+
+size_t
+csring_size (csring_t *self);
+
+unsigned char *
+csring_tail (csring_t *self);
+
+unsigned char *
+csring_reserve (csring_t *self, size_t len);
+
+size_t
+csring_free (csring_t *self);
+
+size_t
+csring_capacity (csring_t *self);
+
+void
+csring_produce (csring_t *self, size_t len);
+
+void
+csring_consume (csring_t *self, size_t len);
+
+int
+csring_append (csring_t *self, const void * const data, size_t len);
+
+void
+csring_reset (csring_t *self);
+
+uint64_t
+csring_overflows (csring_t *self);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,286 @@
+/*  =========================================================================
+    csrtp - RTP sender of G.711 streams
+    =========================================================================*/
+
+/*
+    This module wraps the A-law samples of an intercepted call into RTP
+    packets, so any RTP capable player can receive the stream of a feeder
+    without a transcoding stage in between.
+
+    The samples are appended to the payload of the packet being built and
+    the packet is sent as soon as it holds ptime milliseconds of voice. The
+    sequence number grows by one and the timestamp by the samples of a
+    packet. The voice of a call arrives while its parties speak only, so
+    when the samples of a send arrive CSRTP_GAP_MS after the end of the
+    voice already sent, the timestamp jumps to the time elapsed and the
+    first packet of the new talkspurt has the marker bit set.
+
+    The SSRC, the first sequence number and the first timestamp are random
+    and change whenever the sender is reset, i.e. for every new listener.
+*/
+
+
+#include "cs.h"
+#include "csrtp.h"
+#include <fcntl.h>
+
+
+#define CSRTP_VERSION 2
+#define CSRTP_HEADER_SIZE 12
+#define CSRTP_MAX_PAYLOAD_SIZE 480
+
+// <Definition>
+
+struct _csrtp_t {
+  int fd;
+  struct sockaddr_in dest;
+  csrtp_sender_fn *sender;      // NULL = sendto through fd
+  void *sender_arg;
+  uint8_t payload_type;
+  uint32_t clock_rate;
+  size_t samples_per_packet;
+  uint32_t ssrc;
+  uint16_t sequence;            // Of the next packet
+  uint32_t timestamp;           // Of the next packet
+  bool marker;                  // The next packet starts a talkspurt
+  int64_t talkspurt_ms;         // Monotonic time of the talkspurt start
+  uint32_t talkspurt_timestamp;
+  size_t pending;               // Samples in the packet being built
+  uint64_t packets;
+  uint8_t packet[CSRTP_HEADER_SIZE + CSRTP_MAX_PAYLOAD_SIZE];
+};
+
+
+//  --------------------------------------------------------------------------
+//  Returns a random number for the SSRC and the initial sequence number and
+//  timestamp of a stream
+
+static uint32_t
+csrtp_random (void)
+{
+  uint32_t value;
+  int fd = open ("/dev/urandom", O_RDONLY);
+
+  if (fd == -1 || read (fd, &value, sizeof (value)) != sizeof (value)) {
+    value = ((uint32_t) random () << 1) ^ (uint32_t) zclock_mono ();
+  }
+  if (fd != -1) {
+    close (fd);
+  }
+
+  return value;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Sends the packet being built
+//  Input:
+//    self: the sender
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+static int
+csrtp_flush (csrtp_t *self)
+{
+  int rc = 0;
+  uint8_t *header = self->packet;
+
+  header[0] = CSRTP_VERSION << 6;
+  header[1] = (self->marker ? 0x80 : 0x00) | (self->payload_type & 0x7f);
+  header[2] = self->sequence >> 8;
+  header[3] = self->sequence & 0xff;
+  header[4] = self->timestamp >> 24;
+  header[5] = (self->timestamp >> 16) & 0xff;
+  header[6] = (self->timestamp >> 8) & 0xff;
+  header[7] = self->timestamp & 0xff;
+  header[8] = self->ssrc >> 24;
+  header[9] = (self->ssrc >> 16) & 0xff;
+  header[10] = (self->ssrc >> 8) & 0xff;
+  header[11] = self->ssrc & 0xff;
+
+  if (self->sender) {
+    rc = self->sender (self->sender_arg, &self->dest, self->packet,
+        CSRTP_HEADER_SIZE + self->pending);
+  } else if (sendto (self->fd, self->packet, CSRTP_HEADER_SIZE + self->pending, 0,
+      (struct sockaddr *) &self->dest, sizeof (self->dest)) == -1) {
+    TRACE (ERROR, "Error: sendto(), errno=%d text=%s", errno, strerror (errno));
+    rc = -1;
+  }
+
+  // A lost packet leaves a gap in the sequence numbers, as in the network
+  self->sequence++;
+  self->timestamp += self->pending;
+  self->marker = false;
+  self->pending = 0;
+  self->packets++;
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Creates a sender
+//  Input:
+//    fd: the UDP socket the packets are sent through
+//    dest: the destination of the packets
+//    payload_type: the RTP payload type, e.g. CSRTP_PT_PCMA
+//    clock_rate: the samples per second
+//    ptime_ms: the duration of the voice of a packet
+//  Output:
+//    The created sender or NULL
+
+csrtp_t *
+csrtp_new (int fd, const struct sockaddr_in * const dest,
+    uint8_t payload_type, uint32_t clock_rate, unsigned int ptime_ms)
+{
+  csrtp_t *self = NULL;
+  size_t samples_per_packet = (size_t) clock_rate * ptime_ms / 1000;
+
+  if (samples_per_packet == 0 || samples_per_packet > CSRTP_MAX_PAYLOAD_SIZE) {
+    TRACE (ERROR, "Bad RTP packetisation: %u ms at %u Hz", ptime_ms, clock_rate);
+  } else {
+    self = (csrtp_t *) calloc (1, sizeof (csrtp_t));
+  }
+
+  if (self) {
+    self->fd = fd;
+    self->dest = *dest;
+    self->payload_type = payload_type;
+    self->clock_rate = clock_rate;
+    self->samples_per_packet = samples_per_packet;
+    csrtp_reset (self);
+  }
+
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees the sender. The socket belongs to the caller
+//  Input:
+//    The target sender
+
+void
+csrtp_destroy (csrtp_t **self_p)
+{
+  if (self_p && *self_p) {
+    free (*self_p);
+    *self_p = NULL;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Hands the packets to a function instead of sending them through the
+//  socket of the sender, e.g. to send them in batches
+//  Input:
+//    self: the sender
+//    sender: the function or NULL to send through the socket again
+//    arg: the first argument of the function
+
+void
+csrtp_set_sender (csrtp_t *self, csrtp_sender_fn *sender, void *arg)
+{
+  self->sender = sender;
+  self->sender_arg = arg;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Starts a new stream. The samples not sent yet are discarded
+//  Input:
+//    self: the sender
+
+void
+csrtp_reset (csrtp_t *self)
+{
+  self->ssrc = csrtp_random ();
+  self->sequence = (uint16_t) csrtp_random ();
+  self->timestamp = csrtp_random ();
+  self->marker = true;
+  self->talkspurt_ms = 0;
+  self->pending = 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Appends samples to the stream and sends the packets completed
+//  Input:
+//    self: the sender
+//    samples: the G.711 samples
+//    len: the number of samples
+//  Output:
+//    The number of packets sent
+//   -1 - Nok
+
+int
+csrtp_send (csrtp_t *self, const uint8_t * const samples, size_t len)
+{
+  int rc = 0;
+  int sent = 0;
+  size_t offset = 0;
+  size_t chunk;
+  int64_t now = zclock_mono ();
+
+  // The end of the voice already sent, as time from the talkspurt start
+  int64_t voice_ms = (int64_t) (uint32_t) (self->timestamp + self->pending -
+      self->talkspurt_timestamp) * 1000 / self->clock_rate;
+
+  if (self->talkspurt_ms == 0) {
+    self->talkspurt_ms = now;
+    self->talkspurt_timestamp = self->timestamp;
+  } else if (now - self->talkspurt_ms > voice_ms + CSRTP_GAP_MS) {
+    // Silence. The samples of the last talkspurt still waiting are sent
+    // before the timestamp jumps
+    if (self->pending) {
+      sent += csrtp_flush (self) == 0;
+    }
+    self->timestamp = self->talkspurt_timestamp +
+        (uint32_t) ((now - self->talkspurt_ms) * self->clock_rate / 1000);
+    self->talkspurt_ms = now;
+    self->talkspurt_timestamp = self->timestamp;
+    self->marker = true;
+  }
+
+  while (offset < len) {
+    chunk = self->samples_per_packet - self->pending;
+    if (chunk > len - offset) {
+      chunk = len - offset;
+    }
+    memcpy (self->packet + CSRTP_HEADER_SIZE + self->pending,
+        samples + offset, chunk);
+    self->pending += chunk;
+    offset += chunk;
+
+    if (self->pending == self->samples_per_packet) {
+      if (csrtp_flush (self) == 0) {
+        sent++;
+      } else {
+        rc = -1;
+      }
+    }
+  }
+
+  return rc == 0 ? sent : -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the synchronization source of the stream
+
+uint32_t
+csrtp_ssrc (csrtp_t *self)
+{
+  return self->ssrc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of packets sent since the sender was created
+
+uint64_t
+csrtp_packets (csrtp_t *self)
+{
+  return self->packets;
+}
@@ -0,0 +1,58 @@
+#ifndef __CSRTP_H_INCLUDED__
+#define __CSRTP_H_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <netinet/in.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//  RTP sender of a G.711 stream (RFC 3550, RFC 3551). The samples are
+//  gathered into packets of ptime milliseconds, which are sent with
+//  consecutive sequence numbers and timestamps to a destination. A silence
+//  longer than CSRTP_GAP_MS moves the timestamp forward by the time elapsed
+//  and starts a new talkspurt (marker bit).
+
+#define CSRTP_PT_PCMA 8
+#define CSRTP_G711_CLOCK_RATE 8000
+#define CSRTP_PTIME_MS 20
+#define CSRTP_GAP_MS 200
+
+typedef struct _csrtp_t csrtp_t;
+
+// Sends a packet instead of the sendto of the sender. Returns 0 or -1
+
+typedef int (csrtp_sender_fn) (void *arg, const struct sockaddr_in * const dest,
+    const uint8_t * const packet, size_t len);
+
+csrtp_t *
+csrtp_new (int fd, const struct sockaddr_in * const dest,
+    uint8_t payload_type, uint32_t clock_rate, unsigned int ptime_ms);
+
+void
+csrtp_destroy (csrtp_t **self_p);
+
+void
+csrtp_set_sender (csrtp_t *self, csrtp_sender_fn *sender, void *arg);
+
+void
+csrtp_reset (csrtp_t *self);
+
+int
+csrtp_send (csrtp_t *self, const uint8_t * const samples, size_t len);
+
+uint32_t
+csrtp_ssrc (csrtp_t *self);
+
+uint64_t
+csrtp_packets (csrtp_t *self);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
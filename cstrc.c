@@ -15,6 +15,8 @@
 
 #include "cs.h"
 #include "csutil.h"
+#include "cslogapi.h"
+#include "csbus.h"
 
 
 #define CSTRC_HEADER_WORKAREA_LENGTH 1024
@@ -204,9 +206,11 @@ cstrc_generate_message_header (cstrc_t *ctx,
 //  Builds, trace and publish a LOG_API_KEEP_ALIVE trace
 
 static void
-cstrc_trace_keep_alive (cstrc_t *ctx,
-    const LogApiKeepAlive * const keep_alive)
+cstrc_trace_keep_alive (cstrc_t *ctx, const void * const log_api_msg)
 {
+  const LogApiKeepAlive * const keep_alive =
+      (const LogApiKeepAlive *) log_api_msg;
+
   TRACE (FUNCTIONS, "Entering in cstrc_trace_keep_alive");
 
   BYTE swVer[sizeof (keep_alive->m_bySwVer) + 1];
@@ -264,9 +268,11 @@ cstrc_trace_keep_alive (cstrc_t *ctx,
 //  Builds, trace and publish a LOG_API_DUPLEX_CALL_CHANGE trace
 
 static void
-cstrc_trace_duplex_call_change (cstrc_t *ctx,
-    const LogApiDuplexCallChange * const duplex_call_change)
+cstrc_trace_duplex_call_change (cstrc_t *ctx, const void * const log_api_msg)
 {
+  const LogApiDuplexCallChange * const duplex_call_change =
+      (const LogApiDuplexCallChange *) log_api_msg;
+
   TRACE (FUNCTIONS, "Entering in cstrc_trace_duplex_call_change");
 
   BYTE descrA[sizeof (duplex_call_change->m_A_Descr) + 1];
@@ -353,9 +359,11 @@ cstrc_trace_duplex_call_change (cstrc_t *ctx,
 //  Builds, trace and publish a LOG_API_DUPLEX_CALL_RELEASE trace
 
 static void
-cstrc_trace_duplex_call_release (cstrc_t *ctx,
-    const LogApiDuplexCallRelease * const duplex_call_release)
+cstrc_trace_duplex_call_release (cstrc_t *ctx, const void * const log_api_msg)
 {
+  const LogApiDuplexCallRelease * const duplex_call_release =
+      (const LogApiDuplexCallRelease *) log_api_msg;
+
   TRACE (FUNCTIONS, "Entering in cstrc_trace_duplex_call_release");
 
   cstrc_generate_message_header (ctx, &duplex_call_release->Header);
@@ -395,9 +403,11 @@ cstrc_trace_duplex_call_release (cstrc_t *ctx,
 //  Builds, trace and publish a LOG_API_SIMPLEX_CALL_START_CHANGE trace
 
 static void
-cstrc_trace_simplex_call_start_change(cstrc_t *ctx,
-    const LogApiSimplexCallStartChange * const simplex_call_start_change)
+cstrc_trace_simplex_call_start_change (cstrc_t *ctx, const void * const log_api_msg)
 {
+  const LogApiSimplexCallStartChange * const simplex_call_start_change =
+      (const LogApiSimplexCallStartChange *) log_api_msg;
+
   TRACE (FUNCTIONS, "Entering in cstrc_trace_simplex_call_start_change");
 
   BYTE descrA[sizeof (simplex_call_start_change->m_A_Descr) + 1];
@@ -484,9 +494,11 @@ cstrc_trace_simplex_call_start_change(cstrc_t *ctx,
 //  Builds, trace and publish a LOG_API_SIMPLEX_CALL_PTT_CHANGE trace
 
 static void
-cstrc_trace_simplex_call_ptt_change (cstrc_t *ctx,
-    const LogApiSimplexCallPttChange * const simplex_call_ptt_change)
+cstrc_trace_simplex_call_ptt_change (cstrc_t *ctx, const void * const log_api_msg)
 {
+  const LogApiSimplexCallPttChange * const simplex_call_ptt_change =
+      (const LogApiSimplexCallPttChange *) log_api_msg;
+
   TRACE (FUNCTIONS, "Entering in cstrc_trace_simplex_call_ptt_change");
 
   cstrc_generate_message_header (ctx, &simplex_call_ptt_change->Header);
@@ -527,9 +539,11 @@ cstrc_trace_simplex_call_ptt_change (cstrc_t *ctx,
 //  Builds, trace and publish a LOG_API_SIMPLEX_CALL_RELEASE trace
 
 static void
-cstrc_trace_simplex_call_release (cstrc_t *ctx,
-    const LogApiSimplexCallRelease * const simplex_call_release)
+cstrc_trace_simplex_call_release (cstrc_t *ctx, const void * const log_api_msg)
 {
+  const LogApiSimplexCallRelease * const simplex_call_release =
+      (const LogApiSimplexCallRelease *) log_api_msg;
+
   TRACE (FUNCTIONS, "Entering in cstrc_trace_simplex_call_release");
 
   cstrc_generate_message_header (ctx, &simplex_call_release->Header);
@@ -572,9 +586,11 @@ cstrc_trace_simplex_call_release (cstrc_t *ctx,
 //  Builds, trace and publish a LOG_API_GROUP_CALL_START_CHANGE trace
 
 static void
-cstrc_trace_group_call_start_change (cstrc_t *ctx,
-    const LogApiGroupCallStartChange * const group_call_start_change)
+cstrc_trace_group_call_start_change (cstrc_t *ctx, const void * const log_api_msg)
 {
+  const LogApiGroupCallStartChange * const group_call_start_change =
+      (const LogApiGroupCallStartChange *) log_api_msg;
+
   TRACE (FUNCTIONS, "Entering in cstrc_trace_group_call_start_change");
 
   BYTE grpDescr[sizeof (group_call_start_change->m_Group_Descr) + 1];
@@ -641,9 +657,11 @@ cstrc_trace_group_call_start_change (cstrc_t *ctx,
 //  Builds, trace and publish a LOG_API_GROUP_CALL_PTT_ACTIVE trace
 
 static void
-cstrc_trace_group_call_ptt_active (cstrc_t *ctx,
-    const LogApiGroupCallPttActive * const group_call_ptt_active)
+cstrc_trace_group_call_ptt_active (cstrc_t *ctx, const void * const log_api_msg)
 {
+  const LogApiGroupCallPttActive * const group_call_ptt_active =
+      (const LogApiGroupCallPttActive *) log_api_msg;
+
   TRACE (FUNCTIONS, "Entering in cstrc_trace_group_call_ptt_active");
 
   BYTE descr[sizeof (group_call_ptt_active->m_TP_Descr) + 1];
@@ -699,9 +717,11 @@ cstrc_trace_group_call_ptt_active (cstrc_t *ctx,
 //  Builds, trace and publish a LOG_API_GROUP_CALL_PTT_IDLE trace
 
 static void
-cstrc_trace_group_call_ptt_idle (cstrc_t *ctx,
-    const LogApiGroupCallPttIdle * const group_call_ptt_idle)
+cstrc_trace_group_call_ptt_idle (cstrc_t *ctx, const void * const log_api_msg)
 {
+  const LogApiGroupCallPttIdle * const group_call_ptt_idle =
+      (const LogApiGroupCallPttIdle *) log_api_msg;
+
   TRACE (FUNCTIONS, "Entering in cstrc_trace_group_call_ptt_idle");
 
   cstrc_generate_message_header (ctx, &group_call_ptt_idle->Header);
@@ -735,9 +755,11 @@ cstrc_trace_group_call_ptt_idle (cstrc_t *ctx,
 //  Builds, trace and publish a LOG_API_GROUP_CALL_RELEASE trace
 
 static void
-cstrc_trace_group_call_release (cstrc_t *ctx,
-    const LogApiGroupCallRelease * const group_call_release)
+cstrc_trace_group_call_release (cstrc_t *ctx, const void * const log_api_msg)
 {
+  const LogApiGroupCallRelease * const group_call_release =
+      (const LogApiGroupCallRelease *) log_api_msg;
+
   TRACE (FUNCTIONS, "Entering in cstrc_trace_group_call_release");
 
   cstrc_generate_message_header (ctx, &group_call_release->Header);
@@ -779,9 +801,11 @@ cstrc_trace_group_call_release (cstrc_t *ctx,
 //  Builds, trace and publish a LOG_API_SDS_STATUS trace
 
 static void
-cstrc_trace_status_sds (cstrc_t *ctx,
-    const LogApiStatusSDS * const status_sds)
+cstrc_trace_status_sds (cstrc_t *ctx, const void * const log_api_msg)
 {
+  const LogApiStatusSDS * const status_sds =
+      (const LogApiStatusSDS *) log_api_msg;
+
   TRACE (FUNCTIONS, "Entering in cstrc_trace_status_sds");
 
   BYTE descrA[sizeof (status_sds->m_A_Descr) + 1];
@@ -853,9 +877,11 @@ cstrc_trace_status_sds (cstrc_t *ctx,
 //  Builds, trace and publish a LOG_API_SDS_TEXT trace
 
 static void
-cstrc_trace_text_sds (cstrc_t *ctx,
-    const LogApiTextSDS * const text_sds)
+cstrc_trace_text_sds (cstrc_t *ctx, const void * const log_api_msg)
 {
+  const LogApiTextSDS * const text_sds =
+      (const LogApiTextSDS *) log_api_msg;
+
   TRACE (FUNCTIONS, "Entering in cstrc_trace_text_sds");
 
   BYTE descrA[sizeof (text_sds->m_A_Descr) + 1];
@@ -988,6 +1014,26 @@ cstrc_trace_voice (cstrc_t *ctx,
 }
 
 
+// Handlers of the LogApi message types indexed by MsgId
+
+typedef void (cstrc_handler_fn) (cstrc_t *ctx, const void * const log_api_msg);
+
+static cstrc_handler_fn * const cstrc_handlers[CS_LOG_API_MSG_ID_COUNT] = {
+  [LOG_API_ALIVE] = cstrc_trace_keep_alive,
+  [LOG_API_DUPLEX_CALL_CHANGE] = cstrc_trace_duplex_call_change,
+  [LOG_API_DUPLEX_CALL_RELEASE] = cstrc_trace_duplex_call_release,
+  [LOG_API_SIMPLEX_CALL_CHANGE] = cstrc_trace_simplex_call_start_change,
+  [LOG_API_SIMPLEX_CALL_PTT_CHANGE] = cstrc_trace_simplex_call_ptt_change,
+  [LOG_API_SIMPLEX_CALL_RELEASE] = cstrc_trace_simplex_call_release,
+  [LOG_API_GROUP_CALL_CHANGE] = cstrc_trace_group_call_start_change,
+  [LOG_API_GROUP_CALL_PTT_ACTIVE] = cstrc_trace_group_call_ptt_active,
+  [LOG_API_GROUP_CALL_PTT_IDLE] = cstrc_trace_group_call_ptt_idle,
+  [LOG_API_GROUP_CALL_RELEASE] = cstrc_trace_group_call_release,
+  [LOG_API_SDS_STATUS] = cstrc_trace_status_sds,
+  [LOG_API_SDS_TEXT] = cstrc_trace_text_sds
+};
+
+
 //  --------------------------------------------------------------------------
 //  Callback responsible for processing a received LogApi message.
 //  Input:
@@ -1002,177 +1048,38 @@ static int
 cstrc_callstream_handler (zloop_t *loop, zsock_t *reader, void *arg)
 {
   TRACE (FUNCTIONS, "Entering in cstrc_callstream_handler");
-  UINT32 msg_id;
-  UINT32 call_id;
-  int rc;
+  const cs_log_api_descriptor_t *descriptor;
+  csbus_msg_t bus_msg;
 
   cstrc_t *ctx = (cstrc_t *) arg;
 
-  zmsg_t* msg;
-  msg = zmsg_recv (reader);
-  assert (msg);
-//  zmsg_print (msg);
-
-  char *tag = zmsg_popstr (msg);
-  zframe_t *timestamp = zmsg_pop (msg);
-  zframe_t *log_api_msg = zmsg_pop (msg);
-
-  if (zframe_size (timestamp) != sizeof (time_t)) {
-    TRACE (ERROR, "Timestamp: Bad format");
-    time_t now = time (NULL);
-    memcpy (&ctx->timestamp, &now, sizeof (time_t));
-  } else {
-    memcpy (&ctx->timestamp, zframe_data (timestamp), sizeof (time_t));
-  }
-
-  rc = sscanf (tag, "S_%u", &msg_id);
-
-  if (rc != EOF && rc > 0) {
-    switch (msg_id) {
-    case LOG_API_ALIVE:
-      TRACE (DEBUG, "Message type: LOG_API_KEEP_ALIVE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiKeepAlive)) {
-        LogApiKeepAlive *keep_alive =
-            (LogApiKeepAlive *) zframe_data (log_api_msg);
-        cstrc_trace_keep_alive (ctx, keep_alive);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_DUPLEX_CALL_CHANGE:
-      TRACE (DEBUG, "Message type: LOG_API_DUPLEX_CALL_CHANGE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiDuplexCallChange)) {
-        LogApiDuplexCallChange *duplex_call_change =
-            (LogApiDuplexCallChange *) zframe_data (log_api_msg);
-        cstrc_trace_duplex_call_change (ctx, duplex_call_change);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_DUPLEX_CALL_RELEASE:
-      TRACE (DEBUG, "Message type: LOG_API_DUPLEX_CALL_RELEASE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiDuplexCallRelease)) {
-        LogApiDuplexCallRelease *duplex_call_release =
-            (LogApiDuplexCallRelease *) zframe_data (log_api_msg);
-        cstrc_trace_duplex_call_release (ctx, duplex_call_release);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_SIMPLEX_CALL_CHANGE:
-      TRACE (DEBUG, "Message type: LOG_API_SIMPLEX_CALL_START_CHANGE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiSimplexCallStartChange)) {
-        LogApiSimplexCallStartChange *simplex_call_start_change =
-            (LogApiSimplexCallStartChange *) zframe_data (log_api_msg);
-        cstrc_trace_simplex_call_start_change (ctx, simplex_call_start_change);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_SIMPLEX_CALL_PTT_CHANGE:
-      TRACE (DEBUG, "Message type: LOG_API_SIMPLEX_CALL_PTT_CHANGE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiSimplexCallPttChange)) {
-        LogApiSimplexCallPttChange *simplex_call_ptt_change =
-            (LogApiSimplexCallPttChange *) zframe_data (log_api_msg);
-        cstrc_trace_simplex_call_ptt_change (ctx, simplex_call_ptt_change);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_SIMPLEX_CALL_RELEASE:
-      TRACE (DEBUG, "Message type: LOG_API_SIMPLEX_CALL_RELEASE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiSimplexCallRelease)) {
-        LogApiSimplexCallRelease *simplex_call_release =
-            (LogApiSimplexCallRelease *) zframe_data (log_api_msg);
-        cstrc_trace_simplex_call_release (ctx, simplex_call_release);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_GROUP_CALL_CHANGE:
-      TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_START_CHANGE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiGroupCallStartChange)) {
-        LogApiGroupCallStartChange *group_call_start_change =
-            (LogApiGroupCallStartChange *) zframe_data (log_api_msg);
-        cstrc_trace_group_call_start_change (ctx, group_call_start_change);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_GROUP_CALL_PTT_ACTIVE:
-      TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_PPT_ACTIVE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiGroupCallPttActive)) {
-        LogApiGroupCallPttActive *group_call_ptt_active =
-            (LogApiGroupCallPttActive *) zframe_data (log_api_msg);
-        cstrc_trace_group_call_ptt_active (ctx, group_call_ptt_active);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_GROUP_CALL_PTT_IDLE:
-      TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_PTT_IDLE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiGroupCallPttIdle)) {
-        LogApiGroupCallPttIdle *group_call_ptt_idle =
-            (LogApiGroupCallPttIdle *) zframe_data (log_api_msg);
-        cstrc_trace_group_call_ptt_idle (ctx, group_call_ptt_idle);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_GROUP_CALL_RELEASE:
-      TRACE (DEBUG, "Message type: LOG_API_GROUP_CALL_RELEASE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiGroupCallRelease)) {
-        LogApiGroupCallRelease *group_call_release =
-            (LogApiGroupCallRelease *) zframe_data (log_api_msg);
-        cstrc_trace_group_call_release (ctx, group_call_release);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_SDS_STATUS:
-      TRACE (DEBUG, "Message type: LOG_API_SDS_STATUS");
-      if (zframe_size (log_api_msg) == sizeof (LogApiStatusSDS)) {
-        LogApiStatusSDS *status_sds =
-            (LogApiStatusSDS *) zframe_data (log_api_msg);
-        cstrc_trace_status_sds (ctx, status_sds);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-      break;
-    case LOG_API_SDS_TEXT:
-      TRACE (DEBUG, "Message type: LOG_API_SDS_TEXT");
-      if (zframe_size (log_api_msg) == sizeof (LogApiTextSDS)) {
-        LogApiTextSDS *text_sds =
-            (LogApiTextSDS *) zframe_data (log_api_msg);
-        cstrc_trace_text_sds (ctx, text_sds);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
+  zframe_t *frame = zframe_recv (reader);
+  assert (frame);
+
+  if (csbus_decode (frame, &bus_msg) == -1) {
+    TRACE (ERROR, "Bus message: Bad format");
+  } else if (bus_msg.type == CSBUS_SIGNALING) {
+    ctx->timestamp = bus_msg.timestamp;
+    descriptor = cs_log_api_descriptor ((UINT8) bus_msg.id);
+    if (!descriptor) {
+      TRACE (DEBUG, "Message type: UNKNOWN (%u)", bus_msg.id);
+    } else if (bus_msg.log_api_msg_size != descriptor->size) {
+      TRACE (ERROR, "LogApi message: Bad format");
+    } else {
+      TRACE (DEBUG, "Message type: %s", descriptor->name);
+      if (cstrc_handlers[descriptor->msg_id]) {
+        cstrc_handlers[descriptor->msg_id] (ctx, bus_msg.log_api_msg);
       }
-      break;
-    default:
-      TRACE (DEBUG, "Message type: UNKNOWN (%x)", msg_id);
-      break;
     }
+  } else if (bus_msg.type == CSBUS_VOICE) {
+    ctx->timestamp = bus_msg.timestamp;
+    TRACE (DEBUG, "Message type: LOG_API_VOICE");
+    cstrc_trace_voice (ctx, (const LogApiVoice *) bus_msg.log_api_msg);
   } else {
-    rc = sscanf (tag, "V_%u", &call_id);
-    if (rc != EOF && rc > 0) {
-      TRACE (DEBUG, "Message type: LOG_API_VOICE");
-      if (zframe_size (log_api_msg) == sizeof (LogApiVoice)) {
-        LogApiVoice *voice =
-            (LogApiVoice *) zframe_data (log_api_msg);
-        cstrc_trace_voice (ctx, voice);
-      } else {
-        TRACE (ERROR, "LogApi message: Bad format");
-      }
-    } else {
-      TRACE (DEBUG, "Message tag: UNKNOWN (%s)", tag);
-    }
+    TRACE (DEBUG, "Message type: UNKNOWN (%c)", bus_msg.type);
   }
 
-  free (tag);
-  zframe_destroy (&timestamp);
-  zframe_destroy (&log_api_msg);
-  zmsg_destroy (&msg);
+  zframe_destroy (&frame);
 
   TRACE (FUNCTIONS, "Leaving cstrc_callstream_handler");
 
@@ -1237,7 +1144,7 @@ cstrc_configure (cstrc_t *ctx)
   for (x = 1; x <= num_subscriptions; x++) {
     snprintf (path, sizeof (path), "/tracer_manager/subscriptions/subscription_%d", x);
     string = zconfig_resolve (root, path, "0");
-    zsock_set_subscribe (ctx->subscriber, string);
+    csbus_subscribe (ctx->subscriber, string);
   }
 
   string = zconfig_resolve (root, "/tracer_manager/json_publisher", "tcp://*:5501");
@@ -1,10 +1,21 @@
 #include "csutil.h"
 #include "trace.h"
-#include "wave.h"
 #include "stdlib.h"
 #include "memory.h"
-#include "sys/stat.h"
-#include "errno.h"
+
+#if defined (__x86_64__) || defined (__i386__)
+#define CS_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Bytes of the LogApi signatures as received from the wire. Both signatures
+// share the first three bytes ("LOG") and differ only in the fourth one.
+
+#define CS_SIGNATURE_BYTE_0 ((unsigned char) (LOG_API_PROTOCOL_SIGNATURE & 0xff))
+#define CS_SIGNATURE_BYTE_1 ((unsigned char) ((LOG_API_PROTOCOL_SIGNATURE >> 8) & 0xff))
+#define CS_SIGNATURE_BYTE_2 ((unsigned char) ((LOG_API_PROTOCOL_SIGNATURE >> 16) & 0xff))
+#define CS_SIGNATURE_BYTE_LOG ((unsigned char) ((LOG_API_PROTOCOL_SIGNATURE >> 24) & 0xff))
+#define CS_SIGNATURE_BYTE_VOICE ((unsigned char) ((VOICE_PROTOCOL_SIGNATURE >> 24) & 0xff))
 
 
 //  --------------------------------------------------------------------------
@@ -167,126 +178,404 @@ cs_string_from_stream_originator (enum StreamOriginatorEnum n)
 
 
 //  --------------------------------------------------------------------------
-//  <Description>
-//  <Returns>
-
-void
-cs_write_wav_file (const char * const path, const unsigned char * const buffer)
+//  Scalar search of the next LogApi or Voice signature
+//  Input:
+//    buffer: the data to search in
+//    from: the offset where the search starts
+//    len: the size of the data
+//  Output:
+//    The offset of the first signature found or len - 3 if there is none
+
+static size_t
+cs_find_signature_scalar (const unsigned char * const buffer, size_t from,
+    size_t len)
 {
-  WaveHeader wave_header;
-  struct stat file_stat;
-  int rc = 0;
-  FILE *fp;
-
-  TRACE (FUNCTIONS, "Entering in cs_write_wav_file");
-
-  if (stat (path, &file_stat) == -1) {
-    /* File doesn't exist. Generate a new WAVE header for A-law */
-    wave_header.riffId[0] = 'R';
-    wave_header.riffId[1] = 'I';
-    wave_header.riffId[2] = 'F';
-    wave_header.riffId[3] = 'F';
-    wave_header.riffSize = 4 + 26 + 12 + 8;
-    wave_header.waveId[0] = 'W';
-    wave_header.waveId[1] = 'A';
-    wave_header.waveId[2] = 'V';
-    wave_header.waveId[3] = 'E';
-
-    wave_header.fmtId[0] = 'f';
-    wave_header.fmtId[1] = 'm';
-    wave_header.fmtId[2] = 't';
-    wave_header.fmtId[3] = ' ';
-    wave_header.fmtSize = 18;
-    wave_header.wFormatTag = 6; /* A-law */
-    wave_header.nChannels = 1;
-    wave_header.nSamplesPerSec = 8000;
-    wave_header.nAvgBytesperSec = 8000;
-    wave_header.nBlockAlign = 1;
-    wave_header.wBitsPerSample = 8;
-    wave_header.cbSize = 0;
-
-    wave_header.factId[0] = 'f';
-    wave_header.factId[1] = 'a';
-    wave_header.factId[2] = 'c';
-    wave_header.factId[3] = 't';
-    wave_header.factSize = 4;
-    wave_header.dwSampleLength = 0;
-
-    wave_header.dataId[0] = 'd';
-    wave_header.dataId[1] = 'a';
-    wave_header.dataId[2] = 't';
-    wave_header.dataId[3] = 'a';
-    wave_header.dataSize = 0;
-
-    TRACE (DEBUG, "WAVE header size: %d", sizeof (wave_header));
-
-    if ((fp = fopen (path, "w")) == NULL) {
-      TRACE (ERROR, "Error: fopen(), errno=%d text=%s", errno, strerror(errno));
-      rc = -1;
+  size_t i;
+
+  for (i = from; i + 3 < len; i++) {
+    if (buffer[i] == CS_SIGNATURE_BYTE_0 &&
+        buffer[i + 1] == CS_SIGNATURE_BYTE_1 &&
+        buffer[i + 2] == CS_SIGNATURE_BYTE_2 &&
+        (buffer[i + 3] == CS_SIGNATURE_BYTE_LOG ||
+         buffer[i + 3] == CS_SIGNATURE_BYTE_VOICE)) {
+      return i;
     }
+  }
+
+  return i;
+}
 
-    if (rc == 0) {
-      if (fwrite (&wave_header, 1, sizeof (wave_header), fp) != sizeof (wave_header)) {
-        TRACE (ERROR, "Error: fwrite(), errno=%d text=%s", errno, strerror (errno));
-        rc = -1;
-      }
 
-      fclose (fp);
-      fp = NULL;
+#ifdef CS_HAVE_X86_SIMD
+
+//  --------------------------------------------------------------------------
+//  SSE2 search of the next LogApi or Voice signature. Checks 16 candidate
+//  positions per iteration.
+//  Input:
+//    buffer: the data to search in
+//    len: the size of the data
+//  Output:
+//    The offset of the first signature found or len - 3 if there is none
+
+__attribute__ ((target ("sse2")))
+static size_t
+cs_find_signature_sse2 (const unsigned char * const buffer, size_t len)
+{
+  const __m128i b0 = _mm_set1_epi8 ((char) CS_SIGNATURE_BYTE_0);
+  const __m128i b1 = _mm_set1_epi8 ((char) CS_SIGNATURE_BYTE_1);
+  const __m128i b2 = _mm_set1_epi8 ((char) CS_SIGNATURE_BYTE_2);
+  const __m128i b3_log = _mm_set1_epi8 ((char) CS_SIGNATURE_BYTE_LOG);
+  const __m128i b3_voice = _mm_set1_epi8 ((char) CS_SIGNATURE_BYTE_VOICE);
+  size_t i = 0;
+
+  for (; i + 3 + 16 <= len; i += 16) {
+    __m128i v0 = _mm_loadu_si128 ((const __m128i *) (buffer + i));
+    __m128i v1 = _mm_loadu_si128 ((const __m128i *) (buffer + i + 1));
+    __m128i v2 = _mm_loadu_si128 ((const __m128i *) (buffer + i + 2));
+    __m128i v3 = _mm_loadu_si128 ((const __m128i *) (buffer + i + 3));
+    __m128i m = _mm_and_si128 (
+        _mm_and_si128 (_mm_cmpeq_epi8 (v0, b0), _mm_cmpeq_epi8 (v1, b1)),
+        _mm_and_si128 (_mm_cmpeq_epi8 (v2, b2),
+            _mm_or_si128 (_mm_cmpeq_epi8 (v3, b3_log),
+                _mm_cmpeq_epi8 (v3, b3_voice))));
+    int mask = _mm_movemask_epi8 (m);
+    if (mask) {
+      return i + __builtin_ctz (mask);
     }
   }
 
-  if (rc == 0) {
-    if ((fp = fopen (path, "a")) == NULL) {
-      TRACE(ERROR, "Error: fopen(), errno=%d text=%s", errno, strerror (errno));
-      rc = -1;
-    }
+  return cs_find_signature_scalar (buffer, i, len);
+}
 
-    if (rc == 0) {
-      if (fwrite (buffer + 20, 1, 480, fp) != 480) {
-        TRACE (ERROR, "Error: fwrite(), errno=%d text=%s", errno, strerror (errno));
-        rc = -1;
-      }
 
-      fclose (fp);
-      fp = NULL;
+//  --------------------------------------------------------------------------
+//  AVX2 search of the next LogApi or Voice signature. Checks 32 candidate
+//  positions per iteration.
+//  Input:
+//    buffer: the data to search in
+//    len: the size of the data
+//  Output:
+//    The offset of the first signature found or len - 3 if there is none
+
+__attribute__ ((target ("avx2")))
+static size_t
+cs_find_signature_avx2 (const unsigned char * const buffer, size_t len)
+{
+  const __m256i b0 = _mm256_set1_epi8 ((char) CS_SIGNATURE_BYTE_0);
+  const __m256i b1 = _mm256_set1_epi8 ((char) CS_SIGNATURE_BYTE_1);
+  const __m256i b2 = _mm256_set1_epi8 ((char) CS_SIGNATURE_BYTE_2);
+  const __m256i b3_log = _mm256_set1_epi8 ((char) CS_SIGNATURE_BYTE_LOG);
+  const __m256i b3_voice = _mm256_set1_epi8 ((char) CS_SIGNATURE_BYTE_VOICE);
+  size_t i = 0;
+
+  for (; i + 3 + 32 <= len; i += 32) {
+    __m256i v0 = _mm256_loadu_si256 ((const __m256i *) (buffer + i));
+    __m256i v1 = _mm256_loadu_si256 ((const __m256i *) (buffer + i + 1));
+    __m256i v2 = _mm256_loadu_si256 ((const __m256i *) (buffer + i + 2));
+    __m256i v3 = _mm256_loadu_si256 ((const __m256i *) (buffer + i + 3));
+    __m256i m = _mm256_and_si256 (
+        _mm256_and_si256 (_mm256_cmpeq_epi8 (v0, b0), _mm256_cmpeq_epi8 (v1, b1)),
+        _mm256_and_si256 (_mm256_cmpeq_epi8 (v2, b2),
+            _mm256_or_si256 (_mm256_cmpeq_epi8 (v3, b3_log),
+                _mm256_cmpeq_epi8 (v3, b3_voice))));
+    unsigned int mask = (unsigned int) _mm256_movemask_epi8 (m);
+    if (mask) {
+      return i + __builtin_ctz (mask);
     }
   }
 
-  if (rc == 0) {
-    /* Update the WAVE header */
-    if ((fp = fopen (path, "r+")) == NULL) {
-      TRACE(ERROR, "Error: fopen(), errno=%d text=%s", errno, strerror(errno));
-      rc = -1;
+  return cs_find_signature_scalar (buffer, i, len);
+}
+
+#endif
+
+
+//  --------------------------------------------------------------------------
+//  Scalar entry point with the same signature as the vectorised versions
+
+static size_t
+cs_find_signature_generic (const unsigned char * const buffer, size_t len)
+{
+  return cs_find_signature_scalar (buffer, 0, len);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Searches the next LogApi ("LOG1") or Voice ("LOG2") signature. The
+//  implementation (AVX2, SSE2 or scalar) is chosen at the first call
+//  according to the CPU features.
+//  Input:
+//    buffer: the data to search in
+//    len: the size of the data
+//  Output:
+//    The offset of the first signature found. If there is none, len - 3 is
+//    returned (or 0 when len < 4) because the last 3 bytes may be the start
+//    of a signature not yet received
+
+size_t
+cs_find_signature (const unsigned char * const buffer, size_t len)
+{
+  static size_t (*find) (const unsigned char * const, size_t) = NULL;
+
+  if (!find) {
+#ifdef CS_HAVE_X86_SIMD
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2")) {
+      find = cs_find_signature_avx2;
+    } else if (__builtin_cpu_supports ("sse2")) {
+      find = cs_find_signature_sse2;
+    } else {
+      find = cs_find_signature_generic;
     }
+#else
+    find = cs_find_signature_generic;
+#endif
+  }
+
+  if (len < 4) {
+    return 0;
+  }
+
+  return find (buffer, len);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Scalar interleave of two mono streams into a stereo stream
+//  Input:
+//    a: the samples of the left channel
+//    b: the samples of the right channel
+//    from: the first sample to interleave
+//    len: the number of samples of every channel
+//  Output:
+//    dest: the 2 * len interleaved samples (a0 b0 a1 b1 ...)
+
+static void
+cs_interleave_scalar (const unsigned char * const a,
+    const unsigned char * const b, size_t from, size_t len, unsigned char *dest)
+{
+  size_t i;
+
+  for (i = from; i < len; i++) {
+    dest[2 * i] = a[i];
+    dest[2 * i + 1] = b[i];
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Scalar split of a stereo stream into two mono streams
+//  Input:
+//    src: the 2 * len interleaved samples
+//    from: the first sample to split
+//    len: the number of samples of every channel
+//  Output:
+//    a: the samples of the left channel
+//    b: the samples of the right channel
+
+static void
+cs_deinterleave_scalar (const unsigned char * const src, size_t from,
+    size_t len, unsigned char *a, unsigned char *b)
+{
+  size_t i;
+
+  for (i = from; i < len; i++) {
+    a[i] = src[2 * i];
+    b[i] = src[2 * i + 1];
+  }
+}
+
+
+static void
+cs_interleave_generic (const unsigned char * const a,
+    const unsigned char * const b, size_t len, unsigned char *dest)
+{
+  cs_interleave_scalar (a, b, 0, len, dest);
+}
 
-    if (rc == 0) {
-      if (fread (&wave_header, 1, sizeof (wave_header), fp) != sizeof (wave_header)) {
-        TRACE (ERROR, "Error: fread(), errno=%d text=%s", errno, strerror (errno));
-        rc = -1;
-      }
-
-      if (rc == 0) {
-        wave_header.riffSize += 480;
-        wave_header.dwSampleLength += 480;
-        wave_header.dataSize += 480;
-
-        if (fseek (fp, 0, SEEK_SET) != 0) {
-          TRACE (ERROR, "Error: fseek(), errno=%d text=%s", errno, strerror(errno));
-          rc = -1;
-        }
-
-        if (fwrite (&wave_header, 1, sizeof (wave_header), fp) != sizeof (wave_header)) {
-          TRACE (ERROR, "Error: fwrite(), errno=%d text=%s", errno, strerror (errno));
-          rc = -1;
-        }
-      }
-
-      fclose (fp);
-      fp = NULL;
+
+static void
+cs_deinterleave_generic (const unsigned char * const src, size_t len,
+    unsigned char *a, unsigned char *b)
+{
+  cs_deinterleave_scalar (src, 0, len, a, b);
+}
+
+
+#ifdef CS_HAVE_X86_SIMD
+
+//  --------------------------------------------------------------------------
+//  SSE2 interleave. Unpacks 16 samples of every channel per iteration
+
+__attribute__ ((target ("sse2")))
+static void
+cs_interleave_sse2 (const unsigned char * const a,
+    const unsigned char * const b, size_t len, unsigned char *dest)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i va = _mm_loadu_si128 ((const __m128i *) (a + i));
+    __m128i vb = _mm_loadu_si128 ((const __m128i *) (b + i));
+    _mm_storeu_si128 ((__m128i *) (dest + 2 * i), _mm_unpacklo_epi8 (va, vb));
+    _mm_storeu_si128 ((__m128i *) (dest + 2 * i + 16), _mm_unpackhi_epi8 (va, vb));
+  }
+
+  cs_interleave_scalar (a, b, i, len, dest);
+}
+
+
+//  --------------------------------------------------------------------------
+//  SSE2 deinterleave. Packs the even and the odd bytes of 32 interleaved
+//  samples per iteration
+
+__attribute__ ((target ("sse2")))
+static void
+cs_deinterleave_sse2 (const unsigned char * const src, size_t len,
+    unsigned char *a, unsigned char *b)
+{
+  const __m128i even = _mm_set1_epi16 (0x00ff);
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v0 = _mm_loadu_si128 ((const __m128i *) (src + 2 * i));
+    __m128i v1 = _mm_loadu_si128 ((const __m128i *) (src + 2 * i + 16));
+    _mm_storeu_si128 ((__m128i *) (a + i), _mm_packus_epi16 (
+        _mm_and_si128 (v0, even), _mm_and_si128 (v1, even)));
+    _mm_storeu_si128 ((__m128i *) (b + i), _mm_packus_epi16 (
+        _mm_srli_epi16 (v0, 8), _mm_srli_epi16 (v1, 8)));
+  }
+
+  cs_deinterleave_scalar (src, i, len, a, b);
+}
+
+
+//  --------------------------------------------------------------------------
+//  AVX2 interleave. Unpacks 32 samples of every channel per iteration. The
+//  unpack works within the 128-bit lanes, so the lanes are reordered before
+//  the store
+
+__attribute__ ((target ("avx2")))
+static void
+cs_interleave_avx2 (const unsigned char * const a,
+    const unsigned char * const b, size_t len, unsigned char *dest)
+{
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i va = _mm256_loadu_si256 ((const __m256i *) (a + i));
+    __m256i vb = _mm256_loadu_si256 ((const __m256i *) (b + i));
+    __m256i lo = _mm256_unpacklo_epi8 (va, vb);
+    __m256i hi = _mm256_unpackhi_epi8 (va, vb);
+    _mm256_storeu_si256 ((__m256i *) (dest + 2 * i),
+        _mm256_permute2x128_si256 (lo, hi, 0x20));
+    _mm256_storeu_si256 ((__m256i *) (dest + 2 * i + 32),
+        _mm256_permute2x128_si256 (lo, hi, 0x31));
+  }
+
+  cs_interleave_sse2 (a + i, b + i, len - i, dest + 2 * i);
+}
+
+
+//  --------------------------------------------------------------------------
+//  AVX2 deinterleave. Packs the even and the odd bytes of 64 interleaved
+//  samples per iteration. The pack works within the 128-bit lanes, so the
+//  64-bit quarters are reordered before the store
+
+__attribute__ ((target ("avx2")))
+static void
+cs_deinterleave_avx2 (const unsigned char * const src, size_t len,
+    unsigned char *a, unsigned char *b)
+{
+  const __m256i even = _mm256_set1_epi16 (0x00ff);
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v0 = _mm256_loadu_si256 ((const __m256i *) (src + 2 * i));
+    __m256i v1 = _mm256_loadu_si256 ((const __m256i *) (src + 2 * i + 32));
+    __m256i va = _mm256_packus_epi16 (
+        _mm256_and_si256 (v0, even), _mm256_and_si256 (v1, even));
+    __m256i vb = _mm256_packus_epi16 (
+        _mm256_srli_epi16 (v0, 8), _mm256_srli_epi16 (v1, 8));
+    _mm256_storeu_si256 ((__m256i *) (a + i), _mm256_permute4x64_epi64 (va, 0xd8));
+    _mm256_storeu_si256 ((__m256i *) (b + i), _mm256_permute4x64_epi64 (vb, 0xd8));
+  }
+
+  cs_deinterleave_sse2 (src + 2 * i, len - i, a + i, b + i);
+}
+
+#endif
+
+
+//  --------------------------------------------------------------------------
+//  Interleaves the samples of two mono streams (e.g. the A and B streams of
+//  a duplex call) into a stereo stream. The implementation (AVX2, SSE2 or
+//  scalar) is chosen at the first call according to the CPU features.
+//  Input:
+//    a: the samples of the left channel
+//    b: the samples of the right channel
+//    len: the number of samples of every channel
+//  Output:
+//    dest: the 2 * len interleaved samples (a0 b0 a1 b1 ...)
+
+void
+cs_interleave (const unsigned char * const a, const unsigned char * const b,
+    size_t len, unsigned char *dest)
+{
+  static void (*interleave) (const unsigned char * const,
+      const unsigned char * const, size_t, unsigned char *) = NULL;
+
+  if (!interleave) {
+#ifdef CS_HAVE_X86_SIMD
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2")) {
+      interleave = cs_interleave_avx2;
+    } else if (__builtin_cpu_supports ("sse2")) {
+      interleave = cs_interleave_sse2;
+    } else {
+      interleave = cs_interleave_generic;
     }
+#else
+    interleave = cs_interleave_generic;
+#endif
   }
 
-  TRACE (FUNCTIONS, "Leaving cs_write_wav_file");
+  interleave (a, b, len, dest);
 }
 
+
+//  --------------------------------------------------------------------------
+//  Splits a stereo stream into the samples of its two channels. The
+//  implementation (AVX2, SSE2 or scalar) is chosen at the first call
+//  according to the CPU features.
+//  Input:
+//    src: the 2 * len interleaved samples (a0 b0 a1 b1 ...)
+//    len: the number of samples of every channel
+//  Output:
+//    a: the samples of the left channel
+//    b: the samples of the right channel
+
+void
+cs_deinterleave (const unsigned char * const src, size_t len,
+    unsigned char *a, unsigned char *b)
+{
+  static void (*deinterleave) (const unsigned char * const, size_t,
+      unsigned char *, unsigned char *) = NULL;
+
+  if (!deinterleave) {
+#ifdef CS_HAVE_X86_SIMD
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2")) {
+      deinterleave = cs_deinterleave_avx2;
+    } else if (__builtin_cpu_supports ("sse2")) {
+      deinterleave = cs_deinterleave_sse2;
+    } else {
+      deinterleave = cs_deinterleave_generic;
+    }
+#else
+    deinterleave = cs_deinterleave_generic;
+#endif
+  }
+
+  deinterleave (src, len, a, b);
+}
@@ -1,6 +1,7 @@
 #ifndef __CSUTIL_H_INCLUDED__
 #define __CSUTIL_H_INCLUDED__
 
+#include <stddef.h>
 #include "LogApiMsgDef.h"
 
 #ifdef __cplusplus
@@ -35,8 +36,16 @@ cs_string_from_group_call_change_action (enum GroupCallChangeAction n);
 const char *
 cs_string_from_stream_originator (enum StreamOriginatorEnum n);
 
+size_t
+cs_find_signature (const unsigned char * const buffer, size_t len);
+
+void
+cs_interleave (const unsigned char * const a, const unsigned char * const b,
+    size_t len, unsigned char *dest);
+
 void
-cs_write_wav_file (const char * const path, const unsigned char * const buffer);
+cs_deinterleave (const unsigned char * const src, size_t len,
+    unsigned char *a, unsigned char *b);
 
 
 #ifdef __cplusplus
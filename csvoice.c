@@ -0,0 +1,156 @@
+/*  =========================================================================
+    csvoice - Voice payloads of the LogApiVoice packets
+    =========================================================================*/
+
+/*
+    This module describes the payloads a LogServer can send in a LogApiVoice
+    packet: G.711 A-law or the native TETRA traffic channel frames (ACELP
+    speech frames and stolen signalling). The native frames are recorded and
+    forwarded as received, and are only decoded to A-law for playback, by
+    the decoder registered with cs_voice_set_decoder. No decoder is
+    registered by default.
+*/
+
+
+#include <string.h>
+#include "csvoice.h"
+
+
+// Payload sizes and durations by PayloadInfo. -1 = unknown payload
+
+static const int cs_voice_payload_sizes[8] = {
+  0,      // PAYLOAD_INFO_NONE
+  16,     // PAYLOAD_INFO_TETRA_STCH_U
+  18,     // PAYLOAD_INFO_TETRA_TCH_S
+  27,     // PAYLOAD_INFO_TETRA_TCH7_2
+  18,     // PAYLOAD_INFO_TETRA_TCH4_8
+  9,      // PAYLOAD_INFO_TETRA_TCH2_4
+  -1,
+  480     // PAYLOAD_INFO_G711
+};
+
+static const int cs_voice_payload_durations_ms[8] = {
+  0, 30, 30, 30, 30, 30, 0, 60
+};
+
+static cs_voice_decoder_fn *cs_voice_decoder = NULL;
+
+
+//  --------------------------------------------------------------------------
+//  Returns the size of a payload
+//  Input:
+//    info: the PayloadInfo of the payload
+//  Output:
+//    The size in bytes or -1 if the payload is unknown
+
+int
+cs_voice_payload_size (PayloadInfo info)
+{
+  return info < 8 ? cs_voice_payload_sizes[info] : -1;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the speech time carried by a payload
+//  Input:
+//    info: the PayloadInfo of the payload
+//  Output:
+//    The duration in ms
+
+int
+cs_voice_payload_duration_ms (PayloadInfo info)
+{
+  return info < 8 ? cs_voice_payload_durations_ms[info] : 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the size of the payloads that follow a LogApiVoice packet. A
+//  G.711 payload fills the packet, so it has no Payload 2
+//  Input:
+//    voice: the LogApiVoice packet
+//  Output:
+//    The size in bytes or -1 if a payload is unknown
+
+int
+cs_voice_packet_payload_size (const LogApiVoice * const voice)
+{
+  int payload1_size = cs_voice_payload_size (voice->m_uiPayload1Info);
+  int payload2_size = cs_voice_payload_size (voice->m_uiPayload2Info);
+
+  if (voice->m_uiPayload1Info == PAYLOAD_INFO_G711) {
+    return payload1_size;
+  }
+
+  if (payload1_size == -1 || payload2_size == -1 ||
+      voice->m_uiPayload2Info == PAYLOAD_INFO_G711) {
+    return -1;
+  }
+
+  return payload1_size + payload2_size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Registers the decoder of the native TETRA speech frames
+//  Input:
+//    decoder: the decoder or NULL
+
+void
+cs_voice_set_decoder (cs_voice_decoder_fn *decoder)
+{
+  cs_voice_decoder = decoder;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Decodes the payloads of a LogApiVoice packet into A-law samples
+//  Input:
+//    voice: the LogApiVoice packet
+//    payload: the payloads of the packet
+//    payload_len: the size of the payloads
+//    alaw_size: the size of the output buffer
+//  Output:
+//    alaw: the A-law samples
+//    The number of samples or -1 if the payloads can't be decoded
+
+int
+cs_voice_decode (const LogApiVoice * const voice,
+    const UINT8 * const payload, size_t payload_len,
+    UINT8 *alaw, size_t alaw_size)
+{
+  PayloadInfo infos[2] = { voice->m_uiPayload1Info, voice->m_uiPayload2Info };
+  size_t offset = 0;
+  size_t samples = 0;
+  int frame_size;
+  int rc;
+  int i;
+
+  if (voice->m_uiPayload1Info == PAYLOAD_INFO_G711) {
+    if (payload_len > alaw_size) {
+      return -1;
+    }
+    memcpy (alaw, payload, payload_len);
+    return (int) payload_len;
+  }
+
+  if (!cs_voice_decoder) {
+    return -1;
+  }
+
+  for (i = 0; i < 2; i++) {
+    frame_size = cs_voice_payload_size (infos[i]);
+    if (frame_size <= 0 || offset + frame_size > payload_len) {
+      continue;
+    }
+    rc = cs_voice_decoder (infos[i], payload + offset, frame_size,
+        alaw + samples, alaw_size - samples);
+    if (rc == -1) {
+      return -1;
+    }
+    offset += frame_size;
+    samples += rc;
+  }
+
+  return (int) samples;
+}
@@ -0,0 +1,72 @@
+#ifndef __CSVOICE_H_INCLUDED__
+#define __CSVOICE_H_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "LogApiMsgDef.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//  Container of the voice of a call recorded with its native TETRA payloads.
+//  All the fields are in host byte order.
+//
+//    <container header>
+//    <record header> <payload 1> <payload 2>
+//    <record header> <payload 1> <payload 2>
+//    ...
+//
+//  The size of the payloads of a record is given by their PayloadInfo.
+
+#define CS_VOICE_CONTAINER_MAGIC "CSTC"
+#define CS_VOICE_CONTAINER_VERSION 1
+
+typedef struct {
+  char magic[4];              // CS_VOICE_CONTAINER_MAGIC
+  uint8_t version;            // CS_VOICE_CONTAINER_VERSION
+  uint8_t spare[3];
+} cs_voice_container_header_t;
+
+typedef struct {
+  uint8_t originator;         // StreamOriginatorEnum
+  uint8_t payload1_info;      // PayloadInfo
+  uint8_t payload2_info;      // PayloadInfo
+  uint8_t spare;
+} cs_voice_record_header_t;
+
+// Maximum size of the payloads of a voice packet
+
+#define CS_VOICE_MAX_PAYLOAD_SIZE 480
+
+// Decoder of a TETRA speech frame into A-law samples. Returns the number of
+// samples written or -1
+
+typedef int (cs_voice_decoder_fn) (PayloadInfo info,
+    const UINT8 * const frame, size_t frame_len, UINT8 *alaw, size_t alaw_size);
+
+
+int
+cs_voice_payload_size (PayloadInfo info);
+
+int
+cs_voice_payload_duration_ms (PayloadInfo info);
+
+int
+cs_voice_packet_payload_size (const LogApiVoice * const voice);
+
+void
+cs_voice_set_decoder (cs_voice_decoder_fn *decoder);
+
+int
+cs_voice_decode (const LogApiVoice * const voice,
+    const UINT8 * const payload, size_t payload_len,
+    UINT8 *alaw, size_t alaw_size);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,350 @@
+/*  =========================================================================
+    cswav - Per-call WAVE file writers
+    =========================================================================*/
+
+/*
+    This module writes the A-law voice data of every call to the file
+
+        <directory>/voice_<call_id>.wav
+
+    The file of a call is opened with its first voice packet and kept open,
+    with a stdio buffer, until the call is released or stays inactive for
+    the inactivity period. The sizes of the WAVE header are not rewritten
+    with every packet but periodically (cswav_maintain) and when the file is
+    closed, so a file being written is a valid WAVE file up to its last
+    header update.
+
+    A file found from a previous run is continued, as the voice data of a
+    call can be received by a restarted collector.
+*/
+
+
+#include "cs.h"
+#include "cswav.h"
+#include "wave.h"
+
+
+#define CSWAV_PATH_LENGTH 1024
+#define CSWAV_KEY_LENGTH 16
+#define CSWAV_STDIO_BUFFER_LENGTH (64 * 1024)
+
+// WAVE file of a call
+
+typedef struct {
+  uint32_t call_id;
+  FILE *fp;
+  char *stdio_buffer;
+  WaveHeader header;
+  int dirty;                    // Data written since the last header update
+  time_t last_activity;
+} cswav_writer_t;
+
+// <Definition>
+
+struct _cswav_t {
+  char *directory;
+  int inactivity_period;
+  zhash_t *writers;             // Writers by call id
+};
+
+
+//  --------------------------------------------------------------------------
+//  Fills the WAVE header of an empty A-law file
+//  Input:
+//    header: the header to fill
+
+static void
+cswav_header_init (WaveHeader *header)
+{
+  memcpy (header->riffId, "RIFF", 4);
+  header->riffSize = 4 + 26 + 12 + 8;
+  memcpy (header->waveId, "WAVE", 4);
+
+  memcpy (header->fmtId, "fmt ", 4);
+  header->fmtSize = 18;
+  header->wFormatTag = 6; /* A-law */
+  header->nChannels = 1;
+  header->nSamplesPerSec = 8000;
+  header->nAvgBytesperSec = 8000;
+  header->nBlockAlign = 1;
+  header->wBitsPerSample = 8;
+  header->cbSize = 0;
+
+  memcpy (header->factId, "fact", 4);
+  header->factSize = 4;
+  header->dwSampleLength = 0;
+
+  memcpy (header->dataId, "data", 4);
+  header->dataSize = 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Rewrites the WAVE header of a file with the sizes of the data written
+//  Input:
+//    writer: the WAVE file of a call
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+static int
+cswav_writer_update_header (cswav_writer_t *writer)
+{
+  int rc = 0;
+
+  if (!writer->dirty) {
+    return 0;
+  }
+
+  if (fseek (writer->fp, 0, SEEK_SET) != 0 ||
+      fwrite (&writer->header, 1, sizeof (writer->header), writer->fp) !=
+          sizeof (writer->header) ||
+      fseek (writer->fp, 0, SEEK_END) != 0 ||
+      fflush (writer->fp) != 0) {
+    TRACE (ERROR, "Error: WAVE header update, errno=%d text=%s",
+        errno, strerror (errno));
+    rc = -1;
+  }
+
+  writer->dirty = 0;
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Updates the WAVE header, closes the file and frees the writer. Used as
+//  the destructor of the table of writers
+//  Input:
+//    data: the WAVE file of a call
+
+static void
+cswav_writer_destroy (void *data)
+{
+  cswav_writer_t *writer = (cswav_writer_t *) data;
+
+  cswav_writer_update_header (writer);
+  fclose (writer->fp);
+  free (writer->stdio_buffer);
+  free (writer);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Opens the WAVE file of a call, creating it or continuing the one written
+//  by a previous run
+//  Input:
+//    self: the WAVE writers cache
+//    call_id: the call
+//  Output:
+//    The writer or NULL
+
+static cswav_writer_t *
+cswav_writer_new (cswav_t *self, uint32_t call_id)
+{
+  char path[CSWAV_PATH_LENGTH];
+  cswav_writer_t *writer;
+  int rc = 0;
+
+  TRACE (FUNCTIONS, "Entering in cswav_writer_new");
+
+  writer = (cswav_writer_t *) calloc (1, sizeof (cswav_writer_t));
+  if (!writer) {
+    return NULL;
+  }
+
+  writer->call_id = call_id;
+  snprintf (path, sizeof (path), "%s/voice_%u.wav", self->directory, call_id);
+
+  if ((writer->fp = fopen (path, "r+")) != NULL) {
+    if (fread (&writer->header, 1, sizeof (writer->header), writer->fp) !=
+        sizeof (writer->header) ||
+        fseek (writer->fp, 0, SEEK_END) != 0) {
+      TRACE (ERROR, "Error: %s isn't a WAVE file", path);
+      rc = -1;
+    }
+  } else if ((writer->fp = fopen (path, "w")) != NULL) {
+    cswav_header_init (&writer->header);
+    writer->dirty = 1;
+  } else {
+    TRACE (ERROR, "Error: fopen(), errno=%d text=%s", errno, strerror (errno));
+    rc = -1;
+  }
+
+  if (rc == 0) {
+    writer->stdio_buffer = (char *) malloc (CSWAV_STDIO_BUFFER_LENGTH);
+    if (writer->stdio_buffer) {
+      setvbuf (writer->fp, writer->stdio_buffer, _IOFBF,
+          CSWAV_STDIO_BUFFER_LENGTH);
+    }
+    rc = cswav_writer_update_header (writer);
+  }
+
+  if (rc == -1) {
+    if (writer->fp) {
+      fclose (writer->fp);
+    }
+    free (writer->stdio_buffer);
+    free (writer);
+    writer = NULL;
+  } else {
+    TRACE (DEBUG, "WAVE file: %s", path);
+  }
+
+  TRACE (FUNCTIONS, "Leaving cswav_writer_new");
+
+  return writer;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Creates a WAVE writers cache
+//  Input:
+//    directory: where the WAVE files are written
+//    inactivity_period: seconds without voice data after which a file is
+//                       closed
+//  Output:
+//    The created cache or NULL
+
+cswav_t *
+cswav_new (const char * const directory, int inactivity_period)
+{
+  cswav_t *self = (cswav_t *) calloc (1, sizeof (cswav_t));
+  if (self) {
+    self->directory = strdup (directory);
+    self->inactivity_period = inactivity_period;
+    self->writers = zhash_new ();
+    if (!self->directory || !self->writers) {
+      cswav_destroy (&self);
+    }
+  }
+
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Closes all the WAVE files and frees the cache
+//  Input:
+//    The target cache
+
+void
+cswav_destroy (cswav_t **self_p)
+{
+  if (self_p && *self_p) {
+    cswav_t *self = *self_p;
+    zhash_destroy (&self->writers);
+    free (self->directory);
+    free (self);
+    *self_p = NULL;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Appends voice data to the WAVE file of a call
+//  Input:
+//    self: the WAVE writers cache
+//    call_id: the call
+//    data: the A-law voice data
+//    len: the size of the voice data
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+int
+cswav_write (cswav_t *self, uint32_t call_id,
+    const unsigned char * const data, size_t len)
+{
+  char key[CSWAV_KEY_LENGTH];
+  cswav_writer_t *writer;
+
+  snprintf (key, sizeof (key), "%u", call_id);
+  writer = (cswav_writer_t *) zhash_lookup (self->writers, key);
+  if (!writer) {
+    if ((writer = cswav_writer_new (self, call_id)) == NULL) {
+      return -1;
+    }
+    zhash_insert (self->writers, key, writer);
+    zhash_freefn (self->writers, key, cswav_writer_destroy);
+  }
+
+  writer->last_activity = time (NULL);
+
+  if (fwrite (data, 1, len, writer->fp) != len) {
+    TRACE (ERROR, "Error: fwrite(), errno=%d text=%s", errno, strerror (errno));
+    return -1;
+  }
+
+  writer->header.riffSize += len;
+  writer->header.dwSampleLength += len;
+  writer->header.dataSize += len;
+  writer->dirty = 1;
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Updates the WAVE header and closes the file of a call, if it is open
+//  Input:
+//    self: the WAVE writers cache
+//    call_id: the call
+
+void
+cswav_close (cswav_t *self, uint32_t call_id)
+{
+  char key[CSWAV_KEY_LENGTH];
+
+  snprintf (key, sizeof (key), "%u", call_id);
+  zhash_delete (self->writers, key);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Updates the WAVE headers of the files written since the last call and
+//  closes the files without activity for the inactivity period
+//  Input:
+//    self: the WAVE writers cache
+//    now: the current time
+
+void
+cswav_maintain (cswav_t *self, time_t now)
+{
+  cswav_writer_t *writer;
+  zlist_t *keys;
+  char *key;
+
+  TRACE (FUNCTIONS, "Entering in cswav_maintain");
+
+  // The table can't be modified while it is iterated
+  keys = zhash_keys (self->writers);
+  key = (char *) zlist_first (keys);
+
+  while (key) {
+    writer = (cswav_writer_t *) zhash_lookup (self->writers, key);
+    if (difftime (now, writer->last_activity) > self->inactivity_period) {
+      TRACE (DEBUG, "WAVE file of call <%u> closed", writer->call_id);
+      zhash_delete (self->writers, key);
+    } else {
+      cswav_writer_update_header (writer);
+    }
+    key = (char *) zlist_next (keys);
+  }
+
+  zlist_destroy (&keys);
+
+  TRACE (FUNCTIONS, "Leaving cswav_maintain");
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of WAVE files open
+//  Input:
+//    self: the WAVE writers cache
+
+size_t
+cswav_size (cswav_t *self)
+{
+  return zhash_size (self->writers);
+}
@@ -0,0 +1,43 @@
+#ifndef __CSWAV_H_INCLUDED__
+#define __CSWAV_H_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//  Cache of the WAVE files written with the A-law voice data of the calls.
+//  Every call keeps its file open while it is active. The WAVE header is
+//  only updated by cswav_maintain and when the file is closed.
+
+typedef struct _cswav_t cswav_t;
+
+cswav_t *
+cswav_new (const char * const directory, int inactivity_period);
+
+void
+cswav_destroy (cswav_t **self_p);
+
+int
+cswav_write (cswav_t *self, uint32_t call_id,
+    const unsigned char * const data, size_t len);
+
+void
+cswav_close (cswav_t *self, uint32_t call_id);
+
+void
+cswav_maintain (cswav_t *self, time_t now);
+
+size_t
+cswav_size (cswav_t *self);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
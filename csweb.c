@@ -0,0 +1,732 @@
+/*  =========================================================================
+    csweb - HTTP and WebSocket live audio client connection
+    =========================================================================*/
+
+/*
+    This module speaks the protocol of a client of the live audio streaming
+    endpoint of the media manager, which owns the listening socket and the
+    calls. A client asks for the voice of a call with
+
+        GET /live/<call id>[.wav][?session=<session>] HTTP/1.1
+
+    A plain request is answered with a chunked audio/wav response. Its first
+    chunk is a WAVE header (A-law, 8000 Hz, 1 channel or 2 for the duplex
+    calls) with unknown sizes and every block of voice is a chunk. A request
+    with "Upgrade: websocket" is switched to WebSocket (RFC 6455). The first
+    message is a text one with the format of the voice, e.g.
+
+        {"codec":"PCMA","rate":8000,"channels":2}
+
+    and every block of voice is a binary message.
+
+    The data is sent without blocking the media manager. What the socket
+    can't take is kept in a ring of CSWEB_BUFFER_SIZE bytes and sent with
+    the following blocks. A block that doesn't fit in the ring is dropped
+    whole, so a slow client loses voice but never gets a broken stream.
+
+    A streaming client has nothing to say but its departure. What it sends
+    is read and discarded, except the WebSocket control frames: a Ping is
+    answered with a Pong, and a Close is answered with a Close and ends
+    the stream, as the end of the connection does.
+*/
+
+
+#include "cs.h"
+#include "csweb.h"
+#include "wave.h"
+#include <sys/socket.h>
+#include <strings.h>
+#include <ctype.h>
+
+
+#define CSWEB_WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define CSWEB_WEBSOCKET_BINARY 0x82
+#define CSWEB_WEBSOCKET_TEXT 0x81
+#define CSWEB_WEBSOCKET_CLOSE 0x88
+#define CSWEB_WEBSOCKET_PING 0x89
+#define CSWEB_WEBSOCKET_PONG 0x8a
+#define CSWEB_WEBSOCKET_CONTROL_MAX_SIZE 125
+#define CSWEB_FIELD_SIZE 256
+
+// <Definition>
+
+struct _csweb_t {
+  int fd;
+  char request[CSWEB_REQUEST_MAX_SIZE + 1];  // Then the frames of the client
+  size_t request_len;
+  size_t request_end;           // Length of the request with its header
+  char path[CSWEB_FIELD_SIZE];
+  char session[CSWEB_FIELD_SIZE];
+  char key[CSWEB_FIELD_SIZE];   // Sec-WebSocket-Key
+  bool websocket;
+  bool streaming;
+  bool closed;                  // Close sent
+  uint64_t skip;                // Bytes left of a discarded frame
+  csring_t *pending;            // Data the socket couldn't take yet
+  uint64_t dropped;
+};
+
+// Connections open in the process
+
+static size_t csweb_count = 0;
+
+
+//  --------------------------------------------------------------------------
+//  Encodes data in base64
+//  Input:
+//    data: the data
+//    len: the length of the data
+//  Output:
+//    dest: the NUL terminated encoding, 4 * ((len + 2) / 3) + 1 bytes
+
+static void
+csweb_base64 (const uint8_t * const data, size_t len, char *dest)
+{
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t i;
+  uint32_t triplet;
+
+  for (i = 0; i < len; i += 3) {
+    triplet = data[i] << 16;
+    if (i + 1 < len) {
+      triplet |= data[i + 1] << 8;
+    }
+    if (i + 2 < len) {
+      triplet |= data[i + 2];
+    }
+    *dest++ = alphabet[(triplet >> 18) & 0x3f];
+    *dest++ = alphabet[(triplet >> 12) & 0x3f];
+    *dest++ = i + 1 < len ? alphabet[(triplet >> 6) & 0x3f] : '=';
+    *dest++ = i + 2 < len ? alphabet[triplet & 0x3f] : '=';
+  }
+  *dest = '\0';
+}
+
+
+//  --------------------------------------------------------------------------
+//  Copies a field without its surrounding blanks
+//  Input:
+//    src: the field
+//    len: the length of the field
+//  Output:
+//    dest: the NUL terminated field, truncated to CSWEB_FIELD_SIZE - 1
+
+static void
+csweb_copy_field (const char *src, size_t len, char *dest)
+{
+  while (len && (*src == ' ' || *src == '\t')) {
+    src++;
+    len--;
+  }
+  while (len && (src[len - 1] == ' ' || src[len - 1] == '\t' || src[len - 1] == '\r')) {
+    len--;
+  }
+  if (len > CSWEB_FIELD_SIZE - 1) {
+    len = CSWEB_FIELD_SIZE - 1;
+  }
+  memcpy (dest, src, len);
+  dest[len] = '\0';
+}
+
+
+//  --------------------------------------------------------------------------
+//  Parses a complete request. A request that isn't a GET leaves the path
+//  empty
+//  Input:
+//    self: the connection
+
+static void
+csweb_parse_request (csweb_t *self)
+{
+  char *line = self->request;
+  char *end;
+  char *value;
+  char *query;
+  char *next;
+  bool upgrade = false;
+
+  // Request line
+  end = strstr (line, "\r\n");
+  *end = '\0';
+  if (strncmp (line, "GET ", 4) == 0) {
+    line += 4;
+    value = strchr (line, ' ');
+    csweb_copy_field (line, value ? (size_t) (value - line) : strlen (line),
+        self->path);
+  }
+  query = strchr (self->path, '?');
+  if (query) {
+    *query++ = '\0';
+    while (query && *query) {
+      next = strchr (query, '&');
+      if (strncmp (query, "session=", 8) == 0) {
+        csweb_copy_field (query + 8,
+            next ? (size_t) (next - query - 8) : strlen (query + 8), self->session);
+      }
+      query = next ? next + 1 : NULL;
+    }
+  }
+
+  // Header fields
+  for (line = end + 2; *line && strncmp (line, "\r\n", 2) != 0; line = end + 2) {
+    end = strstr (line, "\r\n");
+    *end = '\0';
+    value = strchr (line, ':');
+    if (!value) {
+      continue;
+    }
+    *value++ = '\0';
+    if (strcasecmp (line, "Upgrade") == 0) {
+      for (next = value; *next; next++) {
+        *next = tolower (*next);
+      }
+      upgrade = strstr (value, "websocket") != NULL;
+    } else if (strcasecmp (line, "Sec-WebSocket-Key") == 0) {
+      csweb_copy_field (value, strlen (value), self->key);
+    }
+  }
+
+  self->websocket = upgrade && self->key[0];
+}
+
+
+//  --------------------------------------------------------------------------
+//  Sends the pending data the socket can take
+//  Input:
+//    self: the connection
+//  Output:
+//    0 - Ok
+//   -1 - Nok. The connection is broken
+
+static int
+csweb_flush (csweb_t *self)
+{
+  ssize_t sent;
+
+  while (csring_size (self->pending)) {
+    sent = send (self->fd, csring_head (self->pending),
+        csring_size (self->pending), MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent > 0) {
+      csring_consume (self->pending, sent);
+    } else if (sent == -1 && errno == EINTR) {
+      continue;
+    } else if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else {
+      TRACE (DEBUG, "Web client %d: connection closed", self->fd);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Queues the pieces of a message and sends them. A message that doesn't
+//  fit in the ring is dropped whole
+//  Input:
+//    self: the connection
+//    prefix: the framing before the data
+//    prefix_len: the length of the prefix
+//    data: the data
+//    len: the length of the data
+//    suffix: the framing after the data
+//    suffix_len: the length of the suffix
+//  Output:
+//    0 - Ok, also when the message has been dropped
+//   -1 - Nok. The connection is broken
+
+static int
+csweb_write (csweb_t *self, const void * const prefix, size_t prefix_len,
+    const void * const data, size_t len,
+    const void * const suffix, size_t suffix_len)
+{
+  size_t total = prefix_len + len + suffix_len;
+
+  if (total > csring_free (self->pending) && csweb_flush (self) == -1) {
+    return -1;
+  }
+  if (total > csring_free (self->pending)) {
+    self->dropped++;
+    return 0;
+  }
+
+  csring_append (self->pending, prefix, prefix_len);
+  csring_append (self->pending, data, len);
+  csring_append (self->pending, suffix, suffix_len);
+
+  return csweb_flush (self);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Queues a message in the framing of the connection and sends it
+//  Input:
+//    self: the connection
+//    opcode: the WebSocket first byte, ignored by the HTTP connections
+//    data: the data
+//    len: the length of the data
+//  Output:
+//    0 - Ok
+//   -1 - Nok. The connection is broken
+
+static int
+csweb_write_message (csweb_t *self, uint8_t opcode,
+    const void * const data, size_t len)
+{
+  char prefix[16];
+  size_t prefix_len = 0;
+
+  if (self->websocket) {
+    prefix[prefix_len++] = opcode;
+    if (len < 126) {
+      prefix[prefix_len++] = len;
+    } else {
+      // The voice blocks are far shorter than 64 KB
+      prefix[prefix_len++] = 126;
+      prefix[prefix_len++] = (len >> 8) & 0xff;
+      prefix[prefix_len++] = len & 0xff;
+    }
+    return csweb_write (self, prefix, prefix_len, data, len, NULL, 0);
+  }
+
+  prefix_len = snprintf (prefix, sizeof (prefix), "%zx\r\n", len);
+  return csweb_write (self, prefix, prefix_len, data, len, "\r\n", 2);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Handles the complete WebSocket frames read from the client and keeps
+//  the beginning of the next one. Only the control frames are looked at
+//  Input:
+//    self: the connection
+//  Output:
+//    0 - Ok
+//   -1 - The client has left: it sent a Close or a bad frame, or the
+//        connection is broken
+
+static int
+csweb_read_frames (csweb_t *self)
+{
+  uint8_t *data = (uint8_t *) self->request;
+  uint8_t payload[CSWEB_WEBSOCKET_CONTROL_MAX_SIZE];
+  uint8_t *mask;
+  uint8_t opcode;
+  uint64_t payload_len;
+  size_t header_len;
+  size_t available;
+  size_t offset = 0;
+  size_t i;
+  int rc = 0;
+
+  while (rc == 0 && offset < self->request_len) {
+    available = self->request_len - offset;
+
+    // The payload of a data frame is skipped as it comes
+    if (self->skip) {
+      i = self->skip < available ? self->skip : available;
+      self->skip -= i;
+      offset += i;
+      continue;
+    }
+
+    if (available < 2) {
+      break;
+    }
+    opcode = data[offset] & 0x0f;
+    payload_len = data[offset + 1] & 0x7f;
+    header_len = 2 + 4;
+    if (payload_len == 126) {
+      header_len += 2;
+    } else if (payload_len == 127) {
+      header_len += 8;
+    }
+    if (!(data[offset + 1] & 0x80)) {
+      TRACE (ERROR, "Web client %d: frame not masked", self->fd);
+      rc = -1;
+      break;
+    }
+    if (available < header_len) {
+      break;
+    }
+    if (payload_len == 126) {
+      payload_len = (data[offset + 2] << 8) | data[offset + 3];
+    } else if (payload_len == 127) {
+      payload_len = 0;
+      for (i = 0; i < 8; i++) {
+        payload_len = (payload_len << 8) | data[offset + 2 + i];
+      }
+    }
+
+    if (!(opcode & 0x08)) {
+      // Text, binary or continuation frame: the client has nothing to say
+      offset += header_len;
+      self->skip = payload_len;
+      continue;
+    }
+
+    if (payload_len > CSWEB_WEBSOCKET_CONTROL_MAX_SIZE) {
+      TRACE (ERROR, "Web client %d: control frame too long", self->fd);
+      rc = -1;
+      break;
+    }
+    if (available < header_len + payload_len) {
+      break;
+    }
+    mask = data + offset + header_len - 4;
+    for (i = 0; i < payload_len; i++) {
+      payload[i] = data[offset + header_len + i] ^ mask[i % 4];
+    }
+    offset += header_len + payload_len;
+
+    if (opcode == (CSWEB_WEBSOCKET_CLOSE & 0x0f)) {
+      // The status code of the client, if any, is echoed
+      TRACE (DEBUG, "Web client %d: close received", self->fd);
+      csweb_write_message (self, CSWEB_WEBSOCKET_CLOSE, payload,
+          payload_len < 2 ? 0 : 2);
+      self->closed = true;
+      rc = -1;
+    } else if (opcode == (CSWEB_WEBSOCKET_PING & 0x0f)) {
+      rc = csweb_write_message (self, CSWEB_WEBSOCKET_PONG, payload,
+          payload_len);
+    }
+  }
+
+  self->request_len -= offset;
+  memmove (data, data + offset, self->request_len);
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Creates a connection
+//  Input:
+//    fd: the accepted non blocking socket. The connection closes it
+//  Output:
+//    The created connection or NULL
+
+csweb_t *
+csweb_new (int fd)
+{
+  csweb_t *self = (csweb_t *) calloc (1, sizeof (csweb_t));
+  if (self) {
+    self->fd = fd;
+    self->pending = csring_new (CSWEB_BUFFER_SIZE);
+    if (!self->pending) {
+      free (self);
+      self = NULL;
+    }
+  }
+
+  if (self) {
+    csweb_count++;
+  } else {
+    close (fd);
+  }
+
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Ends the stream, if it was started, and closes the connection
+//  Input:
+//    The target connection
+
+void
+csweb_destroy (csweb_t **self_p)
+{
+  if (self_p && *self_p) {
+    csweb_t *self = *self_p;
+    if (self->streaming && !self->closed) {
+      if (self->websocket) {
+        csweb_write_message (self, CSWEB_WEBSOCKET_CLOSE, NULL, 0);
+      } else {
+        csweb_write (self, "0\r\n\r\n", 5, NULL, 0, NULL, 0);
+      }
+    }
+    close (self->fd);
+    csring_destroy (&self->pending);
+    free (self);
+    csweb_count--;
+    *self_p = NULL;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the socket of the connection
+
+int
+csweb_fd (csweb_t *self)
+{
+  return self->fd;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Reads the data of the request available in the socket
+//  Input:
+//    self: the connection
+//  Output:
+//    1 - The request is complete
+//    0 - The request is not complete yet
+//   -1 - Nok. The connection is closed or the request too long
+
+int
+csweb_read_request (csweb_t *self)
+{
+  ssize_t len;
+  char *end;
+
+  len = recv (self->fd, self->request + self->request_len,
+      CSWEB_REQUEST_MAX_SIZE - self->request_len, MSG_DONTWAIT);
+  if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return 0;
+  }
+  if (len <= 0) {
+    return -1;
+  }
+
+  self->request_len += len;
+  self->request[self->request_len] = '\0';
+
+  end = strstr (self->request, "\r\n\r\n");
+  if (end) {
+    self->request_end = end + 4 - self->request;
+    csweb_parse_request (self);
+    return 1;
+  }
+
+  if (self->request_len == CSWEB_REQUEST_MAX_SIZE) {
+    TRACE (ERROR, "Web client %d: request too long", self->fd);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the path of the request, without the query
+
+const char *
+csweb_path (csweb_t *self)
+{
+  return self->path;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the session parameter of the request or NULL
+
+const char *
+csweb_session (csweb_t *self)
+{
+  return self->session[0] ? self->session : NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns true if the request asks for a WebSocket
+
+bool
+csweb_is_websocket (csweb_t *self)
+{
+  return self->websocket;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Answers the request with an error. The connection must be destroyed
+//  afterwards
+//  Input:
+//    self: the connection
+//    status: the HTTP status code
+//    reason: the text of the response
+
+void
+csweb_reject (csweb_t *self, int status, const char * const reason)
+{
+  char header[CSWEB_FIELD_SIZE];
+  int len;
+
+  len = snprintf (header, sizeof (header),
+      "HTTP/1.1 %d %s\r\n"
+      "Content-Type: text/plain\r\n"
+      "Content-Length: %zu\r\n"
+      "Connection: close\r\n"
+      "\r\n",
+      status, reason, strlen (reason) + 2);
+  csweb_write (self, header, len, reason, strlen (reason), "\r\n", 2);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Accepts the request and starts the stream
+//  Input:
+//    self: the connection
+//    channels: 1 for mono voice, 2 for the interleaved voice of duplex calls
+//  Output:
+//    0 - Ok
+//   -1 - Nok. The connection is broken
+
+int
+csweb_start (csweb_t *self, int channels)
+{
+  char header[CSWEB_FIELD_SIZE * 2];
+  char format[CSWEB_FIELD_SIZE];
+  uint8_t *digest;
+  char accept[32];
+  int len;
+  int rc = 0;
+
+  // What the client sent after its request are its first frames
+  self->request_len -= self->request_end;
+  memmove (self->request, self->request + self->request_end,
+      self->request_len);
+
+  if (self->websocket) {
+    zdigest_t *sha1 = zdigest_new ();
+    assert (sha1);
+    zdigest_update (sha1, (byte *) self->key, strlen (self->key));
+    zdigest_update (sha1, (byte *) CSWEB_WEBSOCKET_GUID,
+        strlen (CSWEB_WEBSOCKET_GUID));
+    digest = (uint8_t *) zdigest_data (sha1);
+    csweb_base64 (digest, zdigest_size (sha1), accept);
+    zdigest_destroy (&sha1);
+
+    len = snprintf (header, sizeof (header),
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: %s\r\n"
+        "\r\n",
+        accept);
+    rc = csweb_write (self, header, len, NULL, 0, NULL, 0);
+
+    len = snprintf (format, sizeof (format),
+        "{\"codec\":\"PCMA\",\"rate\":8000,\"channels\":%d}", channels);
+    if (rc == 0) {
+      rc = csweb_write_message (self, CSWEB_WEBSOCKET_TEXT, format, len);
+    }
+  } else {
+    len = snprintf (header, sizeof (header),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: audio/wav\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Connection: close\r\n"
+        "\r\n");
+    rc = csweb_write (self, header, len, NULL, 0, NULL, 0);
+
+    // The length of a live stream is unknown
+    WaveHeader wave;
+    memcpy (wave.riffId, "RIFF", 4);
+    wave.riffSize = 0xffffffff;
+    memcpy (wave.waveId, "WAVE", 4);
+    memcpy (wave.fmtId, "fmt ", 4);
+    wave.fmtSize = 18;
+    wave.wFormatTag = 6; /* A-law */
+    wave.nChannels = channels;
+    wave.nSamplesPerSec = 8000;
+    wave.nAvgBytesperSec = 8000 * channels;
+    wave.nBlockAlign = channels;
+    wave.wBitsPerSample = 8;
+    wave.cbSize = 0;
+    memcpy (wave.factId, "fact", 4);
+    wave.factSize = 4;
+    wave.dwSampleLength = 0xffffffff;
+    memcpy (wave.dataId, "data", 4);
+    wave.dataSize = 0xffffffff;
+    if (rc == 0) {
+      rc = csweb_write_message (self, 0, &wave, sizeof (wave));
+    }
+  }
+
+  self->streaming = true;
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Reads what the streaming client sent: the WebSocket control frames are
+//  answered, anything else is discarded
+//  Input:
+//    self: the connection
+//  Output:
+//    0 - Ok
+//   -1 - The client has left: the connection is closed or broken, or the
+//        client sent a Close or a bad frame. The Close has been answered
+
+int
+csweb_read (csweb_t *self)
+{
+  ssize_t len;
+  int rc = 0;
+
+  if (self->websocket) {
+    rc = csweb_read_frames (self);
+  }
+
+  while (rc == 0) {
+    len = recv (self->fd, self->request + self->request_len,
+        CSWEB_REQUEST_MAX_SIZE - self->request_len, MSG_DONTWAIT);
+    if (len == -1 && errno == EINTR) {
+      continue;
+    }
+    if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (len <= 0) {
+      TRACE (DEBUG, "Web client %d: connection closed", self->fd);
+      rc = -1;
+    } else if (self->websocket) {
+      self->request_len += len;
+      rc = csweb_read_frames (self);
+    }
+  }
+
+  return rc;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Sends a block of voice
+//  Input:
+//    self: the connection
+//    data: the A-law samples, interleaved for 2 channels
+//    len: the length of the data
+//  Output:
+//    0 - Ok, also when the block has been dropped
+//   -1 - Nok. The connection is broken
+
+int
+csweb_send (csweb_t *self, const uint8_t * const data, size_t len)
+{
+  return csweb_write_message (self, CSWEB_WEBSOCKET_BINARY, data, len);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of voice blocks dropped because the client was slow
+
+uint64_t
+csweb_dropped (csweb_t *self)
+{
+  return self->dropped;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of connections open
+
+size_t
+csweb_connections (void)
+{
+  return csweb_count;
+}
@@ -0,0 +1,71 @@
+#ifndef __CSWEB_H_INCLUDED__
+#define __CSWEB_H_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//  Client connection of the live audio streaming endpoint. The client sends
+//  a GET request and receives the A-law voice of a call either as a chunked
+//  HTTP response, which starts with a WAVE header, or, when the request
+//  upgrades to WebSocket, as binary messages after a text message with the
+//  format of the voice. The voice is written to the socket without blocking;
+//  when a slow client has CSWEB_BUFFER_SIZE bytes pending, the following
+//  voice blocks are dropped. Once streaming, the socket is still read to
+//  see the client leave and to answer its WebSocket Ping and Close frames.
+
+#define CSWEB_REQUEST_MAX_SIZE 4096
+#define CSWEB_BUFFER_SIZE 65536
+
+typedef struct _csweb_t csweb_t;
+
+csweb_t *
+csweb_new (int fd);
+
+void
+csweb_destroy (csweb_t **self_p);
+
+int
+csweb_fd (csweb_t *self);
+
+int
+csweb_read_request (csweb_t *self);
+
+const char *
+csweb_path (csweb_t *self);
+
+const char *
+csweb_session (csweb_t *self);
+
+bool
+csweb_is_websocket (csweb_t *self);
+
+void
+csweb_reject (csweb_t *self, int status, const char * const reason);
+
+int
+csweb_start (csweb_t *self, int channels);
+
+int
+csweb_read (csweb_t *self);
+
+int
+csweb_send (csweb_t *self, const uint8_t * const data, size_t len);
+
+uint64_t
+csweb_dropped (csweb_t *self);
+
+size_t
+csweb_connections (void);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
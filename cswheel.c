@@ -0,0 +1,353 @@
+/*  =========================================================================
+    cswheel - Timing wheel
+    =========================================================================*/
+
+/*
+    A hierarchical timing wheel. The time is divided in ticks of tick_ms
+    milliseconds and the wheel has CSWHEEL_LEVELS levels of the same
+    number of slots S. A slot of level L spans S^L ticks, so level 0 holds
+    the timers due in the next S ticks, one tick per slot, level 1 the ones
+    due in the next S^2 ticks, S ticks per slot, and so on.
+
+    Advancing the wheel to a tick visits the slot of the tick in level 0
+    and expires its timers. When the tick starts a slot of a higher level,
+    the timers of that slot are moved first to the lower levels, by their
+    due tick; the higher levels go first so a timer falls down to level 0
+    in the same tick. Scheduling, cancelling and expiring a timer cost the
+    same whatever the number of timers, and a timer is moved at most
+    CSWHEEL_LEVELS - 1 times, however far its due time is: with 64 slots
+    the timers of the next 64^4 ticks are placed without wrapping. The
+    timers due even later wait in the last slot of the highest level and
+    are placed again when it is visited.
+
+    The timers are doubly linked lists nodes embedded in their items. The
+    slots are the heads of circular lists, so a timer is unlinked without
+    knowing its slot.
+*/
+
+
+#include "cs.h"
+#include "cswheel.h"
+
+
+#define CSWHEEL_LEVELS 4
+
+// <Definition>
+
+struct _cswheel_t {
+  cswheel_timer_t *slots;       // Heads of the lists of timers, by level
+  size_t num_slots;             // Of every level
+  int64_t spans[CSWHEEL_LEVELS];  // Ticks of a slot of every level
+  int tick_ms;
+  int64_t current_tick;         // Last tick advanced
+  size_t size;
+};
+
+
+//  --------------------------------------------------------------------------
+//  Links a timer at the end of a list
+//  Input:
+//    head: the head of the list
+//    timer: the timer
+
+static void
+cswheel_link (cswheel_timer_t *head, cswheel_timer_t *timer)
+{
+  timer->prev = head->prev;
+  timer->next = head;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Unlinks a timer of its list
+//  Input:
+//    timer: the timer
+
+static void
+cswheel_unlink (cswheel_timer_t *timer)
+{
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->next = timer->prev = timer;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Links a scheduled timer in the slot of its due tick, in the lowest level
+//  whose slots reach it
+//  Input:
+//    self: the wheel
+//    timer: the timer
+
+static void
+cswheel_place (cswheel_t *self, cswheel_timer_t *timer)
+{
+  int level = 0;
+  int64_t tick = timer->due_tick;
+  int64_t last_tick = self->current_tick +
+      self->spans[CSWHEEL_LEVELS - 1] * self->num_slots - 1;
+
+  if (tick < self->current_tick) {
+    tick = self->current_tick;
+  } else if (tick > last_tick) {
+    tick = last_tick;
+  }
+  while (level < CSWHEEL_LEVELS - 1 &&
+      tick - self->current_tick >= self->spans[level + 1]) {
+    level++;
+  }
+
+  cswheel_link (&self->slots[level * self->num_slots +
+      (tick / self->spans[level]) % self->num_slots], timer);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Moves the timers of a slot of a higher level to the lower levels
+//  Input:
+//    self: the wheel
+//    slot: the slot
+
+static void
+cswheel_cascade (cswheel_t *self, cswheel_timer_t *slot)
+{
+  cswheel_timer_t moved;
+  cswheel_timer_t *timer;
+
+  // The slot is emptied first, so no timer is placed back in it
+  if (slot->next == slot) {
+    return;
+  }
+  moved.next = slot->next;
+  moved.prev = slot->prev;
+  moved.next->prev = moved.prev->next = &moved;
+  slot->next = slot->prev = slot;
+
+  while (moved.next != &moved) {
+    timer = moved.next;
+    cswheel_unlink (timer);
+    cswheel_place (self, timer);
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Creates a wheel
+//  Input:
+//    slots: the number of slots of every level, 2 at least. The timers due
+//      in less than slots * tick_ms milliseconds are never moved before
+//      they expire
+//    tick_ms: the resolution of the timers
+//    now: the current time in milliseconds
+//  Output:
+//    The created wheel or NULL
+
+cswheel_t *
+cswheel_new (size_t slots, int tick_ms, int64_t now)
+{
+  size_t i;
+  cswheel_t *self = (cswheel_t *) zmalloc (sizeof (cswheel_t));
+
+  assert (slots > 1 && tick_ms > 0);
+
+  if (self) {
+    self->slots = (cswheel_timer_t *) zmalloc (
+        CSWHEEL_LEVELS * slots * sizeof (cswheel_timer_t));
+    if (!self->slots) {
+      free (self);
+      self = NULL;
+    }
+  }
+
+  if (self) {
+    self->num_slots = slots;
+    self->tick_ms = tick_ms;
+    self->current_tick = now / tick_ms;
+    self->spans[0] = 1;
+    for (i = 1; i < CSWHEEL_LEVELS; i++) {
+      self->spans[i] = self->spans[i - 1] * slots;
+    }
+    for (i = 0; i < CSWHEEL_LEVELS * slots; i++) {
+      self->slots[i].next = self->slots[i].prev = &self->slots[i];
+    }
+  }
+
+  return self;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Frees the wheel. The timers still scheduled are cancelled
+//  Input:
+//    The target wheel
+
+void
+cswheel_destroy (cswheel_t **self_p)
+{
+  size_t i;
+
+  if (self_p && *self_p) {
+    cswheel_t *self = *self_p;
+    for (i = 0; i < CSWHEEL_LEVELS * self->num_slots; i++) {
+      while (self->slots[i].next != &self->slots[i]) {
+        cswheel_cancel (self->slots[i].next);
+      }
+    }
+    free (self->slots);
+    free (self);
+    *self_p = NULL;
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Prepares a timer to be scheduled
+//  Input:
+//    timer: the timer
+//    item: the item the timer belongs to
+
+void
+cswheel_timer_init (cswheel_timer_t *timer, void *item)
+{
+  timer->next = timer->prev = timer;
+  timer->wheel = NULL;
+  timer->due_tick = 0;
+  timer->item = item;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Schedules a timer, cancelling it first if it is already scheduled
+//  Input:
+//    self: the wheel
+//    timer: the timer
+//    due: the time when the timer expires, in milliseconds. A time already
+//      past expires in the next tick
+
+void
+cswheel_schedule (cswheel_t *self, cswheel_timer_t *timer, int64_t due)
+{
+  int64_t due_tick = (due + self->tick_ms - 1) / self->tick_ms;
+
+  cswheel_cancel (timer);
+
+  if (due_tick <= self->current_tick) {
+    due_tick = self->current_tick + 1;
+  }
+  timer->due_tick = due_tick;
+  timer->wheel = self;
+  cswheel_place (self, timer);
+  self->size++;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Cancels a timer. Nothing is done if it isn't scheduled
+//  Input:
+//    timer: the timer
+
+void
+cswheel_cancel (cswheel_timer_t *timer)
+{
+  if (timer->wheel) {
+    timer->wheel->size--;
+    timer->wheel = NULL;
+    cswheel_unlink (timer);
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns true if the timer is scheduled
+
+bool
+cswheel_pending (cswheel_timer_t *timer)
+{
+  return timer->wheel != NULL;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Expires the timers due up to a time
+//  Input:
+//    self: the wheel
+//    now: the current time in milliseconds
+//    expire: the function called for every expired timer
+//    arg: the first argument of the function
+//  Output:
+//    The number of timers expired
+
+size_t
+cswheel_advance (cswheel_t *self, int64_t now,
+    cswheel_expire_fn *expire, void *arg)
+{
+  int64_t target_tick = now / self->tick_ms;
+  size_t expired = 0;
+  int level;
+  cswheel_timer_t due;
+  cswheel_timer_t *slot;
+  cswheel_timer_t *timer;
+  cswheel_timer_t *next;
+
+  // Every tick is visited, except when there is nothing to expire
+  if (self->size == 0 && target_tick > self->current_tick) {
+    self->current_tick = target_tick;
+  }
+
+  while (self->current_tick < target_tick) {
+    self->current_tick++;
+
+    for (level = CSWHEEL_LEVELS - 1; level > 0; level--) {
+      if (self->current_tick % self->spans[level] == 0) {
+        cswheel_cascade (self, &self->slots[level * self->num_slots +
+            (self->current_tick / self->spans[level]) % self->num_slots]);
+      }
+    }
+
+    slot = &self->slots[self->current_tick % self->num_slots];
+
+    // The timers due are moved apart first, so the expire function can
+    // schedule timers into this slot and cancel any other timer
+    due.next = due.prev = &due;
+    for (timer = slot->next; timer != slot; timer = next) {
+      next = timer->next;
+      cswheel_unlink (timer);
+      if (timer->due_tick <= self->current_tick) {
+        cswheel_link (&due, timer);
+      } else {
+        cswheel_place (self, timer);
+      }
+    }
+
+    while (due.next != &due) {
+      timer = due.next;
+      cswheel_cancel (timer);
+      expire (arg, timer);
+      expired++;
+    }
+  }
+
+  return expired;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the number of timers scheduled
+
+size_t
+cswheel_size (cswheel_t *self)
+{
+  return self->size;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Returns the resolution of the wheel
+
+int
+cswheel_tick_ms (cswheel_t *self)
+{
+  return self->tick_ms;
+}
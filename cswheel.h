@@ -0,0 +1,68 @@
+#ifndef __CSWHEEL_H_INCLUDED__
+#define __CSWHEEL_H_INCLUDED__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+//  Hierarchical timing wheel of timers with a resolution of tick_ms
+//  milliseconds, for the short timers of the voice as well as the long ones
+//  of the calls. The timers are embedded in the items they belong to, so
+//  scheduling and cancelling a timer never allocates memory. A timer expires
+//  in the first cswheel_advance at or after its due time, in the order of
+//  the ticks.
+
+typedef struct _cswheel_t cswheel_t;
+typedef struct _cswheel_timer_t cswheel_timer_t;
+
+struct _cswheel_timer_t {
+  cswheel_timer_t *next;
+  cswheel_timer_t *prev;
+  cswheel_t *wheel;             // NULL = not scheduled
+  int64_t due_tick;
+  void *item;
+};
+
+// Called for every expired timer. The timer may be scheduled again
+
+typedef void (cswheel_expire_fn) (void *arg, cswheel_timer_t *timer);
+
+cswheel_t *
+cswheel_new (size_t slots, int tick_ms, int64_t now);
+
+void
+cswheel_destroy (cswheel_t **self_p);
+
+void
+cswheel_timer_init (cswheel_timer_t *timer, void *item);
+
+void
+cswheel_schedule (cswheel_t *self, cswheel_timer_t *timer, int64_t due);
+
+void
+cswheel_cancel (cswheel_timer_t *timer);
+
+bool
+cswheel_pending (cswheel_timer_t *timer);
+
+size_t
+cswheel_advance (cswheel_t *self, int64_t now,
+    cswheel_expire_fn *expire, void *arg);
+
+size_t
+cswheel_size (cswheel_t *self);
+
+int
+cswheel_tick_ms (cswheel_t *self);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
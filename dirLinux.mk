@@ -5,3 +5,7 @@ MYLIBS = \
   -L$(TOP_PACKAGES)/czmq=3_0_0-Linux/lib -L$(TOP_PACKAGES)/zeromq=4_0_5-Linux/lib -lczmq -lzmq -luuid  \
   -L/usr/local/iap/postgresql/lib -lpq -lmd5
 
+
+# io_uring receive backend of the collector (liburing >= 2.3):
+#   DIR_CPPFLAGS += -DCSCOL_HAVE_IO_URING
+#   MYLIBS += -luring
@@ -0,0 +1,141 @@
+/*  =========================================================================
+    csbench_backend - Collector run for the comparison of its backends
+    =========================================================================*/
+
+/*
+    This tool runs the collector alone, as the server does, with the
+    receive backend of the command line in place of /collector/backend of
+    the configuration file. On SIGUSR1 it prints the answer of the
+    collector to the STATS command, one key=value per line, and exits:
+    SIGINT would stop the reactor of the collector before it answers.
+    csbench_backend.sh replays the same capture against each backend with
+    csreplay and compares their statistics.
+
+    The tool is linked with the objects of the server but main.c, e.g.
+
+        gcc -O2 -I.. <server flags> csbench_backend.c <server objects> -o
+            csbench_backend <server libraries>
+
+    Usage:
+
+        csbench_backend -c config -b socket|io_uring [-t trace]
+
+          -c config  configuration file of the server
+          -b backend receive backend of the collector
+          -t trace   trace file (default csbench_backend.trace)
+*/
+
+
+#include <signal.h>
+#include "../cs.h"
+
+
+void cscol_task (zsock_t *pipe, void *args);
+
+static volatile sig_atomic_t csbench_stats_requested = 0;
+
+
+//  --------------------------------------------------------------------------
+//  Asks for the statistics of the collector (SIGUSR1 handler)
+
+static void
+csbench_request_stats (int signal_number)
+{
+  csbench_stats_requested = 1;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  int rc = 0;
+  int opt;
+  const char *config_file = NULL;
+  const char *backend = NULL;
+  const char *trace_file = "csbench_backend.trace";
+  char run_config_file[64];
+  zconfig_t *config = NULL;
+  zactor_t *collector = NULL;
+  zmsg_t *response;
+  char *line;
+
+  while ((opt = getopt (argc, argv, "c:b:t:")) != -1) {
+    switch (opt) {
+    case 'c':
+      config_file = optarg;
+      break;
+    case 'b':
+      backend = optarg;
+      break;
+    case 't':
+      trace_file = optarg;
+      break;
+    default:
+      rc = -1;
+      break;
+    }
+  }
+  if (rc == -1 || !config_file || !backend) {
+    fprintf (stderr, "Usage: %s -c config -b socket|io_uring [-t trace]\n",
+        argv[0]);
+    return 1;
+  }
+
+  initTRACE ((char *) trace_file, "csbench_backend");
+
+  // The collector reads its own copy of the configuration, with the backend
+  snprintf (run_config_file, sizeof (run_config_file),
+      "csbench_backend_%d.cfg", (int) getpid ());
+  config = zconfig_load (config_file);
+  if (!config) {
+    fprintf (stderr, "Unable to load %s\n", config_file);
+    rc = -1;
+  }
+  if (!rc) {
+    zconfig_put (config, "/collector/backend", backend);
+    if (zconfig_save (config, run_config_file) == -1) {
+      fprintf (stderr, "Unable to write %s\n", run_config_file);
+      rc = -1;
+    }
+  }
+
+  if (!rc) {
+    collector = zactor_new (cscol_task, run_config_file);
+    if (!collector) {
+      fprintf (stderr, "Collector not created\n");
+      rc = -1;
+    }
+  }
+
+  if (!rc) {
+    signal (SIGUSR1, csbench_request_stats);
+    fprintf (stderr, "Collector running with the %s backend\n", backend);
+    while (!csbench_stats_requested && !zsys_interrupted) {
+      zclock_sleep (100);
+    }
+    if (zsys_interrupted) {
+      rc = -1;
+    }
+  }
+
+  if (!rc) {
+    zstr_send (collector, "STATS");
+    response = zmsg_recv (collector);
+    if (response) {
+      while ((line = zmsg_popstr (response))) {
+        printf ("%s\n", line);
+        free (line);
+      }
+      zmsg_destroy (&response);
+    } else {
+      fprintf (stderr, "No statistics received\n");
+      rc = -1;
+    }
+  }
+
+  zactor_destroy (&collector);
+  zconfig_destroy (&config);
+  unlink (run_config_file);
+
+  return rc == 0 ? 0 : 1;
+}
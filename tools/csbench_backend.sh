@@ -0,0 +1,84 @@
+#!/bin/sh
+#  =========================================================================
+#  csbench_backend.sh - Comparison of the receive backends of the collector
+#  =========================================================================
+#
+#  Replays the same captures (see csreplay) as fast as possible against the
+#  collector run with the socket backend (recvfrom/recvmmsg) and then with
+#  the io_uring one, and prints their STATS counters side by side: what was
+#  received and drained, and what was lost on the way (kernel_drops,
+#  truncated, ring overflows, sequence gaps).
+#
+#  The collector must have been built with CSCOL_HAVE_IO_URING, and the
+#  configuration file must enable the collector listener on the port given.
+#  csbench_backend and csreplay are looked for in the directory of this
+#  script. The STATS of every run are kept in <output>/<backend>.stats.
+#
+#  Usage:
+#
+#      csbench_backend.sh -c config [-p port] [-l loops] [-o output] file...
+#
+#        -c config  configuration file of the server
+#        -p port    collector port (default 4321)
+#        -l loops   times the capture files are replayed (default 1)
+#        -o output  directory of the results (default csbench_backend.out)
+
+TOOLS=$(dirname "$0")
+CONFIG=
+PORT=4321
+LOOPS=1
+OUTPUT=csbench_backend.out
+SETTLE=2
+
+while getopts c:p:l:o: opt; do
+  case $opt in
+    c) CONFIG=$OPTARG ;;
+    p) PORT=$OPTARG ;;
+    l) LOOPS=$OPTARG ;;
+    o) OUTPUT=$OPTARG ;;
+    *) CONFIG= ; break ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+if [ -z "$CONFIG" ] || [ $# -eq 0 ]; then
+  echo "Usage: $0 -c config [-p port] [-l loops] [-o output] file..." >&2
+  exit 1
+fi
+
+mkdir -p "$OUTPUT" || exit 1
+
+for backend in socket io_uring; do
+  "$TOOLS/csbench_backend" -c "$CONFIG" -b $backend \
+      -t "$OUTPUT/$backend.trace" > "$OUTPUT/$backend.stats" &
+  collector=$!
+  sleep $SETTLE
+
+  echo "== $backend"
+  "$TOOLS/csreplay" -p "$PORT" -s max -l "$LOOPS" "$@" 2>&1 |
+      tee "$OUTPUT/$backend.replay"
+
+  # The datagrams still in the socket buffer are drained before the STATS
+  sleep $SETTLE
+  kill -USR1 $collector
+  if ! wait $collector; then
+    echo "The collector with the $backend backend failed" >&2
+    exit 1
+  fi
+done
+
+# Counters of the main collector thread, before the ones of the shards
+echo
+printf "%-32s %12s %12s\n" counter socket io_uring
+awk -F= '
+  /^shard=/ && ++shards[FILENAME] > 1 { nextfile }
+  /^(datagrams|wakeups|io_uring_rearms|truncated|rejected|kernel_drops|seq_lost|seq_out_of_order|voice_lost|drained_[0-9]+)=/ ||
+  /^source\..*\.(ring_overflows|junk_bytes|resyncs)=/ {
+    if (FILENAME ~ /socket.stats$/) socket[$1] = $2; else uring[$1] = $2
+    keys[$1] = 1
+  }
+  END {
+    for (key in keys)
+      printf "%-32s %12s %12s\n", key, socket[key] == "" ? "-" : socket[key],
+          uring[key] == "" ? "-" : uring[key]
+  }' "$OUTPUT/socket.stats" "$OUTPUT/io_uring.stats" | sort
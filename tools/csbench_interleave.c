@@ -0,0 +1,327 @@
+/*  =========================================================================
+    csbench_interleave - Benchmark of the stereo interleave kernels
+    =========================================================================*/
+
+/*
+    This tool times the interleave of the two streams of a duplex call, and
+    the split back, with every implementation of csutil: AVX2, SSE2 and
+    scalar, and the function with the dispatch on the CPU features that the
+    server calls. They are compared with the byte by byte loop of two
+    zchunk_append calls per sample they replaced.
+
+    The streams are one hour of A-law voice by default, 8000 samples per
+    second, and are interleaved in blocks of the voice payload size as the
+    persistence manager does. Every implementation is checked against the
+    byte by byte loop before being timed.
+
+    csutil.c is included, to reach its static implementations, so the tool
+    is built with the include paths and libraries of the server (see
+    dirLinux.mk), e.g.
+
+        gcc -O2 -I.. <server flags> csbench_interleave.c -o csbench_interleave
+            <server libraries>
+
+    Usage:
+
+        csbench_interleave [-t seconds] [-l loops]
+
+          -t seconds  duration of the call (default 3600)
+          -l loops    times every implementation is timed, the best time is
+                      reported (default 5)
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "czmq.h"
+#include "../csutil.c"
+
+
+#define CSBENCH_SAMPLE_RATE 8000
+#define CSBENCH_BLOCK_SIZE 480
+
+typedef void (interleave_fn) (const unsigned char * const,
+    const unsigned char * const, size_t, unsigned char *);
+typedef void (deinterleave_fn) (const unsigned char * const, size_t,
+    unsigned char *, unsigned char *);
+
+// An implementation of the kernels
+
+typedef struct {
+  const char *name;
+  interleave_fn *interleave;
+  deinterleave_fn *deinterleave;
+  int supported;
+} csbench_kernel_t;
+
+// Context of the benchmark
+
+typedef struct {
+  size_t len;                   // Samples of every stream
+  int loops;
+  unsigned char *a;
+  unsigned char *b;
+  unsigned char *stereo;
+  unsigned char *split_a;
+  unsigned char *split_b;
+  zchunk_t *reference;          // Interleave of the byte by byte loop
+} csbench_t;
+
+
+//  --------------------------------------------------------------------------
+//  Returns the current time in seconds
+
+static double
+csbench_now (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Interleaves the streams byte by byte into a chunk, as the persistence
+//  manager did before the kernels
+//  Input:
+//    ctx: the benchmark context
+//  Output:
+//    The chunk
+
+static zchunk_t *
+csbench_append_loop (csbench_t *ctx)
+{
+  size_t i;
+  zchunk_t *voice_data = zchunk_new (NULL, 2 * ctx->len);
+
+  for (i = 0; i < ctx->len; i++) {
+    zchunk_append (voice_data, ctx->a + i, 1);
+    zchunk_append (voice_data, ctx->b + i, 1);
+  }
+
+  return voice_data;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Interleaves the streams with a kernel, block by block
+//  Input:
+//    ctx: the benchmark context
+//    kernel: the implementation
+
+static void
+csbench_interleave (csbench_t *ctx, csbench_kernel_t *kernel)
+{
+  size_t offset;
+  size_t len;
+
+  for (offset = 0; offset < ctx->len; offset += len) {
+    len = ctx->len - offset;
+    if (len > CSBENCH_BLOCK_SIZE) {
+      len = CSBENCH_BLOCK_SIZE;
+    }
+    kernel->interleave (ctx->a + offset, ctx->b + offset, len,
+        ctx->stereo + 2 * offset);
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Splits the stereo stream with a kernel, block by block
+//  Input:
+//    ctx: the benchmark context
+//    kernel: the implementation
+
+static void
+csbench_deinterleave (csbench_t *ctx, csbench_kernel_t *kernel)
+{
+  size_t offset;
+  size_t len;
+
+  for (offset = 0; offset < ctx->len; offset += len) {
+    len = ctx->len - offset;
+    if (len > CSBENCH_BLOCK_SIZE) {
+      len = CSBENCH_BLOCK_SIZE;
+    }
+    kernel->deinterleave (ctx->stereo + 2 * offset, len,
+        ctx->split_a + offset, ctx->split_b + offset);
+  }
+}
+
+
+//  --------------------------------------------------------------------------
+//  Prints the throughput of a run
+//  Input:
+//    name: the implementation
+//    operation: what was timed
+//    bytes: the bytes of the stereo stream
+//    best: the best time in seconds
+
+static void
+csbench_report (const char * const name, const char * const operation,
+    size_t bytes, double best)
+{
+  printf ("%-8s %-12s %10.3f ms %10.1f MB/s\n", name, operation,
+      best * 1e3, bytes / best / 1e6);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Checks and times a kernel
+//  Input:
+//    ctx: the benchmark context
+//    kernel: the implementation
+//  Output:
+//    0 - Ok
+//   -1 - Nok, the kernel gives a wrong result
+
+static int
+csbench_run (csbench_t *ctx, csbench_kernel_t *kernel)
+{
+  int i;
+  double start;
+  double elapsed;
+  double best_interleave = 0;
+  double best_deinterleave = 0;
+
+  memset (ctx->stereo, 0, 2 * ctx->len);
+  memset (ctx->split_a, 0, ctx->len);
+  memset (ctx->split_b, 0, ctx->len);
+  csbench_interleave (ctx, kernel);
+  csbench_deinterleave (ctx, kernel);
+  if (memcmp (ctx->stereo, zchunk_data (ctx->reference), 2 * ctx->len) ||
+      memcmp (ctx->split_a, ctx->a, ctx->len) ||
+      memcmp (ctx->split_b, ctx->b, ctx->len)) {
+    fprintf (stderr, "%s: wrong result\n", kernel->name);
+    return -1;
+  }
+
+  for (i = 0; i < ctx->loops; i++) {
+    start = csbench_now ();
+    csbench_interleave (ctx, kernel);
+    elapsed = csbench_now () - start;
+    if (i == 0 || elapsed < best_interleave) {
+      best_interleave = elapsed;
+    }
+
+    start = csbench_now ();
+    csbench_deinterleave (ctx, kernel);
+    elapsed = csbench_now () - start;
+    if (i == 0 || elapsed < best_deinterleave) {
+      best_deinterleave = elapsed;
+    }
+  }
+
+  csbench_report (kernel->name, "interleave", 2 * ctx->len, best_interleave);
+  csbench_report (kernel->name, "deinterleave", 2 * ctx->len,
+      best_deinterleave);
+
+  return 0;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  int rc = 0;
+  int opt;
+  int i;
+  size_t n;
+  int seconds = 3600;
+  double start;
+  double elapsed;
+  double best = 0;
+  zchunk_t *voice_data;
+  csbench_t ctx;
+  csbench_kernel_t kernels[] = {
+#ifdef CS_HAVE_X86_SIMD
+    { "avx2", cs_interleave_avx2, cs_deinterleave_avx2, 0 },
+    { "sse2", cs_interleave_sse2, cs_deinterleave_sse2, 0 },
+#endif
+    { "scalar", cs_interleave_generic, cs_deinterleave_generic, 1 },
+    { "dispatch", cs_interleave, cs_deinterleave, 1 }
+  };
+
+  memset (&ctx, 0, sizeof (ctx));
+  ctx.loops = 5;
+
+  while ((opt = getopt (argc, argv, "t:l:")) != -1) {
+    switch (opt) {
+    case 't':
+      seconds = atoi (optarg);
+      break;
+    case 'l':
+      ctx.loops = atoi (optarg);
+      break;
+    default:
+      rc = -1;
+      break;
+    }
+  }
+  if (rc == -1 || seconds <= 0 || ctx.loops <= 0) {
+    fprintf (stderr, "Usage: %s [-t seconds] [-l loops]\n", argv[0]);
+    return 1;
+  }
+
+#ifdef CS_HAVE_X86_SIMD
+  __builtin_cpu_init ();
+  kernels[0].supported = __builtin_cpu_supports ("avx2");
+  kernels[1].supported = __builtin_cpu_supports ("sse2");
+#endif
+
+  ctx.len = (size_t) seconds * CSBENCH_SAMPLE_RATE;
+  ctx.a = (unsigned char *) malloc (ctx.len);
+  ctx.b = (unsigned char *) malloc (ctx.len);
+  ctx.stereo = (unsigned char *) malloc (2 * ctx.len);
+  ctx.split_a = (unsigned char *) malloc (ctx.len);
+  ctx.split_b = (unsigned char *) malloc (ctx.len);
+  if (!ctx.a || !ctx.b || !ctx.stereo || !ctx.split_a || !ctx.split_b) {
+    fprintf (stderr, "Out of memory\n");
+    return 1;
+  }
+  srand (1);
+  for (n = 0; n < ctx.len; n++) {
+    ctx.a[n] = (unsigned char) rand ();
+    ctx.b[n] = (unsigned char) rand ();
+  }
+
+  printf ("Duplex call of %d s: 2 x %zu samples, %zu bytes interleaved\n",
+      seconds, ctx.len, 2 * ctx.len);
+
+  // The byte by byte loop builds its own chunk every time
+  for (i = 0; i < ctx.loops; i++) {
+    start = csbench_now ();
+    voice_data = csbench_append_loop (&ctx);
+    elapsed = csbench_now () - start;
+    if (i == 0 || elapsed < best) {
+      best = elapsed;
+    }
+    if (ctx.reference) {
+      zchunk_destroy (&voice_data);
+    } else {
+      ctx.reference = voice_data;
+    }
+  }
+  csbench_report ("append", "interleave", 2 * ctx.len, best);
+
+  for (n = 0; n < sizeof (kernels) / sizeof (kernels[0]); n++) {
+    if (!kernels[n].supported) {
+      printf ("%-8s not supported by the CPU\n", kernels[n].name);
+    } else if (csbench_run (&ctx, &kernels[n]) == -1) {
+      rc = -1;
+    }
+  }
+
+  zchunk_destroy (&ctx.reference);
+  free (ctx.a);
+  free (ctx.b);
+  free (ctx.stereo);
+  free (ctx.split_a);
+  free (ctx.split_b);
+
+  return rc == 0 ? 0 : 1;
+}
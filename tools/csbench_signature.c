@@ -0,0 +1,232 @@
+/*  =========================================================================
+    csbench_signature - Benchmark of the LogApi signature scan
+    =========================================================================*/
+
+/*
+    This tool times the search of the next LogApi or Voice signature that
+    the collector does when its stream is out of sync, with every
+    implementation of csutil: AVX2, SSE2 and scalar, and the function with
+    the dispatch on the CPU features that the collector calls. They are
+    compared with the loop they replaced, which read the 4 bytes at every
+    offset with memcpy and compared them with both signatures, stepping one
+    byte at a time.
+
+    The buffer is filled with random junk without any signature, and a
+    signature is put after every run of junk, so a run is the data skipped
+    by one resynchronisation. Every implementation must find the same
+    signatures as the loop.
+
+    csutil.c is included, to reach its static implementations, so the tool
+    is built with the include paths and libraries of the server (see
+    dirLinux.mk), e.g.
+
+        gcc -O2 -I.. <server flags> csbench_signature.c -o csbench_signature
+            <server libraries>
+
+    Usage:
+
+        csbench_signature [-s size] [-r run] [-l loops]
+
+          -s size   size of the buffer in bytes (default 64 MiB)
+          -r run    bytes of junk between signatures, 0 = only junk
+                    (default 0)
+          -l loops  times every implementation is timed, the best time is
+                    reported (default 5)
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../csutil.c"
+
+
+typedef size_t (find_fn) (const unsigned char * const, size_t);
+
+// An implementation of the search
+
+typedef struct {
+  const char *name;
+  find_fn *find;
+  int supported;
+} csbench_kernel_t;
+
+
+//  --------------------------------------------------------------------------
+//  Returns the current time in seconds
+
+static double
+csbench_now (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Searches the next signature one byte at a time, as the collector did
+//  before the vectorised search
+//  Input:
+//    buffer: the data to search in
+//    len: the size of the data
+//  Output:
+//    The offset of the first signature found or len - 3 if there is none
+
+static size_t
+csbench_find_bytewise (const unsigned char * const buffer, size_t len)
+{
+  size_t i;
+  unsigned int signature;
+
+  for (i = 0; i + 3 < len; i++) {
+    memcpy (&signature, buffer + i, 4);
+    if (signature == LOG_API_PROTOCOL_SIGNATURE ||
+        signature == VOICE_PROTOCOL_SIGNATURE) {
+      break;
+    }
+  }
+
+  return i;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Scans a whole buffer, skipping every signature found
+//  Input:
+//    find: the search
+//    buffer: the data
+//    len: the size of the data
+//  Output:
+//    The number of signatures found
+
+static size_t
+csbench_scan (find_fn *find, const unsigned char * const buffer, size_t len)
+{
+  size_t offset = 0;
+  size_t found = 0;
+
+  while (len - offset >= 4) {
+    offset += find (buffer + offset, len - offset);
+    if (len - offset >= 4) {
+      found++;
+      offset += 4;
+    } else {
+      break;
+    }
+  }
+
+  return found;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  int rc = 0;
+  int opt;
+  int i;
+  size_t n;
+  size_t size = 64 << 20;
+  size_t run = 0;
+  int loops = 5;
+  size_t expected;
+  size_t found;
+  double start;
+  double elapsed;
+  double best;
+  unsigned char *buffer;
+  unsigned int signature = LOG_API_PROTOCOL_SIGNATURE;
+  csbench_kernel_t kernels[] = {
+    { "bytewise", csbench_find_bytewise, 1 },
+#ifdef CS_HAVE_X86_SIMD
+    { "avx2", cs_find_signature_avx2, 0 },
+    { "sse2", cs_find_signature_sse2, 0 },
+#endif
+    { "scalar", cs_find_signature_generic, 1 },
+    { "dispatch", cs_find_signature, 1 }
+  };
+
+  while ((opt = getopt (argc, argv, "s:r:l:")) != -1) {
+    switch (opt) {
+    case 's':
+      size = strtoul (optarg, NULL, 10);
+      break;
+    case 'r':
+      run = strtoul (optarg, NULL, 10);
+      break;
+    case 'l':
+      loops = atoi (optarg);
+      break;
+    default:
+      rc = -1;
+      break;
+    }
+  }
+  if (rc == -1 || size < 4 || loops <= 0) {
+    fprintf (stderr, "Usage: %s [-s size] [-r run] [-l loops]\n", argv[0]);
+    return 1;
+  }
+
+#ifdef CS_HAVE_X86_SIMD
+  __builtin_cpu_init ();
+  kernels[1].supported = __builtin_cpu_supports ("avx2");
+  kernels[2].supported = __builtin_cpu_supports ("sse2");
+#endif
+
+  buffer = (unsigned char *) malloc (size);
+  if (!buffer) {
+    fprintf (stderr, "Out of memory\n");
+    return 1;
+  }
+
+  // Junk without the first byte of the signatures, so none is made by
+  // chance, and a signature after every run
+  srand (1);
+  for (n = 0; n < size; n++) {
+    buffer[n] = (unsigned char) rand ();
+    if (buffer[n] == CS_SIGNATURE_BYTE_0) {
+      buffer[n]++;
+    }
+  }
+  if (run) {
+    for (n = run; n + 4 <= size; n += run + 4) {
+      memcpy (buffer + n, &signature, 4);
+      signature = signature == LOG_API_PROTOCOL_SIGNATURE ?
+          VOICE_PROTOCOL_SIGNATURE : LOG_API_PROTOCOL_SIGNATURE;
+    }
+  }
+
+  expected = csbench_scan (csbench_find_bytewise, buffer, size);
+  printf ("Buffer of %zu bytes, %zu signatures\n", size, expected);
+
+  for (n = 0; n < sizeof (kernels) / sizeof (kernels[0]); n++) {
+    if (!kernels[n].supported) {
+      printf ("%-8s not supported by the CPU\n", kernels[n].name);
+      continue;
+    }
+    best = 0;
+    for (i = 0; i < loops; i++) {
+      start = csbench_now ();
+      found = csbench_scan (kernels[n].find, buffer, size);
+      elapsed = csbench_now () - start;
+      if (i == 0 || elapsed < best) {
+        best = elapsed;
+      }
+    }
+    if (found != expected) {
+      fprintf (stderr, "%s: %zu signatures found\n", kernels[n].name, found);
+      rc = -1;
+    } else {
+      printf ("%-8s %10.3f ms %10.1f MB/s\n", kernels[n].name, best * 1e3,
+          size / best / 1e6);
+    }
+  }
+
+  free (buffer);
+
+  return rc == 0 ? 0 : 1;
+}
@@ -0,0 +1,284 @@
+/*  =========================================================================
+    csreplay - Replay of raw ingest captures
+    =========================================================================*/
+
+/*
+    This tool sends the datagrams of one or several capture files written by
+    the collector (see cscap.h) to the UDP listener of a collector. The
+    datagrams can be sent at the original pace, N times faster or as fast as
+    possible.
+
+    Every source found in the capture is replayed from its own UDP socket, so
+    the collector keeps a separate reassembly context for each one, as it did
+    with the original LogServers.
+
+    Usage:
+
+        csreplay [-h host] [-p port] [-s speed|max] [-l loops] file...
+
+          -h host   collector address (default 127.0.0.1)
+          -p port   collector port (default 4321)
+          -s speed  pace factor, 1 = original pace (default), max = no pacing
+          -l loops  times the capture files are replayed (default 1)
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "../cscap.h"
+
+
+#define CSREPLAY_MAX_SOURCES 64
+#define CSREPLAY_DATAGRAM_LENGTH 65536
+
+
+// Replay socket of a source found in the capture
+
+typedef struct {
+  uint32_t ip;
+  uint16_t port;
+  int channel;
+} csreplay_source_t;
+
+// Context of the replay
+
+typedef struct {
+  struct sockaddr_in collector;
+  double speed;                 // 0 = as fast as possible
+  int loops;
+  csreplay_source_t sources[CSREPLAY_MAX_SOURCES];
+  int nr_sources;
+  unsigned char datagram[CSREPLAY_DATAGRAM_LENGTH];
+  int first;                    // The first datagram has not been sent yet
+  uint64_t first_timestamp_ns;
+  struct timespec start;
+  uint64_t datagrams;
+  uint64_t bytes;
+} csreplay_t;
+
+
+//  --------------------------------------------------------------------------
+//  Returns the socket used to replay the datagrams of a source
+//  Input:
+//    ctx: the replay context
+//    record: the record of a datagram of the source
+//  Output:
+//    The socket or -1
+
+static int
+csreplay_source_channel (csreplay_t *ctx,
+    const cscap_record_header_t * const record)
+{
+  int i;
+  csreplay_source_t *source;
+
+  for (i = 0; i < ctx->nr_sources; i++) {
+    source = &ctx->sources[i];
+    if (source->ip == record->source_ip && source->port == record->source_port) {
+      return source->channel;
+    }
+  }
+
+  if (ctx->nr_sources == CSREPLAY_MAX_SOURCES) {
+    fprintf (stderr, "Too many sources in the capture\n");
+    return -1;
+  }
+
+  source = &ctx->sources[ctx->nr_sources];
+  source->ip = record->source_ip;
+  source->port = record->source_port;
+  source->channel = socket (AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (source->channel == -1) {
+    fprintf (stderr, "Error: socket(), errno=%d text=%s\n",
+        errno, strerror (errno));
+    return -1;
+  }
+
+  ctx->nr_sources++;
+
+  return source->channel;
+}
+
+
+//  --------------------------------------------------------------------------
+//  Waits until a datagram has to be sent according to the replay speed
+//  Input:
+//    ctx: the replay context
+//    timestamp_ns: the reception time of the datagram in the capture
+
+static void
+csreplay_pace (csreplay_t *ctx, uint64_t timestamp_ns)
+{
+  struct timespec deadline;
+  uint64_t offset_ns;
+
+  if (ctx->first) {
+    ctx->first = 0;
+    ctx->first_timestamp_ns = timestamp_ns;
+    clock_gettime (CLOCK_MONOTONIC, &ctx->start);
+    return;
+  }
+
+  if (ctx->speed <= 0 || timestamp_ns <= ctx->first_timestamp_ns) {
+    return;
+  }
+
+  offset_ns = (uint64_t) ((timestamp_ns - ctx->first_timestamp_ns) / ctx->speed);
+  deadline.tv_sec = ctx->start.tv_sec + offset_ns / 1000000000ULL;
+  deadline.tv_nsec = ctx->start.tv_nsec + offset_ns % 1000000000ULL;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+}
+
+
+//  --------------------------------------------------------------------------
+//  Replays a capture file
+//  Input:
+//    ctx: the replay context
+//    path: the capture file
+//  Output:
+//    0 - Ok
+//   -1 - Nok
+
+static int
+csreplay_file (csreplay_t *ctx, const char * const path)
+{
+  FILE *fp;
+  cscap_file_header_t header;
+  cscap_record_header_t record;
+  int channel;
+  int rc = 0;
+
+  if ((fp = fopen (path, "r")) == NULL) {
+    fprintf (stderr, "Error: fopen(%s), errno=%d text=%s\n",
+        path, errno, strerror (errno));
+    return -1;
+  }
+
+  if (fread (&header, sizeof (header), 1, fp) != 1 ||
+      memcmp (header.magic, CSCAP_MAGIC, sizeof (header.magic)) != 0 ||
+      header.version != CSCAP_VERSION) {
+    fprintf (stderr, "%s: not a capture file\n", path);
+    rc = -1;
+  }
+
+  while (rc == 0 && fread (&record, sizeof (record), 1, fp) == 1) {
+    if (fread (ctx->datagram, 1, record.length, fp) != record.length) {
+      fprintf (stderr, "%s: truncated record\n", path);
+      break;
+    }
+
+    if ((channel = csreplay_source_channel (ctx, &record)) == -1) {
+      rc = -1;
+      break;
+    }
+
+    csreplay_pace (ctx, record.timestamp_ns);
+
+    if (sendto (channel, ctx->datagram, record.length, 0,
+        (struct sockaddr *) &ctx->collector, sizeof (ctx->collector)) == -1) {
+      fprintf (stderr, "Error: sendto(), errno=%d text=%s\n",
+          errno, strerror (errno));
+    } else {
+      ctx->datagrams++;
+      ctx->bytes += record.length;
+    }
+  }
+
+  fclose (fp);
+
+  return rc;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  csreplay_t *ctx;
+  const char *host = "127.0.0.1";
+  int port = 4321;
+  struct timespec end;
+  double elapsed;
+  int loop;
+  int opt;
+  int i;
+  int rc = 0;
+
+  ctx = (csreplay_t *) calloc (1, sizeof (csreplay_t));
+  if (!ctx) {
+    return 1;
+  }
+
+  ctx->speed = 1;
+  ctx->loops = 1;
+
+  while ((opt = getopt (argc, argv, "h:p:s:l:")) != -1) {
+    switch (opt) {
+    case 'h':
+      host = optarg;
+      break;
+    case 'p':
+      port = atoi (optarg);
+      break;
+    case 's':
+      ctx->speed = strcmp (optarg, "max") == 0 ? 0 : atof (optarg);
+      break;
+    case 'l':
+      ctx->loops = atoi (optarg);
+      break;
+    default:
+      rc = -1;
+      break;
+    }
+  }
+
+  if (rc == -1 || optind == argc) {
+    fprintf (stderr, "Usage: %s [-h host] [-p port] [-s speed|max] "
+        "[-l loops] file...\n", argv[0]);
+    free (ctx);
+    return 1;
+  }
+
+  ctx->collector.sin_family = AF_INET;
+  ctx->collector.sin_port = htons (port);
+  if (inet_pton (AF_INET, host, &ctx->collector.sin_addr) != 1) {
+    fprintf (stderr, "Invalid address: %s\n", host);
+    free (ctx);
+    return 1;
+  }
+
+  for (loop = 0; rc == 0 && loop < ctx->loops; loop++) {
+    // Every loop is paced from its own start
+    ctx->first = 1;
+    for (i = optind; rc == 0 && i < argc; i++) {
+      rc = csreplay_file (ctx, argv[i]);
+    }
+  }
+
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  elapsed = (end.tv_sec - ctx->start.tv_sec) +
+      (end.tv_nsec - ctx->start.tv_nsec) / 1e9;
+
+  printf ("datagrams=%" PRIu64 " bytes=%" PRIu64 " sources=%d "
+      "seconds=%.3f datagrams_per_second=%.0f\n",
+      ctx->datagrams, ctx->bytes, ctx->nr_sources, elapsed,
+      elapsed > 0 ? ctx->datagrams / elapsed : 0);
+
+  for (i = 0; i < ctx->nr_sources; i++) {
+    close (ctx->sources[i].channel);
+  }
+  free (ctx);
+
+  return rc == 0 ? 0 : 1;
+}